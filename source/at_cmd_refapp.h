@@ -63,6 +63,206 @@
                        ( ( ( (unsigned char *)a )[5] ) == 0 ) )
 #define AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS              (10)
 
+/*
+ * Host commands that may be outstanding at the same time. Commands above the
+ * limit are answered with "busy" without being processed. WCM and MQTT
+ * messages run in a worker thread per subsystem, so they complete out of
+ * order with each other and with SYS commands.
+ */
+#define AT_CMD_REF_APP_CMD_CREDITS                     (8)
+#define AT_CMD_REF_APP_CMD_WORKER_STACK_SIZE           (1024 * 8)
+#define AT_CMD_REF_APP_CMD_WORKER_PRIORITY             (CY_RTOS_PRIORITY_NORMAL)
+#define AT_CMD_REF_APP_CMD_WORKER_QUEUE_MSGS           (AT_CMD_REF_APP_CMD_CREDITS + AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS)
+
+/*
+ * Time client_task waits for room in a worker queue for an application
+ * message before the message is dropped and counted in SYS_Stats "drops".
+ */
+#define AT_CMD_REF_APP_CMD_WORKER_EVENT_TIMEOUT_MS     (100)
+
+/*
+ * Slots of the small message pool. The messages of the WCM commands without
+ * or with few arguments, the WCM events and the busy answers are taken from
+ * the pool, they are allocated from the heap when it is empty. Up to 32 slots.
+ */
+#define AT_CMD_REF_APP_MSG_POOL_SLOTS                  (AT_CMD_REF_APP_CMD_CREDITS * 2)
+
+/*
+ * WCM_APConnect and WCM_Ping run in a worker thread so the wcm_cmd worker
+ * keeps serving commands and events while WCM is busy.
+ */
+#define AT_CMD_REF_APP_WCM_WORKER_STACK_SIZE           (1024 * 4)
+#define AT_CMD_REF_APP_WCM_WORKER_PRIORITY             (CY_RTOS_PRIORITY_NORMAL)
+#define AT_CMD_REF_APP_WCM_WORKER_QUEUE_MSGS           (2)
+
+/*
+ * WCM_Ping defaults and limits, times in ms.
+ */
+#define AT_CMD_REF_APP_PING_DEFAULT_TIMEOUT            (1000)
+#define AT_CMD_REF_APP_PING_DEFAULT_INTERVAL           (1000)
+#define AT_CMD_REF_APP_PING_MAX_COUNT                  (100)
+#define AT_CMD_REF_APP_PING_MAX_TIMEOUT                (10000)
+#define AT_CMD_REF_APP_PING_MAX_INTERVAL               (60000)
+
+/*
+ * Network change events arriving within the debounce time of each other
+ * are coalesced into one notification carrying the last event.
+ */
+#define AT_CMD_REF_APP_NW_EVENT_DEBOUNCE_MS            (500)
+#define AT_CMD_REF_APP_NW_EVENT_MAX_DEBOUNCE_MS        (10000)
+
+/*
+ * Command latency tracing. Each command is stamped when parsing starts, when
+ * it is queued, started by client_task or a command worker, executed and
+ * responded to. Set to 0 to remove the stamps from the command path.
+ */
+#ifndef AT_CMD_REF_APP_TRACE_ENABLE
+#define AT_CMD_REF_APP_TRACE_ENABLE                    (1)
+#endif
+
+/*
+ * Command ids with SYS_Trace and SYS_Stats statistics.
+ */
+#define AT_CMD_REF_APP_SYS_MAX_CMD_ID                  (48)
+
+/*
+ * Threads reported by SYS_Stats and the longest thread name kept.
+ */
+#define AT_CMD_REF_APP_SYS_MAX_THREADS                 (24)
+#define AT_CMD_REF_APP_SYS_THREAD_NAME_LEN             (24)
+
+/*
+ * Byte pool malloc allocates from on ThreadX ports that back the C heap
+ * with one, e.g. (&heap_pool). SYS_Stats then reports the heap from
+ * tx_byte_pool_info_get, otherwise from mallinfo (GCC_ARM only).
+ */
+/* #define AT_CMD_REF_APP_SYS_HEAP_POOL                (&heap_pool) */
+
+/*
+ * Benchmark build (make BENCH=1). The SYS_Bench command replays AT command
+ * scripts through the parser over a loopback transport and reports the
+ * throughput, response latency, heap peak and allocations.
+ */
+#ifndef AT_CMD_REF_APP_BENCH_ENABLE
+#define AT_CMD_REF_APP_BENCH_ENABLE                    (0)
+#endif
+
+/*
+ * SYS_Bench script limits. A script line is "AT+0000<serial>;<cmd>,<args>;".
+ */
+#define AT_CMD_REF_APP_BENCH_MAX_STEPS                 (8)
+#define AT_CMD_REF_APP_BENCH_NAME_LEN                  (32)
+#define AT_CMD_REF_APP_BENCH_MAX_LINE                  (2048)
+#define AT_CMD_REF_APP_BENCH_MAX_FILL                  (1024)
+
+/*
+ * Replayed commands are given serials from AT_CMD_REF_APP_BENCH_SERIAL_BASE on,
+ * responses with these serials are consumed by the benchmark.
+ */
+#define AT_CMD_REF_APP_BENCH_SERIAL_BASE               (90000)
+#define AT_CMD_REF_APP_BENCH_SERIAL_RANGE              (10000)
+
+/*
+ * Commands in flight for a step with a rate, a step without rate sends the
+ * next command when the previous one was answered. Commands not answered
+ * within AT_CMD_REF_APP_BENCH_TIMEOUT_MS count as timeouts. Keep it within
+ * AT_CMD_REF_APP_CMD_CREDITS, commands above the credits are answered "busy".
+ */
+#define AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING           (AT_CMD_REF_APP_CMD_CREDITS)
+#define AT_CMD_REF_APP_BENCH_TIMEOUT_MS                (10000)
+
+/*
+ * Loopback transport buffer, must be a power of two.
+ */
+#define AT_CMD_REF_APP_BENCH_INJECT_SIZE               (4096)
+
+/*
+ * Latency histogram: 8 buckets per power of two, values within 12.5%.
+ */
+#define AT_CMD_REF_APP_BENCH_BUCKETS                   (240)
+
+#define AT_CMD_REF_APP_BENCH_STACK_SIZE                (1024 * 4)
+#define AT_CMD_REF_APP_BENCH_PRIORITY                  (CY_RTOS_PRIORITY_BELOWNORMAL)
+#define AT_CMD_REF_APP_BENCH_QUEUE_MSGS                (1)
+
+/*
+ * SYS_MicroBench: default iterations per case, and the corpus sizes.
+ */
+#define AT_CMD_REF_APP_BENCH_MICRO_COUNT               (1000)
+#define AT_CMD_REF_APP_BENCH_MICRO_MAX_CASES           (12)
+#define AT_CMD_REF_APP_BENCH_PEM_SIZE                  (4096)
+#define AT_CMD_REF_APP_BENCH_MESSAGE_SIZE              (1024)
+
+/*
+ * Loopback MQTT broker of the benchmark build, serving the brokers defined
+ * with host AT_CMD_REF_APP_MQTT_LOOPBACK_HOST. Each client keeps up to
+ * AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_SUBS topic filters, a publish whose PUBACK
+ * is lost fails after AT_CMD_REF_APP_MQTT_LOOPBACK_ACK_TIMEOUT_MS.
+ */
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_HOST              "loopback"
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_CLIENTS       (4)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_SUBS          (8)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_TOPIC_LEN         (64)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_ACK_TIMEOUT_MS    (1000)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_STACK_SIZE        (1024 * 4)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_PRIORITY          (CY_RTOS_PRIORITY_NORMAL)
+#define AT_CMD_REF_APP_MQTT_LOOPBACK_QUEUE_MSGS        (16)
+
+/*
+ * SYS_SetBaud: rates the AT UART may be switched to, and the time the host
+ * has to confirm the new rate before the previous one is restored. RTS/CTS
+ * flow control is enabled with 'make UART_FLOW_CONTROL=1' on boards routing
+ * CYBSP_DEBUG_UART_RTS and CYBSP_DEBUG_UART_CTS to the host.
+ */
+#define AT_CMD_REF_APP_UART_BAUD_RATES                 {115200, 230400, 460800, 921600, 1000000, 2000000, 3000000}
+#define AT_CMD_REF_APP_UART_CONFIRM_TIMEOUT_MS         (2000)
+#define AT_CMD_REF_APP_UART_MAX_CONFIRM_TIMEOUT_MS     (10000)
+#define AT_CMD_REF_APP_UART_REVERT_RETRY_MS            (100)
+
+#ifndef AT_CMD_REF_APP_UART_FLOW_CONTROL
+#define AT_CMD_REF_APP_UART_FLOW_CONTROL               (0)
+#endif
+
+/*
+ * AT transports. SYS_SetTransport,{"transport":"tcp"} listens on
+ * AT_CMD_REF_APP_TRANSPORT_TCP_PORT, the commands move to the first TCP
+ * client and back to the UART (SDIO) transport when the client goes away.
+ */
+#define AT_CMD_REF_APP_TRANSPORT_UART                  "uart"
+#define AT_CMD_REF_APP_TRANSPORT_SDIO                  "sdio"
+#define AT_CMD_REF_APP_TRANSPORT_TCP                   "tcp"
+#define AT_CMD_REF_APP_TRANSPORT_TCP_PORT              (5000)
+#define AT_CMD_REF_APP_TRANSPORT_TCP_RECV_TIMEOUT_MS   (10)
+
+/*
+ * Messages traced at the same time: the command queue, the commands holding
+ * a credit plus the ones being parsed or processed.
+ */
+#define AT_CMD_REF_APP_TRACE_SLOTS                     (AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS + AT_CMD_REF_APP_CMD_CREDITS + 4)
+
+/*
+ * Command ids with latency statistics, commands with a higher id are not traced.
+ */
+#define AT_CMD_REF_APP_TRACE_MAX_CMD_ID                (AT_CMD_REF_APP_SYS_MAX_CMD_ID)
+
+/*
+ * Latency histogram buckets, the bucket limits are 1, 4, 16, 64, 256, 1024
+ * and 4096 ms.
+ */
+#define AT_CMD_REF_APP_TRACE_BUCKETS                   (8)
+
+/*
+ * Commands per SYS_Trace dump response.
+ */
+#define AT_CMD_REF_APP_TRACE_RESULTS_PER_CHUNK         (8)
+
+/*
+ * Frame size of the WCM and MQTT responses. A longer response is sent in
+ * parts {"data":"<text>","seq":<n>,"total":<n>}, each holding the next piece
+ * of the response text as a JSON string.
+ */
+#define AT_CMD_REF_APP_JSON_PART_SIZE                  (1024)
+
 /*
  * Command IDs.
  */
@@ -87,6 +287,29 @@
 #define CMD_ID_MQTT_PUBLISH                    (18)
 #define CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT     (19)
 #define CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT   (20)
+#define CMD_ID_MQTT_DEFINE_CREDENTIAL          (21)
+#define CMD_ID_MQTT_DELETE_CREDENTIAL          (22)
+#define CMD_ID_MQTT_UPLOAD_CREDENTIAL          (23)
+#define CMD_ID_SCAN_GET_RESULTS                (24)
+#define CMD_ID_HOST_WCM_CONNECT_PROGRESS       (25)
+#define CMD_ID_HOST_WCM_PING_RESULT            (26)
+#define CMD_ID_HOST_WCM_NETWORK_EVENT          (27)
+
+#define CMD_ID_SYS_TRACE                       (28)
+#define CMD_ID_HOST_SYS_TRACE_DUMP             (29)
+#define CMD_ID_SYS_STATS                       (30)
+#define CMD_ID_SYS_BENCH                       (31)
+#define CMD_ID_HOST_SYS_BENCH_RESULT           (32)
+#define CMD_ID_SYS_MICROBENCH                  (33)
+#define CMD_ID_HOST_SYS_MICROBENCH_RESULT      (34)
+#define CMD_ID_MQTT_LOOPBACK                   (35)
+#define CMD_ID_HOST_CMD_BUSY                   (36)
+#define CMD_ID_SYS_SET_FORMAT                  (37)
+#define CMD_ID_SYS_SET_BAUD                    (38)
+#define CMD_ID_HOST_SYS_BAUD_SWITCH            (39)
+#define CMD_ID_HOST_SYS_BAUD_REVERT            (40)
+#define CMD_ID_SYS_SET_TRANSPORT               (41)
+#define CMD_ID_HOST_SYS_TRANSPORT_CLOSE        (42)
 
 #define CMD_ID_INVALID                  (255)
 
@@ -134,6 +357,37 @@
 #define WCM_TOKEN_PRIMARY_DNS             "primary-dns"
 #define WCM_TOKEN_SECONDARY_DNS           "secondary-dns"
 #define WCM_TOKEN_NW_STATUS               "link-status"
+#define WCM_TOKEN_RESULTS                 "results"
+#define WCM_TOKEN_COUNT                   "count"
+#define WCM_TOKEN_DROPPED                 "dropped"
+#define WCM_TOKEN_REPLACED                "replaced"
+#define WCM_TOKEN_MIN_RSSI                "min-rssi"
+#define WCM_TOKEN_CHANNELS                "channels"
+#define WCM_TOKEN_AGE                     "age"
+#define WCM_TOKEN_MAX_AGE                 "max-age"
+#define WCM_TOKEN_SORT                    "sort"
+#define WCM_TOKEN_CACHED                  "cached"
+#define WCM_TOKEN_CONNECT_TIME            "connect-time"
+#define WCM_TOKEN_DIRECTED                "directed"
+#define WCM_TOKEN_SAVED_TIME              "saved-time"
+#define WCM_TOKEN_ACCEPTED                "accepted"
+#define WCM_TOKEN_ASSOCIATING             "associating"
+#define WCM_TOKEN_IP_ACQUIRED             "ip-acquired"
+#define WCM_TOKEN_FAILED                  "failed"
+#define WCM_TOKEN_REASON                  "reason"
+#define WCM_TOKEN_INTERVAL                "interval"
+#define WCM_TOKEN_TIMEOUT                 "timeout"
+#define WCM_TOKEN_SENT                    "sent"
+#define WCM_TOKEN_RECEIVED                "received"
+#define WCM_TOKEN_LOSS                    "loss"
+#define WCM_TOKEN_MIN                     "min"
+#define WCM_TOKEN_AVG                     "avg"
+#define WCM_TOKEN_MAX                     "max"
+#define WCM_TOKEN_JITTER                  "jitter"
+#define WCM_TOKEN_EVENT                   "event"
+#define WCM_TOKEN_EVENTS                  "events"
+#define WCM_TOKEN_DEBOUNCE                "debounce"
+#define WCM_TOKEN_COALESCED               "coalesced"
 
 #define MQTT_TOKEN_BROKERID_TYPE          "brokerid"
 #define MQTT_TOKEN_HOSTNAME               "host"
@@ -159,6 +413,253 @@
 #define MQTT_TOKEN_QOS                    "qos"
 #define MQTT_TOKEN_MSG                    "message"
 #define MQTT_TOKEN_DISCONNECT_REASON      "disconnectreason"
+#define MQTT_TOKEN_CREDID                 "credid"
+#define MQTT_TOKEN_CREDDATA               "data"
+#define MQTT_TOKEN_ROOTCAID               "rootcaid"
+#define MQTT_TOKEN_CLIENTCERTID           "clientcertid"
+#define MQTT_TOKEN_CLIENTKEYID            "clientkeyid"
+#define MQTT_TOKEN_REUSED                 "reused"
+#define MQTT_TOKEN_HANDSHAKE_TIME         "handshake-time"
+#define MQTT_TOKEN_RECEIVED               "received"
+#define MQTT_TOKEN_READY                  "ready"
+#define MQTT_TOKEN_TOTAL                  "total"
+#define MQTT_TOKEN_PUBACK_DELAY           "puback-delay"
+#define MQTT_TOKEN_PUBACK_LOSS            "puback-loss"
+#define MQTT_TOKEN_DISCONNECT             "disconnect"
+#define MQTT_TOKEN_DELIVERY_DELAY         "delivery-delay"
+#define MQTT_TOKEN_PUBLISHED              "published"
+#define MQTT_TOKEN_DELIVERED              "delivered"
+#define MQTT_TOKEN_DELIVERY_DROPS         "delivery-drops"
+#define MQTT_TOKEN_ACKS_LOST              "acks-lost"
+#define MQTT_TOKEN_DISCONNECTS            "disconnects"
+#define MQTT_TOKEN_RECONNECTS             "reconnects"
+#define MQTT_TOKEN_DELIVERY               "delivery"
+#define MQTT_TOKEN_RECONNECT              "reconnect"
+#define MQTT_TOKEN_AVG                    "avg"
+#define MQTT_TOKEN_MAX                    "max"
+#define MQTT_TOKEN_LAST                   "last"
+
+#define SYS_TOKEN_RESET                   "reset"
+#define SYS_TOKEN_COMMANDS                "commands"
+#define SYS_TOKEN_RESULTS                 "results"
+#define SYS_TOKEN_STATUS                  "status"
+#define SYS_TOKEN_COMPLETE                "complete"
+#define SYS_TOKEN_INCOMPLETE              "incomplete"
+#define SYS_TOKEN_CMD_ID                  "cmd-id"
+#define SYS_TOKEN_COUNT                   "count"
+#define SYS_TOKEN_PARSE                   "parse"
+#define SYS_TOKEN_QUEUE                   "queue"
+#define SYS_TOKEN_EXECUTE                 "execute"
+#define SYS_TOKEN_RESPOND                 "respond"
+#define SYS_TOKEN_HISTOGRAM               "histogram"
+#define SYS_TOKEN_DEPTH                   "depth"
+#define SYS_TOKEN_MAX_DEPTH               "max-depth"
+#define SYS_TOKEN_SIZE                    "size"
+#define SYS_TOKEN_DROPS                   "drops"
+#define SYS_TOKEN_LOG_DROPS               "log-drops"
+#define SYS_TOKEN_HEAP                    "heap"
+#define SYS_TOKEN_FREE                    "free"
+#define SYS_TOKEN_MIN_FREE                "min-free"
+#define SYS_TOKEN_SAMPLED_MIN_FREE        "sampled-min-free"
+#define SYS_TOKEN_LARGEST                 "largest"
+#define SYS_TOKEN_THREADS                 "threads"
+#define SYS_TOKEN_NAME                    "name"
+#define SYS_TOKEN_STACK                   "stack"
+#define SYS_TOKEN_MAX_USED                "max-used"
+#define SYS_TOKEN_CMDS                    "cmds"
+#define SYS_TOKEN_ACCEPTED                "accepted"
+#define SYS_TOKEN_STEPS                   "steps"
+#define SYS_TOKEN_CMD                     "cmd"
+#define SYS_TOKEN_ARGS                    "args"
+#define SYS_TOKEN_RATE                    "rate"
+#define SYS_TOKEN_FILL                    "fill"
+#define SYS_TOKEN_DELAY                   "delay"
+#define SYS_TOKEN_ERRORS                  "errors"
+#define SYS_TOKEN_TIMEOUTS                "timeouts"
+#define SYS_TOKEN_DURATION                "duration"
+#define SYS_TOKEN_LATENCY                 "latency"
+#define SYS_TOKEN_P50                     "p50"
+#define SYS_TOKEN_P99                     "p99"
+#define SYS_TOKEN_P999                    "p999"
+#define SYS_TOKEN_MAX                     "max"
+#define SYS_TOKEN_HEAP_PEAK               "heap-peak"
+#define SYS_TOKEN_ALLOCS                  "allocs"
+#define SYS_TOKEN_ALLOC_BYTES             "alloc-bytes"
+#define SYS_TOKEN_CASE                    "case"
+#define SYS_TOKEN_NS_OP                   "ns-op"
+#define SYS_TOKEN_BYTES_OP                "bytes-op"
+#define SYS_TOKEN_ALLOCS_OP               "allocs-op"
+#define SYS_TOKEN_EVENT                   "event"
+#define SYS_TOKEN_EVENT_RATE              "event-rate"
+#define SYS_TOKEN_DATA                    "data"
+#define SYS_TOKEN_EVENTS                  "events"
+#define SYS_TOKEN_EVENT_DROPS             "event-drops"
+#define SYS_TOKEN_MQTT_MESSAGE            "mqtt-message"
+#define SYS_TOKEN_WRITE_DELAY             "write-delay"
+#define SYS_TOKEN_MALLOC_FAIL             "malloc-fail"
+#define SYS_TOKEN_DISCONNECT              "disconnect"
+#define SYS_TOKEN_WCM_DELAY               "wcm-delay"
+#define SYS_TOKEN_FAULTS                  "faults"
+#define SYS_TOKEN_RECOVERY                "recovery"
+#define SYS_TOKEN_CREDITS                 "credits"
+#define SYS_TOKEN_LIMIT                   "limit"
+#define SYS_TOKEN_IN_USE                  "in-use"
+#define SYS_TOKEN_MAX_IN_USE              "max-in-use"
+#define SYS_TOKEN_BUSY                    "busy"
+#define SYS_TOKEN_FORMAT                  "format"
+#define SYS_TOKEN_VERBOSE                 "verbose"
+#define SYS_TOKEN_COMPACT                 "compact"
+#define SYS_TOKEN_VERSION                 "version"
+#define SYS_TOKEN_KEYS                    "keys"
+#define SYS_TOKEN_BAUD                    "baud"
+#define SYS_TOKEN_ACTUAL                  "actual"
+#define SYS_TOKEN_TIMEOUT                 "timeout"
+#define SYS_TOKEN_CONFIRM                 "confirm"
+#define SYS_TOKEN_FLOW_CONTROL            "flow-control"
+#define SYS_TOKEN_SWITCHING               "switching"
+#define SYS_TOKEN_CONFIRMED               "confirmed"
+#define SYS_TOKEN_REVERTED                "reverted"
+#define SYS_TOKEN_TRANSPORT               "transport"
+#define SYS_TOKEN_PORT                    "port"
+#define SYS_TOKEN_LISTENING               "listening"
+#define SYS_TOKEN_SELECTED                "selected"
+#define SYS_TOKEN_MSG_POOL                "msg-pool"
+#define SYS_TOKEN_FALLBACKS               "fallbacks"
+
+/*
+ * Key dictionary of the compact response format. In compact format the keys
+ * of the JSON responses are replaced by the index of the key in this list in
+ * base 62 ("0"-"9", "a"-"z", "A"-"Z", then "10"...). Keys are only ever
+ * appended, any other change needs a new AT_CMD_REF_APP_KEYS_VERSION. The
+ * keys of scan results and subscription events come first so they get one
+ * character. Keys not listed are sent as they are.
+ */
+#define AT_CMD_REF_APP_KEYS_VERSION       (2)
+#define AT_CMD_REF_APP_KEYS(X) \
+    X(WCM_TOKEN_SSID) \
+    X(WCM_TOKEN_MACADDR) \
+    X(WCM_TOKEN_CHANNEL) \
+    X(WCM_TOKEN_BAND) \
+    X(WCM_TOKEN_SIGNAL_STRENGTH) \
+    X(WCM_TOKEN_SECURITY_TYPE) \
+    X(WCM_TOKEN_AGE) \
+    X(MQTT_TOKEN_BROKERID_TYPE) \
+    X(MQTT_TOKEN_TOPIC) \
+    X(MQTT_TOKEN_QOS) \
+    X(MQTT_TOKEN_MSG) \
+    X(WCM_TOKEN_STATUS) \
+    X(WCM_TOKEN_RESULTS) \
+    X(WCM_TOKEN_COUNT) \
+    X(WCM_TOKEN_DROPPED) \
+    X(WCM_TOKEN_BSSID) \
+    X(WCM_TOKEN_CHANNEL_WIDTH) \
+    X(STR_TOKEN_IP_ADDRESS) \
+    X(WCM_TOKEN_NW_STATUS) \
+    X(WCM_TOKEN_EVENT) \
+    X(WCM_TOKEN_COALESCED) \
+    X(WCM_TOKEN_CONNECT_TIME) \
+    X(WCM_TOKEN_DIRECTED) \
+    X(WCM_TOKEN_SAVED_TIME) \
+    X(WCM_TOKEN_REASON) \
+    X(WCM_TOKEN_METHOD) \
+    X(WCM_TOKEN_NETMASK) \
+    X(WCM_TOKEN_GATEWAY) \
+    X(WCM_TOKEN_PRIMARY_DNS) \
+    X(WCM_TOKEN_SECONDARY_DNS) \
+    X(WCM_TOKEN_SENT) \
+    X(WCM_TOKEN_RECEIVED) \
+    X(WCM_TOKEN_LOSS) \
+    X(WCM_TOKEN_MIN) \
+    X(WCM_TOKEN_AVG) \
+    X(WCM_TOKEN_MAX) \
+    X(WCM_TOKEN_JITTER) \
+    X(STR_TOKEN_ENABLED) \
+    X(WCM_TOKEN_EVENTS) \
+    X(WCM_TOKEN_DEBOUNCE) \
+    X(WCM_TOKEN_CACHED) \
+    X(MQTT_TOKEN_DISCONNECT_REASON) \
+    X(MQTT_TOKEN_REUSED) \
+    X(MQTT_TOKEN_HANDSHAKE_TIME) \
+    X(MQTT_TOKEN_HOSTNAME) \
+    X(MQTT_TOKEN_PORT) \
+    X(MQTT_TOKEN_TLS) \
+    X(MQTT_TOKEN_CLIENTID) \
+    X(MQTT_TOKEN_CLEANSESSION) \
+    X(MQTT_TOKEN_USERNAME) \
+    X(MQTT_TOKEN_PASSWORD) \
+    X(MQTT_TOKEN_LASTWILLTOPIC) \
+    X(MQTT_TOKEN_LASTWILLQOS) \
+    X(MQTT_TOKEN_LASTWILLMSG) \
+    X(MQTT_TOKEN_LASTWILLRETAIN) \
+    X(MQTT_TOKEN_KEEPALIVE) \
+    X(MQTT_TOKEN_PUBLISHQOS) \
+    X(MQTT_TOKEN_PUBLISHRETAIN) \
+    X(MQTT_TOKEN_PUBLISHRETRYLIMIT) \
+    X(MQTT_TOKEN_SUBSCRIBERQOS) \
+    X(MQTT_TOKEN_CREDID) \
+    X(MQTT_TOKEN_TOTAL) \
+    X(MQTT_TOKEN_PUBACK_DELAY) \
+    X(MQTT_TOKEN_PUBACK_LOSS) \
+    X(MQTT_TOKEN_DISCONNECT) \
+    X(MQTT_TOKEN_DELIVERY_DELAY) \
+    X(MQTT_TOKEN_PUBLISHED) \
+    X(MQTT_TOKEN_DELIVERED) \
+    X(MQTT_TOKEN_DELIVERY_DROPS) \
+    X(MQTT_TOKEN_ACKS_LOST) \
+    X(MQTT_TOKEN_DISCONNECTS) \
+    X(MQTT_TOKEN_RECONNECTS) \
+    X(MQTT_TOKEN_DELIVERY) \
+    X(MQTT_TOKEN_RECONNECT) \
+    X(MQTT_TOKEN_LAST) \
+    X(SYS_TOKEN_COMMANDS) \
+    X(SYS_TOKEN_CMD_ID) \
+    X(SYS_TOKEN_PARSE) \
+    X(SYS_TOKEN_QUEUE) \
+    X(SYS_TOKEN_EXECUTE) \
+    X(SYS_TOKEN_RESPOND) \
+    X(SYS_TOKEN_HISTOGRAM) \
+    X(SYS_TOKEN_DEPTH) \
+    X(SYS_TOKEN_MAX_DEPTH) \
+    X(SYS_TOKEN_SIZE) \
+    X(SYS_TOKEN_DROPS) \
+    X(SYS_TOKEN_LOG_DROPS) \
+    X(SYS_TOKEN_CREDITS) \
+    X(SYS_TOKEN_LIMIT) \
+    X(SYS_TOKEN_IN_USE) \
+    X(SYS_TOKEN_MAX_IN_USE) \
+    X(SYS_TOKEN_BUSY) \
+    X(SYS_TOKEN_HEAP) \
+    X(SYS_TOKEN_FREE) \
+    X(SYS_TOKEN_MIN_FREE) \
+    X(SYS_TOKEN_LARGEST) \
+    X(SYS_TOKEN_THREADS) \
+    X(SYS_TOKEN_NAME) \
+    X(SYS_TOKEN_STACK) \
+    X(SYS_TOKEN_MAX_USED) \
+    X(SYS_TOKEN_CMDS) \
+    X(SYS_TOKEN_STEPS) \
+    X(SYS_TOKEN_CMD) \
+    X(SYS_TOKEN_RATE) \
+    X(SYS_TOKEN_ERRORS) \
+    X(SYS_TOKEN_TIMEOUTS) \
+    X(SYS_TOKEN_DURATION) \
+    X(SYS_TOKEN_LATENCY) \
+    X(SYS_TOKEN_P50) \
+    X(SYS_TOKEN_P99) \
+    X(SYS_TOKEN_P999) \
+    X(SYS_TOKEN_HEAP_PEAK) \
+    X(SYS_TOKEN_ALLOCS) \
+    X(SYS_TOKEN_ALLOC_BYTES) \
+    X(SYS_TOKEN_CASE) \
+    X(SYS_TOKEN_NS_OP) \
+    X(SYS_TOKEN_BYTES_OP) \
+    X(SYS_TOKEN_ALLOCS_OP) \
+    X(SYS_TOKEN_EVENT_DROPS) \
+    X(SYS_TOKEN_FAULTS) \
+    X(SYS_TOKEN_RECOVERY) \
+    X(WCM_TOKEN_REPLACED) \
+    X(MQTT_TOKEN_READY) \
+    X(SYS_TOKEN_SAMPLED_MIN_FREE)
 
 /*
  * IP Addresses are stored in big endian format.
@@ -167,13 +668,112 @@
 
 #define AT_CMD_REFAPP_LOG_ENABLE
 
+/*
+ * Log levels. AT_CMD_REFAPP_LOG_ERR logs at ERR, AT_CMD_REFAPP_LOG_MSG at
+ * INFO and AT_CMD_REFAPP_LOG_DBG at DEBUG. Messages above the level of their
+ * module are compiled out.
+ */
+#define AT_CMD_REFAPP_LOG_LEVEL_NONE    (0)
+#define AT_CMD_REFAPP_LOG_LEVEL_ERR     (1)
+#define AT_CMD_REFAPP_LOG_LEVEL_INFO    (2)
+#define AT_CMD_REFAPP_LOG_LEVEL_DEBUG   (3)
+
+#ifndef AT_CMD_REFAPP_LOG_LEVEL_APP
+#define AT_CMD_REFAPP_LOG_LEVEL_APP     AT_CMD_REFAPP_LOG_LEVEL_INFO
+#endif
+#ifndef AT_CMD_REFAPP_LOG_LEVEL_WCM
+#define AT_CMD_REFAPP_LOG_LEVEL_WCM     AT_CMD_REFAPP_LOG_LEVEL_INFO
+#endif
+#ifndef AT_CMD_REFAPP_LOG_LEVEL_MQTT
+#define AT_CMD_REFAPP_LOG_LEVEL_MQTT    AT_CMD_REFAPP_LOG_LEVEL_INFO
+#endif
+#ifndef AT_CMD_REFAPP_LOG_LEVEL_SYS
+#define AT_CMD_REFAPP_LOG_LEVEL_SYS     AT_CMD_REFAPP_LOG_LEVEL_INFO
+#endif
+
+/*
+ * Source files select their module level before including this header.
+ */
+#ifndef AT_CMD_REFAPP_LOG_MODULE_LEVEL
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL  AT_CMD_REFAPP_LOG_LEVEL_APP
+#endif
+
+/*
+ * Deferred logging stores the format string and the raw arguments in a ring
+ * and leaves the formatting and the UART output to a low priority thread. Set
+ * to 0 to print from the calling thread.
+ */
+#ifndef AT_CMD_REFAPP_LOG_DEFERRED
+#define AT_CMD_REFAPP_LOG_DEFERRED      (1)
+#endif
+
+#if AT_CMD_REFAPP_LOG_DEFERRED
+#define AT_CMD_REFAPP_LOG_OUTPUT        at_cmd_refapp_log_write
+#else
+#define AT_CMD_REFAPP_LOG_OUTPUT        printf
+#endif
+
 #ifdef AT_CMD_REFAPP_LOG_ENABLE
-#define AT_CMD_REFAPP_LOG_MSG(args) { printf args;}
+#define AT_CMD_REFAPP_LOG_AT(level, args) do { if ((level) <= AT_CMD_REFAPP_LOG_MODULE_LEVEL) { AT_CMD_REFAPP_LOG_OUTPUT args; } } while (0)
 #else
-#define AT_CMD_REFAPP_LOG_MSG(args)
+#define AT_CMD_REFAPP_LOG_AT(level, args)
 #endif
 
+#define AT_CMD_REFAPP_LOG_ERR(args)     AT_CMD_REFAPP_LOG_AT(AT_CMD_REFAPP_LOG_LEVEL_ERR, args)
+#define AT_CMD_REFAPP_LOG_MSG(args)     AT_CMD_REFAPP_LOG_AT(AT_CMD_REFAPP_LOG_LEVEL_INFO, args)
+#define AT_CMD_REFAPP_LOG_DBG(args)     AT_CMD_REFAPP_LOG_AT(AT_CMD_REFAPP_LOG_LEVEL_DEBUG, args)
+
+/*
+ * Log ring entries, each holds the format string pointer and up to
+ * AT_CMD_REFAPP_LOG_ENTRY_WORDS words of arguments (strings are copied and
+ * truncated to fit). Must be a power of two. 64 entries use 3.5 KB of RAM.
+ */
+#define AT_CMD_REFAPP_LOG_RING_ENTRIES  (64)
+#define AT_CMD_REFAPP_LOG_ENTRY_WORDS   (12)
+
+/*
+ * Log drain thread, it polls the ring every AT_CMD_REFAPP_LOG_DRAIN_PERIOD_MS
+ * when the ring is empty.
+ */
+#define AT_CMD_REFAPP_LOG_STACK_SIZE        (1024 * 2)
+#define AT_CMD_REFAPP_LOG_PRIORITY          (CY_RTOS_PRIORITY_LOW)
+#define AT_CMD_REFAPP_LOG_DRAIN_PERIOD_MS   (10)
+
 #define AT_CMD_REF_APP_IP_ADDR_STR_LEN   ( 20)
+
+/*
+ * Number of access points kept in the scan table. Each entry takes 52 bytes
+ * (sizeof(at_cmd_ref_app_scan_entry_t)), 64 entries use 3.3 KB of static RAM.
+ * When the table is full, entries not seen by the current scan are replaced
+ * first, then weaker access points are dropped.
+ */
+#define AT_CMD_REF_APP_SCAN_TABLE_SIZE   (64)
+
+/*
+ * Access points per scan result response. A worst case entry (escaped 32 byte
+ * SSID) is below 320 bytes of JSON text, a chunk longer than a frame is sent
+ * in parts.
+ */
+#define AT_CMD_REF_APP_SCAN_RESULTS_PER_CHUNK   (8)
+
+/*
+ * Maximum number of channels in a scan filter channel list.
+ */
+#define AT_CMD_REF_APP_SCAN_MAX_CHANNELS        (16)
+
+/*
+ * WCM_ScanGetResults without max-age accepts cached entries of any age.
+ */
+#define AT_CMD_REF_APP_SCAN_MAX_AGE_ANY         (0xFFFFFFFFUL)
+
+/*
+ * Scan filter criteria, see at_cmd_ref_app_scan_filter_t.
+ */
+#define AT_CMD_REF_APP_SCAN_FILTER_SSID         (1 << 0)
+#define AT_CMD_REF_APP_SCAN_FILTER_MAC          (1 << 1)
+#define AT_CMD_REF_APP_SCAN_FILTER_RSSI         (1 << 2)
+#define AT_CMD_REF_APP_SCAN_FILTER_BAND         (1 << 3)
+#define AT_CMD_REF_APP_SCAN_FILTER_CHANNEL      (1 << 4)
 #define AT_CMD_REF_APP_MQTT_BUFFER_SIZE  (5*1024)
 
 /******************************************************
@@ -204,6 +804,44 @@
  */
 #define AT_CMD_REF_APP_MQTT_PUBLISH_RETRY_LIMIT 3
 
+/*
+ * Maximum number of credentials the host can upload with MQTT_DefineCredential.
+ */
+#define AT_CMD_REF_APP_MQTT_MAX_CREDENTIALS 8
+
+/*
+ * Credentials are validated when they are defined. If enabled, a credential
+ * holding a single PEM certificate or key is also kept in its decoded DER form
+ * so that the PEM decoding is not repeated by the TLS layer on every connect.
+ * PEM with headers, such as an encrypted key, is kept as PEM.
+ */
+#ifndef AT_CMD_REF_APP_MQTT_CRED_CACHE_DER
+#define AT_CMD_REF_APP_MQTT_CRED_CACHE_DER 1
+#endif
+
+/*
+ * Largest DER credential accepted by MQTT_UploadCredential.
+ */
+#define AT_CMD_REF_APP_MQTT_MAX_CREDENTIAL_SIZE 4096
+
+/*
+ * Longest "<credid>,<offset>,<total>,<length>" header of an MQTT_UploadCredential chunk.
+ */
+#define AT_CMD_REF_APP_MQTT_UPLOAD_HEADER_MAX   48
+
+/*
+ * Time the host has to send the raw bytes of an MQTT_UploadCredential chunk
+ * once the device sent "ready".
+ */
+#define AT_CMD_REF_APP_MQTT_UPLOAD_TIMEOUT_MS   (2000)
+
+/*
+ * PEM armor markers.
+ */
+#define AT_CMD_REF_APP_PEM_BEGIN  "-----BEGIN "
+#define AT_CMD_REF_APP_PEM_END    "-----END "
+#define AT_CMD_REF_APP_PEM_DASHES "-----"
+
 /*
  * Default Client ID
  */
@@ -256,8 +894,34 @@ typedef struct
     at_cmd_msg_base_t       base;       /**< AT command message header  structure */
     cy_wcm_event_t          event;      /**< WCM event */
     cy_wcm_ip_address_t     ip_addr;    /**< Contains the IP address for the CY_WCM_EVENT_IP_CHANGED event. */
+    bool                    flush;      /**< debounce timer expired, send the pending event */
+    uint32_t                coalesced;  /**< events folded into this one */
 } at_cmd_ref_app_network_change_t;
 
+/**
+ * WCM_APConnect progress states reported to the host
+ */
+typedef enum
+{
+    AT_CMD_REF_APP_CONNECT_ASSOCIATING = 0,
+    AT_CMD_REF_APP_CONNECT_IP_ACQUIRED,
+    AT_CMD_REF_APP_CONNECT_FAILED
+} at_cmd_ref_app_connect_state_t;
+
+/**
+ * WCM_APConnect progress event
+ */
+typedef struct
+{
+    at_cmd_msg_base_t              base;          /**< AT command message header  structure */
+    at_cmd_ref_app_connect_state_t state;         /**< connect progress state */
+    cy_rslt_t                      reason;        /**< WCM result for the failed state */
+    cy_wcm_ip_address_t            ip_addr;       /**< IP address for the ip-acquired state */
+    bool                           directed;      /**< connected using the last associated AP */
+    uint32_t                       connect_time;  /**< time taken to connect in ms */
+    uint32_t                       saved_time;    /**< ms saved by the directed connect */
+} at_cmd_ref_app_wcm_connect_progress_t;
+
 
 /**
  * wifi connect structure
@@ -271,6 +935,8 @@ typedef struct
     char                    password[CY_WCM_MAX_PASSPHRASE_LEN]; /**< Length of WIFI password */
     uint8_t                 macaddr[CY_WCM_MAC_ADDR_LEN];        /**< MAC Address of the access point */
     cy_wcm_wifi_band_t      band;                                /**< WiFi band of access point */
+    bool                    directed;                            /**< connected using the last associated AP */
+    uint32_t                connect_time;                        /**< time taken to connect in ms */
 }  at_cmd_ref_app_wcm_connect_specific_t;
 
 /**
@@ -313,12 +979,20 @@ typedef struct
 } at_cmd_ref_host_ipv4_info_t ;
 
 /**
- * ICMP ping structure
+ * ICMP ping structure, also used to return the ping statistics
  */
 typedef struct
 {
     at_cmd_msg_base_t     base;          /**< AT command message header  structure */
-    uint32_t              elapsed_time;  /**< elapsed time */
+    cy_wcm_ip_address_t   ip_addr;       /**< target address, gateway if not set   */
+    uint32_t              count;         /**< number of pings to send              */
+    uint32_t              interval;      /**< time between pings in ms             */
+    uint32_t              timeout;       /**< reply timeout in ms                  */
+    uint32_t              received;      /**< number of replies                    */
+    uint32_t              min_time;      /**< minimum round trip time in ms        */
+    uint32_t              avg_time;      /**< average round trip time in ms        */
+    uint32_t              max_time;      /**< maximum round trip time in ms        */
+    uint32_t              jitter;        /**< mean round trip time variation in ms */
 } at_cmd_ref_ping_ip_addr_t;
 
 /**
@@ -328,31 +1002,122 @@ typedef struct
 {
     at_cmd_msg_base_t       base;        /**< AT command message header  structure          */
     bool                    enable;      /**< Enable/Disable notification of network change */
+    uint32_t                events;      /**< mask of (1 << cy_wcm_event_t) to notify       */
+    uint32_t                debounce;    /**< debounce time in ms, 0 to notify every event  */
 }  at_cmd_ref_app_wcm_nw_change_notification_t;
 
 /**
- * Get WiFi scan result structure
+ * WiFi scan table entry, one per BSSID
  */
 typedef struct
 {
-    at_cmd_msg_base_t       base;                          /**< AT command message header  structure */
-    size_t                  ssid_length;                   /**< SSID length                          */
+    uint8_t                 bssid[CY_WCM_MAC_ADDR_LEN];    /**< MAC Address of the access point      */
+    uint8_t                 ssid_length;                   /**< SSID length                          */
+    uint8_t                 channel;                       /**< channel number                       */
     char                    ssid[CY_WCM_MAX_SSID_LEN + 1]; /**< SSID of the access point             */
+    int8_t                  signal_strength;               /**< strongest signal strength seen       */
+    uint8_t                 band;                          /**< WiFi band of access point            */
     cy_wcm_security_t       security_type;                 /**< WiFi security type                   */
-    uint8_t                 macaddr[CY_WCM_MAC_ADDR_LEN];  /**< MAC Address of the access point      */
-    int16_t                 signal_strength;               /**< signal strength                      */
-    uint8_t                 channel;                       /**< channel number                       */
-    cy_wcm_wifi_band_t      band;                          /**< WiFi band of access point            */
-    bool                    scan_complete;                 /**< WiFi scan complete/incomplete        */
+    cy_time_t               last_seen;                     /**< time the AP was last reported (ms)   */
+}  at_cmd_ref_app_scan_entry_t;
+
+/**
+ * WiFi scan filter, only the criteria set in flags are applied
+ */
+typedef struct
+{
+    uint32_t                flags;                         /**< AT_CMD_REF_APP_SCAN_FILTER_ flags    */
+    char                    ssid[CY_WCM_MAX_SSID_LEN + 1]; /**< SSID to match                        */
+    uint8_t                 ssid_length;                   /**< SSID length                          */
+    uint8_t                 bssid[CY_WCM_MAC_ADDR_LEN];    /**< MAC Address to match                 */
+    int16_t                 min_rssi;                      /**< minimum signal strength              */
+    cy_wcm_wifi_band_t      band;                          /**< WiFi band to match                   */
+    uint8_t                 num_channels;                  /**< number of entries in channels        */
+    uint8_t                 channels[AT_CMD_REF_APP_SCAN_MAX_CHANNELS]; /**< channels to match       */
+}  at_cmd_ref_app_scan_filter_t;
+
+/**
+ * WiFi scan start and scan get results message
+ */
+typedef struct
+{
+    at_cmd_msg_base_t            base;                     /**< AT command message header  structure */
+    at_cmd_ref_app_scan_filter_t filter;                   /**< optional scan filter                 */
+    uint32_t                     max_age;                  /**< max age of cached results in ms      */
+    bool                         sort_rssi;                /**< sort results by signal strength      */
+}  at_cmd_ref_app_scan_start_t;
+
+/**
+ * WiFi scan complete message
+ */
+typedef struct
+{
+    at_cmd_msg_base_t            base;                     /**< AT command message header  structure */
+    at_cmd_ref_app_scan_filter_t filter;                   /**< entries to report                    */
+    cy_time_t                    seen_since;               /**< report entries seen since this time  */
+    bool                         sort_rssi;                /**< sort results by signal strength      */
+    uint32_t                     num_dropped;              /**< Results dropped with the table full  */
+    uint32_t                     num_replaced;             /**< Weaker results replaced, table full  */
 }  at_cmd_ref_app_scan_result_t;
 
 /**
- * Json Text result structure
+ * WiFi scan results chunk, the entries copied out of the scan table
+ */
+typedef struct
+{
+    at_cmd_msg_base_t            base;                     /**< AT command message header  structure */
+    at_cmd_ref_app_scan_entry_t  entries[AT_CMD_REF_APP_SCAN_RESULTS_PER_CHUNK]; /**< access points */
+    uint32_t                     num_entries;              /**< entries in the chunk                 */
+    cy_time_t                    now;                      /**< time the ages are counted from       */
+    bool                         last;                     /**< last chunk of the results            */
+    uint32_t                     count;                    /**< entries reported, last chunk         */
+    uint32_t                     num_dropped;              /**< Results dropped with the table full  */
+    uint32_t                     num_replaced;             /**< Weaker results replaced, table full  */
+}  at_cmd_ref_app_scan_chunk_t;
+
+/**
+ * JSON text writer. The text goes to a buffer, or is sent in parts of the
+ * buffer size as it is written, or is only counted.
  */
 typedef struct
 {
-    char                              result_text[AT_CMD_REF_APP_BUFFER_SIZE]; /**< Result buffer */
-    at_cmd_ref_app_result_status_t    result_status;                           /**< Result status */
+    char                             *buffer;     /**< Text or part buffer, NULL to count      */
+    uint32_t                          size;       /**< Size of the buffer                       */
+    uint32_t                          len;        /**< Bytes in the buffer                      */
+    uint32_t                          length;     /**< Length of the JSON text                  */
+    uint32_t                          parts;      /**< Parts completed                          */
+    uint32_t                          total;      /**< Parts of the response, 0 for a text      */
+    uint32_t                          serial;     /**< Serial of the response                   */
+    uint32_t                          status;     /**< Status of the response                   */
+    bool                              async;      /**< Response is an async message             */
+    bool                              compact;    /**< Keys are written compact                 */
+    uint8_t                           depth;      /**< Nesting level                            */
+    uint8_t                           utf8_have;  /**< Bytes of the open UTF-8 sequence written */
+    uint8_t                           utf8_need;  /**< Bytes of the open UTF-8 sequence         */
+    uint32_t                          members;    /**< Bit per level holding a member           */
+    cy_rslt_t                         result;     /**< First error                              */
+} at_cmd_ref_app_json_t;
+
+/**
+ * Writes the response of cmd_id for msg
+ */
+typedef void (*at_cmd_refapp_json_fn_t)(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg);
+
+/**
+ * Json Text result structure. A response written by json_fn is generated
+ * when it is sent, result_text is then the frame buffer. The command workers
+ * have a buffer of AT_CMD_REF_APP_JSON_PART_SIZE, client_task one of
+ * AT_CMD_REF_APP_BUFFER_SIZE for the SYS responses.
+ */
+typedef struct
+{
+    char                             *result_text;                             /**< Result buffer                           */
+    uint32_t                          result_size;                             /**< Size of the result buffer               */
+    at_cmd_ref_app_result_status_t    result_status;                           /**< Result status                           */
+    at_cmd_refapp_json_fn_t           json_fn;                                 /**< Writes the response, NULL for the text  */
+    uint32_t                          json_cmd_id;                             /**< Command id passed to json_fn            */
+    at_cmd_msg_base_t                *json_msg;                                /**< Message passed to json_fn               */
+    bool                              json_msg_free;                           /**< Free json_msg once the response is sent */
 } at_cmd_result_data_t;
 
 /* MQTT Structures */
@@ -366,6 +1131,70 @@ typedef struct
     uint32_t brokerid;             /**< MQTT broker id */
 } at_cmd_ref_app_mqtt_brokerid_t;
 
+/**
+ *  MQTT credential id
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;        /**< AT command message header  structure */
+    uint32_t credid;               /**< MQTT credential id */
+} at_cmd_ref_app_mqtt_credid_t;
+
+/**
+ * MQTT credential (root CA, client certificate or client key).
+ * Identical credentials are stored once and shared by reference count.
+ */
+typedef struct
+{
+    cy_linked_list_node_t node;    /**< Linked list node to keep track of credentials      */
+    uint32_t refcount;             /**< Number of credential ids and brokers referring it  */
+    uint32_t hash;                 /**< Hash of the credential data                        */
+    uint32_t length;               /**< Length of the credential data                      */
+    bool der;                      /**< True if data holds DER, else NUL terminated PEM    */
+    char data[0];                  /**< Credential data                                    */
+} at_cmd_ref_app_mqtt_credential_t;
+
+/**
+ *  MQTT Define credential message
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;        /**< AT command message header  structure               */
+    uint32_t credid;               /**< credential id                                      */
+    uint32_t length;               /**< length of the credential data                      */
+    char data[0];                  /**< credential data (NUL terminated)                   */
+} at_cmd_ref_app_mqtt_define_credential_t;
+
+/**
+ *  MQTT Upload credential message, one chunk of a raw DER credential
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;        /**< AT command message header  structure               */
+    uint32_t credid;               /**< credential id                                      */
+    uint32_t offset;               /**< offset of this chunk in the credential             */
+    uint32_t total;                /**< total length of the credential                     */
+    uint32_t received;             /**< bytes of the credential received so far            */
+    uint32_t length;               /**< length of this chunk                               */
+    uint8_t data[0];               /**< raw DER bytes of this chunk                        */
+} at_cmd_ref_app_mqtt_upload_credential_t;
+
+/**
+ * MQTT client calls, served by the MQTT library or by the loopback broker
+ */
+typedef struct
+{
+    cy_rslt_t (*create)(uint8_t *buffer, uint32_t buff_len, cy_awsport_ssl_credentials_t *security,
+                        cy_mqtt_broker_info_t *broker_info, char *descriptor, cy_mqtt_t *mqtt_handle);
+    cy_rslt_t (*register_event_callback)(cy_mqtt_t mqtt_handle, cy_mqtt_callback_t event_callback, void *user_data);
+    cy_rslt_t (*connect)(cy_mqtt_t mqtt_handle, cy_mqtt_connect_info_t *connect_info);
+    cy_rslt_t (*disconnect)(cy_mqtt_t mqtt_handle);
+    cy_rslt_t (*destroy)(cy_mqtt_t mqtt_handle);
+    cy_rslt_t (*publish)(cy_mqtt_t mqtt_handle, cy_mqtt_publish_info_t *pub_msg);
+    cy_rslt_t (*subscribe)(cy_mqtt_t mqtt_handle, cy_mqtt_subscribe_info_t *sub_info, uint8_t sub_count);
+    cy_rslt_t (*unsubscribe)(cy_mqtt_t mqtt_handle, cy_mqtt_unsubscribe_info_t *unsub_info, uint8_t unsub_count);
+} at_cmd_ref_app_mqtt_client_t;
+
 /**
  * MQTT Define broker
  */
@@ -381,6 +1210,9 @@ typedef struct
     char *rootca;                  /**< Root CA certificate of the MQTT broker             */
     char *cert;                    /**< client certificate of the MQTT client              */
     char *key;                     /**< client private key of the MQTT client              */
+    at_cmd_ref_app_mqtt_credential_t *rootca_cred; /**< shared credential holding rootca  */
+    at_cmd_ref_app_mqtt_credential_t *cert_cred;   /**< shared credential holding cert    */
+    at_cmd_ref_app_mqtt_credential_t *key_cred;    /**< shared credential holding key     */
     char *clientid;                /**< client id string                                   */
     bool cleansession;             /**< clean session (true/false)                         */
     char *username;                /**< user name                )                         */
@@ -395,10 +1227,36 @@ typedef struct
     uint32_t publishretrylimit;    /**< publish retry limit                                */
     uint32_t subscribeqos;         /**< subscribe qos                                      */
     uint16_t data_length;          /**< data length of the server strings                  */
-    cy_mqtt_t mqtt_handle;         /**< MQTT handle                                        */
+    cy_mqtt_t mqtt_handle;         /**< MQTT handle, kept across unexpected disconnects    */
     uint8_t  *mqtt_buffer;         /**< MQTT buffer                                        */
+    bool reused;                   /**< True if the last connect reused the MQTT handle    */
+    uint32_t handshake_time;       /**< Duration of the last connect handshake in ms       */
+    const at_cmd_ref_app_mqtt_client_t *client; /**< MQTT library or loopback broker   */
 } at_cmd_ref_app_mqtt_broker_info_t;
 
+/**
+ * MQTT_Loopback settings and statistics of the loopback broker
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;        /**< AT command message header  structure               */
+    bool configure;                /**< apply the settings and restart the statistics      */
+    uint32_t puback_delay;         /**< ms until a QoS 1 or 2 publish is acknowledged      */
+    uint32_t puback_loss;          /**< every puback_loss-th PUBACK is lost, 0 for none    */
+    uint32_t disconnect;           /**< every disconnect-th publish drops the client       */
+    uint32_t delivery_delay;       /**< ms until a message reaches the subscribers         */
+    uint32_t published;            /**< messages published                                 */
+    uint32_t delivered;            /**< messages delivered to subscribers                  */
+    uint32_t delivery_drops;       /**< deliveries the broker had no room for              */
+    uint32_t acks_lost;            /**< PUBACKs lost                                       */
+    uint32_t disconnects;          /**< clients dropped by the broker                      */
+    uint32_t reconnects;           /**< dropped clients connected again                    */
+    uint32_t delivery_avg;         /**< average publish to delivery time in us             */
+    uint32_t delivery_max;         /**< longest publish to delivery time in us             */
+    uint32_t reconnect_last;       /**< ms from the last drop until the client was back    */
+    uint32_t reconnect_max;        /**< longest time from a drop until the client was back */
+} at_cmd_ref_app_mqtt_loopback_t;
+
 /**
  *  MQTT Define server message
  */
@@ -412,6 +1270,9 @@ typedef struct
     char *rootca;                 /**< Root CA certificate of the MQTT broker             */
     char *cert;                   /**< client certificate of the MQTT client              */
     char *key;                    /**< client private key of the MQTT client              */
+    uint32_t rootcaid;            /**< credential id of the root CA (0 if inline/none)    */
+    uint32_t certid;              /**< credential id of the client cert (0 if inline/none)*/
+    uint32_t keyid;               /**< credential id of the client key (0 if inline/none) */
     char *clientid;               /**< client id string                                   */
     bool cleansession;            /**< clean session (true/false)                         */
     char *username;               /**< user name                )                         */
@@ -466,44 +1327,418 @@ typedef struct
 typedef struct
 {
     at_cmd_msg_base_t base;                     /**< AT command message header  structure */
+    uint32_t brokerid;                          /**< broker id                            */
     cy_mqtt_disconn_type_t disconnect_reason;   /**< MQTT async disconnect reason         */
 } at_cmd_ref_app_mqtt_disconnect_event_t;
 
-/******************************************************
- *                    Function Declarations
- ******************************************************/
-/** This function checks if the protocol data is ready at the USB Receive FIFO
- *
- * @param   opaque                     : Pointer to the opaque data
- * @return  bool                       : True  ( Data is ready)
- *                                     : False ( Data is not ready )
- *
- *******************************************************************************/
-bool at_cmd_refapp_transport_is_data_ready(void *opaque);
-
-/** This function parses the WCM command in Json Text format to corresponding data structure.
- *
- * @param   cmd_id                     : The command id of the WCM command
- * @param   serial                     : The serial number of the WCM command
- * @param   cmd_len                    : The command length of the  WCM command
- * @param   cmd                        : The pointer to the command buffer containing Json Text
- * @return  at_cmd_msg_base_t          : The pointer to the at_cmd_msg_base_t
- *                                     : NULL ( error case)
- *
- *******************************************************************************/
-at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd( uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd);
-
-/** This function initializes the WCM and registers callback with WCM for event notification
- *
- * @param   msgq                       : The pointer to message queue
- * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
- *                                     : CY_RSLT_TYPE_ERROR
- *
- *******************************************************************************/
-cy_rslt_t at_cmd_refapp_wcm_init(cy_queue_t *msgq);
+/**
+ * Command processing stages stamped by the latency trace
+ */
+typedef enum
+{
+    AT_CMD_REF_APP_TRACE_PARSE = 0,     /**< parser callback called */
+    AT_CMD_REF_APP_TRACE_ENQUEUE,       /**< message parsed and queued */
+    AT_CMD_REF_APP_TRACE_DISPATCH,      /**< message taken from the queue by client_task */
+    AT_CMD_REF_APP_TRACE_EXECUTE,       /**< command executed, response being sent */
+    AT_CMD_REF_APP_TRACE_RESPOND,       /**< response sent */
+    AT_CMD_REF_APP_TRACE_NUM_STAMPS
+} at_cmd_ref_app_trace_stamp_t;
 
+/**
+ * Trace clock, returns a free running time in us. The default counts CPU
+ * cycles, or has ms resolution on a core without a cycle counter.
+ */
+typedef uint32_t (*at_cmd_refapp_trace_clock_t)(void);
 
-/** This function looks up the wifi security table given a name to return index to the table.
+/**
+ * SYS_Trace command and trace dump message
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;      /**< AT command message header  structure  */
+    bool              reset;     /**< clear the statistics after the dump   */
+} at_cmd_ref_app_sys_trace_t;
+
+/**
+ * Messages counted by SYS_Stats
+ */
+typedef enum
+{
+    AT_CMD_REF_APP_SYS_COUNT_COMMAND = 0,   /**< command received from the host */
+    AT_CMD_REF_APP_SYS_COUNT_EVENT,         /**< message posted by the application */
+    AT_CMD_REF_APP_SYS_COUNT_DROP,          /**< message dropped, the queue was full */
+    AT_CMD_REF_APP_SYS_COUNT_BUSY           /**< command rejected, no credit was left */
+} at_cmd_ref_app_sys_count_t;
+
+/**
+ * SYS_Stats command
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;      /**< AT command message header  structure         */
+    bool              reset;     /**< reset the statistics after reporting them    */
+} at_cmd_ref_app_sys_stats_t;
+
+/**
+ * SYS_SetFormat command
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;      /**< AT command message header  structure         */
+    bool              compact;   /**< send the responses with compact keys         */
+    uint32_t          version;   /**< key dictionary version the host has, 0 none  */
+} at_cmd_ref_app_sys_format_t;
+
+/**
+ * SYS_SetBaud command, and the messages switching and restoring the rate
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;      /**< AT command message header  structure         */
+    bool              confirm;   /**< confirm the rate switched to before          */
+    uint32_t          baud;      /**< rate requested, or the rate to restore       */
+    uint32_t          actual;    /**< rate set by the UART                         */
+    uint32_t          timeout;   /**< time in ms the host has to confirm the rate  */
+} at_cmd_ref_app_sys_baud_t;
+
+/**
+ * SYS_SetTransport command
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;      /**< AT command message header  structure         */
+    bool              tcp;       /**< listen for a TCP client, else the default    */
+    uint32_t          port;      /**< TCP port                                     */
+} at_cmd_ref_app_sys_transport_t;
+
+/**
+ * Thread stack usage
+ */
+typedef struct
+{
+    char     name[AT_CMD_REF_APP_SYS_THREAD_NAME_LEN];  /**< thread name                          */
+    uint32_t stack_size;                                /**< stack size in bytes                  */
+    uint32_t max_used;                                  /**< stack high-water mark in bytes       */
+} at_cmd_ref_app_sys_thread_info_t;
+
+/**
+ * Small message pool statistics
+ */
+typedef struct
+{
+    uint32_t in_use;                                    /**< slots allocated                        */
+    uint32_t max_in_use;                                /**< slots allocated high-water mark        */
+    uint32_t allocs;                                    /**< messages taken from the pool           */
+    uint32_t fallbacks;                                 /**< messages allocated with the pool empty */
+} at_cmd_ref_app_msg_pool_stats_t;
+
+/**
+ * SYS_Stats host message
+ */
+typedef struct
+{
+    at_cmd_msg_base_t                base;                                       /**< AT command message header  structure */
+    uint32_t                         queue_depth;                                /**< messages in the command queue         */
+    uint32_t                         queue_max_depth;                            /**< command queue high-water mark         */
+    uint32_t                         drops;                                      /**< messages dropped by send_message      */
+    uint32_t                         log_drops;                                  /**< log messages dropped, the ring was full */
+    uint32_t                         credits_in_use;                             /**< host commands outstanding             */
+    uint32_t                         credits_max_in_use;                         /**< outstanding commands high-water mark  */
+    uint32_t                         busy;                                       /**< commands rejected with "busy"         */
+    at_cmd_ref_app_msg_pool_stats_t  msg_pool;                                   /**< small message pool                    */
+    bool                             heap_valid;                                 /**< heap statistics are available         */
+    uint32_t                         heap_size;                                  /**< heap obtained by the allocator        */
+    uint32_t                         heap_free;                                  /**< free heap                             */
+    uint32_t                         heap_sampled_min_free;                      /**< lowest free heap seen by SYS_Stats    */
+    uint32_t                         num_threads;                                /**< number of entries in threads          */
+    at_cmd_ref_app_sys_thread_info_t threads[AT_CMD_REF_APP_SYS_MAX_THREADS];    /**< thread stack usage                    */
+    uint32_t                         commands[AT_CMD_REF_APP_SYS_MAX_CMD_ID];    /**< host commands by cmd_id               */
+    uint32_t                         events[AT_CMD_REF_APP_SYS_MAX_CMD_ID];      /**< application messages by cmd_id        */
+    uint32_t                         cmd_drops[AT_CMD_REF_APP_SYS_MAX_CMD_ID];   /**< dropped messages by cmd_id            */
+} at_cmd_ref_app_sys_stats_info_t;
+
+/**
+ * Faults a SYS_Bench step can inject
+ */
+typedef enum
+{
+    AT_CMD_REF_APP_BENCH_FAULT_WRITE_DELAY = 0,    /**< transport writes take write-delay ms          */
+    AT_CMD_REF_APP_BENCH_FAULT_MALLOC,             /**< every malloc-fail-th allocation fails         */
+    AT_CMD_REF_APP_BENCH_FAULT_MQTT_DISCONNECT,    /**< the broker drops every disconnect-th publish  */
+    AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY,          /**< WCM commands and jobs take wcm-delay ms       */
+
+    AT_CMD_REF_APP_BENCH_NUM_FAULTS
+} at_cmd_ref_app_bench_fault_t;
+
+/**
+ * Async events a SYS_Bench step can generate
+ */
+typedef enum
+{
+    AT_CMD_REF_APP_BENCH_EVENT_NONE = 0,           /**< the step sends commands                       */
+    AT_CMD_REF_APP_BENCH_EVENT_MQTT_MESSAGE        /**< MQTT subscription messages of fill characters */
+} at_cmd_ref_app_bench_event_t;
+
+/**
+ * SYS_Bench script step. "$n" in args is replaced by the iteration number and
+ * "$f" by fill characters.
+ */
+typedef struct
+{
+    char     cmd[AT_CMD_REF_APP_BENCH_NAME_LEN];   /**< AT command name                               */
+    char    *args;                                  /**< AT command arguments, NULL for none           */
+    at_cmd_ref_app_bench_event_t event;             /**< event sent instead of a command               */
+    uint32_t count;                                 /**< times the command or event is sent            */
+    uint32_t rate;                                  /**< per second, 0 waits for each response         */
+    uint32_t event_rate;                            /**< MQTT messages per second sent alongside       */
+    uint32_t fill;                                  /**< number of fill characters for "$f"            */
+    uint32_t delay;                                 /**< wait in ms after the step                     */
+    uint32_t faults[AT_CMD_REF_APP_BENCH_NUM_FAULTS]; /**< fault settings, 0 for none                  */
+    uint8_t *data;                                  /**< raw bytes sent on "ready", NULL for none      */
+    uint32_t data_len;                              /**< number of raw bytes                           */
+} at_cmd_ref_app_bench_step_t;
+
+/**
+ * SYS_Bench result of one step
+ */
+typedef struct
+{
+    uint32_t commands;                              /**< commands answered                             */
+    uint32_t errors;                                /**< commands answered with an error               */
+    uint32_t timeouts;                              /**< commands not answered in time                 */
+    uint32_t events;                                /**< events queued                                 */
+    uint32_t event_drops;                           /**< events the queue had no room for              */
+    uint32_t drops;                                 /**< messages dropped by the application           */
+    uint32_t max_depth;                             /**< most messages seen in the command queue       */
+    uint32_t p50;                                   /**< median response latency in us                 */
+    uint32_t p99;                                   /**< 99th percentile response latency in us        */
+    uint32_t faults;                                /**< faults injected                               */
+    int32_t  recovery;                              /**< ms until latency was back to normal after faults, -1 if it was not */
+    bool     after_faults;                          /**< the previous step injected faults             */
+} at_cmd_ref_app_bench_step_result_t;
+
+/**
+ * SYS_Bench command
+ */
+typedef struct
+{
+    at_cmd_msg_base_t           base;                                      /**< AT command message header  structure */
+    char                        name[AT_CMD_REF_APP_BENCH_NAME_LEN];       /**< benchmark name echoed in the result  */
+    uint32_t                    num_steps;                                 /**< number of steps                      */
+    at_cmd_ref_app_bench_step_t steps[AT_CMD_REF_APP_BENCH_MAX_STEPS];     /**< script steps                         */
+} at_cmd_ref_app_sys_bench_t;
+
+/**
+ * SYS_Bench result
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;                                 /**< AT command message header  structure      */
+    char              name[AT_CMD_REF_APP_BENCH_NAME_LEN];  /**< benchmark name                            */
+    uint32_t          commands;                             /**< commands answered                         */
+    uint32_t          errors;                               /**< commands answered with an error           */
+    uint32_t          timeouts;                             /**< commands not answered in time             */
+    uint32_t          duration;                             /**< run time in ms                            */
+    uint32_t          p50;                                  /**< median response latency in us             */
+    uint32_t          p99;                                  /**< 99th percentile response latency in us    */
+    uint32_t          p999;                                 /**< 99.9th percentile response latency in us  */
+    uint32_t          max;                                  /**< highest response latency in us            */
+    uint32_t          heap_peak;                            /**< highest heap use in bytes                 */
+    uint32_t          allocs;                               /**< allocations during the run                */
+    uint32_t          alloc_bytes;                          /**< bytes allocated during the run            */
+    uint32_t          num_steps;                            /**< number of steps                           */
+    at_cmd_ref_app_bench_step_result_t steps[AT_CMD_REF_APP_BENCH_MAX_STEPS]; /**< step results        */
+} at_cmd_ref_app_sys_bench_result_t;
+
+/**
+ * SYS_MicroBench command
+ */
+typedef struct
+{
+    at_cmd_msg_base_t base;                                 /**< AT command message header  structure      */
+    uint32_t          count;                                /**< iterations per case                       */
+    char              name[AT_CMD_REF_APP_BENCH_NAME_LEN];  /**< case to run, empty for all                */
+} at_cmd_ref_app_sys_microbench_t;
+
+/**
+ * SYS_MicroBench result of one case
+ */
+typedef struct
+{
+    const char *name;                                       /**< case name                                 */
+    uint32_t    ns_per_op;                                  /**< time per iteration in ns                  */
+    uint32_t    allocs;                                     /**< allocations of all iterations             */
+    uint32_t    alloc_bytes;                                /**< bytes allocated by all iterations         */
+    bool        failed;                                     /**< the function failed on the corpus         */
+} at_cmd_ref_app_bench_case_result_t;
+
+/**
+ * SYS_MicroBench result
+ */
+typedef struct
+{
+    at_cmd_msg_base_t                  base;                                        /**< AT command message header  structure */
+    uint32_t                           count;                                       /**< iterations per case                  */
+    bool                               alloc_counts;                                /**< allocations were counted             */
+    uint32_t                           num_cases;                                   /**< number of cases run                  */
+    at_cmd_ref_app_bench_case_result_t cases[AT_CMD_REF_APP_BENCH_MICRO_MAX_CASES]; /**< case results                         */
+} at_cmd_ref_app_sys_microbench_result_t;
+
+#if AT_CMD_REF_APP_TRACE_ENABLE
+#define AT_CMD_REFAPP_TRACE_CLOCK()                 at_cmd_refapp_trace_clock()
+#define AT_CMD_REFAPP_TRACE_STAMP(msg, stamp, time) at_cmd_refapp_trace_stamp((msg), (stamp), (time))
+#define AT_CMD_REFAPP_TRACE_CANCEL(msg)             at_cmd_refapp_trace_cancel(msg)
+#define AT_CMD_REFAPP_TRACE_COMPLETE(msg)           at_cmd_refapp_trace_complete(msg)
+#else
+#define AT_CMD_REFAPP_TRACE_CLOCK()                 (0)
+#define AT_CMD_REFAPP_TRACE_STAMP(msg, stamp, time) ((void)(time))
+#define AT_CMD_REFAPP_TRACE_CANCEL(msg)
+#define AT_CMD_REFAPP_TRACE_COMPLETE(msg)
+#endif
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+#define AT_CMD_REFAPP_BENCH_FAULT(fault)            at_cmd_refapp_bench_fault(fault)
+#define AT_CMD_REFAPP_BENCH_FAULT_DELAY(fault)      at_cmd_refapp_bench_fault_delay(fault)
+#else
+#define AT_CMD_REFAPP_BENCH_FAULT(fault)            (0)
+#define AT_CMD_REFAPP_BENCH_FAULT_DELAY(fault)
+#endif
+
+/******************************************************
+ *                    Function Declarations
+ ******************************************************/
+/** This function checks if the protocol data is ready at the USB Receive FIFO
+ *
+ * @param   opaque                     : Pointer to the opaque data
+ * @return  bool                       : True  ( Data is ready)
+ *                                     : False ( Data is not ready )
+ *
+ *******************************************************************************/
+bool at_cmd_refapp_transport_is_data_ready(void *opaque);
+
+/** This function creates the transport lock and selects the transport of the build
+ *
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_transport_init(void);
+
+/** This function reads the protocol data waiting at the transport
+ *
+ * @param   buffer                     : The buffer to read into
+ * @param   size                       : The size of the buffer
+ * @param   opaque                     : Pointer to the opaque data
+ * @return  uint32_t                   : The number of bytes read
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_transport_read(uint8_t *buffer, uint32_t size, void *opaque);
+
+/** This function reads raw data sent by the host after a command, bypassing
+ *  the AT parser. It is called from the parser thread.
+ *
+ * @param   buffer                     : The buffer to read into
+ * @param   length                     : The number of bytes to read
+ * @param   timeout_ms                 : The time to wait for the data
+ * @return  uint32_t                   : The number of bytes read, less than length on timeout
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_transport_read_data(uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+
+/** This function writes protocol data to the transport
+ *
+ * @param   buffer                     : The data
+ * @param   length                     : The length of the data
+ * @param   opaque                     : Pointer to the opaque data
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_transport_write(uint8_t *buffer, uint32_t length, void *opaque);
+
+/** This function holds the transport, a response frame is written with the
+ *  lock held so it is not split by other frames or a change of transport.
+ *
+ *******************************************************************************/
+void at_cmd_refapp_transport_lock(void);
+
+/** This function releases the transport
+ *
+ *******************************************************************************/
+void at_cmd_refapp_transport_unlock(void);
+
+/** This function returns the name of the transport in use
+ *
+ * @return  const char *               : "uart", "sdio" or "tcp"
+ *
+ *******************************************************************************/
+const char *at_cmd_refapp_transport_name(void);
+
+/** This function returns the name of the transport of the build
+ *
+ * @return  const char *               : "uart" or "sdio"
+ *
+ *******************************************************************************/
+const char *at_cmd_refapp_transport_default_name(void);
+
+/** This function listens for a TCP client, the AT commands move to the first
+ *  client connecting and back to the transport of the build when it goes away.
+ *
+ * @param   port                       : The TCP port
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR ( already listening on another port, or socket error)
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_transport_listen(uint16_t port);
+
+/** This function closes the TCP transport and selects the transport of the build
+ *
+ *******************************************************************************/
+void at_cmd_refapp_transport_close(void);
+
+/** This function changes the rate of the AT UART once the frames being sent
+ *  are on the wire. Responses are held until the new rate is set. Fails when
+ *  the transport in use has no rate.
+ *
+ * @param   baud                       : The new rate
+ * @param   actual                     : The rate set by the UART, may be NULL
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_transport_set_baud(uint32_t baud, uint32_t *actual);
+
+/** This function returns the rate of the AT UART
+ *
+ * @return  uint32_t                   : The rate, 0 when the transport in use is no UART
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_transport_get_baud(void);
+
+/** This function parses the WCM command in Json Text format to corresponding data structure.
+ *
+ * @param   cmd_id                     : The command id of the WCM command
+ * @param   serial                     : The serial number of the WCM command
+ * @param   cmd_len                    : The command length of the  WCM command
+ * @param   cmd                        : The pointer to the command buffer containing Json Text
+ * @return  at_cmd_msg_base_t          : The pointer to the at_cmd_msg_base_t
+ *                                     : NULL ( error case)
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd( uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd);
+
+/** This function initializes the WCM, registers callback with WCM for event notification
+ *  and starts the worker thread running WCM_APConnect
+ *
+ * @param   msgq                       : The pointer to message queue
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_wcm_init(cy_queue_t *msgq);
+
+
+/** This function looks up the wifi security table given a name to return index to the table.
  *
  * @param   cmd_name                   : The pointer to wifi security name
  * @param   table                      : The pointer to the structure of the security table
@@ -532,7 +1767,94 @@ int at_cmd_refapp_security_table_lookup_by_value(uint32_t value, at_cmd_security
  *******************************************************************************/
 cy_rslt_t at_cmd_refapp_send_message(at_cmd_msg_base_t *msg);
 
-/** This function creates a Json Text from the structure and stores into buffer
+/** This function sends a response to a host command. Responses are sent from
+ *  client_task and the command workers, the frames are serialized here.
+ *
+ * @param   serial                     : The serial of the command
+ * @param   status                     : AT_CMD_REF_APP_RESULT_STATUS_SUCCESS or AT_CMD_REF_APP_RESULT_STATUS_ERROR
+ * @param   text                       : The response text
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_send_response(uint32_t serial, uint32_t status, char *text);
+
+/** This function sends an asynchronous message to the host
+ *
+ * @param   serial                     : The serial of the command or the event id
+ * @param   text                       : The message text
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_send_async_response(uint32_t serial, char *text);
+
+/** This function sends a frame to the host as it is, without compacting its keys
+ *
+ * @param   serial                     : The serial of the command or the event id
+ * @param   status                     : The status of a command response
+ * @param   async                      : true to send an async message
+ * @param   text                       : The frame text
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_send_frame(uint32_t serial, uint32_t status, bool async, char *text);
+
+/** This function has the response written by fn when the result is sent
+ *
+ * @param   result_str                 : The pointer to the result structure
+ * @param   fn                         : The function writing the response
+ * @param   cmd_id                     : The command id passed to fn
+ * @param   msg                        : The message passed to fn, valid until the result is sent
+ * @param   free_msg                   : true to free msg once the result is sent
+ *
+ *******************************************************************************/
+void at_cmd_refapp_result_set_json(at_cmd_result_data_t *result_str, at_cmd_refapp_json_fn_t fn, uint32_t cmd_id,
+                                   at_cmd_msg_base_t *msg, bool free_msg);
+
+/** This function sends a result to the host, the text or the response written by its json_fn
+ *
+ * @param   serial                     : The serial of the command or the event id
+ * @param   async                      : true to send the result as an async message
+ * @param   result_str                 : The pointer to the result structure
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_send_result(uint32_t serial, bool async, at_cmd_result_data_t *result_str);
+
+/** This function returns the number of host commands holding a credit
+ *
+ * @return  uint32_t                   : Commands received and not yet responded to
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_credits_in_use(void);
+
+/** This function allocates a zeroed message, from the small message pool when it fits a slot
+ *
+ * @param   size                       : The size of the message structure
+ * @return  at_cmd_msg_base_t          : The message, NULL if out of memory
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_msg_alloc(uint32_t size);
+
+/** This function frees a message allocated with at_cmd_refapp_msg_alloc or from the heap
+ *
+ * @param   msg                        : The message, may be NULL
+ *
+ *******************************************************************************/
+void at_cmd_refapp_msg_free(at_cmd_msg_base_t *msg);
+
+/** This function reads the small message pool statistics
+ *
+ * @param   stats                      : The statistics
+ * @param   reset                      : true to restart the counts and the high-water mark
+ *
+ *******************************************************************************/
+void at_cmd_refapp_msg_pool_stats(at_cmd_ref_app_msg_pool_stats_t *stats, bool reset);
+
+/** This function creates a Json Text from the structure and stores into buffer, failing if it does not fit
  *
  * @param   cmd_id                     : The command id of the command
  * @param   msg                        : The pointer to the message structure
@@ -544,6 +1866,15 @@ cy_rslt_t at_cmd_refapp_send_message(at_cmd_msg_base_t *msg);
  *******************************************************************************/
 cy_rslt_t at_cmd_refapp_process_wcm_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen);
 
+/** This function writes the Json text of a WCM response
+ *
+ * @param   json                       : The writer
+ * @param   cmd_id                     : The command id of the command
+ * @param   msg                        : The pointer to the message structure
+ *
+ *******************************************************************************/
+void at_cmd_refapp_wcm_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg);
+
 /** This function processes the message to call respective WCM API(s) based on the command id in the message.
  *
  * @param   msg                        : The pointer to the message structure
@@ -564,6 +1895,23 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
  *******************************************************************************/
 void at_cmd_refapp_build_wcm_json_text_to_host(uint32_t cmd_id, uint32_t serial, at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str);
 
+/** This function handles a WCM network change event, sending it to the host as an async response
+ *  once the debounce time passed without further events
+ *
+ * @param   msg                        : The pointer to the network change message
+ * @param   result_str                 : The pointer to the buffer used to build the response
+ *
+ *******************************************************************************/
+void at_cmd_refapp_wcm_network_event(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
+
+/** This function sends the WiFi scan table entries selected by the message to the host in one or more async responses
+ *
+ * @param   msg                        : The pointer to the scan complete message
+ * @param   result_str                 : The pointer to the result structure used to build the responses
+ *
+ *******************************************************************************/
+void at_cmd_refapp_wcm_send_scan_results(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
+
 /** This function initializes MQTT
  *
  * @return   result_str                 : The pointer to the result structure in Json format to be sent to host
@@ -602,7 +1950,7 @@ void at_cmd_refapp_build_mqtt_json_text_to_host(uint32_t cmd_id, uint32_t serial
  *******************************************************************************/
 at_cmd_msg_base_t* at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
 
-/** This function creates a Json Text from the structure and stores into buffer
+/** This function creates a Json Text from the structure and stores into buffer, failing if it does not fit
  *
  * @param   cmd_id                     : The command id of the command
  * @param   msg                        : The pointer to the message structure
@@ -614,6 +1962,15 @@ at_cmd_msg_base_t* at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
  *******************************************************************************/
 cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen);
 
+/** This function writes the Json text of an MQTT response
+ *
+ * @param   json                       : The writer
+ * @param   cmd_id                     : The command id of the command
+ * @param   msg                        : The pointer to the message structure
+ *
+ *******************************************************************************/
+void at_cmd_refapp_mqtt_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg);
+
 /** This function process MQTT event callback
  *
  * @param   cmd_id                     : The command id of the command
@@ -624,3 +1981,441 @@ cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t
  *
  *******************************************************************************/
 cy_rslt_t at_cmd_refapp_mqtt_event_callback( uint32_t cmd_id, at_cmd_msg_base_t *mqtt_async_event, at_cmd_result_data_t *result_str );
+
+/** This function starts the loopback MQTT broker thread
+ *
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_mqtt_loopback_init(void);
+
+/** This function returns the MQTT client calls served by the loopback broker
+ *
+ * @return  at_cmd_ref_app_mqtt_client_t* : The loopback broker client calls
+ *
+ *******************************************************************************/
+const at_cmd_ref_app_mqtt_client_t *at_cmd_refapp_mqtt_loopback_client(void);
+
+/** This function reports the loopback broker statistics and applies new settings
+ *
+ * @param   loopback                   : The MQTT_Loopback message, the statistics and settings are
+ *                                       filled in, the settings are applied if configure is set
+ *
+ *******************************************************************************/
+void at_cmd_refapp_mqtt_loopback_config(at_cmd_ref_app_mqtt_loopback_t *loopback);
+
+/** This function starts the log drain thread
+ *
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_log_init(void);
+
+/** This function adds a message to the log ring without formatting it. It does not block and
+ *  can be called from any thread, timer callback or interrupt.
+ *
+ * @param   fmt                        : The printf format string, it must stay valid (a string literal)
+ *
+ *******************************************************************************/
+void at_cmd_refapp_log_write(const char *fmt, ...);
+
+/** This function returns the number of log messages dropped because the log ring was full
+ *
+ * @return  uint32_t                   : The number of dropped log messages
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_log_get_drops(void);
+
+/** This function returns the heap in use
+ *
+ * @return  uint32_t                   : The allocated heap in bytes, 0 if not known
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_sys_heap_used(void);
+
+/** This function builds the lookup table of the compact key dictionary
+ *
+ *******************************************************************************/
+void at_cmd_refapp_keys_init(void);
+
+/** This function selects the verbose or the compact response format
+ *
+ * @param   compact                    : true for compact keys
+ *
+ *******************************************************************************/
+void at_cmd_refapp_keys_set_compact(bool compact);
+
+/** This function tells whether the responses are sent with compact keys
+ *
+ * @return  bool                       : true in compact format
+ *
+ *******************************************************************************/
+bool at_cmd_refapp_keys_is_compact(void);
+
+/** This function returns a key of the compact key dictionary
+ *
+ * @param   index                      : The index of the key
+ * @return  const char *               : The key, NULL past the end of the dictionary
+ *
+ *******************************************************************************/
+const char *at_cmd_refapp_keys_get(uint32_t index);
+
+/** This function replaces the dictionary keys of a JSON text by their compact keys, in place
+ *
+ * @param   text                       : The NUL terminated JSON text
+ * @return  uint32_t                   : The length of the compacted text
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_keys_compact(char *text);
+
+/** This function returns the compact key of a dictionary key
+ *
+ * @param   key                        : The key
+ * @param   code                       : Two characters receiving the compact key, not NUL terminated
+ * @return  uint32_t                   : The length of the compact key, 0 if the key is not in the dictionary
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_keys_code(const char *key, char *code);
+
+/** This function starts writing a JSON text
+ *
+ * @param   json                       : The writer
+ * @param   buffer                     : The buffer receiving the text, NULL to only count its length
+ * @param   size                       : The size of the buffer
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_init(at_cmd_ref_app_json_t *json, char *buffer, uint32_t size);
+
+/** This function starts an object
+ *
+ * @param   json                       : The writer
+ * @param   key                        : The member name, NULL for the top level object and in arrays
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_object_begin(at_cmd_ref_app_json_t *json, const char *key);
+
+/** This function ends the current object
+ *
+ * @param   json                       : The writer
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_object_end(at_cmd_ref_app_json_t *json);
+
+/** This function starts an array
+ *
+ * @param   json                       : The writer
+ * @param   key                        : The member name, NULL in arrays
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_array_begin(at_cmd_ref_app_json_t *json, const char *key);
+
+/** This function ends the current array
+ *
+ * @param   json                       : The writer
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_array_end(at_cmd_ref_app_json_t *json);
+
+/** This function adds a string
+ *
+ * @param   json                       : The writer
+ * @param   key                        : The member name, NULL in arrays
+ * @param   value                      : The NUL terminated string
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_string(at_cmd_ref_app_json_t *json, const char *key, const char *value);
+
+/** This function adds a number
+ *
+ * @param   json                       : The writer
+ * @param   key                        : The member name, NULL in arrays
+ * @param   value                      : The number
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_number(at_cmd_ref_app_json_t *json, const char *key, double value);
+
+/** This function adds a boolean
+ *
+ * @param   json                       : The writer
+ * @param   key                        : The member name, NULL in arrays
+ * @param   value                      : The boolean
+ *
+ *******************************************************************************/
+void at_cmd_refapp_json_bool(at_cmd_ref_app_json_t *json, const char *key, bool value);
+
+/** This function completes the JSON text, terminating it in the buffer or sending the last part
+ *
+ * @param   json                       : The writer
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR ( the text is longer than the buffer )
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_json_finish(at_cmd_ref_app_json_t *json);
+
+/** This function writes a response to a buffer, without truncating it
+ *
+ * @param   fn                         : The function writing the response
+ * @param   cmd_id                     : The command id passed to fn
+ * @param   msg                        : The message passed to fn
+ * @param   buffer                     : The buffer receiving the text
+ * @param   size                       : The size of the buffer
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR ( the response is longer than the buffer )
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_json_render(at_cmd_refapp_json_fn_t fn, uint32_t cmd_id, at_cmd_msg_base_t *msg,
+                                    char *buffer, uint32_t size);
+
+/** This function sends a response to the host. A response longer than the buffer is
+ *  sent in parts of the buffer size, written as they are sent.
+ *
+ * @param   serial                     : The serial of the command or the event id
+ * @param   status                     : The status of a command response
+ * @param   async                      : true to send the response as an async message
+ * @param   fn                         : The function writing the response, called twice for a response sent in parts
+ * @param   cmd_id                     : The command id passed to fn
+ * @param   msg                        : The message passed to fn
+ * @param   buffer                     : The frame buffer
+ * @param   size                       : The size of the frame buffer
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_TYPE_ERROR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_json_send(uint32_t serial, uint32_t status, bool async, at_cmd_refapp_json_fn_t fn,
+                                  uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t size);
+
+/** This function starts the benchmark thread
+ *
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_bench_init(void);
+
+/** This function tells whether a benchmark owns the transport
+ *
+ * @return  bool                       : true while a benchmark runs
+ *
+ *******************************************************************************/
+bool at_cmd_refapp_bench_active(void);
+
+/** This function checks if replayed command data is ready for the parser
+ *
+ * @return  bool                       : true if data is ready
+ *
+ *******************************************************************************/
+bool at_cmd_refapp_bench_is_data_ready(void);
+
+/** This function reads replayed command data for the parser
+ *
+ * @param   buffer                     : The buffer to read into
+ * @param   size                       : The size of the buffer
+ * @return  uint32_t                   : The number of bytes read
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_bench_read(uint8_t *buffer, uint32_t size);
+
+/** This function passes parser output to the benchmark
+ *
+ * @param   buffer                     : The output data
+ * @param   length                     : The length of the output data
+ * @return  bool                       : true if the output answered a replayed command and was consumed
+ *
+ *******************************************************************************/
+bool at_cmd_refapp_bench_write(const uint8_t *buffer, uint32_t length);
+
+/** This function parses the SYS_Bench script
+ *
+ * @param   cmd_len                    : The command length
+ * @param   cmd                        : The pointer to the command in Json Text format
+ * @return  at_cmd_msg_base_t          : The pointer to the at_cmd_ref_app_sys_bench_t structure
+ *                                     : NULL ( error case)
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_bench_parse(uint32_t cmd_len, char *cmd);
+
+/** This function parses the SYS_MicroBench arguments
+ *
+ * @param   cmd_len                    : The command length
+ * @param   cmd                        : The pointer to the command in Json Text format
+ * @return  at_cmd_msg_base_t          : The pointer to the at_cmd_ref_app_sys_microbench_t structure
+ *                                     : NULL ( error case)
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_bench_parse_micro(uint32_t cmd_len, char *cmd);
+
+/** This function hands a SYS_Bench script or SYS_MicroBench run to the benchmark thread
+ *
+ * @param   msg                        : The SYS_Bench or SYS_MicroBench message, SYS_Bench steps are moved to the benchmark thread
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR ( a benchmark is running )
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_bench_start(at_cmd_msg_base_t *msg);
+
+/** This function frees the steps of a SYS_Bench message
+ *
+ * @param   msg                        : The SYS_Bench message
+ *
+ *******************************************************************************/
+void at_cmd_refapp_bench_free_steps(at_cmd_msg_base_t *msg);
+
+/** This function returns the number of messages dropped
+ *
+ * @return  uint32_t                   : Messages dropped since the last SYS_Stats reset
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_sys_stats_drops(void);
+
+/** This function returns the command queue depth
+ *
+ * @return  uint32_t                   : Messages waiting in the command queue
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_sys_queue_depth(void);
+
+/** This function checks whether the running benchmark injects a fault
+ *
+ * @param   fault                      : The fault
+ * @return  uint32_t                   : The delay in ms for the delay faults, 1 if the fault fires, else 0
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_bench_fault(at_cmd_ref_app_bench_fault_t fault);
+
+/** This function waits for the delay of a benchmark delay fault
+ *
+ * @param   fault                      : AT_CMD_REF_APP_BENCH_FAULT_WRITE_DELAY or AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY
+ *
+ *******************************************************************************/
+void at_cmd_refapp_bench_fault_delay(at_cmd_ref_app_bench_fault_t fault);
+
+/** This function initializes the SYS module, the command latency trace and the runtime statistics
+ *
+ * @param   msgq                       : The command message queue
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_sys_init(cy_queue_t *msgq);
+
+/** This function installs the clock used for the latency trace stamps
+ *
+ * @param   clock                      : The clock function returning us, NULL restores the RTOS clock
+ *
+ *******************************************************************************/
+void at_cmd_refapp_trace_set_clock(at_cmd_refapp_trace_clock_t clock);
+
+/** This function reads the latency trace clock
+ *
+ * @return  uint32_t                   : The current trace time in us
+ *
+ *******************************************************************************/
+uint32_t at_cmd_refapp_trace_clock(void);
+
+/** This function records the time a message reached a processing stage
+ *
+ * @param   msg                        : The pointer to the message structure
+ * @param   stamp                      : The processing stage
+ * @param   time                       : The trace time of the stage in us
+ *
+ *******************************************************************************/
+void at_cmd_refapp_trace_stamp(const at_cmd_msg_base_t *msg, at_cmd_ref_app_trace_stamp_t stamp, uint32_t time);
+
+/** This function drops a traced message that will not be processed
+ *
+ * @param   msg                        : The pointer to the message structure
+ *
+ *******************************************************************************/
+void at_cmd_refapp_trace_cancel(const at_cmd_msg_base_t *msg);
+
+/** This function stamps the response time of a message and adds its latency to the statistics
+ *
+ * @param   msg                        : The pointer to the message structure
+ *
+ *******************************************************************************/
+void at_cmd_refapp_trace_complete(const at_cmd_msg_base_t *msg);
+
+/** This function counts a host command, an application message or a dropped message for SYS_Stats
+ *
+ * @param   cmd_id                     : The command id of the message
+ * @param   type                       : The kind of message counted
+ *
+ *******************************************************************************/
+void at_cmd_refapp_sys_stats_count(uint32_t cmd_id, at_cmd_ref_app_sys_count_t type);
+
+/** This function samples the command queue depth when client_task dispatches a message
+ *
+ *******************************************************************************/
+void at_cmd_refapp_sys_stats_dispatch(void);
+
+/** This function parses Json text of the SYS command
+ *
+ * @param   cmd_id                     : The command id of the SYS command
+ * @param   serial                     : The serial number of the SYS command
+ * @param   cmd_len                    : The command length
+ * @param   cmd                        : The pointer to the command in Json Text format
+ * @return  at_cmd_msg_base_t          : The pointer to the SYS structure based on the SYS command id
+ *                                     : NULL ( error case)
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_parse_sys_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd);
+
+/** This function processes the message based on the SYS command id in the message.
+ *
+ * @param   msg                        : The pointer to the message structure
+ * @param   result_str                 : The pointer to the result structure
+ * @return  at_cmd_msg_base_t          : The pointer to the SYS structure based on the SYS command id
+ *                                     : NULL ( error case )
+ *
+ *******************************************************************************/
+at_cmd_msg_base_t *at_cmd_refapp_sys_process_message(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
+
+/** This function creates a Json Text from the SYS structure and stores into buffer
+ *
+ * @param   cmd_id                     : The command id of the command
+ * @param   msg                        : The pointer to the message structure
+ * @param   buffer                     : The buffer to which Json text needs to be copied
+ * @param   buflen                     : The length of the Json text buffer
+ * @return  cy_rslt_t                  : CY_RSLT_SUCCESS
+ *                                     : CY_RSLT_AT_CMD_REF_APP_ERR if the text does not fit the buffer
+ *
+ *******************************************************************************/
+cy_rslt_t at_cmd_refapp_process_sys_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen);
+
+/** This function writes the Json text of a SYS response
+ *
+ * @param   json                       : The writer
+ * @param   cmd_id                     : The command id of the command
+ * @param   msg                        : The pointer to the message structure
+ *
+ *******************************************************************************/
+void at_cmd_refapp_sys_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg);
+
+/** This function builds the SYS Json text to be sent to the host after processing based on SYS command id
+ *
+ * @param   cmd_id                     : The command id of the SYS command
+ * @param   serial                     : The serial number of the SYS command
+ * @param   cmd                        : The pointer to the message structure of SYS
+ * @param   result_str                 : The pointer to the result structure in Json format to be sent to host
+ *
+ *******************************************************************************/
+void at_cmd_refapp_build_sys_json_text_to_host(uint32_t cmd_id, uint32_t serial, at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str);
+
+/** This function sends the command latency statistics to the host in chunks
+ *
+ * @param   msg                        : The pointer to the trace dump message
+ * @param   result_str                 : The result structure used as the Json text buffer
+ *
+ *******************************************************************************/
+void at_cmd_refapp_sys_send_trace(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
+
+/** This function switches the AT UART to the rate of SYS_SetBaud, or restores
+ *  the previous rate when the switch was not confirmed in time
+ *
+ * @param   msg                        : CMD_ID_HOST_SYS_BAUD_SWITCH or CMD_ID_HOST_SYS_BAUD_REVERT message
+ * @param   result_str                 : Buffer for the message to the host
+ *
+ *******************************************************************************/
+void at_cmd_refapp_sys_baud_event(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str);
@@ -0,0 +1,1663 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/**
+ * @file at_cmd_refapp_bench.c
+ * @brief Benchmark support: replays SYS_Bench scripts through the AT command
+ *        parser over a loopback transport and measures the responses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#include "cyhal.h"
+#include "cJSON.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_SYS
+#include "at_cmd_refapp.h"
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+
+/******************************************************
+ *                      Macros
+ ******************************************************/
+#define BENCH_INJECT_MASK        (AT_CMD_REF_APP_BENCH_INJECT_SIZE - 1)
+#define BENCH_POLL_MS            (100)
+#define BENCH_EVENT_POLL_MS      (10)
+#define BENCH_SUB_BUCKET_BITS    (3)
+#define BENCH_SUB_BUCKETS        (1 << BENCH_SUB_BUCKET_BITS)
+
+/******************************************************
+ *                    Structures
+ ******************************************************/
+
+/*
+ * A SYS_MicroBench case: setup builds the corpus, run is the timed operation.
+ */
+typedef struct
+{
+    const char *name;
+    bool (*setup)(void);
+    bool (*run)(void);
+} bench_case_t;
+
+/*
+ * A replayed command waiting for its response.
+ */
+typedef struct
+{
+    bool     busy;
+    uint32_t serial;
+    uint32_t start;
+} bench_slot_t;
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static void bench_thread(cy_thread_arg_t arg);
+static bool micro_setup_wcm_connect(void);
+static bool micro_setup_scan_filter(void);
+static bool micro_setup_define_broker(void);
+static bool micro_setup_define_broker_pem(void);
+static bool micro_setup_publish(void);
+static bool micro_setup_ap_info(void);
+static bool micro_setup_get_broker(void);
+static bool micro_setup_subscription(void);
+static bool micro_run_parse_wcm(void);
+static bool micro_run_parse_mqtt(void);
+static bool micro_run_serialize_wcm(void);
+static bool micro_run_serialize_mqtt(void);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+static struct
+{
+    atomic_bool  running;                   /* a script is queued or running          */
+    atomic_bool  active;                    /* the transport is given to the script   */
+    bool         swallow;                   /* the current response is consumed       */
+
+    atomic_uint  inject_head;               /* written by the benchmark thread        */
+    atomic_uint  inject_tail;               /* read by the parser                     */
+    uint8_t      inject[AT_CMD_REF_APP_BENCH_INJECT_SIZE];
+
+    bench_slot_t slots[AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING];
+    uint32_t     outstanding;
+    uint32_t     next_serial;
+
+    /* Raw data of the command in flight, sent once the device asks for it. */
+    atomic_uint  data_serial;
+    atomic_bool  data_ready;
+
+    /* Running step, updated by the response path under a critical section. */
+    at_cmd_ref_app_bench_step_result_t step;
+    uint32_t     step_max;
+    uint32_t     step_histogram[AT_CMD_REF_APP_BENCH_BUCKETS];
+    cy_time_t    step_start;
+    uint32_t     events_sent;
+    uint32_t     drops_start;
+    bool         recovering;
+    uint32_t     recovery_start;
+    uint32_t     recovery_limit;
+
+    /* Faults of the running step. */
+    uint32_t     faults[AT_CMD_REF_APP_BENCH_NUM_FAULTS];
+    atomic_uint  fault_counts[AT_CMD_REF_APP_BENCH_NUM_FAULTS];
+    atomic_uint  faults_injected;
+
+    /* Totals of the run. */
+    uint32_t     commands;
+    uint32_t     errors;
+    uint32_t     timeouts;
+    uint32_t     max;
+    uint32_t     heap_peak;
+    uint32_t     histogram[AT_CMD_REF_APP_BENCH_BUCKETS];
+
+    cy_queue_t   queue;
+    cy_semaphore_t done;
+    cy_thread_t  thread;
+    char         line[AT_CMD_REF_APP_BENCH_MAX_LINE];
+} g_bench;
+
+static uint64_t g_bench_stack[AT_CMD_REF_APP_BENCH_STACK_SIZE / 8];
+
+/*
+ * SYS_MicroBench corpus of the running case.
+ */
+static struct
+{
+    uint32_t           cmd_id;
+    char              *text;
+    at_cmd_msg_base_t *msg;
+    char               buffer[AT_CMD_REF_APP_BUFFER_SIZE];
+} g_micro;
+
+static const bench_case_t g_micro_cases[] =
+{
+    { "wcm-connect",            micro_setup_wcm_connect,       micro_run_parse_wcm },
+    { "wcm-scan-filter",        micro_setup_scan_filter,       micro_run_parse_wcm },
+    { "mqtt-define-broker",     micro_setup_define_broker,     micro_run_parse_mqtt },
+    { "mqtt-define-broker-pem", micro_setup_define_broker_pem, micro_run_parse_mqtt },
+    { "mqtt-publish-1k",        micro_setup_publish,           micro_run_parse_mqtt },
+    { "wcm-ap-info",            micro_setup_ap_info,           micro_run_serialize_wcm },
+    { "mqtt-get-broker",        micro_setup_get_broker,        micro_run_serialize_mqtt },
+    { "mqtt-subscription-1k",   micro_setup_subscription,      micro_run_serialize_mqtt },
+};
+
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+static atomic_uint g_bench_allocs;
+static atomic_uint g_bench_alloc_bytes;
+#endif
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+/*
+ * Allocation counters and the allocation fault, the benchmark build links
+ * with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    if (at_cmd_refapp_bench_fault(AT_CMD_REF_APP_BENCH_FAULT_MALLOC))
+    {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&g_bench_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_bench_alloc_bytes, size, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    if (at_cmd_refapp_bench_fault(AT_CMD_REF_APP_BENCH_FAULT_MALLOC))
+    {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&g_bench_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_bench_alloc_bytes, num * size, memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (at_cmd_refapp_bench_fault(AT_CMD_REF_APP_BENCH_FAULT_MALLOC))
+    {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&g_bench_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_bench_alloc_bytes, size, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+#endif /* AT_CMD_REF_APP_BENCH_WRAP_MALLOC */
+
+/**
+ * Start the benchmark thread
+ */
+cy_rslt_t at_cmd_refapp_bench_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_queue_init(&g_bench.queue, AT_CMD_REF_APP_BENCH_QUEUE_MSGS, sizeof(at_cmd_ref_app_sys_bench_t *));
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench queue init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_init_semaphore(&g_bench.done, AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench semaphore init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_thread_create(&g_bench.thread, &bench_thread, "bench", g_bench_stack,
+                                   AT_CMD_REF_APP_BENCH_STACK_SIZE, AT_CMD_REF_APP_BENCH_PRIORITY, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench thread create failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Histogram bucket of a latency: values below 8 have their own bucket, larger
+ * values are split into 8 buckets per power of two.
+ */
+static uint32_t bench_bucket(uint32_t value)
+{
+    uint32_t msb;
+
+    if (value < BENCH_SUB_BUCKETS)
+    {
+        return value;
+    }
+    msb = 31 - __builtin_clz(value);
+    return (msb - BENCH_SUB_BUCKET_BITS + 1) * BENCH_SUB_BUCKETS +
+           ((value >> (msb - BENCH_SUB_BUCKET_BITS)) & (BENCH_SUB_BUCKETS - 1));
+}
+
+/*
+ * Highest latency falling into a bucket.
+ */
+static uint32_t bench_bucket_limit(uint32_t bucket)
+{
+    uint32_t shift;
+    uint64_t limit;
+
+    if (bucket < BENCH_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    shift = bucket / BENCH_SUB_BUCKETS - 1;
+    limit = ((uint64_t)(BENCH_SUB_BUCKETS + bucket % BENCH_SUB_BUCKETS + 1) << shift) - 1;
+    return limit > UINT32_MAX ? UINT32_MAX : (uint32_t)limit;
+}
+
+/*
+ * Latency at a rank given in thousandths of the samples.
+ */
+static uint32_t bench_percentile(const uint32_t *histogram, uint32_t max, uint32_t permille)
+{
+    uint32_t total = 0;
+    uint32_t rank;
+    uint32_t limit;
+    uint32_t i;
+
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_BUCKETS; i++)
+    {
+        total += histogram[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    rank = (uint32_t)(((uint64_t)total * permille + 999) / 1000);
+    rank = rank == 0 ? 1 : rank;
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_BUCKETS; i++)
+    {
+        if (histogram[i] >= rank)
+        {
+            break;
+        }
+        rank -= histogram[i];
+    }
+    limit = bench_bucket_limit(i);
+    return limit < max ? limit : max;
+}
+
+static void bench_sample_heap(void)
+{
+    uint32_t used = at_cmd_refapp_sys_heap_used();
+
+    if (used > g_bench.heap_peak)
+    {
+        g_bench.heap_peak = used;
+    }
+}
+
+/**
+ * Check whether the running step injects a fault
+ */
+uint32_t at_cmd_refapp_bench_fault(at_cmd_ref_app_bench_fault_t fault)
+{
+    uint32_t setting;
+
+    if (!atomic_load_explicit(&g_bench.active, memory_order_relaxed))
+    {
+        return 0;
+    }
+    setting = g_bench.faults[fault];
+    if (setting == 0)
+    {
+        return 0;
+    }
+
+    /* Delays apply every time, the other faults every setting-th time. */
+    if ((fault != AT_CMD_REF_APP_BENCH_FAULT_WRITE_DELAY) && (fault != AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY))
+    {
+        if ((atomic_fetch_add_explicit(&g_bench.fault_counts[fault], 1, memory_order_relaxed) + 1) % setting != 0)
+        {
+            return 0;
+        }
+        setting = 1;
+    }
+    atomic_fetch_add_explicit(&g_bench.faults_injected, 1, memory_order_relaxed);
+
+    return setting;
+}
+
+/**
+ * Wait for a delay fault
+ */
+void at_cmd_refapp_bench_fault_delay(at_cmd_ref_app_bench_fault_t fault)
+{
+    uint32_t delay = at_cmd_refapp_bench_fault(fault);
+
+    if (delay > 0)
+    {
+        cy_rtos_delay_milliseconds(delay);
+    }
+}
+
+/**
+ * The benchmark owns the transport while it runs
+ */
+bool at_cmd_refapp_bench_active(void)
+{
+    return atomic_load(&g_bench.active);
+}
+
+/**
+ * Replayed data ready for the parser
+ */
+bool at_cmd_refapp_bench_is_data_ready(void)
+{
+    return atomic_load_explicit(&g_bench.inject_head, memory_order_acquire) !=
+           atomic_load_explicit(&g_bench.inject_tail, memory_order_relaxed);
+}
+
+/**
+ * Read replayed data
+ */
+uint32_t at_cmd_refapp_bench_read(uint8_t *buffer, uint32_t size)
+{
+    uint32_t head = atomic_load_explicit(&g_bench.inject_head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&g_bench.inject_tail, memory_order_relaxed);
+    uint32_t len = 0;
+
+    while ((tail != head) && (len < size))
+    {
+        buffer[len++] = g_bench.inject[tail & BENCH_INJECT_MASK];
+        tail++;
+    }
+    atomic_store_explicit(&g_bench.inject_tail, tail, memory_order_release);
+
+    return len;
+}
+
+/*
+ * Queue a command line for the parser, waiting for the parser to make room.
+ */
+static void bench_inject(const char *line, uint32_t len)
+{
+    uint32_t head = atomic_load_explicit(&g_bench.inject_head, memory_order_relaxed);
+    uint32_t i;
+
+    while (AT_CMD_REF_APP_BENCH_INJECT_SIZE -
+           (head - atomic_load_explicit(&g_bench.inject_tail, memory_order_acquire)) < len)
+    {
+        cy_rtos_delay_milliseconds(1);
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        g_bench.inject[(head + i) & BENCH_INJECT_MASK] = (uint8_t)line[i];
+    }
+    atomic_store_explicit(&g_bench.inject_head, head + len, memory_order_release);
+}
+
+/*
+ * Parse the "+S<len>,<serial>;<status>," or "+H<len>,<serial>;" header of a
+ * response. The parser writes each response header in one call.
+ */
+static bool bench_parse_header(const uint8_t *buffer, uint32_t length, bool *sync, uint32_t *serial, bool *success)
+{
+    uint32_t pos = 2;
+    uint32_t value = 0;
+
+    if ((length < 8) || (buffer[0] != '+') || ((buffer[1] != 'S') && (buffer[1] != 'H')))
+    {
+        return false;
+    }
+    for (; (pos < 6) && (buffer[pos] >= '0') && (buffer[pos] <= '9'); pos++)
+        ;
+    if ((pos != 6) || (buffer[pos++] != ','))
+    {
+        return false;
+    }
+    for (; (pos < length) && (buffer[pos] >= '0') && (buffer[pos] <= '9'); pos++)
+    {
+        value = value * 10 + (buffer[pos] - '0');
+    }
+    if ((pos >= length) || (buffer[pos++] != ';'))
+    {
+        return false;
+    }
+
+    *sync = buffer[1] == 'S';
+    *serial = value;
+    *success = (pos < length) && (buffer[pos] == '0' + AT_CMD_REF_APP_RESULT_STATUS_SUCCESS);
+    return true;
+}
+
+/**
+ * Consume responses to replayed commands and record their latency
+ */
+bool at_cmd_refapp_bench_write(const uint8_t *buffer, uint32_t length)
+{
+    uint32_t now = at_cmd_refapp_trace_clock();
+    uint32_t serial;
+    uint32_t latency;
+    uint32_t irq;
+    uint32_t i;
+    bool sync;
+    bool success;
+
+    /* Slow host link, applies to all output while a benchmark runs. */
+    at_cmd_refapp_bench_fault_delay(AT_CMD_REF_APP_BENCH_FAULT_WRITE_DELAY);
+
+    if (!bench_parse_header(buffer, length, &sync, &serial, &success))
+    {
+        /* Rest of the response, or output that is not a response. */
+        return g_bench.swallow;
+    }
+
+    g_bench.swallow = (serial >= AT_CMD_REF_APP_BENCH_SERIAL_BASE) &&
+                      (serial < AT_CMD_REF_APP_BENCH_SERIAL_BASE + AT_CMD_REF_APP_BENCH_SERIAL_RANGE);
+    if (g_bench.swallow && !sync && (serial == atomic_load(&g_bench.data_serial)))
+    {
+        atomic_store(&g_bench.data_ready, true);
+    }
+    if (!g_bench.swallow || !sync)
+    {
+        return g_bench.swallow;
+    }
+
+    irq = cyhal_system_critical_section_enter();
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING; i++)
+    {
+        if (g_bench.slots[i].busy && (g_bench.slots[i].serial == serial))
+        {
+            latency = now - g_bench.slots[i].start;
+            g_bench.slots[i].busy = false;
+            g_bench.outstanding--;
+            g_bench.step.commands++;
+            g_bench.step.errors += success ? 0 : 1;
+            g_bench.step_max = latency > g_bench.step_max ? latency : g_bench.step_max;
+            g_bench.step_histogram[bench_bucket(latency)]++;
+
+            /* Recovered once a command succeeds as fast as before the faults. */
+            if (g_bench.recovering && success && (latency <= g_bench.recovery_limit))
+            {
+                g_bench.step.recovery = (int32_t)((now - g_bench.recovery_start) / 1000);
+                g_bench.recovering = false;
+            }
+            break;
+        }
+    }
+    cyhal_system_critical_section_exit(irq);
+
+    if (i < AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING)
+    {
+        bench_sample_heap();
+        cy_rtos_set_semaphore(&g_bench.done, false);
+    }
+
+    return true;
+}
+
+/*
+ * Give up on commands not answered within AT_CMD_REF_APP_BENCH_TIMEOUT_MS.
+ */
+static void bench_expire(void)
+{
+    uint32_t now = at_cmd_refapp_trace_clock();
+    uint32_t irq;
+    uint32_t i;
+
+    irq = cyhal_system_critical_section_enter();
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING; i++)
+    {
+        if (g_bench.slots[i].busy && (now - g_bench.slots[i].start > AT_CMD_REF_APP_BENCH_TIMEOUT_MS * 1000))
+        {
+            g_bench.slots[i].busy = false;
+            g_bench.outstanding--;
+            g_bench.step.timeouts++;
+        }
+    }
+    cyhal_system_critical_section_exit(irq);
+}
+
+/*
+ * Track how many messages wait in the client_task queue.
+ */
+static void bench_sample_depth(void)
+{
+    uint32_t depth = at_cmd_refapp_sys_queue_depth();
+
+    g_bench.step.max_depth = depth > g_bench.step.max_depth ? depth : g_bench.step.max_depth;
+}
+
+/*
+ * Queue an MQTT subscription message the way the MQTT event callback does,
+ * the serial is in the benchmark range so the async response is swallowed.
+ */
+static void bench_send_event(const at_cmd_ref_app_bench_step_t *step)
+{
+    at_cmd_ref_app_mqtt_publish_t *publish;
+    uint32_t i;
+
+    publish = calloc(1, sizeof(at_cmd_ref_app_mqtt_publish_t));
+    if (publish == NULL)
+    {
+        g_bench.step.event_drops++;
+        return;
+    }
+    publish->base.cmd_id = CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT;
+    publish->base.serial = AT_CMD_REF_APP_BENCH_SERIAL_BASE + g_bench.next_serial;
+    g_bench.next_serial = (g_bench.next_serial + 1) % AT_CMD_REF_APP_BENCH_SERIAL_RANGE;
+    publish->brokerid = 1;
+    publish->topic = malloc(sizeof("bench"));
+    publish->msg = malloc(step->fill + 1);
+    if ((publish->topic == NULL) || (publish->msg == NULL))
+    {
+        free(publish->topic);
+        free(publish->msg);
+        free(publish);
+        g_bench.step.event_drops++;
+        return;
+    }
+    memcpy(publish->topic, "bench", sizeof("bench"));
+    for (i = 0; i < step->fill; i++)
+    {
+        publish->msg[i] = 'a' + (i % 26);
+    }
+    publish->msg[step->fill] = '\0';
+
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)publish) != CY_RSLT_SUCCESS)
+    {
+        free(publish->topic);
+        free(publish->msg);
+        free(publish);
+        g_bench.step.event_drops++;
+        return;
+    }
+    g_bench.step.events++;
+    bench_sample_depth();
+}
+
+/*
+ * Send the background events due by now at the event-rate of the step.
+ */
+static void bench_pump_events(const at_cmd_ref_app_bench_step_t *step)
+{
+    cy_time_t now;
+    uint32_t due;
+
+    if (step->event_rate == 0)
+    {
+        return;
+    }
+    cy_rtos_get_time(&now);
+    due = (uint32_t)(((uint64_t)(now - g_bench.step_start) * step->event_rate) / 1000);
+    while (g_bench.events_sent < due)
+    {
+        bench_send_event(step);
+        g_bench.events_sent++;
+    }
+}
+
+/*
+ * Wait until fewer than limit commands are in flight, sending background
+ * events meanwhile.
+ */
+static void bench_wait(const at_cmd_ref_app_bench_step_t *step, uint32_t limit)
+{
+    const uint32_t poll = step->event_rate ? BENCH_EVENT_POLL_MS : BENCH_POLL_MS;
+
+    while (g_bench.outstanding >= limit)
+    {
+        bench_sample_depth();
+        bench_pump_events(step);
+        if (cy_rtos_get_semaphore(&g_bench.done, poll, false) != CY_RSLT_SUCCESS)
+        {
+            bench_expire();
+        }
+    }
+}
+
+/*
+ * Wait until the given time, sending background events meanwhile.
+ */
+static void bench_sleep_until(const at_cmd_ref_app_bench_step_t *step, cy_time_t due)
+{
+    cy_time_t now;
+    uint32_t delay;
+
+    for (;;)
+    {
+        bench_pump_events(step);
+        cy_rtos_get_time(&now);
+        if ((int32_t)(due - now) <= 0)
+        {
+            break;
+        }
+        delay = due - now;
+        if (step->event_rate && (delay > BENCH_EVENT_POLL_MS))
+        {
+            delay = BENCH_EVENT_POLL_MS;
+        }
+        cy_rtos_delay_milliseconds(delay);
+    }
+}
+
+/*
+ * Build "AT+0000<serial>;<cmd>,<args>;" with "$n" replaced by the iteration
+ * and "$f" by fill characters. Returns the length, 0 if the line is too long.
+ */
+static uint32_t bench_build_line(const at_cmd_ref_app_bench_step_t *step, uint32_t serial, uint32_t iteration)
+{
+    char *line = g_bench.line;
+    const uint32_t size = sizeof(g_bench.line) - 1;
+    const char *arg;
+    uint32_t len;
+    uint32_t i;
+    int n;
+
+    n = snprintf(line, size, "AT+0000%lu;%s", (unsigned long)serial, step->cmd);
+    if ((n < 0) || ((uint32_t)n >= size))
+    {
+        return 0;
+    }
+    len = (uint32_t)n;
+
+    if (step->args != NULL)
+    {
+        line[len++] = ',';
+        for (arg = step->args; (*arg != '\0') && (len < size); arg++)
+        {
+            if ((arg[0] == '$') && (arg[1] == 'n'))
+            {
+                n = snprintf(&line[len], size - len, "%lu", (unsigned long)iteration);
+                len += (n > 0) ? (uint32_t)n : 0;
+                arg++;
+            }
+            else if ((arg[0] == '$') && (arg[1] == 'f'))
+            {
+                for (i = 0; (i < step->fill) && (len < size); i++)
+                {
+                    line[len++] = 'a' + (i % 26);
+                }
+                arg++;
+            }
+            else
+            {
+                line[len++] = *arg;
+            }
+        }
+    }
+
+    if (len >= size)
+    {
+        return 0;
+    }
+    line[len++] = ';';
+    line[len] = '\0';
+
+    return len;
+}
+
+/*
+ * Send one command, the slot is claimed before the line is queued so a fast
+ * response finds it.
+ */
+static void bench_send(const at_cmd_ref_app_bench_step_t *step, uint32_t iteration)
+{
+    uint32_t serial;
+    uint32_t len;
+    uint32_t irq;
+    uint32_t i;
+
+    serial = AT_CMD_REF_APP_BENCH_SERIAL_BASE + g_bench.next_serial;
+    g_bench.next_serial = (g_bench.next_serial + 1) % AT_CMD_REF_APP_BENCH_SERIAL_RANGE;
+
+    len = bench_build_line(step, serial, iteration);
+    if (len == 0)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench: %s line too long\n", step->cmd));
+        g_bench.step.errors++;
+        return;
+    }
+
+    irq = cyhal_system_critical_section_enter();
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING; i++)
+    {
+        if (!g_bench.slots[i].busy)
+        {
+            g_bench.slots[i].busy = true;
+            g_bench.slots[i].serial = serial;
+            g_bench.slots[i].start = at_cmd_refapp_trace_clock();
+            g_bench.outstanding++;
+            break;
+        }
+    }
+    cyhal_system_critical_section_exit(irq);
+
+    atomic_store(&g_bench.data_ready, false);
+    atomic_store(&g_bench.data_serial, serial);
+    bench_inject(g_bench.line, len);
+
+    /* Raw data follows the "ready" message, as a host would send it. */
+    if (step->data != NULL)
+    {
+        for (i = 0; !atomic_load(&g_bench.data_ready) && (i < AT_CMD_REF_APP_BENCH_TIMEOUT_MS); i++)
+        {
+            cy_rtos_delay_milliseconds(1);
+        }
+        if (atomic_load(&g_bench.data_ready))
+        {
+            bench_inject((const char *)step->data, step->data_len);
+        }
+    }
+    bench_sample_heap();
+}
+
+/*
+ * Reset the counters of a step and arm its faults. After a step with faults
+ * the recovery clock runs until a command is answered within the baseline
+ * p99 latency.
+ */
+static void bench_step_begin(const at_cmd_ref_app_bench_step_t *step, bool after_faults, uint32_t baseline)
+{
+    uint32_t irq;
+    uint32_t i;
+
+    irq = cyhal_system_critical_section_enter();
+    memset(&g_bench.step, 0, sizeof(g_bench.step));
+    memset(g_bench.step_histogram, 0, sizeof(g_bench.step_histogram));
+    g_bench.step_max = 0;
+    g_bench.step.recovery = -1;
+    g_bench.step.after_faults = after_faults;
+    g_bench.recovering = after_faults;
+    g_bench.recovery_start = at_cmd_refapp_trace_clock();
+    g_bench.recovery_limit = baseline;
+    cyhal_system_critical_section_exit(irq);
+
+    g_bench.events_sent = 0;
+    g_bench.drops_start = at_cmd_refapp_sys_stats_drops();
+    atomic_store(&g_bench.faults_injected, 0);
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_NUM_FAULTS; i++)
+    {
+        atomic_store(&g_bench.fault_counts[i], 0);
+        g_bench.faults[i] = step->faults[i];
+    }
+    cy_rtos_get_time(&g_bench.step_start);
+}
+
+/*
+ * Disarm the faults of a step, store its result and add it to the totals.
+ */
+static void bench_step_end(at_cmd_ref_app_bench_step_result_t *result)
+{
+    uint32_t irq;
+    uint32_t i;
+
+    memset(g_bench.faults, 0, sizeof(g_bench.faults));
+
+    irq = cyhal_system_critical_section_enter();
+    *result = g_bench.step;
+    g_bench.recovering = false;
+    cyhal_system_critical_section_exit(irq);
+
+    result->p50 = bench_percentile(g_bench.step_histogram, g_bench.step_max, 500);
+    result->p99 = bench_percentile(g_bench.step_histogram, g_bench.step_max, 990);
+    result->drops = at_cmd_refapp_sys_stats_drops() - g_bench.drops_start;
+    result->faults = atomic_load(&g_bench.faults_injected);
+
+    g_bench.commands += result->commands;
+    g_bench.errors += result->errors;
+    g_bench.timeouts += result->timeouts;
+    g_bench.max = g_bench.step_max > g_bench.max ? g_bench.step_max : g_bench.max;
+    for (i = 0; i < AT_CMD_REF_APP_BENCH_BUCKETS; i++)
+    {
+        g_bench.histogram[i] += g_bench.step_histogram[i];
+    }
+}
+
+/*
+ * Send the events of an event step and wait until client_task took them.
+ */
+static void bench_run_events(const at_cmd_ref_app_bench_step_t *step)
+{
+    uint32_t waited = 0;
+    uint32_t i;
+
+    for (i = 0; i < step->count; i++)
+    {
+        if (step->rate)
+        {
+            bench_sleep_until(step, g_bench.step_start + (cy_time_t)(((uint64_t)i * 1000) / step->rate));
+        }
+        bench_send_event(step);
+    }
+
+    while ((at_cmd_refapp_sys_queue_depth() > 0) && (waited < AT_CMD_REF_APP_BENCH_TIMEOUT_MS))
+    {
+        cy_rtos_delay_milliseconds(BENCH_EVENT_POLL_MS);
+        waited += BENCH_EVENT_POLL_MS;
+    }
+}
+
+/*
+ * Send the commands of a step. A step with a rate sends open loop with up to
+ * AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING commands in flight, a step without
+ * rate waits for each response.
+ */
+static void bench_run_commands(const at_cmd_ref_app_bench_step_t *step)
+{
+    const uint32_t limit = step->rate ? AT_CMD_REF_APP_BENCH_MAX_OUTSTANDING : 1;
+    uint32_t i;
+
+    for (i = 0; i < step->count; i++)
+    {
+        if (step->rate)
+        {
+            bench_sleep_until(step, g_bench.step_start + (cy_time_t)(((uint64_t)i * 1000) / step->rate));
+        }
+        bench_wait(step, limit);
+        bench_send(step, i);
+        bench_sample_depth();
+    }
+
+    /* Drain the step before the next one. */
+    bench_wait(step, 1);
+}
+
+/*
+ * Run the steps of a script. The first command step without faults sets the
+ * baseline latency the recovery after faults is measured against.
+ */
+static void bench_run(at_cmd_ref_app_sys_bench_t *bench, at_cmd_ref_app_sys_bench_result_t *result)
+{
+    at_cmd_ref_app_bench_step_t *step;
+    at_cmd_ref_app_bench_step_result_t *step_result;
+    uint32_t baseline = UINT32_MAX;
+    bool has_baseline = false;
+    bool after_faults = false;
+    uint32_t s;
+
+    for (s = 0; s < bench->num_steps; s++)
+    {
+        step = &bench->steps[s];
+        step_result = &result->steps[s];
+
+        bench_step_begin(step, after_faults, baseline);
+        if (step->event == AT_CMD_REF_APP_BENCH_EVENT_MQTT_MESSAGE)
+        {
+            bench_run_events(step);
+        }
+        else
+        {
+            bench_run_commands(step);
+        }
+        bench_step_end(step_result);
+        result->num_steps++;
+
+        if (!has_baseline && !after_faults && (step_result->faults == 0) && (step_result->commands > 0))
+        {
+            baseline = step_result->p99;
+            has_baseline = true;
+        }
+        after_faults = (step_result->faults > 0);
+
+        if (step->delay)
+        {
+            cy_rtos_delay_milliseconds(step->delay);
+        }
+    }
+}
+
+/*
+ * Run a SYS_Bench script and post the result to client_task.
+ */
+static void bench_script(at_cmd_ref_app_sys_bench_t *bench)
+{
+    at_cmd_ref_app_sys_bench_result_t *result;
+    cy_time_t start;
+    cy_time_t end;
+    uint32_t irq;
+
+    /* Allocated up front so a malloc fault cannot lose the result. */
+    result = calloc(1, sizeof(at_cmd_ref_app_sys_bench_result_t));
+    if (result == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench: out of memory for the result\n"));
+        at_cmd_refapp_bench_free_steps((at_cmd_msg_base_t *)bench);
+        return;
+    }
+
+    irq = cyhal_system_critical_section_enter();
+    memset(g_bench.slots, 0, sizeof(g_bench.slots));
+    memset(g_bench.histogram, 0, sizeof(g_bench.histogram));
+    g_bench.outstanding = 0;
+    g_bench.commands = 0;
+    g_bench.errors = 0;
+    g_bench.timeouts = 0;
+    g_bench.max = 0;
+    cyhal_system_critical_section_exit(irq);
+    g_bench.heap_peak = at_cmd_refapp_sys_heap_used();
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+    atomic_store(&g_bench_allocs, 0);
+    atomic_store(&g_bench_alloc_bytes, 0);
+#endif
+
+    AT_CMD_REFAPP_LOG_MSG(("bench: %s started\n", bench->name));
+    cy_rtos_get_time(&start);
+    atomic_store(&g_bench.active, true);
+    bench_run(bench, result);
+    atomic_store(&g_bench.active, false);
+    cy_rtos_get_time(&end);
+
+    result->base.cmd_id = CMD_ID_HOST_SYS_BENCH_RESULT;
+    result->base.serial = bench->base.serial;
+    memcpy(result->name, bench->name, sizeof(result->name));
+    result->commands = g_bench.commands;
+    result->errors = g_bench.errors;
+    result->timeouts = g_bench.timeouts;
+    result->duration = end - start;
+    result->p50 = bench_percentile(g_bench.histogram, g_bench.max, 500);
+    result->p99 = bench_percentile(g_bench.histogram, g_bench.max, 990);
+    result->p999 = bench_percentile(g_bench.histogram, g_bench.max, 999);
+    result->max = g_bench.max;
+    result->heap_peak = g_bench.heap_peak;
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+    result->allocs = atomic_load(&g_bench_allocs);
+    result->alloc_bytes = atomic_load(&g_bench_alloc_bytes);
+#endif
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)result) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench: error sending the result\n"));
+        free(result);
+    }
+
+    AT_CMD_REFAPP_LOG_MSG(("bench: %s done, %lu commands\n", bench->name, g_bench.commands));
+    at_cmd_refapp_bench_free_steps((at_cmd_msg_base_t *)bench);
+}
+
+/*
+ * JSON text of a 4 KB class certificate chain, newlines escaped.
+ */
+static char *micro_append(char *pos, const char *text)
+{
+    size_t len = strlen(text);
+
+    memcpy(pos, text, len);
+    return pos + len;
+}
+
+static char *micro_append_pem(char *pos, uint32_t size)
+{
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t i;
+
+    pos = micro_append(pos, "-----BEGIN CERTIFICATE-----\\n");
+    for (i = 0; i < size; i++)
+    {
+        *pos++ = base64[(i * 7 + i / 64) % 64];
+        if (i % 64 == 63)
+        {
+            pos = micro_append(pos, "\\n");
+        }
+    }
+    return micro_append(pos, "\\n-----END CERTIFICATE-----\\n");
+}
+
+/*
+ * Message text of size characters.
+ */
+static char *micro_message(uint32_t size)
+{
+    char *text = malloc(size + 1);
+    uint32_t i;
+
+    if (text != NULL)
+    {
+        for (i = 0; i < size; i++)
+        {
+            text[i] = 'a' + (i % 26);
+        }
+        text[size] = '\0';
+    }
+    return text;
+}
+
+static bool micro_setup_wcm_connect(void)
+{
+    g_micro.cmd_id = CMD_ID_AP_CONNECT;
+    g_micro.text = strdup("{\"ssid\":\"MY_SSID\",\"password\":\"MY_KEY123\",\"security-type\":\"wpa2-aes\"}");
+    return g_micro.text != NULL;
+}
+
+static bool micro_setup_scan_filter(void)
+{
+    g_micro.cmd_id = CMD_ID_SCAN_START;
+    g_micro.text = strdup("{\"ssid\":\"Bobo\",\"macaddr\":\"f4:0e:83:bf:8f:54\",\"min-rssi\":-70,\"band\":2,\"channels\":[1,6,11]}");
+    return g_micro.text != NULL;
+}
+
+static bool micro_setup_define_broker(void)
+{
+    g_micro.cmd_id = CMD_ID_MQTT_DEFINE_BROKER;
+    g_micro.text = strdup("{\"brokerid\":1,\"host\":\"test.mosquitto.org\",\"port\":1883,\"tls\":false,"
+                          "\"clientid\":\"h1cp-test-client\",\"cleansession\":true,\"username\":\"user\","
+                          "\"password\":\"secret\",\"lastwilltopic\":\"1\",\"lastwillqos\":0,\"lastwillmsg\":\"1\","
+                          "\"lastwillretain\":false,\"keepalive\":60,\"publishqos\":1,\"publishretain\":true,"
+                          "\"publishretrylimit\":1,\"subscribeqos\":2}");
+    return g_micro.text != NULL;
+}
+
+static bool micro_setup_define_broker_pem(void)
+{
+    const uint32_t pem_bytes = AT_CMD_REF_APP_BENCH_PEM_SIZE * 2;
+    char *pos;
+
+    g_micro.cmd_id = CMD_ID_MQTT_DEFINE_BROKER;
+    g_micro.text = malloc(pem_bytes + pem_bytes / 32 + 512);
+    if (g_micro.text == NULL)
+    {
+        return false;
+    }
+
+    /* A root CA chain of AT_CMD_REF_APP_BENCH_PEM_SIZE and a client certificate and key of half that. */
+    pos = micro_append(g_micro.text, "{\"brokerid\":1,\"host\":\"broker.example.com\",\"port\":8883,\"tls\":true,\"rootca\":\"");
+    pos = micro_append_pem(pos, AT_CMD_REF_APP_BENCH_PEM_SIZE);
+    pos = micro_append(pos, "\",\"clientcert\":\"");
+    pos = micro_append_pem(pos, AT_CMD_REF_APP_BENCH_PEM_SIZE / 2);
+    pos = micro_append(pos, "\",\"clientkey\":\"");
+    pos = micro_append_pem(pos, AT_CMD_REF_APP_BENCH_PEM_SIZE / 2);
+    pos = micro_append(pos, "\",\"clientid\":\"h1cp-test-client\",\"cleansession\":true,\"keepalive\":60}");
+    *pos = '\0';
+
+    return true;
+}
+
+static bool micro_setup_publish(void)
+{
+    char *message = micro_message(AT_CMD_REF_APP_BENCH_MESSAGE_SIZE);
+
+    g_micro.cmd_id = CMD_ID_MQTT_PUBLISH;
+    if (message != NULL)
+    {
+        g_micro.text = malloc(AT_CMD_REF_APP_BENCH_MESSAGE_SIZE + 128);
+        if (g_micro.text != NULL)
+        {
+            sprintf(g_micro.text, "{\"brokerid\":1,\"topic\":\"subscription_topic_name\",\"qos\":\"1\",\"message\":\"%s\"}", message);
+        }
+        free(message);
+    }
+    return g_micro.text != NULL;
+}
+
+static bool micro_setup_ap_info(void)
+{
+    at_cmd_ref_app_host_ap_info_result_t *ap_info;
+
+    ap_info = calloc(1, sizeof(at_cmd_ref_app_host_ap_info_result_t));
+    if (ap_info == NULL)
+    {
+        return false;
+    }
+    strcpy(ap_info->ssid, "MY_SSID");
+    ap_info->ssid_length = strlen(ap_info->ssid);
+    ap_info->security_type = CY_WCM_SECURITY_WPA2_AES_PSK;
+    memcpy(ap_info->bssid, "\xf4\x0e\x83\xbf\x8f\x54", CY_WCM_MAC_ADDR_LEN);
+    ap_info->channel_width = 20;
+    ap_info->signal_strength = -52;
+    ap_info->channel = 6;
+
+    g_micro.cmd_id = CMD_ID_AP_GET_INFO;
+    g_micro.msg = (at_cmd_msg_base_t *)ap_info;
+    return true;
+}
+
+static bool micro_setup_get_broker(void)
+{
+    at_cmd_ref_app_mqtt_broker_info_t *broker;
+
+    broker = calloc(1, sizeof(at_cmd_ref_app_mqtt_broker_info_t));
+    if (broker == NULL)
+    {
+        return false;
+    }
+    broker->hostname = "test.mosquitto.org";
+    broker->port = 1883;
+    broker->clientid = "h1cp-test-client";
+    broker->cleansession = true;
+    broker->lastwilltopic = "status";
+    broker->lastwillmessage = "offline";
+    broker->keepalive = 60;
+    broker->publishqos = 1;
+    broker->publishretrylimit = 1;
+    broker->subscribeqos = 2;
+
+    g_micro.cmd_id = CMD_ID_MQTT_GET_BROKER;
+    g_micro.msg = (at_cmd_msg_base_t *)broker;
+    return true;
+}
+
+static bool micro_setup_subscription(void)
+{
+    at_cmd_ref_app_mqtt_publish_t *publish;
+
+    g_micro.text = micro_message(AT_CMD_REF_APP_BENCH_MESSAGE_SIZE);
+    publish = calloc(1, sizeof(at_cmd_ref_app_mqtt_publish_t));
+    if ((g_micro.text == NULL) || (publish == NULL))
+    {
+        free(publish);
+        return false;
+    }
+    publish->brokerid = 1;
+    publish->topic = "subscription_topic_name";
+    publish->qos = 1;
+    publish->msg = g_micro.text;
+
+    g_micro.cmd_id = CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT;
+    g_micro.msg = (at_cmd_msg_base_t *)publish;
+    return true;
+}
+
+static bool micro_run_parse_wcm(void)
+{
+    at_cmd_msg_base_t *msg;
+
+    msg = at_cmd_refapp_parse_wcm_cmd(g_micro.cmd_id, 1, strlen(g_micro.text), g_micro.text);
+    at_cmd_refapp_msg_free(msg);
+    return msg != NULL;
+}
+
+static bool micro_run_parse_mqtt(void)
+{
+    at_cmd_msg_base_t *msg;
+    at_cmd_ref_app_mqtt_publish_t *publish;
+
+    msg = at_cmd_refapp_parse_mqtt_cmd(g_micro.cmd_id, 1, strlen(g_micro.text), g_micro.text);
+    if ((msg != NULL) && (g_micro.cmd_id == CMD_ID_MQTT_PUBLISH))
+    {
+        publish = (at_cmd_ref_app_mqtt_publish_t *)msg;
+        free(publish->topic);
+        free(publish->msg);
+    }
+    free(msg);
+    return msg != NULL;
+}
+
+static bool micro_run_serialize_wcm(void)
+{
+    return at_cmd_refapp_process_wcm_host_msg(g_micro.cmd_id, g_micro.msg, g_micro.buffer, sizeof(g_micro.buffer)) == CY_RSLT_SUCCESS;
+}
+
+static bool micro_run_serialize_mqtt(void)
+{
+    return at_cmd_refapp_process_mqtt_host_msg(g_micro.cmd_id, g_micro.msg, g_micro.buffer, sizeof(g_micro.buffer)) == CY_RSLT_SUCCESS;
+}
+
+/*
+ * Time one case, the corpus is built before and freed after the timed loop.
+ */
+static void micro_case(const bench_case_t *bench_case, uint32_t count, at_cmd_ref_app_bench_case_result_t *result)
+{
+    uint32_t start;
+    uint32_t end;
+    uint32_t i;
+
+    memset(result, 0, sizeof(*result));
+    result->name = bench_case->name;
+    g_micro.text = NULL;
+    g_micro.msg = NULL;
+
+    if (!bench_case->setup())
+    {
+        result->failed = true;
+    }
+    else
+    {
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+        atomic_store(&g_bench_allocs, 0);
+        atomic_store(&g_bench_alloc_bytes, 0);
+#endif
+        start = at_cmd_refapp_trace_clock();
+        for (i = 0; (i < count) && !result->failed; i++)
+        {
+            result->failed = !bench_case->run();
+        }
+        end = at_cmd_refapp_trace_clock();
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+        result->allocs = atomic_load(&g_bench_allocs);
+        result->alloc_bytes = atomic_load(&g_bench_alloc_bytes);
+#endif
+        result->ns_per_op = (uint32_t)(((uint64_t)(end - start) * 1000) / count);
+    }
+
+    free(g_micro.text);
+    free(g_micro.msg);
+}
+
+/*
+ * Run the SYS_MicroBench cases and post the result to client_task.
+ */
+static void bench_micro(at_cmd_ref_app_sys_microbench_t *micro)
+{
+    at_cmd_ref_app_sys_microbench_result_t *result;
+    uint32_t i;
+
+    result = calloc(1, sizeof(at_cmd_ref_app_sys_microbench_result_t));
+    if (result == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench: error allocating the result\n"));
+        return;
+    }
+    result->base.cmd_id = CMD_ID_HOST_SYS_MICROBENCH_RESULT;
+    result->base.serial = micro->base.serial;
+    result->count = micro->count;
+#ifdef AT_CMD_REF_APP_BENCH_WRAP_MALLOC
+    result->alloc_counts = true;
+#endif
+
+    for (i = 0; i < sizeof(g_micro_cases) / sizeof(g_micro_cases[0]); i++)
+    {
+        if ((micro->name[0] == '\0') || (strcmp(micro->name, g_micro_cases[i].name) == 0))
+        {
+            micro_case(&g_micro_cases[i], micro->count, &result->cases[result->num_cases++]);
+        }
+    }
+
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)result) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("bench: error sending the result\n"));
+        free(result);
+    }
+}
+
+/*
+ * Benchmark thread: runs queued benchmarks one at a time.
+ */
+static void bench_thread(cy_thread_arg_t arg)
+{
+    at_cmd_msg_base_t *msg;
+
+    while (true)
+    {
+        if (cy_rtos_queue_get(&g_bench.queue, &msg, CY_RTOS_NEVER_TIMEOUT) != CY_RSLT_SUCCESS)
+        {
+            continue;
+        }
+
+        if (msg->cmd_id == CMD_ID_SYS_BENCH)
+        {
+            bench_script((at_cmd_ref_app_sys_bench_t *)msg);
+        }
+        else
+        {
+            bench_micro((at_cmd_ref_app_sys_microbench_t *)msg);
+        }
+        free(msg);
+        atomic_store(&g_bench.running, false);
+    }
+}
+
+/**
+ * Free the step arguments of a SYS_Bench message
+ */
+void at_cmd_refapp_bench_free_steps(at_cmd_msg_base_t *msg)
+{
+    at_cmd_ref_app_sys_bench_t *bench = (at_cmd_ref_app_sys_bench_t *)msg;
+    uint32_t i;
+
+    if (msg->cmd_id != CMD_ID_SYS_BENCH)
+    {
+        return;
+    }
+    for (i = 0; i < bench->num_steps; i++)
+    {
+        free(bench->steps[i].args);
+        bench->steps[i].args = NULL;
+        free(bench->steps[i].data);
+        bench->steps[i].data = NULL;
+    }
+}
+
+/**
+ * Hand a SYS_Bench script or SYS_MicroBench run to the benchmark thread
+ */
+cy_rslt_t at_cmd_refapp_bench_start(at_cmd_msg_base_t *msg)
+{
+    at_cmd_msg_base_t *bench;
+    size_t size;
+    bool running = false;
+
+    size = msg->cmd_id == CMD_ID_SYS_BENCH ? sizeof(at_cmd_ref_app_sys_bench_t) : sizeof(at_cmd_ref_app_sys_microbench_t);
+
+    if (!atomic_compare_exchange_strong(&g_bench.running, &running, true))
+    {
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    bench = malloc(size);
+    if (bench == NULL)
+    {
+        atomic_store(&g_bench.running, false);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    memcpy(bench, msg, size);
+
+    if (cy_rtos_put_queue(&g_bench.queue, &bench, 0, false) != CY_RSLT_SUCCESS)
+    {
+        free(bench);
+        atomic_store(&g_bench.running, false);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    /* The steps now belong to the benchmark thread. */
+    if (msg->cmd_id == CMD_ID_SYS_BENCH)
+    {
+        ((at_cmd_ref_app_sys_bench_t *)msg)->num_steps = 0;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Read an optional number from a step.
+ */
+static uint32_t bench_get_number(cJSON *json, const char *name)
+{
+    cJSON *item = cJSON_GetObjectItem(json, name);
+
+    return cJSON_IsNumber(item) && (item->valuedouble > 0) ? (uint32_t)item->valuedouble : 0;
+}
+
+/*
+ * Table of the fault settings of a step.
+ */
+static const char *const g_bench_fault_tokens[AT_CMD_REF_APP_BENCH_NUM_FAULTS] =
+{
+    [AT_CMD_REF_APP_BENCH_FAULT_WRITE_DELAY]     = SYS_TOKEN_WRITE_DELAY,
+    [AT_CMD_REF_APP_BENCH_FAULT_MALLOC]          = SYS_TOKEN_MALLOC_FAIL,
+    [AT_CMD_REF_APP_BENCH_FAULT_MQTT_DISCONNECT] = SYS_TOKEN_DISCONNECT,
+    [AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY]       = SYS_TOKEN_WCM_DELAY,
+};
+
+/*
+ * Decode the hex "data" of a step into raw bytes.
+ */
+static bool bench_get_data(cJSON *json, at_cmd_ref_app_bench_step_t *step)
+{
+    cJSON *value = cJSON_GetObjectItem(json, SYS_TOKEN_DATA);
+    uint32_t len;
+    uint32_t i;
+    char byte[3] = { 0 };
+    char *end;
+
+    if (value == NULL)
+    {
+        return true;
+    }
+    len = cJSON_IsString(value) ? strlen(value->valuestring) : 0;
+    if ((len == 0) || (len & 1) || (len / 2 > AT_CMD_REF_APP_BENCH_INJECT_SIZE))
+    {
+        return false;
+    }
+    step->data = malloc(len / 2);
+    if (step->data == NULL)
+    {
+        return false;
+    }
+    step->data_len = len / 2;
+    for (i = 0; i < step->data_len; i++)
+    {
+        memcpy(byte, &value->valuestring[i * 2], 2);
+        step->data[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parse {"name":"...","steps":[{"cmd":"...","args":...,"count":n,"rate":n,"fill":n,"delay":n,
+ * "event-rate":n,"data":"<hex>","faults":{...}}]}, a step sends {"event":"mqtt-message"}
+ * instead of "cmd"
+ */
+at_cmd_msg_base_t *at_cmd_refapp_bench_parse(uint32_t cmd_len, char *cmd)
+{
+    at_cmd_ref_app_sys_bench_t *bench;
+    at_cmd_ref_app_bench_step_t *step;
+    cJSON *json;
+    cJSON *steps;
+    cJSON *item;
+    cJSON *value;
+    cJSON *faults;
+    bool valid = true;
+    uint32_t i;
+
+    if ((cmd_len == 0) || (cmd == NULL))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("SYS_Bench needs a script\n"));
+        return NULL;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS_Bench script\n"));
+        return NULL;
+    }
+
+    bench = calloc(1, sizeof(at_cmd_ref_app_sys_bench_t));
+    if (bench == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error allocating SYS bench message\n"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+
+    value = cJSON_GetObjectItem(json, SYS_TOKEN_NAME);
+    if (cJSON_IsString(value))
+    {
+        strncpy(bench->name, value->valuestring, sizeof(bench->name) - 1);
+    }
+
+    steps = cJSON_GetObjectItem(json, SYS_TOKEN_STEPS);
+    if (!cJSON_IsArray(steps) || (cJSON_GetArraySize(steps) == 0) ||
+        (cJSON_GetArraySize(steps) > AT_CMD_REF_APP_BENCH_MAX_STEPS))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("SYS_Bench needs 1 to %d steps\n", AT_CMD_REF_APP_BENCH_MAX_STEPS));
+        valid = false;
+    }
+
+    for (item = valid ? steps->child : NULL; item != NULL; item = item->next)
+    {
+        step = &bench->steps[bench->num_steps++];
+
+        value = cJSON_GetObjectItem(item, SYS_TOKEN_EVENT);
+        if (value != NULL)
+        {
+            if (!cJSON_IsString(value) || (strcmp(value->valuestring, SYS_TOKEN_MQTT_MESSAGE) != 0))
+            {
+                AT_CMD_REFAPP_LOG_ERR(("SYS_Bench unknown event\n"));
+                valid = false;
+                break;
+            }
+            step->event = AT_CMD_REF_APP_BENCH_EVENT_MQTT_MESSAGE;
+        }
+        else
+        {
+            value = cJSON_GetObjectItem(item, SYS_TOKEN_CMD);
+            if (!cJSON_IsString(value) || (strlen(value->valuestring) >= sizeof(step->cmd)))
+            {
+                AT_CMD_REFAPP_LOG_ERR(("SYS_Bench step without command or event\n"));
+                valid = false;
+                break;
+            }
+            strcpy(step->cmd, value->valuestring);
+        }
+
+        /* Arguments are given as text or as the JSON object itself. */
+        value = cJSON_GetObjectItem(item, SYS_TOKEN_ARGS);
+        if (cJSON_IsString(value))
+        {
+            step->args = strdup(value->valuestring);
+        }
+        else if (value != NULL)
+        {
+            step->args = cJSON_PrintUnformatted(value);
+        }
+        if ((value != NULL) && (step->args == NULL))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS_Bench arguments\n"));
+            valid = false;
+            break;
+        }
+
+        step->count = cJSON_GetObjectItem(item, SYS_TOKEN_COUNT) ? bench_get_number(item, SYS_TOKEN_COUNT) : 1;
+        step->rate = bench_get_number(item, SYS_TOKEN_RATE);
+        step->fill = bench_get_number(item, SYS_TOKEN_FILL);
+        step->delay = bench_get_number(item, SYS_TOKEN_DELAY);
+        step->event_rate = bench_get_number(item, SYS_TOKEN_EVENT_RATE);
+
+        faults = cJSON_GetObjectItem(item, SYS_TOKEN_FAULTS);
+        for (i = 0; (faults != NULL) && (i < AT_CMD_REF_APP_BENCH_NUM_FAULTS); i++)
+        {
+            step->faults[i] = bench_get_number(faults, g_bench_fault_tokens[i]);
+        }
+
+        if (step->fill > AT_CMD_REF_APP_BENCH_MAX_FILL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("SYS_Bench fill above %d\n", AT_CMD_REF_APP_BENCH_MAX_FILL));
+            valid = false;
+            break;
+        }
+
+        /* Raw data is sent after each command, which must wait for its response. */
+        if (!bench_get_data(item, step) || ((step->data != NULL) && (step->rate != 0)))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("SYS_Bench data must be hex, at most %d bytes, without rate\n",
+                                   AT_CMD_REF_APP_BENCH_INJECT_SIZE));
+            valid = false;
+            break;
+        }
+    }
+    cJSON_Delete(json);
+
+    if (!valid)
+    {
+        at_cmd_refapp_bench_free_steps((at_cmd_msg_base_t *)bench);
+        free(bench);
+        return NULL;
+    }
+
+    return (at_cmd_msg_base_t *)bench;
+}
+
+/**
+ * Parse the optional {"count":n,"case":"..."} arguments of SYS_MicroBench
+ */
+at_cmd_msg_base_t *at_cmd_refapp_bench_parse_micro(uint32_t cmd_len, char *cmd)
+{
+    at_cmd_ref_app_sys_microbench_t *micro;
+    cJSON *json;
+    cJSON *value;
+    uint32_t i;
+
+    micro = calloc(1, sizeof(at_cmd_ref_app_sys_microbench_t));
+    if (micro == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error allocating SYS microbench message\n"));
+        return NULL;
+    }
+    micro->count = AT_CMD_REF_APP_BENCH_MICRO_COUNT;
+
+    if ((cmd_len == 0) || (cmd == NULL) || (cmd[0] == '\0'))
+    {
+        return (at_cmd_msg_base_t *)micro;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS_MicroBench arguments\n"));
+        free(micro);
+        return NULL;
+    }
+
+    if (cJSON_GetObjectItem(json, SYS_TOKEN_COUNT) != NULL)
+    {
+        micro->count = bench_get_number(json, SYS_TOKEN_COUNT);
+    }
+
+    value = cJSON_GetObjectItem(json, SYS_TOKEN_CASE);
+    if (cJSON_IsString(value))
+    {
+        for (i = 0; i < sizeof(g_micro_cases) / sizeof(g_micro_cases[0]); i++)
+        {
+            if (strcmp(value->valuestring, g_micro_cases[i].name) == 0)
+            {
+                strcpy(micro->name, g_micro_cases[i].name);
+                break;
+            }
+        }
+        if (micro->name[0] == '\0')
+        {
+            AT_CMD_REFAPP_LOG_ERR(("unknown SYS_MicroBench case %s\n", value->valuestring));
+            micro->count = 0;
+        }
+    }
+    cJSON_Delete(json);
+
+    if (micro->count == 0)
+    {
+        free(micro);
+        return NULL;
+    }
+
+    return (at_cmd_msg_base_t *)micro;
+}
+
+#endif /* AT_CMD_REF_APP_BENCH_ENABLE */
+
+/* [] END OF FILE */
@@ -0,0 +1,439 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+
+/**
+ * @file at_cmd_refapp_json.c
+ * @brief JSON writer for the WCM and MQTT responses. The text is written
+ *        as it is generated, so a response longer than a frame is sent in
+ *        parts of a fixed size instead of being built in one buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_APP
+#include "at_cmd_refapp.h"
+
+/******************************************************
+ *                      Macros
+ ******************************************************/
+
+/*
+ * A part is {"data":"<escaped text>","seq":<n>,"total":<n>}. The trailer is
+ * written when the part is full, room for it is kept while the text is added.
+ */
+#define JSON_PART_HEADER        "{\"data\":\""
+#define JSON_PART_HEADER_LEN    (sizeof(JSON_PART_HEADER) - 1)
+#define JSON_PART_TRAILER_MAX   (40)
+
+/* Longest escape of a text byte in the data string, \u00xx. */
+#define JSON_ESCAPE_MAX         (6)
+
+#if AT_CMD_REF_APP_JSON_PART_SIZE > AT_CMD_REF_APP_BUFFER_SIZE
+#error "AT_CMD_REF_APP_JSON_PART_SIZE has to fit the result buffer"
+#endif
+
+_Static_assert(AT_CMD_REF_APP_JSON_PART_SIZE >= JSON_PART_HEADER_LEN + 2 * JSON_ESCAPE_MAX + JSON_PART_TRAILER_MAX,
+               "a part has to hold the envelope and some text");
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static void json_part_flush(at_cmd_ref_app_json_t *json, bool last);
+static void json_part_put(at_cmd_ref_app_json_t *json, uint8_t c);
+static void json_put(at_cmd_ref_app_json_t *json, const char *text, uint32_t len);
+static void json_put_string(at_cmd_ref_app_json_t *json, const char *text);
+static void json_member(at_cmd_ref_app_json_t *json, const char *key);
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/*
+ * Send the part in the buffer and start the next one. Bytes of a UTF-8
+ * sequence not yet complete are moved to the next part, so every part is
+ * valid UTF-8 on its own. Without a buffer only the parts are counted.
+ */
+static void json_part_flush(at_cmd_ref_app_json_t *json, bool last)
+{
+    uint32_t carry = last ? 0 : json->utf8_have;
+    uint32_t len = json->len - carry;
+    cy_rslt_t result;
+
+    json->parts++;
+    if (json->buffer != NULL)
+    {
+        snprintf(&json->buffer[len], json->size - len, "\",\"seq\":%lu,\"total\":%lu}",
+                 (unsigned long)json->parts, (unsigned long)json->total);
+
+        /* The first part is the response to the command, the others are async messages. */
+        result = at_cmd_refapp_send_frame(json->serial, json->status, json->async || (json->parts > 1), json->buffer);
+        if ((result != CY_RSLT_SUCCESS) && (json->result == CY_RSLT_SUCCESS))
+        {
+            json->result = result;
+        }
+        memmove(&json->buffer[JSON_PART_HEADER_LEN], &json->buffer[len], carry);
+    }
+    json->len = JSON_PART_HEADER_LEN + carry;
+}
+
+/*
+ * Add a byte of the text to the data string of the part.
+ */
+static void json_part_put(at_cmd_ref_app_json_t *json, uint8_t c)
+{
+    uint32_t escape_len = ((c == '"') || (c == '\\')) ? 2 : (c < 0x20 ? JSON_ESCAPE_MAX : 1);
+
+    if (json->len + escape_len + JSON_PART_TRAILER_MAX >= json->size)
+    {
+        json_part_flush(json, false);
+    }
+
+    if (json->buffer != NULL)
+    {
+        if (escape_len == JSON_ESCAPE_MAX)
+        {
+            snprintf(&json->buffer[json->len], JSON_ESCAPE_MAX + 1, "\\u%04x", c);
+        }
+        else if (escape_len == 2)
+        {
+            json->buffer[json->len] = '\\';
+            json->buffer[json->len + 1] = (char)c;
+        }
+        else
+        {
+            json->buffer[json->len] = (char)c;
+        }
+    }
+    json->len += escape_len;
+
+    /* Track the UTF-8 sequence the byte belongs to. */
+    if ((c & 0xc0) == 0x80)
+    {
+        if ((json->utf8_have > 0) && (++json->utf8_have == json->utf8_need))
+        {
+            json->utf8_have = 0;
+        }
+    }
+    else if (c >= 0xc0)
+    {
+        json->utf8_need = c >= 0xf0 ? 4 : (c >= 0xe0 ? 3 : 2);
+        json->utf8_have = 1;
+    }
+    else
+    {
+        json->utf8_have = 0;
+    }
+}
+
+/*
+ * Add JSON text. A text that does not fit the buffer is still counted, the
+ * error is reported by at_cmd_refapp_json_finish.
+ */
+static void json_put(at_cmd_ref_app_json_t *json, const char *text, uint32_t len)
+{
+    uint32_t i;
+
+    json->length += len;
+    if (json->total > 0)
+    {
+        for (i = 0; i < len; i++)
+        {
+            json_part_put(json, (uint8_t)text[i]);
+        }
+    }
+    else if (json->buffer != NULL)
+    {
+        if (json->len + len >= json->size)
+        {
+            json->result = CY_RSLT_AT_CMD_REF_APP_ERR;
+            return;
+        }
+        memcpy(&json->buffer[json->len], text, len);
+        json->len += len;
+    }
+}
+
+/*
+ * Add a string, escaped the way cJSON does.
+ */
+static void json_put_string(at_cmd_ref_app_json_t *json, const char *text)
+{
+    const char *run = text;
+    char escape[JSON_ESCAPE_MAX + 1];
+
+    json_put(json, "\"", 1);
+    for (; *text != '\0'; text++)
+    {
+        if (((uint8_t)*text >= 0x20) && (*text != '"') && (*text != '\\'))
+        {
+            continue;
+        }
+        json_put(json, run, text - run);
+        run = text + 1;
+        switch (*text)
+        {
+        case '"':  json_put(json, "\\\"", 2); break;
+        case '\\': json_put(json, "\\\\", 2); break;
+        case '\b': json_put(json, "\\b", 2);  break;
+        case '\f': json_put(json, "\\f", 2);  break;
+        case '\n': json_put(json, "\\n", 2);  break;
+        case '\r': json_put(json, "\\r", 2);  break;
+        case '\t': json_put(json, "\\t", 2);  break;
+        default:
+            snprintf(escape, sizeof(escape), "\\u%04x", (uint8_t)*text);
+            json_put(json, escape, JSON_ESCAPE_MAX);
+            break;
+        }
+    }
+    json_put(json, run, text - run);
+    json_put(json, "\"", 1);
+}
+
+/*
+ * Start a member of the current object or array, key is NULL in arrays.
+ */
+static void json_member(at_cmd_ref_app_json_t *json, const char *key)
+{
+    char code[2];
+    uint32_t len = 0;
+
+    if (json->depth > 0)
+    {
+        if (json->members & (1u << json->depth))
+        {
+            json_put(json, ",", 1);
+        }
+        json->members |= 1u << json->depth;
+    }
+
+    if (key != NULL)
+    {
+        if (json->compact)
+        {
+            len = at_cmd_refapp_keys_code(key, code);
+        }
+        json_put(json, "\"", 1);
+        if (len > 0)
+        {
+            json_put(json, code, len);
+        }
+        else
+        {
+            json_put(json, key, strlen(key));
+        }
+        json_put(json, "\":", 2);
+    }
+}
+
+/**
+ * Start writing a JSON text to buffer, or only count it if buffer is NULL
+ */
+void at_cmd_refapp_json_init(at_cmd_ref_app_json_t *json, char *buffer, uint32_t size)
+{
+    memset(json, 0, sizeof(*json));
+    json->buffer = buffer;
+    json->size = size;
+    json->compact = at_cmd_refapp_keys_is_compact();
+    json->result = CY_RSLT_SUCCESS;
+}
+
+/**
+ * Start an object, key is NULL for the top level object and in arrays
+ */
+void at_cmd_refapp_json_object_begin(at_cmd_ref_app_json_t *json, const char *key)
+{
+    json_member(json, key);
+    json_put(json, "{", 1);
+    json->depth++;
+    json->members &= ~(1u << json->depth);
+}
+
+/**
+ * End the current object
+ */
+void at_cmd_refapp_json_object_end(at_cmd_ref_app_json_t *json)
+{
+    json->depth--;
+    json_put(json, "}", 1);
+}
+
+/**
+ * Start an array, key is NULL in arrays
+ */
+void at_cmd_refapp_json_array_begin(at_cmd_ref_app_json_t *json, const char *key)
+{
+    json_member(json, key);
+    json_put(json, "[", 1);
+    json->depth++;
+    json->members &= ~(1u << json->depth);
+}
+
+/**
+ * End the current array
+ */
+void at_cmd_refapp_json_array_end(at_cmd_ref_app_json_t *json)
+{
+    json->depth--;
+    json_put(json, "]", 1);
+}
+
+/**
+ * Add a string member, a NULL string is left out like cJSON does
+ */
+void at_cmd_refapp_json_string(at_cmd_ref_app_json_t *json, const char *key, const char *value)
+{
+    if (value == NULL)
+    {
+        return;
+    }
+    json_member(json, key);
+    json_put_string(json, value);
+}
+
+/**
+ * Add a number member, printed like cJSON prints it
+ */
+void at_cmd_refapp_json_number(at_cmd_ref_app_json_t *json, const char *key, double value)
+{
+    char number[26];
+    int len;
+
+    json_member(json, key);
+    if ((value >= INT32_MIN) && (value <= INT32_MAX) && ((double)(int32_t)value == value))
+    {
+        len = snprintf(number, sizeof(number), "%ld", (long)value);
+    }
+    else
+    {
+        len = snprintf(number, sizeof(number), "%1.15g", value);
+    }
+    json_put(json, number, (uint32_t)len);
+}
+
+/**
+ * Add a boolean member
+ */
+void at_cmd_refapp_json_bool(at_cmd_ref_app_json_t *json, const char *key, bool value)
+{
+    json_member(json, key);
+    json_put(json, value ? "true" : "false", value ? 4 : 5);
+}
+
+/**
+ * Complete the JSON text: terminate it in the buffer, or send the last part
+ */
+cy_rslt_t at_cmd_refapp_json_finish(at_cmd_ref_app_json_t *json)
+{
+    if (json->total > 0)
+    {
+        json_part_flush(json, true);
+    }
+    else if (json->buffer != NULL)
+    {
+        json->buffer[json->len] = '\0';
+    }
+    return json->result;
+}
+
+/**
+ * Write the response of cmd_id for msg to buffer. Fails if it is longer than
+ * the buffer, the text is not truncated.
+ */
+cy_rslt_t at_cmd_refapp_json_render(at_cmd_refapp_json_fn_t fn, uint32_t cmd_id, at_cmd_msg_base_t *msg,
+                                    char *buffer, uint32_t size)
+{
+    at_cmd_ref_app_json_t json;
+    cy_rslt_t result;
+
+    at_cmd_refapp_json_init(&json, buffer, size);
+    fn(&json, cmd_id, msg);
+    result = at_cmd_refapp_json_finish(&json);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("response of cmd_id:%lu is %lu bytes, longer than %lu\n",
+                               cmd_id, json.length, size));
+        buffer[0] = '\0';
+    }
+    return result;
+}
+
+/**
+ * Send the response of cmd_id for msg, using buffer for the frames. A response
+ * that fits the buffer is sent as it is. A longer one is counted first, then
+ * written again and sent in parts as the buffer fills, so the memory used does
+ * not depend on the length of the response.
+ */
+cy_rslt_t at_cmd_refapp_json_send(uint32_t serial, uint32_t status, bool async, at_cmd_refapp_json_fn_t fn,
+                                  uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t size)
+{
+    at_cmd_ref_app_json_t json;
+    uint32_t total;
+    bool compact;
+
+    /* Count the text, and the parts it takes when it is split. */
+    at_cmd_refapp_json_init(&json, NULL, size);
+    json.total = 1;
+    json.len = JSON_PART_HEADER_LEN;
+    fn(&json, cmd_id, msg);
+    json_part_flush(&json, true);
+    total = json.parts;
+    compact = json.compact;
+
+    if (json.length < size)
+    {
+        at_cmd_refapp_json_init(&json, buffer, size);
+        json.compact = compact;
+        fn(&json, cmd_id, msg);
+        at_cmd_refapp_json_finish(&json);
+        return at_cmd_refapp_send_frame(serial, status, async, buffer);
+    }
+
+    AT_CMD_REFAPP_LOG_DBG(("response of cmd_id:%lu is %lu bytes, sent in %lu parts\n", cmd_id, json.length, total));
+    at_cmd_refapp_json_init(&json, buffer, size);
+    json.compact = compact;
+    json.total = total;
+    json.serial = serial;
+    json.status = status;
+    json.async = async;
+    json.len = JSON_PART_HEADER_LEN;
+    memcpy(buffer, JSON_PART_HEADER, JSON_PART_HEADER_LEN);
+    fn(&json, cmd_id, msg);
+    return at_cmd_refapp_json_finish(&json);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/**
+ * @file at_cmd_refapp_keys.c
+ * @brief Compact response format: replaces the keys of the JSON responses
+ *        by short keys from the versioned dictionary AT_CMD_REF_APP_KEYS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_SYS
+#include "at_cmd_refapp.h"
+
+/******************************************************
+ *                      Macros
+ ******************************************************/
+
+/*
+ * Slots of the key lookup table, a power of two with room to keep the
+ * probe sequences short.
+ */
+#define KEYS_HASH_SLOTS         (256)
+
+#define KEYS_ENTRY(token)       token,
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static uint32_t keys_hash(const char *key, uint32_t len);
+static int keys_lookup(const char *key, uint32_t len);
+static uint32_t keys_encode(uint32_t index, char *code);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+static const char *const g_keys[] =
+    {
+        AT_CMD_REF_APP_KEYS(KEYS_ENTRY)};
+
+#define KEYS_NUM                (sizeof(g_keys) / sizeof(g_keys[0]))
+
+static const char g_keys_digits[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/* Index + 1 of the key in each slot, 0 for an empty slot. */
+static uint8_t g_keys_slots[KEYS_HASH_SLOTS];
+
+static volatile bool g_keys_compact;
+
+_Static_assert(KEYS_NUM < 255, "the lookup table holds up to 254 keys");
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/*
+ * FNV-1a hash of a key.
+ */
+static uint32_t keys_hash(const char *key, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Index of a key in the dictionary, -1 if it is not in it.
+ */
+static int keys_lookup(const char *key, uint32_t len)
+{
+    uint32_t slot = keys_hash(key, len) & (KEYS_HASH_SLOTS - 1);
+    uint32_t index;
+
+    while (g_keys_slots[slot] != 0)
+    {
+        index = g_keys_slots[slot] - 1;
+        if ((strncmp(g_keys[index], key, len) == 0) && (g_keys[index][len] == '\0'))
+        {
+            return (int)index;
+        }
+        slot = (slot + 1) & (KEYS_HASH_SLOTS - 1);
+    }
+    return -1;
+}
+
+/*
+ * Write the compact key of an index in base 62, returns its length.
+ */
+static uint32_t keys_encode(uint32_t index, char *code)
+{
+    if (index < sizeof(g_keys_digits) - 1)
+    {
+        code[0] = g_keys_digits[index];
+        return 1;
+    }
+    code[0] = g_keys_digits[index / (sizeof(g_keys_digits) - 1)];
+    code[1] = g_keys_digits[index % (sizeof(g_keys_digits) - 1)];
+    return 2;
+}
+
+/**
+ * Build the key lookup table
+ */
+void at_cmd_refapp_keys_init(void)
+{
+    uint32_t slot;
+    uint32_t i;
+
+    memset(g_keys_slots, 0, sizeof(g_keys_slots));
+    for (i = 0; i < KEYS_NUM; i++)
+    {
+        /* Keys shorter than a compact key would make the text grow. */
+        if ((strlen(g_keys[i]) < 3) || (keys_lookup(g_keys[i], strlen(g_keys[i])) >= 0))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("key %s is too short or twice in the dictionary\n", g_keys[i]));
+            continue;
+        }
+        slot = keys_hash(g_keys[i], strlen(g_keys[i])) & (KEYS_HASH_SLOTS - 1);
+        while (g_keys_slots[slot] != 0)
+        {
+            slot = (slot + 1) & (KEYS_HASH_SLOTS - 1);
+        }
+        g_keys_slots[slot] = (uint8_t)(i + 1);
+    }
+}
+
+/**
+ * Select the response format
+ */
+void at_cmd_refapp_keys_set_compact(bool compact)
+{
+    g_keys_compact = compact;
+}
+
+/**
+ * Responses are sent with compact keys
+ */
+bool at_cmd_refapp_keys_is_compact(void)
+{
+    return g_keys_compact;
+}
+
+/**
+ * Key of the dictionary at index
+ */
+const char *at_cmd_refapp_keys_get(uint32_t index)
+{
+    return index < KEYS_NUM ? g_keys[index] : NULL;
+}
+
+/**
+ * Compact key of a dictionary key, returns its length, 0 if the key is not in
+ * the dictionary
+ */
+uint32_t at_cmd_refapp_keys_code(const char *key, char *code)
+{
+    int index = keys_lookup(key, strlen(key));
+
+    return index >= 0 ? keys_encode((uint32_t)index, code) : 0;
+}
+
+/**
+ * Replace the dictionary keys of a JSON text by their compact keys. Compact
+ * keys are at most two characters and the dictionary keys at least three, so
+ * the text only shrinks and is rewritten in place.
+ */
+uint32_t at_cmd_refapp_keys_compact(char *text)
+{
+    uint32_t read = 0;
+    uint32_t write = 0;
+    uint32_t start;
+    uint32_t end;
+    int index;
+
+    while (text[read] != '\0')
+    {
+        if (text[read] != '"')
+        {
+            text[write++] = text[read++];
+            continue;
+        }
+
+        /* Find the end of the string, skipping escaped characters. */
+        start = read + 1;
+        for (end = start; (text[end] != '"') && (text[end] != '\0'); end++)
+        {
+            if ((text[end] == '\\') && (text[end + 1] != '\0'))
+            {
+                end++;
+            }
+        }
+        if (text[end] == '\0')
+        {
+            /* Unterminated string, copy the rest as it is. */
+            memmove(&text[write], &text[read], end - read);
+            write += end - read;
+            break;
+        }
+
+        /* A string followed by ':' is a key. */
+        index = text[end + 1] == ':' ? keys_lookup(&text[start], end - start) : -1;
+        text[write++] = '"';
+        if (index >= 0)
+        {
+            write += keys_encode((uint32_t)index, &text[write]);
+        }
+        else
+        {
+            memmove(&text[write], &text[start], end - start);
+            write += end - start;
+        }
+        text[write++] = '"';
+        read = end + 1;
+    }
+    text[write] = '\0';
+
+    return write;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,467 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/**
+ * @file at_cmd_refapp_log.c
+ * @brief Deferred logging: a lock-free ring of unformatted log messages and
+ *        the low priority thread printing them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_SYS
+#include "at_cmd_refapp.h"
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static void log_drain(cy_thread_arg_t arg);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+#define LOG_RING_MASK     (AT_CMD_REFAPP_LOG_RING_ENTRIES - 1)
+#define LOG_ENTRY_BYTES   (AT_CMD_REFAPP_LOG_ENTRY_WORDS * sizeof(uint32_t))
+#define LOG_SPEC_MAX      (16)
+
+/*
+ * Argument classes of a printf conversion.
+ */
+typedef enum
+{
+    LOG_ARG_NONE = 0,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LONG_LONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_POINTER,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING
+} log_arg_t;
+
+/*
+ * A log message. The arguments are stored in the order of the format string,
+ * strings as NUL terminated text padded to a word.
+ *
+ * The ring is a bounded multi producer, single consumer queue: a producer
+ * claims an entry by advancing head, and publishes it by setting the entry
+ * sequence. seq holds the sequence minus the entry index so that the zero
+ * initialized ring is empty and usable before at_cmd_refapp_log_init.
+ */
+typedef struct
+{
+    atomic_uint seq;
+    const char *fmt;
+    uint16_t    len;
+    uint32_t    data[AT_CMD_REFAPP_LOG_ENTRY_WORDS];
+} log_entry_t;
+
+static struct
+{
+    atomic_uint head;
+    uint32_t    tail;
+    atomic_uint drops;
+    uint32_t    reported_drops;
+    cy_thread_t thread;
+    log_entry_t ring[AT_CMD_REFAPP_LOG_RING_ENTRIES];
+} g_log;
+
+static uint64_t g_log_stack[AT_CMD_REFAPP_LOG_STACK_SIZE / 8];
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/**
+ * Start the log drain thread
+ */
+cy_rslt_t at_cmd_refapp_log_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_thread_create(&g_log.thread, &log_drain, "log_drain", g_log_stack,
+                                   AT_CMD_REFAPP_LOG_STACK_SIZE, AT_CMD_REFAPP_LOG_PRIORITY, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("log drain thread create failed\n");
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * Number of log messages dropped because the ring was full
+ */
+uint32_t at_cmd_refapp_log_get_drops(void)
+{
+    return atomic_load_explicit(&g_log.drops, memory_order_relaxed);
+}
+
+/*
+ * Parse the conversion starting after the '%' at fmt. Returns the length of
+ * the conversion and its argument class.
+ */
+static uint32_t log_parse_spec(const char *fmt, log_arg_t *arg)
+{
+    const char *p = fmt;
+    uint32_t longs = 0;
+    bool size = false;
+
+    while ((*p != '\0') && (strchr("-+ #0123456789.", *p) != NULL))
+    {
+        p++;
+    }
+    while ((*p != '\0') && (strchr("hlzjtL", *p) != NULL))
+    {
+        longs += (*p == 'l') ? 1 : 0;
+        longs += (*p == 'j') ? 2 : 0;
+        size |= (*p == 'z') || (*p == 't');
+        p++;
+    }
+
+    switch (*p)
+    {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        *arg = longs >= 2 ? LOG_ARG_LONG_LONG : (longs == 1 ? LOG_ARG_LONG : (size ? LOG_ARG_SIZE : LOG_ARG_INT));
+        break;
+    case 'c':
+        *arg = LOG_ARG_INT;
+        break;
+    case 'p':
+        *arg = LOG_ARG_POINTER;
+        break;
+    case 's':
+        *arg = LOG_ARG_STRING;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *arg = LOG_ARG_DOUBLE;
+        break;
+    case '\0':
+        *arg = LOG_ARG_NONE;
+        return (uint32_t)(p - fmt);
+    default:
+        *arg = LOG_ARG_NONE;
+        break;
+    }
+    return (uint32_t)(p - fmt) + 1;
+}
+
+/*
+ * Copy the arguments of fmt into data, stops at the first argument that does
+ * not fit. Returns the number of bytes used.
+ */
+static uint16_t log_store_args(uint8_t *data, const char *fmt, va_list ap)
+{
+    uint32_t used = 0;
+    uint32_t size;
+    uint32_t value;
+    uint64_t value64;
+    double real;
+    const char *str;
+    log_arg_t arg;
+
+    while (*fmt != '\0')
+    {
+        if (*fmt++ != '%')
+        {
+            continue;
+        }
+        if (*fmt == '%')
+        {
+            fmt++;
+            continue;
+        }
+        fmt += log_parse_spec(fmt, &arg);
+
+        switch (arg)
+        {
+        case LOG_ARG_INT:
+        case LOG_ARG_LONG:
+        case LOG_ARG_SIZE:
+        case LOG_ARG_POINTER:
+            if (used + sizeof(uint32_t) > LOG_ENTRY_BYTES)
+            {
+                return (uint16_t)used;
+            }
+            if (arg == LOG_ARG_POINTER)
+            {
+                value = (uint32_t)(uintptr_t)va_arg(ap, void *);
+            }
+            else if (arg == LOG_ARG_LONG)
+            {
+                value = (uint32_t)va_arg(ap, unsigned long);
+            }
+            else if (arg == LOG_ARG_SIZE)
+            {
+                value = (uint32_t)va_arg(ap, size_t);
+            }
+            else
+            {
+                value = (uint32_t)va_arg(ap, unsigned int);
+            }
+            memcpy(&data[used], &value, sizeof(value));
+            used += sizeof(value);
+            break;
+
+        case LOG_ARG_LONG_LONG:
+        case LOG_ARG_DOUBLE:
+            if (used + sizeof(uint64_t) > LOG_ENTRY_BYTES)
+            {
+                return (uint16_t)used;
+            }
+            if (arg == LOG_ARG_DOUBLE)
+            {
+                real = va_arg(ap, double);
+                memcpy(&data[used], &real, sizeof(real));
+            }
+            else
+            {
+                value64 = va_arg(ap, unsigned long long);
+                memcpy(&data[used], &value64, sizeof(value64));
+            }
+            used += sizeof(uint64_t);
+            break;
+
+        case LOG_ARG_STRING:
+            if (used + sizeof(uint32_t) > LOG_ENTRY_BYTES)
+            {
+                return (uint16_t)used;
+            }
+            str = va_arg(ap, const char *);
+            str = str != NULL ? str : "(null)";
+            size = strlen(str);
+            size = size > LOG_ENTRY_BYTES - used - 1 ? LOG_ENTRY_BYTES - used - 1 : size;
+            memcpy(&data[used], str, size);
+            data[used + size] = '\0';
+            used += (size + sizeof(uint32_t)) & ~(sizeof(uint32_t) - 1);
+            break;
+
+        default:
+            break;
+        }
+    }
+    return (uint16_t)used;
+}
+
+/**
+ * Add a log message to the ring
+ */
+void at_cmd_refapp_log_write(const char *fmt, ...)
+{
+    log_entry_t *entry;
+    unsigned int pos;
+    int32_t diff;
+    va_list ap;
+
+    pos = atomic_load_explicit(&g_log.head, memory_order_relaxed);
+    for (;;)
+    {
+        entry = &g_log.ring[pos & LOG_RING_MASK];
+        diff = (int32_t)(atomic_load_explicit(&entry->seq, memory_order_acquire) + (pos & LOG_RING_MASK) - pos);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&g_log.head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* The ring is full, the drain thread reports the drop. */
+            atomic_fetch_add_explicit(&g_log.drops, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&g_log.head, memory_order_relaxed);
+        }
+    }
+
+    entry->fmt = fmt;
+    va_start(ap, fmt);
+    entry->len = log_store_args((uint8_t *)entry->data, fmt, ap);
+    va_end(ap);
+
+    atomic_store_explicit(&entry->seq, pos + 1 - (pos & LOG_RING_MASK), memory_order_release);
+}
+
+/*
+ * Print a log message from its format string and stored arguments.
+ */
+static void log_print(const char *fmt, const uint8_t *data, uint32_t len)
+{
+    char spec[LOG_SPEC_MAX];
+    const char *start;
+    uint32_t used = 0;
+    uint32_t size;
+    uint32_t value;
+    uint64_t value64;
+    double real;
+    log_arg_t arg;
+
+    while (*fmt != '\0')
+    {
+        start = fmt;
+        while ((*fmt != '\0') && (*fmt != '%'))
+        {
+            fmt++;
+        }
+        if (fmt != start)
+        {
+            fwrite(start, 1, (size_t)(fmt - start), stdout);
+        }
+        if (*fmt == '\0')
+        {
+            break;
+        }
+        if (fmt[1] == '%')
+        {
+            putchar('%');
+            fmt += 2;
+            continue;
+        }
+
+        start = fmt++;
+        fmt += log_parse_spec(fmt, &arg);
+        size = (uint32_t)(fmt - start);
+        if (size >= sizeof(spec))
+        {
+            break;
+        }
+        memcpy(spec, start, size);
+        spec[size] = '\0';
+
+        size = ((arg == LOG_ARG_LONG_LONG) || (arg == LOG_ARG_DOUBLE)) ? sizeof(uint64_t) : sizeof(uint32_t);
+        if ((arg != LOG_ARG_NONE) && (used + size > len))
+        {
+            /* The arguments did not fit in the entry. */
+            fputs("...\n", stdout);
+            break;
+        }
+
+        switch (arg)
+        {
+        case LOG_ARG_INT:
+            memcpy(&value, &data[used], sizeof(value));
+            printf(spec, (unsigned int)value);
+            break;
+        case LOG_ARG_LONG:
+            memcpy(&value, &data[used], sizeof(value));
+            printf(spec, (unsigned long)value);
+            break;
+        case LOG_ARG_SIZE:
+            memcpy(&value, &data[used], sizeof(value));
+            printf(spec, (size_t)value);
+            break;
+        case LOG_ARG_POINTER:
+            memcpy(&value, &data[used], sizeof(value));
+            printf(spec, (void *)(uintptr_t)value);
+            break;
+        case LOG_ARG_LONG_LONG:
+            memcpy(&value64, &data[used], sizeof(value64));
+            printf(spec, (unsigned long long)value64);
+            break;
+        case LOG_ARG_DOUBLE:
+            memcpy(&real, &data[used], sizeof(real));
+            printf(spec, real);
+            break;
+        case LOG_ARG_STRING:
+            printf(spec, (const char *)&data[used]);
+            size = (strlen((const char *)&data[used]) + sizeof(uint32_t)) & ~(sizeof(uint32_t) - 1);
+            break;
+        default:
+            fputs(spec, stdout);
+            size = 0;
+            break;
+        }
+        used += size;
+    }
+}
+
+/*
+ * Log drain thread: formats and prints the queued log messages.
+ */
+static void log_drain(cy_thread_arg_t arg)
+{
+    log_entry_t entry;
+    log_entry_t *slot;
+    uint32_t drops;
+
+    (void)arg;
+
+    for (;;)
+    {
+        slot = &g_log.ring[g_log.tail & LOG_RING_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) + (g_log.tail & LOG_RING_MASK) != g_log.tail + 1)
+        {
+            drops = atomic_load_explicit(&g_log.drops, memory_order_relaxed);
+            if (drops != g_log.reported_drops)
+            {
+                printf("log: %lu messages dropped\n", (unsigned long)(drops - g_log.reported_drops));
+                g_log.reported_drops = drops;
+            }
+            cy_rtos_delay_milliseconds(AT_CMD_REFAPP_LOG_DRAIN_PERIOD_MS);
+            continue;
+        }
+
+        /* Copy the entry out and free it before the slow output. */
+        entry.fmt = slot->fmt;
+        entry.len = slot->len;
+        memcpy(entry.data, slot->data, entry.len);
+        atomic_store_explicit(&slot->seq, g_log.tail + AT_CMD_REFAPP_LOG_RING_ENTRIES - (g_log.tail & LOG_RING_MASK),
+                              memory_order_release);
+        g_log.tail++;
+
+        log_print(entry.fmt, (const uint8_t *)entry.data, entry.len);
+    }
+}
+
+/* [] END OF FILE */
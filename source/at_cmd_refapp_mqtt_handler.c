@@ -42,6 +42,7 @@
 
 #include "cy_result.h"
 #include "cyabs_rtos.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_MQTT
 #include "at_cmd_refapp.h"
 #include "cy_wcm.h"
 
@@ -49,17 +50,69 @@ static cy_linked_list_t g_mqtt_server_list;
 cy_linked_list_node_t *g_node_found = NULL;
 bool is_mqtt_initialized = false;
 
+/*
+ * Credentials are kept once per unique content in g_mqtt_cred_list. The host
+ * visible credential ids map onto those shared entries, each id and each broker
+ * using a credential holds one reference.
+ */
+static cy_linked_list_t g_mqtt_cred_list;
+static const char g_mqtt_default_clientid[] = AT_CMD_REF_APP_MQTT_CLIENT_ID;
+static struct
+{
+    uint32_t credid;
+    at_cmd_ref_app_mqtt_credential_t *cred;
+} g_mqtt_cred_ids[AT_CMD_REF_APP_MQTT_MAX_CREDENTIALS];
+
+/*
+ * Raw DER credential being assembled by MQTT_UploadCredential. Only one upload
+ * is in progress at a time to bound the memory used.
+ */
+static struct
+{
+    uint32_t credid;
+    uint32_t total;
+    uint32_t received;
+    uint8_t *buffer;
+} g_mqtt_cred_upload;
+
+/*
+ * Lookup key used to find an already stored credential with the same content.
+ */
+typedef struct
+{
+    const char *data;
+    uint32_t length;
+    uint32_t hash;
+    bool der;
+} at_cmd_ref_app_mqtt_cred_key_t;
+
 /*String that describes the MQTT handle that is being created in order to uniquely identify it*/
 #define MQTT_HANDLE_DESCRIPTOR "MQTThandleID"
 
+/*
+ * MQTT client calls served by the MQTT library.
+ */
+static const at_cmd_ref_app_mqtt_client_t g_mqtt_library_client =
+{
+    .create                  = cy_mqtt_create,
+    .register_event_callback = cy_mqtt_register_event_callback,
+    .connect                 = cy_mqtt_connect,
+    .disconnect              = cy_mqtt_disconnect,
+    .destroy                 = cy_mqtt_delete,
+    .publish                 = cy_mqtt_publish,
+    .subscribe               = cy_mqtt_subscribe,
+    .unsubscribe             = cy_mqtt_unsubscribe,
+};
+
 /******************************************************
  *               Static Function Declarations
  ******************************************************/
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd);
 static bool at_cmd_refapp_mqtt_find_item(cy_linked_list_node_t *node_to_compare, void *user_data);
-static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_define_server_t *server_config);
+static cy_rslt_t at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_define_server_t *server_config);
 static cy_rslt_t at_cmd_refapp_mqtt_connect(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server);
 static cy_rslt_t at_cmd_refapp_mqtt_disconnect(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server);
+static void at_cmd_refapp_mqtt_link_down(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server);
 static cy_rslt_t at_cmd_refapp_mqtt_publish(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_publish_t *publish);
 static cy_rslt_t at_cmd_refapp_mqtt_subscribe(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_subscribe_t *subscribe);
 static cy_rslt_t at_cmd_refapp_mqtt_unsubscribe(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_unsubscribe_t *unsubscribe);
@@ -70,9 +123,22 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_unsubscribe(char *cmd_txt, uint32_t
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_subscribe(char *cmd_txt, uint32_t cmd_id);
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_id);
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_server(char *cmd_txt, uint32_t cmd_id);
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_credential(char *cmd_txt, uint32_t cmd_id);
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_cred_id(char *cmd_txt, uint32_t cmd_id);
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_upload_credential(char *cmd_txt, uint32_t cmd_len, uint32_t cmd_id, uint32_t serial);
+#if AT_CMD_REF_APP_BENCH_ENABLE
+static at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_loopback(char *cmd_txt, uint32_t cmd_len, uint32_t cmd_id, uint32_t serial);
+#endif
 static cy_linked_list_node_t *at_cmd_refapp_find_broker_id(uint32_t broker_id);
 static cy_rslt_t at_cmd_refapp_cleanup_broker(at_cmd_ref_app_mqtt_broker_info_t *broker);
 static void at_cmd_refapp_mqtt_set_result_string(char *response_text, at_cmd_result_data_t *result_str);
+static at_cmd_ref_app_mqtt_credential_t *at_cmd_refapp_mqtt_cred_acquire(const char *data, uint32_t length);
+static uint32_t at_cmd_refapp_mqtt_cred_size(at_cmd_ref_app_mqtt_credential_t *cred);
+static void at_cmd_refapp_mqtt_cred_release(at_cmd_ref_app_mqtt_credential_t *cred);
+static at_cmd_ref_app_mqtt_credential_t *at_cmd_refapp_mqtt_cred_find_id(uint32_t credid);
+static cy_rslt_t at_cmd_refapp_mqtt_cred_define(uint32_t credid, at_cmd_ref_app_mqtt_credential_t *cred);
+static cy_rslt_t at_cmd_refapp_mqtt_cred_upload(at_cmd_ref_app_mqtt_upload_credential_t *upload);
+static cy_rslt_t at_cmd_refapp_mqtt_cred_delete(uint32_t credid);
 
 /******************************************************
  *               Function Definitions
@@ -84,8 +150,19 @@ cy_rslt_t at_cmd_refapp_mqtt_init(void)
 
     if (is_mqtt_initialized == false)
     {
+        /*
+         * Credentials outlive broker deletion, so set up their list only once.
+         */
+        cy_linked_list_init(&g_mqtt_cred_list);
+
         /* Initialize the MQTT library. */
         result = cy_mqtt_init();
+#if AT_CMD_REF_APP_BENCH_ENABLE
+        if (result == CY_RSLT_SUCCESS)
+        {
+            result = at_cmd_refapp_mqtt_loopback_init();
+        }
+#endif
         if (result == CY_RSLT_SUCCESS)
         {
             is_mqtt_initialized = true;
@@ -101,7 +178,6 @@ cy_rslt_t at_cmd_refapp_mqtt_init(void)
 void at_cmd_refapp_build_mqtt_json_text_to_host(uint32_t cmd_id, uint32_t serial, at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str)
 {
     at_cmd_msg_base_t *host_resp_msg = NULL;
-    cy_rslt_t result = CY_RSLT_SUCCESS;
 
     switch (cmd_id)
     {
@@ -113,20 +189,20 @@ void at_cmd_refapp_build_mqtt_json_text_to_host(uint32_t cmd_id, uint32_t serial
     case CMD_ID_MQTT_SUBSCRIBE:
     case CMD_ID_MQTT_UNSUBSCRIBE:
     case CMD_ID_MQTT_PUBLISH:
+    case CMD_ID_MQTT_DEFINE_CREDENTIAL:
+    case CMD_ID_MQTT_DELETE_CREDENTIAL:
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    case CMD_ID_MQTT_LOOPBACK:
         host_resp_msg = at_cmd_refapp_mqtt_process_message((at_cmd_msg_base_t *)cmd, result_str);
         if (host_resp_msg != NULL)
         {
-            /* process host message */
-            result = at_cmd_refapp_process_mqtt_host_msg(cmd_id, host_resp_msg, result_str->result_text, sizeof(result_str->result_text));
-            if (result != CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_process_wcm_host_msg failed result:%ld\n", result));
-            }
+            /* The response is written as it is sent. */
+            at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_mqtt_write_json, cmd_id, host_resp_msg, false);
         }
         break;
 
     default:
-        AT_CMD_REFAPP_LOG_MSG(("unknown command received cmd_id:%ld\n", cmd_id));
+        AT_CMD_REFAPP_LOG_ERR(("unknown command received cmd_id:%ld\n", cmd_id));
         break;
     }
 }
@@ -155,7 +231,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(brokerid->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found \n"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found \n"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -164,14 +240,14 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found \n"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found \n"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
         }
         at_cmd_msg = (at_cmd_msg_base_t *)mqtt_broker_info;
         mqtt_broker_info->base.cmd_id = msg->cmd_id;
-        mqtt_broker_info->base.serial = msg->cmd_id;
+        mqtt_broker_info->base.serial = msg->serial;
         break;
     }
 
@@ -185,7 +261,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         mqtt_broker_info = malloc(sizeof(at_cmd_ref_app_mqtt_broker_info_t));
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory-error"));
+            AT_CMD_REFAPP_LOG_ERR(("memory-error"));
             response_text = "memory-error";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -193,14 +269,21 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         memset(mqtt_broker_info, 0, sizeof(at_cmd_ref_app_mqtt_broker_info_t));
         mqtt_broker_info->base.cmd_id = msg->cmd_id;
-        mqtt_broker_info->base.serial = msg->cmd_id;
+        mqtt_broker_info->base.serial = msg->serial;
 
-        at_cmd_refapp_create_mqtt_broker_info(mqtt_broker_info, mqtt_define_server);
+        result = at_cmd_refapp_create_mqtt_broker_info(mqtt_broker_info, mqtt_define_server);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            at_cmd_refapp_cleanup_broker(mqtt_broker_info);
+            response_text = "mqtt broker define failed";
+            at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
+            return NULL;
+        }
         cy_linked_list_set_node_data(&mqtt_broker_info->node, mqtt_broker_info);
         cy_linked_list_insert_node_at_rear(&g_mqtt_server_list, &mqtt_broker_info->node);
 
-        AT_CMD_REFAPP_LOG_MSG(("mqtt_server hostname:%s port:%d clientid:%s username:%s password:%s\n",
-                               mqtt_broker_info->hostname, mqtt_broker_info->port, mqtt_broker_info->clientid, mqtt_broker_info->username, mqtt_broker_info->password));
+        AT_CMD_REFAPP_LOG_MSG(("mqtt_server hostname:%s port:%d clientid:%s\n",
+                               mqtt_broker_info->hostname, mqtt_broker_info->port, mqtt_broker_info->clientid));
         break;
     }
 
@@ -211,7 +294,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(brokerid->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -220,21 +303,25 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
         }
-        AT_CMD_REFAPP_LOG_MSG(("mqtt hostname:%s \n", mqtt_broker_info->hostname));
+        AT_CMD_REFAPP_LOG_DBG(("mqtt hostname:%s \n", mqtt_broker_info->hostname));
         result = at_cmd_refapp_mqtt_connect(mqtt_broker_info);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Connection failed \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Connection failed \n"));
             response_text = "MQTT Connection failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
         }
-        AT_CMD_REFAPP_LOG_MSG(("MQTT Connection successful \n"));
+        AT_CMD_REFAPP_LOG_MSG(("MQTT Connection successful reused:%d time:%ld ms\n",
+                               mqtt_broker_info->reused, mqtt_broker_info->handshake_time));
+        at_cmd_msg = (at_cmd_msg_base_t *)mqtt_broker_info;
+        mqtt_broker_info->base.cmd_id = msg->cmd_id;
+        mqtt_broker_info->base.serial = msg->serial;
         break;
     }
 
@@ -245,7 +332,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(brokerid->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -253,7 +340,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         mqtt_broker_info = (at_cmd_ref_app_mqtt_broker_info_t *)nodeptr->data;
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -261,14 +348,14 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         result = at_cmd_refapp_mqtt_disconnect(mqtt_broker_info);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Disconnect failed \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Disconnect failed \n"));
             response_text = "MQTT Disconnect failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
         }
         AT_CMD_REFAPP_LOG_MSG(("MQTT Disconnect successful \n"));
         mqtt_broker_info->base.cmd_id = msg->cmd_id;
-        mqtt_broker_info->base.serial = msg->cmd_id;
+        mqtt_broker_info->base.serial = msg->serial;
         break;
     }
 
@@ -279,7 +366,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(brokerid->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -287,7 +374,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         mqtt_broker_info = (at_cmd_ref_app_mqtt_broker_info_t *)nodeptr->data;
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -295,7 +382,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -306,7 +393,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         result = at_cmd_refapp_mqtt_disconnect(mqtt_broker_info);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt disconnect failed"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt disconnect failed"));
             response_text = "mqtt disconnect failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
         }
@@ -315,7 +402,6 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
          * Delete the server from the list.
          */
         cy_linked_list_remove_node(&g_mqtt_server_list, g_node_found);
-        at_cmd_refapp_mqtt_init();
 
         /*
          * Free the memory allocated for server
@@ -331,7 +417,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (subscribe == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt subscribe info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt subscribe info not found"));
             response_text = "mqtt subscribe info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -341,7 +427,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(subscribe->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -349,7 +435,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         mqtt_broker_info = (at_cmd_ref_app_mqtt_broker_info_t *)nodeptr->data;
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -357,7 +443,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (subscribe->topic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Subscribe failed, topic NULL \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Subscribe failed, topic NULL \n"));
             response_text = "MQTT Subscribe failed, topic NULL";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -366,7 +452,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         result = at_cmd_refapp_mqtt_subscribe(mqtt_broker_info, subscribe);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Subscribe failed"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Subscribe failed"));
             response_text = "MQTT Subscribe failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -384,7 +470,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         
         if (unsubscribe == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("unsubscribe info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("unsubscribe info not found"));
             response_text = "unsubscribe info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -394,7 +480,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         nodeptr = at_cmd_refapp_find_broker_id(unsubscribe->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -402,7 +488,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         mqtt_broker_info = (at_cmd_ref_app_mqtt_broker_info_t *)nodeptr->data;
         if (mqtt_broker_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+            AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
             response_text = "mqtt broker info not found";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -410,7 +496,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (unsubscribe->topic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT UnSubscribe failed, topic NULL \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT UnSubscribe failed, topic NULL \n"));
             response_text = "MQTT UnSubscribe failed, topic NULL";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -419,7 +505,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         result = at_cmd_refapp_mqtt_unsubscribe(mqtt_broker_info, unsubscribe);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT UnSubscribe failed \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT UnSubscribe failed \n"));
             response_text = "MQTT UnSubscribe failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -464,7 +550,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (publish->topic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Publish failed, topic NULL \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Publish failed, topic NULL \n"));
             response_text = "MQTT Publish failed, topic NULL";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -472,7 +558,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
         if (publish->msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Publish failed, msg NULL \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Publish failed, msg NULL \n"));
             response_text = "MQTT Publish failed, msg NULL";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -481,7 +567,7 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         result = at_cmd_refapp_mqtt_publish(mqtt_broker_info, publish);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("MQTT Publish failed \n"));
+            AT_CMD_REFAPP_LOG_ERR(("MQTT Publish failed \n"));
             response_text = "MQTT Publish failed";
             at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
             return NULL;
@@ -497,9 +583,69 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
         break;
     }
 
+    case CMD_ID_MQTT_DEFINE_CREDENTIAL:
+    {
+        at_cmd_ref_app_mqtt_define_credential_t *define_cred = (at_cmd_ref_app_mqtt_define_credential_t *)msg;
+        at_cmd_ref_app_mqtt_credential_t *cred = NULL;
+
+        result = CY_RSLT_AT_CMD_REF_APP_ERR;
+        cred = at_cmd_refapp_mqtt_cred_acquire(define_cred->data, define_cred->length);
+        if (cred != NULL)
+        {
+            result = at_cmd_refapp_mqtt_cred_define(define_cred->credid, cred);
+        }
+        if (result != CY_RSLT_SUCCESS)
+        {
+            response_text = "mqtt credential define failed";
+            at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
+            return NULL;
+        }
+        AT_CMD_REFAPP_LOG_MSG(("MQTT define credential %ld successful \n", define_cred->credid));
+        break;
+    }
+
+    case CMD_ID_MQTT_DELETE_CREDENTIAL:
+    {
+        at_cmd_ref_app_mqtt_credid_t *credid = (at_cmd_ref_app_mqtt_credid_t *)msg;
+
+        result = at_cmd_refapp_mqtt_cred_delete(credid->credid);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            response_text = "mqtt credential not found";
+            at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
+            return NULL;
+        }
+        AT_CMD_REFAPP_LOG_MSG(("MQTT delete credential %ld successful \n", credid->credid));
+        break;
+    }
+
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    {
+        at_cmd_ref_app_mqtt_upload_credential_t *upload = (at_cmd_ref_app_mqtt_upload_credential_t *)msg;
+
+        result = at_cmd_refapp_mqtt_cred_upload(upload);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            response_text = "mqtt credential upload failed";
+            at_cmd_refapp_mqtt_set_result_string(response_text, result_str);
+            return NULL;
+        }
+        at_cmd_msg = (at_cmd_msg_base_t *)upload;
+        break;
+    }
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    case CMD_ID_MQTT_LOOPBACK:
+    {
+        at_cmd_refapp_mqtt_loopback_config((at_cmd_ref_app_mqtt_loopback_t *)msg);
+        at_cmd_msg = msg;
+        break;
+    }
+#endif
+
     default:
     {
-        AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_mqtt_process_message unknown command id:%ld!! \n", msg->cmd_id));
+        AT_CMD_REFAPP_LOG_ERR(("at_cmd_refapp_mqtt_process_message unknown command id:%ld!! \n", msg->cmd_id));
         break;
     }
 
@@ -510,18 +656,21 @@ at_cmd_msg_base_t *at_cmd_refapp_mqtt_process_message(at_cmd_msg_base_t *msg, at
 
 static void at_cmd_refapp_mqtt_set_result_string(char *response_text, at_cmd_result_data_t *result_str)
 {
-    AT_CMD_REFAPP_LOG_MSG((response_text));
+    AT_CMD_REFAPP_LOG_ERR(("%s\n", response_text));
     strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
     result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
 }
 
 static cy_rslt_t at_cmd_refapp_cleanup_broker(at_cmd_ref_app_mqtt_broker_info_t *broker)
 {
-    if (broker->cert != NULL)
-    {
-        free(broker->cert);
-    }
-    if (broker->clientid != NULL)
+    /*
+     * rootca, cert and key point into shared credentials, drop our references.
+     */
+    at_cmd_refapp_mqtt_cred_release(broker->rootca_cred);
+    at_cmd_refapp_mqtt_cred_release(broker->cert_cred);
+    at_cmd_refapp_mqtt_cred_release(broker->key_cred);
+
+    if ((broker->clientid != NULL) && (broker->clientid != g_mqtt_default_clientid))
     {
         free(broker->clientid);
     }
@@ -529,10 +678,6 @@ static cy_rslt_t at_cmd_refapp_cleanup_broker(at_cmd_ref_app_mqtt_broker_info_t
     {
         free(broker->hostname);
     }
-    if (broker->key != NULL)
-    {
-        free(broker->key);
-    }
     if (broker->lastwillmessage != NULL)
     {
         free(broker->lastwillmessage);
@@ -545,10 +690,6 @@ static cy_rslt_t at_cmd_refapp_cleanup_broker(at_cmd_ref_app_mqtt_broker_info_t
     {
         free(broker->password);
     }
-    if (broker->rootca != NULL)
-    {
-        free(broker->rootca);
-    }
     if (broker->username != NULL)
     {
         free(broker->username);
@@ -573,30 +714,490 @@ static cy_linked_list_node_t *at_cmd_refapp_find_broker_id(uint32_t broker_id)
     result = cy_linked_list_find_node(&g_mqtt_server_list, at_cmd_refapp_mqtt_find_item, (void *)&item, &g_node_found);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_find_broker_id failed count:%ld brokerid:%ld  input broker_id:%ld\n",
+        AT_CMD_REFAPP_LOG_ERR(("at_cmd_refapp_find_broker_id failed count:%ld brokerid:%ld  input broker_id:%ld\n",
                                g_mqtt_server_list.count, item.id, broker_id));
-        AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+        AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
         return NULL;
     }
     return g_node_found;
 }
 
-cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen)
+static bool at_cmd_refapp_mqtt_cred_match(cy_linked_list_node_t *node_to_compare, void *user_data)
 {
-    cy_rslt_t result = CY_RSLT_SUCCESS;
-    cJSON *cjson = NULL;
-    char *json_text = NULL;
-    uint32_t len;
+    at_cmd_ref_app_mqtt_cred_key_t *key = (at_cmd_ref_app_mqtt_cred_key_t *)user_data;
+    at_cmd_ref_app_mqtt_credential_t *cred = (at_cmd_ref_app_mqtt_credential_t *)node_to_compare->data;
+
+    return ((cred->hash == key->hash) && (cred->length == key->length) && (cred->der == key->der) &&
+            (memcmp(cred->data, key->data, key->length) == 0));
+}
+
+/*
+ * Decode one base64 character, returns -1 for characters outside the alphabet.
+ */
+static int at_cmd_refapp_mqtt_b64_value(char c)
+{
+    if ((c >= 'A') && (c <= 'Z'))
+    {
+        return c - 'A';
+    }
+    if ((c >= 'a') && (c <= 'z'))
+    {
+        return c - 'a' + 26;
+    }
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0' + 52;
+    }
+    if (c == '+')
+    {
+        return 62;
+    }
+    if (c == '/')
+    {
+        return 63;
+    }
+    return -1;
+}
+
+/*
+ * Decode the base64 text from src up to end into out, which must hold at least
+ * (end - src) * 3 / 4 bytes. White space is skipped. Returns false if the text
+ * is not well formed base64.
+ */
+static bool at_cmd_refapp_mqtt_b64_decode(const char *src, const char *end, uint8_t *out, uint32_t *out_length)
+{
+    const char *ptr;
+    uint32_t length = 0;
+    uint32_t acc = 0;
+    uint32_t bits = 0;
+    uint32_t chars = 0;
+    uint32_t pad = 0;
+    int value;
+
+    for (ptr = src; ptr < end; ptr++)
+    {
+        if (isspace((unsigned char)*ptr))
+        {
+            continue;
+        }
+        if (*ptr == '=')
+        {
+            pad++;
+            continue;
+        }
+        value = at_cmd_refapp_mqtt_b64_value(*ptr);
+        if ((value < 0) || (pad != 0))
+        {
+            return false;
+        }
+        chars++;
+        acc = (acc << 6) | (uint32_t)value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[length++] = (uint8_t)(acc >> bits);
+        }
+    }
+
+    if ((pad > 2) || (((chars + pad) % 4) != 0))
+    {
+        return false;
+    }
 
+    *out_length = length;
+    return true;
+}
+
+/*
+ * Check that der holds exactly one well formed DER element (tag, length, value).
+ */
+static bool at_cmd_refapp_mqtt_der_valid(const uint8_t *der, uint32_t length)
+{
+    uint32_t header = 2;
+    uint32_t value_length = 0;
+    uint32_t num_bytes;
+    uint32_t i;
+
+    if (length < 2)
+    {
+        return false;
+    }
+
+    if (der[1] < 0x80)
+    {
+        value_length = der[1];
+    }
+    else
+    {
+        num_bytes = der[1] & 0x7F;
+        if ((num_bytes == 0) || (num_bytes > 4) || (length < 2 + num_bytes))
+        {
+            return false;
+        }
+        for (i = 0; i < num_bytes; i++)
+        {
+            value_length = (value_length << 8) | der[2 + i];
+        }
+        header += num_bytes;
+    }
+
+    return (value_length == length - header);
+}
+
+/*
+ * Decode all PEM blocks in pem (NUL terminated) and write their DER back to
+ * back into der, which must hold at least strlen(pem) bytes. Blocks with
+ * headers (e.g. "Proc-Type: 4,ENCRYPTED" of an encrypted key) are left to
+ * the TLS layer and only flagged in headers. Returns the number of blocks or
+ * -1 if the PEM data is malformed.
+ */
+static int at_cmd_refapp_mqtt_pem_to_der(const char *pem, uint8_t *der, uint32_t *der_length, bool *headers)
+{
+    const char *ptr = pem;
+    const char *body;
+    const char *body_end;
+    uint32_t out = 0;
+    uint32_t length;
+    int blocks = 0;
+
+    while ((ptr = strstr(ptr, AT_CMD_REF_APP_PEM_BEGIN)) != NULL)
+    {
+        /*
+         * Skip the "-----BEGIN <label>-----" line.
+         */
+        body = strstr(ptr + strlen(AT_CMD_REF_APP_PEM_BEGIN), AT_CMD_REF_APP_PEM_DASHES);
+        if (body == NULL)
+        {
+            return -1;
+        }
+        body += strlen(AT_CMD_REF_APP_PEM_DASHES);
+
+        body_end = strstr(body, AT_CMD_REF_APP_PEM_END);
+        if (body_end == NULL)
+        {
+            return -1;
+        }
+
+        if (memchr(body, ':', body_end - body) != NULL)
+        {
+            *headers = true;
+            blocks++;
+            ptr = body_end + strlen(AT_CMD_REF_APP_PEM_END);
+            continue;
+        }
+
+        if ((!at_cmd_refapp_mqtt_b64_decode(body, body_end, &der[out], &length)) ||
+            (!at_cmd_refapp_mqtt_der_valid(&der[out], length)))
+        {
+            return -1;
+        }
+
+        out += length;
+        blocks++;
+        ptr = body_end + strlen(AT_CMD_REF_APP_PEM_END);
+    }
+
+    *der_length = out;
+    return (blocks > 0) ? blocks : -1;
+}
+
+/*
+ * Return a shared credential with the given content, creating it if no
+ * identical credential is stored yet. The caller owns one reference.
+ */
+static at_cmd_ref_app_mqtt_credential_t *at_cmd_refapp_mqtt_cred_store(const char *data, uint32_t length, bool der)
+{
+    at_cmd_ref_app_mqtt_credential_t *cred = NULL;
+    at_cmd_ref_app_mqtt_cred_key_t key;
+    cy_linked_list_node_t *nodeptr = NULL;
+    uint32_t i;
+
+    /*
+     * FNV-1a hash to avoid comparing the full data against every stored credential.
+     */
+    key.data = data;
+    key.length = length;
+    key.der = der;
+    key.hash = 2166136261UL;
+    for (i = 0; i < length; i++)
+    {
+        key.hash ^= (uint8_t)data[i];
+        key.hash *= 16777619UL;
+    }
+
+    if (cy_linked_list_find_node(&g_mqtt_cred_list, at_cmd_refapp_mqtt_cred_match, (void *)&key, &nodeptr) == CY_RSLT_SUCCESS)
+    {
+        cred = (at_cmd_ref_app_mqtt_credential_t *)nodeptr->data;
+        cred->refcount++;
+        return cred;
+    }
+
+    cred = malloc(sizeof(at_cmd_ref_app_mqtt_credential_t) + length + 1);
+    if (cred == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+        return NULL;
+    }
+    memset(cred, 0, sizeof(at_cmd_ref_app_mqtt_credential_t));
+    memcpy(cred->data, data, length);
+    cred->data[length] = '\0';
+    cred->length = length;
+    cred->der = der;
+    cred->hash = key.hash;
+    cred->refcount = 1;
+
+    cy_linked_list_set_node_data(&cred->node, cred);
+    cy_linked_list_insert_node_at_rear(&g_mqtt_cred_list, &cred->node);
+    return cred;
+}
+
+/*
+ * Validate PEM credential data and store it, as DER if caching is enabled.
+ * PEM with headers is stored unchanged.
+ */
+static at_cmd_ref_app_mqtt_credential_t *at_cmd_refapp_mqtt_cred_acquire(const char *data, uint32_t length)
+{
+    uint8_t *der = NULL;
+    uint32_t der_length = 0;
+    bool headers = false;
+    int blocks;
+
+    der = malloc(length + 1);
+    if (der == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+        return NULL;
+    }
+
+    blocks = at_cmd_refapp_mqtt_pem_to_der(data, der, &der_length, &headers);
+    if (blocks < 0)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("malformed PEM credential\n"));
+        free(der);
+        return NULL;
+    }
+
+#if AT_CMD_REF_APP_MQTT_CRED_CACHE_DER
     /*
-     * Create a JSON object to construct the output data.
+     * Certificate bundles (e.g. several root CAs) are passed on as PEM.
      */
-    cjson = cJSON_CreateObject();
-    if (cjson == NULL)
+    if ((blocks == 1) && !headers)
     {
+        at_cmd_ref_app_mqtt_credential_t *cred;
+
+        cred = at_cmd_refapp_mqtt_cred_store((const char *)der, der_length, true);
+        free(der);
+        return cred;
+    }
+#endif
+
+    free(der);
+    return at_cmd_refapp_mqtt_cred_store(data, length, false);
+}
+
+/*
+ * Size of the credential as passed to the TLS layer, PEM includes the NUL.
+ */
+static uint32_t at_cmd_refapp_mqtt_cred_size(at_cmd_ref_app_mqtt_credential_t *cred)
+{
+    return cred->der ? cred->length : cred->length + 1;
+}
+
+static void at_cmd_refapp_mqtt_cred_release(at_cmd_ref_app_mqtt_credential_t *cred)
+{
+    if (cred == NULL)
+    {
+        return;
+    }
+
+    cred->refcount--;
+    if (cred->refcount == 0)
+    {
+        cy_linked_list_remove_node(&g_mqtt_cred_list, &cred->node);
+        free(cred);
+    }
+}
+
+static at_cmd_ref_app_mqtt_credential_t *at_cmd_refapp_mqtt_cred_find_id(uint32_t credid)
+{
+    int i;
+
+    for (i = 0; i < AT_CMD_REF_APP_MQTT_MAX_CREDENTIALS; i++)
+    {
+        if ((credid != 0) && (g_mqtt_cred_ids[i].credid == credid))
+        {
+            return g_mqtt_cred_ids[i].cred;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Bind credid to cred, the reference owned by the caller is passed on to the id.
+ */
+static cy_rslt_t at_cmd_refapp_mqtt_cred_define(uint32_t credid, at_cmd_ref_app_mqtt_credential_t *cred)
+{
+    int free_slot = -1;
+    int i;
+
+    if (credid == 0)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("invalid credential id\n"));
+        at_cmd_refapp_mqtt_cred_release(cred);
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
 
+    for (i = 0; i < AT_CMD_REF_APP_MQTT_MAX_CREDENTIALS; i++)
+    {
+        if (g_mqtt_cred_ids[i].credid == credid)
+        {
+            /*
+             * Redefining an id does not affect brokers already holding the old credential.
+             */
+            at_cmd_refapp_mqtt_cred_release(g_mqtt_cred_ids[i].cred);
+            g_mqtt_cred_ids[i].cred = cred;
+            return CY_RSLT_SUCCESS;
+        }
+        if ((g_mqtt_cred_ids[i].credid == 0) && (free_slot < 0))
+        {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot < 0)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("credential table full\n"));
+        at_cmd_refapp_mqtt_cred_release(cred);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    g_mqtt_cred_ids[free_slot].credid = credid;
+    g_mqtt_cred_ids[free_slot].cred = cred;
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Append one chunk of a raw DER credential. Chunks must arrive in order, the
+ * credential is validated and bound to its id once the last chunk is received.
+ * It is kept as DER whether or not AT_CMD_REF_APP_MQTT_CRED_CACHE_DER is set.
+ */
+static cy_rslt_t at_cmd_refapp_mqtt_cred_upload(at_cmd_ref_app_mqtt_upload_credential_t *upload)
+{
+    at_cmd_ref_app_mqtt_credential_t *cred = NULL;
+
+    if (upload->offset == 0)
+    {
+        /*
+         * A new upload replaces any unfinished one.
+         */
+        free(g_mqtt_cred_upload.buffer);
+        memset(&g_mqtt_cred_upload, 0, sizeof(g_mqtt_cred_upload));
+
+        if ((upload->credid == 0) || (upload->total == 0) || (upload->total > AT_CMD_REF_APP_MQTT_MAX_CREDENTIAL_SIZE))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("invalid credential upload credid:%ld total:%ld\n", upload->credid, upload->total));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+
+        g_mqtt_cred_upload.buffer = malloc(upload->total);
+        if (g_mqtt_cred_upload.buffer == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        g_mqtt_cred_upload.credid = upload->credid;
+        g_mqtt_cred_upload.total = upload->total;
+    }
+
+    /*
+     * Out of sequence chunks are rejected but keep the upload, so the host
+     * can resend from the expected offset.
+     */
+    if ((g_mqtt_cred_upload.buffer == NULL) || (upload->credid != g_mqtt_cred_upload.credid) ||
+        (upload->total != g_mqtt_cred_upload.total) || (upload->offset != g_mqtt_cred_upload.received) ||
+        (upload->length > g_mqtt_cred_upload.total - g_mqtt_cred_upload.received))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("credential upload out of sequence offset:%ld expected:%ld\n",
+                               upload->offset, g_mqtt_cred_upload.received));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    memcpy(&g_mqtt_cred_upload.buffer[g_mqtt_cred_upload.received], upload->data, upload->length);
+    g_mqtt_cred_upload.received += upload->length;
+    upload->received = g_mqtt_cred_upload.received;
+
+    if (g_mqtt_cred_upload.received < g_mqtt_cred_upload.total)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (at_cmd_refapp_mqtt_der_valid(g_mqtt_cred_upload.buffer, g_mqtt_cred_upload.total))
+    {
+        cred = at_cmd_refapp_mqtt_cred_store((const char *)g_mqtt_cred_upload.buffer, g_mqtt_cred_upload.total, true);
+    }
+    else
+    {
+        AT_CMD_REFAPP_LOG_ERR(("malformed DER credential\n"));
+    }
+
+    free(g_mqtt_cred_upload.buffer);
+    memset(&g_mqtt_cred_upload, 0, sizeof(g_mqtt_cred_upload));
+
+    if (cred == NULL)
+    {
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    return at_cmd_refapp_mqtt_cred_define(upload->credid, cred);
+}
+
+static cy_rslt_t at_cmd_refapp_mqtt_cred_delete(uint32_t credid)
+{
+    int i;
+
+    for (i = 0; i < AT_CMD_REF_APP_MQTT_MAX_CREDENTIALS; i++)
+    {
+        if ((credid != 0) && (g_mqtt_cred_ids[i].credid == credid))
+        {
+            at_cmd_refapp_mqtt_cred_release(g_mqtt_cred_ids[i].cred);
+            g_mqtt_cred_ids[i].credid = 0;
+            g_mqtt_cred_ids[i].cred = NULL;
+            return CY_RSLT_SUCCESS;
+        }
+    }
+    return CY_RSLT_AT_CMD_REF_APP_ERR;
+}
+
+/*
+ * Attach a credential to a broker, either by id from the credential store or
+ * by sharing the inline PEM supplied with MQTT_DefineBroker.
+ */
+static cy_rslt_t at_cmd_refapp_mqtt_broker_set_cred(uint32_t credid, char *inline_data, at_cmd_ref_app_mqtt_credential_t **cred)
+{
+    if (credid != 0)
+    {
+        *cred = at_cmd_refapp_mqtt_cred_find_id(credid);
+        if (*cred == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("mqtt credential %ld not found\n", credid));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        (*cred)->refcount++;
+    }
+    else if ((inline_data != NULL) && (inline_data[0] != '\0'))
+    {
+        *cred = at_cmd_refapp_mqtt_cred_acquire(inline_data, strlen(inline_data));
+        if (*cred == NULL)
+        {
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+void at_cmd_refapp_mqtt_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg)
+{
+    at_cmd_refapp_json_object_begin(json, NULL);
     switch (cmd_id)
     {
     case CMD_ID_MQTT_GET_BROKER:
@@ -604,50 +1205,50 @@ cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t
         at_cmd_ref_app_mqtt_broker_info_t *server_info;
         server_info = (at_cmd_ref_app_mqtt_broker_info_t *)msg;
 
-        cJSON_AddStringToObject(cjson, MQTT_TOKEN_HOSTNAME, server_info->hostname);
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_PORT, server_info->port);
-        cJSON_AddBoolToObject(cjson, MQTT_TOKEN_TLS, server_info->tls);
+        at_cmd_refapp_json_string(json, MQTT_TOKEN_HOSTNAME, server_info->hostname);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PORT, server_info->port);
+        at_cmd_refapp_json_bool(json, MQTT_TOKEN_TLS, server_info->tls);
 
         if (server_info->clientid)
         {
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_CLIENTID, server_info->clientid);
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_CLIENTID, server_info->clientid);
         }
 
-        cJSON_AddBoolToObject(cjson, MQTT_TOKEN_CLEANSESSION, server_info->cleansession);
+        at_cmd_refapp_json_bool(json, MQTT_TOKEN_CLEANSESSION, server_info->cleansession);
 
         if (server_info->username)
         {
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_USERNAME, server_info->username);
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_USERNAME, server_info->username);
         }
 
         if (server_info->password)
         {
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_PASSWORD, server_info->password);
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_PASSWORD, server_info->password);
         }
 
         if (server_info->lastwilltopic)
         {
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_LASTWILLTOPIC, server_info->lastwilltopic);
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_LASTWILLTOPIC, server_info->lastwilltopic);
         }
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_LASTWILLQOS, server_info->lastwillqos);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_LASTWILLQOS, server_info->lastwillqos);
 
         if (server_info->lastwillmessage)
         {
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_LASTWILLMSG, server_info->lastwillmessage);
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_LASTWILLMSG, server_info->lastwillmessage);
         }
 
-        cJSON_AddBoolToObject(cjson, MQTT_TOKEN_LASTWILLRETAIN, server_info->lastwillretain);
+        at_cmd_refapp_json_bool(json, MQTT_TOKEN_LASTWILLRETAIN, server_info->lastwillretain);
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_KEEPALIVE, server_info->keepalive);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_KEEPALIVE, server_info->keepalive);
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_PUBLISHQOS, server_info->publishqos);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PUBLISHQOS, server_info->publishqos);
 
-        cJSON_AddBoolToObject(cjson, MQTT_TOKEN_PUBLISHRETAIN, server_info->publishretain);
+        at_cmd_refapp_json_bool(json, MQTT_TOKEN_PUBLISHRETAIN, server_info->publishretain);
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_PUBLISHRETRYLIMIT, server_info->publishretrylimit);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PUBLISHRETRYLIMIT, server_info->publishretrylimit);
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_SUBSCRIBERQOS, server_info->subscribeqos);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_SUBSCRIBERQOS, server_info->subscribeqos);
         break;
     }
 
@@ -656,66 +1257,92 @@ cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t
         at_cmd_ref_app_mqtt_publish_t *publish_msg = NULL;
         publish_msg = (at_cmd_ref_app_mqtt_publish_t *)msg;
 
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_BROKERID_TYPE, publish_msg->brokerid);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_BROKERID_TYPE, publish_msg->brokerid);
 
         if (publish_msg->topic != NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG((" publish topic:%s\n", publish_msg->topic));
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_TOPIC, publish_msg->topic);
+            AT_CMD_REFAPP_LOG_DBG((" publish topic:%s\n", publish_msg->topic));
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_TOPIC, publish_msg->topic);
         }
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_QOS, publish_msg->qos);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_QOS, publish_msg->qos);
 
         if (publish_msg->msg != NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG((" publish msg:%s\n", publish_msg->msg));
-            cJSON_AddStringToObject(cjson, MQTT_TOKEN_MSG, publish_msg->msg);
+            AT_CMD_REFAPP_LOG_DBG((" publish msg length:%d\n", (int)strlen(publish_msg->msg)));
+            at_cmd_refapp_json_string(json, MQTT_TOKEN_MSG, publish_msg->msg);
         }
         break;
     }
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    {
+        at_cmd_ref_app_mqtt_upload_credential_t *upload;
+        upload = (at_cmd_ref_app_mqtt_upload_credential_t *)msg;
+
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_CREDID, upload->credid);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_RECEIVED, upload->received);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_TOTAL, upload->total);
+        break;
+    }
+
+    case CMD_ID_MQTT_CONNECT_BROKER:
+    {
+        at_cmd_ref_app_mqtt_broker_info_t *server_info;
+        server_info = (at_cmd_ref_app_mqtt_broker_info_t *)msg;
+
+        at_cmd_refapp_json_bool(json, MQTT_TOKEN_REUSED, server_info->reused);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_HANDSHAKE_TIME, server_info->handshake_time);
+        break;
+    }
+
     case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
     {
         at_cmd_ref_app_mqtt_disconnect_event_t *disconnect_event = NULL;
         disconnect_event = (at_cmd_ref_app_mqtt_disconnect_event_t *)msg;
-        cJSON_AddNumberToObject(cjson, MQTT_TOKEN_DISCONNECT_REASON, disconnect_event->disconnect_reason);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_BROKERID_TYPE, disconnect_event->brokerid);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DISCONNECT_REASON, disconnect_event->disconnect_reason);
         break;
     }
 
-    default:
+    case CMD_ID_MQTT_LOOPBACK:
     {
-        AT_CMD_REFAPP_LOG_MSG((" unknown cmd_id:%ld received\n", cmd_id));
-        break;
-    }
-    }
+        at_cmd_ref_app_mqtt_loopback_t *loopback = (at_cmd_ref_app_mqtt_loopback_t *)msg;
 
-    /*
-     * Do we have a JSON object to output?
-     */
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PUBACK_DELAY, loopback->puback_delay);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PUBACK_LOSS, loopback->puback_loss);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DISCONNECT, loopback->disconnect);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DELIVERY_DELAY, loopback->delivery_delay);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_PUBLISHED, loopback->published);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DELIVERED, loopback->delivered);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DELIVERY_DROPS, loopback->delivery_drops);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_ACKS_LOST, loopback->acks_lost);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_DISCONNECTS, loopback->disconnects);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_RECONNECTS, loopback->reconnects);
 
-    if (cjson != NULL)
-    {
-        /*
-         * Create the output JSON text and copy it to the output buffer.
-         */
+        at_cmd_refapp_json_object_begin(json, MQTT_TOKEN_DELIVERY);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_AVG, loopback->delivery_avg);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_MAX, loopback->delivery_max);
 
-        json_text = cJSON_PrintUnformatted(cjson);
-        cJSON_Delete(cjson);
+        at_cmd_refapp_json_object_end(json);
 
-        if (json_text)
-        {
-            len = strlen(json_text) + 1;
-            len = len > buflen ? buflen - 1 : len;
-            memcpy(buffer, json_text, len);
-            free(json_text);
-        }
-        else
-        {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc json text\n"));
-            result = CY_RSLT_AT_CMD_REF_APP_ERR;
-        }
+        at_cmd_refapp_json_object_begin(json, MQTT_TOKEN_RECONNECT);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_LAST, loopback->reconnect_last);
+        at_cmd_refapp_json_number(json, MQTT_TOKEN_MAX, loopback->reconnect_max);
+        at_cmd_refapp_json_object_end(json);
+        break;
     }
 
-    AT_CMD_REFAPP_LOG_MSG(("exit func:%s \n", __func__));
-    return result;
+    default:
+    {
+        AT_CMD_REFAPP_LOG_ERR((" unknown cmd_id:%ld received\n", cmd_id));
+        break;
+    }
+    }
+    at_cmd_refapp_json_object_end(json);
+}
+
+cy_rslt_t at_cmd_refapp_process_mqtt_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen)
+{
+    return at_cmd_refapp_json_render(at_cmd_refapp_mqtt_write_json, cmd_id, msg, buffer, buflen);
 }
 
 static bool at_cmd_refapp_mqtt_find_item(cy_linked_list_node_t *node_to_compare, void *user_data)
@@ -750,7 +1377,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_broker_id(char *cmd_txt, uint32_t cm
     json = cJSON_Parse(cmd_txt);
     if (!json)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error parsing the CMD_ID_GET_BROKER \n"));
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_GET_BROKER \n"));
         return NULL;
     }
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_BROKERID_TYPE))
@@ -759,18 +1386,17 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_broker_id(char *cmd_txt, uint32_t cm
     }
     else
     {
-        AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+        AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
         return NULL;
     }
     mqtt_broker_id = calloc(1, sizeof(at_cmd_ref_app_mqtt_broker_info_t));
     if (mqtt_broker_id == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error"));
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
         return NULL;
     }
     memset(mqtt_broker_id, 0, sizeof(at_cmd_ref_app_mqtt_brokerid_t));
     mqtt_broker_id->base.cmd_id = cmd_id;
-    mqtt_broker_id->base.serial = cmd_id;
     mqtt_broker_id->brokerid = brokerid;
 
     cJSON_Delete(json);
@@ -788,7 +1414,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_subscribe(char *cmd_txt, uint32_t cm
     json = cJSON_Parse(cmd_txt);
     if (!json)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error parsing the CMD_ID_GET_BROKER \n"));
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_GET_BROKER \n"));
         return NULL;
     }
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_BROKERID_TYPE))
@@ -797,18 +1423,17 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_subscribe(char *cmd_txt, uint32_t cm
     }
     else
     {
-        AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+        AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
         return NULL;
     }
     subscribe = calloc(1, sizeof(at_cmd_ref_app_mqtt_broker_info_t));
     if (subscribe == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error"));
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
         return NULL;
     }
     memset(subscribe, 0, sizeof(at_cmd_ref_app_mqtt_subscribe_t));
     subscribe->base.cmd_id = cmd_id;
-    subscribe->base.serial = cmd_id;
     subscribe->brokerid = brokerid;
 
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_TOPIC))
@@ -818,7 +1443,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_subscribe(char *cmd_txt, uint32_t cm
         if (subscribe->topic == NULL)
         {
             free(subscribe);
-            AT_CMD_REFAPP_LOG_MSG(("memory error"));
+            AT_CMD_REFAPP_LOG_ERR(("memory error"));
             return NULL;
         }
         strcpy(subscribe->topic, cJSON_GetObjectItem(json, MQTT_TOKEN_TOPIC)->valuestring);
@@ -842,13 +1467,14 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_server(char *cmd_txt, uint32_
     json = cJSON_Parse(cmd_txt);
     if (!json)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error parsing the CMD_ID_DEFINE_BROKER \n"));
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_DEFINE_BROKER \n"));
         return NULL;
     }
 
     if ((!cJSON_HasObjectItem(json, MQTT_TOKEN_BROKERID_TYPE)) || (!cJSON_HasObjectItem(json, MQTT_TOKEN_HOSTNAME)))
     {
-        AT_CMD_REFAPP_LOG_MSG(("BrokerID or hostname  parameter not set\n"));
+        AT_CMD_REFAPP_LOG_ERR(("BrokerID or hostname  parameter not set\n"));
+        cJSON_Delete(json);
         return NULL;
     }
 
@@ -888,7 +1514,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_server(char *cmd_txt, uint32_
 
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_LASTWILLTOPIC))
     {
-        count += (strlen(cJSON_GetObjectItem(json, MQTT_TOKEN_PASSWORD)->valuestring) + 1);
+        count += (strlen(cJSON_GetObjectItem(json, MQTT_TOKEN_LASTWILLTOPIC)->valuestring) + 1);
     }
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_LASTWILLMSG))
     {
@@ -898,7 +1524,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_server(char *cmd_txt, uint32_
     server_config = calloc(1, sizeof(at_cmd_ref_app_mqtt_define_server_t) + count);
     if (server_config == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error"));
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
         cJSON_Delete(json);
         return NULL;
     }
@@ -908,21 +1534,166 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_server(char *cmd_txt, uint32_
     server_config->base.serial = CMD_ID_MQTT_DEFINE_BROKER;
 
     result = at_cmd_refapp_mqtt_server_config(server_config, json);
+    cJSON_Delete(json);
     if (result != CY_RSLT_SUCCESS)
     {
         free(server_config);
-        AT_CMD_REFAPP_LOG_MSG(("error MQTT define server setup\n"));
+        AT_CMD_REFAPP_LOG_ERR(("error MQTT define server setup\n"));
         return NULL;
     }
 
-    if ((server_config->username != NULL) && (server_config->clientid != NULL) && (server_config->password != NULL))
+    if (server_config->clientid != NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("clientid %s username %s password %s\n",
-                               server_config->clientid, server_config->username, server_config->password));
+        AT_CMD_REFAPP_LOG_DBG(("clientid %s\n", server_config->clientid));
     }
     return (at_cmd_msg_base_t *)server_config;
 }
 
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_define_credential(char *cmd_txt, uint32_t cmd_id)
+{
+    at_cmd_ref_app_mqtt_define_credential_t *define_cred = NULL;
+    cJSON *json;
+    cJSON *data;
+    uint32_t length = 0;
+
+    json = cJSON_Parse(cmd_txt);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_MQTT_DEFINE_CREDENTIAL \n"));
+        return NULL;
+    }
+
+    data = cJSON_GetObjectItem(json, MQTT_TOKEN_CREDDATA);
+    if ((!cJSON_HasObjectItem(json, MQTT_TOKEN_CREDID)) || (data == NULL) || (!cJSON_IsString(data)))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("credid or data parameter not set\n"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+
+    length = strlen(data->valuestring);
+    define_cred = calloc(1, sizeof(at_cmd_ref_app_mqtt_define_credential_t) + length + 1);
+    if (define_cred == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+    define_cred->base.cmd_id = cmd_id;
+    define_cred->credid = cJSON_GetObjectItem(json, MQTT_TOKEN_CREDID)->valueint;
+    define_cred->length = length;
+    memcpy(define_cred->data, data->valuestring, length + 1);
+
+    cJSON_Delete(json);
+    return (at_cmd_msg_base_t *)define_cred;
+}
+
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_cred_id(char *cmd_txt, uint32_t cmd_id)
+{
+    at_cmd_ref_app_mqtt_credid_t *credid = NULL;
+    cJSON *json;
+
+    json = cJSON_Parse(cmd_txt);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_MQTT_DELETE_CREDENTIAL \n"));
+        return NULL;
+    }
+    if (!cJSON_HasObjectItem(json, MQTT_TOKEN_CREDID))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("mqtt credential id not found"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+    credid = calloc(1, sizeof(at_cmd_ref_app_mqtt_credid_t));
+    if (credid == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+    credid->base.cmd_id = cmd_id;
+    credid->credid = cJSON_GetObjectItem(json, MQTT_TOKEN_CREDID)->valueint;
+
+    cJSON_Delete(json);
+    return (at_cmd_msg_base_t *)credid;
+}
+
+/*
+ * MQTT_UploadCredential arguments are "<credid>,<offset>,<total>,<length>".
+ * The chunk does not go through the AT parser, which ends a command at ';':
+ * the host waits for the "ready" message and then sends <length> raw DER
+ * bytes, read here straight from the transport. Offset and total count DER
+ * bytes.
+ */
+at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_upload_credential(char *cmd_txt, uint32_t cmd_len, uint32_t cmd_id, uint32_t serial)
+{
+    at_cmd_ref_app_mqtt_upload_credential_t *upload = NULL;
+    char header[AT_CMD_REF_APP_MQTT_UPLOAD_HEADER_MAX];
+    char ready[AT_CMD_REF_APP_MQTT_UPLOAD_HEADER_MAX * 2];
+    uint32_t values[4];
+    uint32_t received;
+    char *ptr;
+    int i;
+
+    if ((cmd_len == 0) || (cmd_len >= sizeof(header)))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_MQTT_UPLOAD_CREDENTIAL \n"));
+        return NULL;
+    }
+    memcpy(header, cmd_txt, cmd_len);
+    header[cmd_len] = '\0';
+
+    ptr = header;
+    for (i = 0; i < 4; i++)
+    {
+        if (!isdigit((unsigned char)*ptr))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_MQTT_UPLOAD_CREDENTIAL \n"));
+            return NULL;
+        }
+        values[i] = strtoul(ptr, &ptr, 10);
+        if (*ptr != ((i < 3) ? ',' : '\0'))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_MQTT_UPLOAD_CREDENTIAL \n"));
+            return NULL;
+        }
+        ptr++;
+    }
+
+    if ((values[3] == 0) || (values[3] > AT_CMD_REF_APP_MQTT_MAX_CREDENTIAL_SIZE))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("invalid credential chunk length:%ld\n", values[3]));
+        return NULL;
+    }
+
+    upload = calloc(1, sizeof(at_cmd_ref_app_mqtt_upload_credential_t) + values[3]);
+    if (upload == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
+        return NULL;
+    }
+    upload->base.cmd_id = cmd_id;
+    upload->credid = values[0];
+    upload->offset = values[1];
+    upload->total = values[2];
+    upload->length = values[3];
+
+    snprintf(ready, sizeof(ready), "{\"" MQTT_TOKEN_CREDID "\":%lu,\"" MQTT_TOKEN_READY "\":%lu}",
+             (unsigned long)upload->credid, (unsigned long)upload->length);
+    at_cmd_refapp_send_async_response(serial, ready);
+
+    received = at_cmd_refapp_transport_read_data(upload->data, upload->length, AT_CMD_REF_APP_MQTT_UPLOAD_TIMEOUT_MS);
+    if (received != upload->length)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("credential chunk timed out after %lu of %lu bytes\n", received, upload->length));
+        free(upload);
+        return NULL;
+    }
+
+    return (at_cmd_msg_base_t *)upload;
+}
+
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_unsubscribe(char *cmd_txt, uint32_t cmd_id)
 {
     at_cmd_ref_app_mqtt_unsubscribe_t *unsubscribe = NULL;
@@ -933,7 +1704,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_unsubscribe(char *cmd_txt, uint32_t
     json = cJSON_Parse(cmd_txt);
     if (!json)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error parsing the CMD_ID_GET_BROKER \n"));
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_GET_BROKER \n"));
         return NULL;
     }
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_BROKERID_TYPE))
@@ -942,18 +1713,17 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_unsubscribe(char *cmd_txt, uint32_t
     }
     else
     {
-        AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+        AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
         return NULL;
     }
     unsubscribe = calloc(1, sizeof(at_cmd_ref_app_mqtt_unsubscribe_t));
     if (unsubscribe == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error"));
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
         return NULL;
     }
     memset(unsubscribe, 0, sizeof(at_cmd_ref_app_mqtt_unsubscribe_t));
     unsubscribe->base.cmd_id = cmd_id;
-    unsubscribe->base.serial = cmd_id;
     unsubscribe->brokerid = brokerid;
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_TOPIC))
     {
@@ -962,7 +1732,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_unsubscribe(char *cmd_txt, uint32_t
         if (unsubscribe->topic == NULL)
         {
             free(unsubscribe);
-            AT_CMD_REFAPP_LOG_MSG(("memory error"));
+            AT_CMD_REFAPP_LOG_ERR(("memory error"));
             return NULL;
         }
         strcpy(unsubscribe->topic, cJSON_GetObjectItem(json, MQTT_TOKEN_TOPIC)->valuestring);
@@ -982,7 +1752,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_
     json = cJSON_Parse(cmd_txt);
     if (!json)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error parsing the CMD_ID_GET_BROKER \n"));
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the CMD_ID_GET_BROKER \n"));
         return NULL;
     }
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_BROKERID_TYPE))
@@ -991,18 +1761,17 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_
     }
     else
     {
-        AT_CMD_REFAPP_LOG_MSG(("mqtt broker info not found"));
+        AT_CMD_REFAPP_LOG_ERR(("mqtt broker info not found"));
         return NULL;
     }
     publish = calloc(1, sizeof(at_cmd_ref_app_mqtt_publish_t));
     if (publish == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error"));
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
         return NULL;
     }
     memset(publish, 0, sizeof(at_cmd_ref_app_mqtt_publish_t));
     publish->base.cmd_id = cmd_id;
-    publish->base.serial = cmd_id;
     publish->brokerid = brokerid;
     if (cJSON_HasObjectItem(json, MQTT_TOKEN_TOPIC))
     {
@@ -1010,7 +1779,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_
         publish->topic = malloc(publish_topiclen);
         if (publish->topic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory-error"));
+            AT_CMD_REFAPP_LOG_ERR(("memory-error"));
             free(publish);
             return NULL;
         }
@@ -1026,7 +1795,7 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_
         publish->msg = malloc(publish_msglen);
         if (publish->msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory-error"));
+            AT_CMD_REFAPP_LOG_ERR(("memory-error"));
             free(publish);
             return NULL;
         }
@@ -1037,6 +1806,57 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_publish(char *cmd_txt, uint32_t cmd_
     return (at_cmd_msg_base_t *)publish;
 }
 
+#if AT_CMD_REF_APP_BENCH_ENABLE
+static uint32_t at_cmd_refapp_mqtt_loopback_setting(cJSON *json, const char *name)
+{
+    cJSON *item = cJSON_GetObjectItem(json, name);
+
+    return cJSON_IsNumber(item) && (item->valuedouble > 0) ? (uint32_t)item->valuedouble : 0;
+}
+
+/*
+ * MQTT_Loopback without arguments reports the loopback broker statistics,
+ * with arguments it also applies the settings given, missing ones are 0.
+ */
+static at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_loopback(char *cmd_txt, uint32_t cmd_len, uint32_t cmd_id, uint32_t serial)
+{
+    at_cmd_ref_app_mqtt_loopback_t *loopback = NULL;
+    cJSON *json = NULL;
+
+    if ((cmd_len > 0) && (cmd_txt != NULL))
+    {
+        json = cJSON_Parse(cmd_txt);
+        if (!json)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error parsing the MQTT_Loopback settings\n"));
+            return NULL;
+        }
+    }
+
+    loopback = calloc(1, sizeof(at_cmd_ref_app_mqtt_loopback_t));
+    if (loopback == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("memory error"));
+        cJSON_Delete(json);
+        return NULL;
+    }
+    loopback->base.cmd_id = cmd_id;
+    loopback->base.serial = serial;
+
+    if (json != NULL)
+    {
+        loopback->configure = true;
+        loopback->puback_delay = at_cmd_refapp_mqtt_loopback_setting(json, MQTT_TOKEN_PUBACK_DELAY);
+        loopback->puback_loss = at_cmd_refapp_mqtt_loopback_setting(json, MQTT_TOKEN_PUBACK_LOSS);
+        loopback->disconnect = at_cmd_refapp_mqtt_loopback_setting(json, MQTT_TOKEN_DISCONNECT);
+        loopback->delivery_delay = at_cmd_refapp_mqtt_loopback_setting(json, MQTT_TOKEN_DELIVERY_DELAY);
+        cJSON_Delete(json);
+    }
+
+    return (at_cmd_msg_base_t *)loopback;
+}
+#endif
+
 at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd)
 {
     at_cmd_msg_base_t *msg = NULL;
@@ -1074,12 +1894,44 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_mqtt_cmd(uint32_t cmd_id, uint32_t serial
         msg = at_cmd_refapp_parse_mqtt_unsubscribe(cmd_txt, cmd_id);
         break;
     }
+
+    case CMD_ID_MQTT_DEFINE_CREDENTIAL:
+    {
+        msg = at_cmd_refapp_parse_mqtt_define_credential(cmd_txt, cmd_id);
+        break;
+    }
+
+    case CMD_ID_MQTT_DELETE_CREDENTIAL:
+    {
+        msg = at_cmd_refapp_parse_mqtt_cred_id(cmd_txt, cmd_id);
+        break;
+    }
+
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    {
+        msg = at_cmd_refapp_parse_mqtt_upload_credential(cmd_txt, cmd_len, cmd_id, serial);
+        break;
+    }
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    case CMD_ID_MQTT_LOOPBACK:
+    {
+        msg = at_cmd_refapp_parse_mqtt_loopback(cmd_txt, cmd_len, cmd_id, serial);
+        break;
+    }
+#endif
     default:
     {
-        AT_CMD_REFAPP_LOG_MSG(("unknown cmd_id:%ld\n", cmd_id));
+        AT_CMD_REFAPP_LOG_ERR(("unknown cmd_id:%ld\n", cmd_id));
         break;
     }
     }
+
+    /* Responses complete out of order, they are matched by the serial. */
+    if (msg != NULL)
+    {
+        msg->serial = serial;
+    }
     return msg;
 }
 
@@ -1091,6 +1943,8 @@ static cy_rslt_t at_cmd_refapp_mqtt_connect(at_cmd_ref_app_mqtt_broker_info_t *m
     cy_mqtt_connect_info_t connect_info;
     cy_mqtt_broker_info_t broker_info;
     cy_mqtt_publish_info_t will_info;
+    cy_time_t start_time = 0;
+    cy_time_t end_time = 0;
 
     if (!mqtt_server->connected)
     {
@@ -1099,78 +1953,91 @@ static cy_rslt_t at_cmd_refapp_mqtt_connect(at_cmd_ref_app_mqtt_broker_info_t *m
         memset(&broker_info, 0x00, sizeof(cy_mqtt_broker_info_t));
         memset(&will_info, 0x00, sizeof(cy_mqtt_publish_info_t));
 
-        if (mqtt_server->tls)
+        /*
+         * A handle kept from an unexpected disconnect already holds the broker
+         * and TLS credential configuration, so reconnect on it instead of
+         * creating and configuring a new MQTT instance. The TLS session is
+         * not resumed, cy_mqtt and secure sockets take no session ticket or
+         * ID, so the full TLS handshake runs on every connect.
+         */
+        mqtt_server->reused = (mqtt_server->mqtt_handle != NULL);
+        if (!mqtt_server->reused)
         {
-            /*
-             * Set credential information.
-             */
-            credentials.client_cert = mqtt_server->cert;
-            if (credentials.client_cert)
+            if (mqtt_server->tls)
             {
-                credentials.client_cert_size = strlen(credentials.client_cert) + 1;
+                /*
+                 * Set credential information.
+                 */
+                credentials.client_cert = mqtt_server->cert;
+                if (credentials.client_cert)
+                {
+                    credentials.client_cert_size = at_cmd_refapp_mqtt_cred_size(mqtt_server->cert_cred);
+                }
+
+                credentials.private_key = mqtt_server->key;
+                if (credentials.private_key)
+                {
+                    credentials.private_key_size = at_cmd_refapp_mqtt_cred_size(mqtt_server->key_cred);
+                }
+
+                credentials.root_ca = mqtt_server->rootca;
+                if (credentials.root_ca)
+                {
+                    credentials.root_ca_size = at_cmd_refapp_mqtt_cred_size(mqtt_server->rootca_cred);
+                }
+
+                credentials.sni_host_name = mqtt_server->hostname;
+                if (credentials.sni_host_name)
+                {
+                    credentials.sni_host_name_size = strlen(mqtt_server->hostname) + 1;
+                }
+
+                security = &credentials;
             }
 
-            credentials.private_key = mqtt_server->key;
-            if (credentials.private_key)
+            /*
+             * Set hostname and port.
+             */
+            broker_info.hostname = mqtt_server->hostname;
+            broker_info.hostname_len = strlen(mqtt_server->hostname);
+            broker_info.port = mqtt_server->port;
+
+            AT_CMD_REFAPP_LOG_DBG(("mqtt_server->hostname:%p\n", mqtt_server->hostname));
+            AT_CMD_REFAPP_LOG_DBG(("broker hostname:%s len:%d port:%d\n", broker_info.hostname, broker_info.hostname_len, broker_info.port));
+            /*
+             * Create network buffer used by MQTT library for send and receive.
+             */
+            mqtt_server->mqtt_buffer = malloc(AT_CMD_REF_APP_MQTT_BUFFER_SIZE);
+            if (mqtt_server->mqtt_buffer == NULL)
             {
-                credentials.private_key_size = strlen(credentials.private_key) + 1;
+                AT_CMD_REFAPP_LOG_ERR(("memory allocation failed for mqtt network buffer \r\n"));
+                return CY_RSLT_AT_CMD_REF_APP_ERR;
             }
 
-            credentials.root_ca = mqtt_server->rootca;
-            if (credentials.root_ca)
+            /*
+             * Create MQTT instance.
+             */
+            result = mqtt_server->client->create(mqtt_server->mqtt_buffer, AT_CMD_REF_APP_MQTT_BUFFER_SIZE, security, &broker_info, MQTT_HANDLE_DESCRIPTOR, &mqtt_server->mqtt_handle);
+            if (result != CY_RSLT_SUCCESS)
             {
-                credentials.root_ca_size = strlen(credentials.root_ca) + 1;
+                AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_create failed %lx\n", result));
+
+                free(mqtt_server->mqtt_buffer);
+                mqtt_server->mqtt_buffer = NULL;
+                return CY_RSLT_AT_CMD_REF_APP_ERR;
             }
 
-            credentials.sni_host_name = mqtt_server->hostname;
-            if (credentials.sni_host_name)
+            /* Register a MQTT event callback */
+            result = mqtt_server->client->register_event_callback(mqtt_server->mqtt_handle, (cy_mqtt_callback_t)at_cmd_refapp_mqtt_event_cb,
+                                                                  (void *)(uintptr_t)mqtt_server->serverid);
+            if (CY_RSLT_SUCCESS == result)
             {
-                credentials.sni_host_name_size = strlen(mqtt_server->hostname) + 1;
+                printf("\nMQTT library initialization successful.\n");
             }
 
-            security = &credentials;
-        }
-
-        /*
-         * Set hostname and port.
-         */
-        broker_info.hostname = mqtt_server->hostname;
-        broker_info.hostname_len = strlen(mqtt_server->hostname);
-        broker_info.port = mqtt_server->port;
-
-        AT_CMD_REFAPP_LOG_MSG(("mqtt_server->hostname:%p\n", mqtt_server->hostname));
-        AT_CMD_REFAPP_LOG_MSG(("broker hostname:%s len:%d port:%d\n", broker_info.hostname, broker_info.hostname_len, broker_info.port));
-        /*
-         * Create network buffer used by MQTT library for send and receive.
-         */
-        mqtt_server->mqtt_buffer = malloc(AT_CMD_REF_APP_MQTT_BUFFER_SIZE);
-        if (mqtt_server->mqtt_buffer == NULL)
-        {
-            AT_CMD_REFAPP_LOG_MSG(("memory allocation failed for mqtt network buffer \r\n"));
-            return CY_RSLT_AT_CMD_REF_APP_ERR;
-        }
-
-        /*
-         * Create MQTT instance.
-         */
-        result = cy_mqtt_create(mqtt_server->mqtt_buffer, AT_CMD_REF_APP_MQTT_BUFFER_SIZE, security, &broker_info, MQTT_HANDLE_DESCRIPTOR, &mqtt_server->mqtt_handle);
-        if (result != CY_RSLT_SUCCESS)
-        {
-            AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_create failed %lx\n", result));
-
-            free(mqtt_server->mqtt_buffer);
-            mqtt_server->mqtt_buffer = NULL;
-            return CY_RSLT_AT_CMD_REF_APP_ERR;
-        }
-
-        /* Register a MQTT event callback */
-        result = cy_mqtt_register_event_callback(mqtt_server->mqtt_handle, (cy_mqtt_callback_t)at_cmd_refapp_mqtt_event_cb, NULL);
-        if (CY_RSLT_SUCCESS == result)
-        {
-            printf("\nMQTT library initialization successful.\n");
+            AT_CMD_REFAPP_LOG_DBG(("cy_mqtt_create success %lx mqtt handle %p\n", result, mqtt_server->mqtt_handle));
         }
 
-        AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_create success %lx mqtt handle %p\n", result, mqtt_server->mqtt_handle));
         /*
          * Set connection info.
          */
@@ -1215,16 +2082,24 @@ static cy_rslt_t at_cmd_refapp_mqtt_connect(at_cmd_ref_app_mqtt_broker_info_t *m
             connect_info.password_len = strlen(mqtt_server->password);
         }
 
-        AT_CMD_REFAPP_LOG_MSG(("calling cy_mqtt_connect ..\n"));
+        AT_CMD_REFAPP_LOG_DBG(("calling cy_mqtt_connect ..\n"));
         /*
          * Connect to MQTT broker.
          */
-        result = cy_mqtt_connect(mqtt_server->mqtt_handle, &connect_info);
+        cy_rtos_get_time(&start_time);
+        result = mqtt_server->client->connect(mqtt_server->mqtt_handle, &connect_info);
+        cy_rtos_get_time(&end_time);
+        mqtt_server->handshake_time = (uint32_t)(end_time - start_time);
         if (result != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_connect failed %lx\n", result));
+            AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_connect failed %lx\n", result));
+
+            /*
+             * Start from a fresh MQTT instance on the next attempt.
+             */
+            mqtt_server->reused = false;
 
-            cy_mqtt_delete(mqtt_server->mqtt_handle);
+            mqtt_server->client->destroy(mqtt_server->mqtt_handle);
             mqtt_server->mqtt_handle = NULL;
 
             free(mqtt_server->mqtt_buffer);
@@ -1233,7 +2108,7 @@ static cy_rslt_t at_cmd_refapp_mqtt_connect(at_cmd_ref_app_mqtt_broker_info_t *m
             return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
 
-        AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_connect returned success!!\n"));
+        AT_CMD_REFAPP_LOG_DBG(("cy_mqtt_connect returned success!!\n"));
         mqtt_server->connected = true;
     }
     else
@@ -1249,20 +2124,38 @@ static cy_rslt_t at_cmd_refapp_mqtt_disconnect(at_cmd_ref_app_mqtt_broker_info_t
 
     if (mqtt_server->connected)
     {
-        cy_mqtt_disconnect(mqtt_server->mqtt_handle);
-        cy_mqtt_delete(mqtt_server->mqtt_handle);
+        mqtt_server->client->disconnect(mqtt_server->mqtt_handle);
+        mqtt_server->connected = false;
+    }
 
+    /*
+     * The handle may also be left over from an unexpected disconnect.
+     */
+    if (mqtt_server->mqtt_handle != NULL)
+    {
+        mqtt_server->client->destroy(mqtt_server->mqtt_handle);
         mqtt_server->mqtt_handle = NULL;
 
         free(mqtt_server->mqtt_buffer);
         mqtt_server->mqtt_buffer = NULL;
-
-        mqtt_server->connected = false;
     }
 
     return result;
 }
 
+/*
+ * The broker connection dropped. Release the network connection but keep the
+ * MQTT handle and buffer so that the next MQTT_ConnectBroker can reuse them.
+ */
+static void at_cmd_refapp_mqtt_link_down(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server)
+{
+    if (mqtt_server->connected)
+    {
+        mqtt_server->client->disconnect(mqtt_server->mqtt_handle);
+        mqtt_server->connected = false;
+    }
+}
+
 static cy_rslt_t at_cmd_refapp_mqtt_publish(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_publish_t *publish)
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
@@ -1279,10 +2172,28 @@ static cy_rslt_t at_cmd_refapp_mqtt_publish(at_cmd_ref_app_mqtt_broker_info_t *m
     pub_info.payload = publish->msg;
     pub_info.payload_len = strlen(pub_info.payload);
 
-    result = cy_mqtt_publish(mqtt_server->mqtt_handle, &pub_info);
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    /*
+     * Benchmark fault: the broker drops the connection during the publish,
+     * reported the way the MQTT library reports it.
+     */
+    if (AT_CMD_REFAPP_BENCH_FAULT(AT_CMD_REF_APP_BENCH_FAULT_MQTT_DISCONNECT))
+    {
+        cy_mqtt_event_t event;
+
+        memset(&event, 0, sizeof(event));
+        event.type = CY_MQTT_EVENT_TYPE_DISCONNECT;
+        event.data.reason = CY_MQTT_DISCONN_TYPE_BROKER_DOWN;
+        at_cmd_refapp_mqtt_event_cb(mqtt_server->mqtt_handle, event, (void *)(uintptr_t)mqtt_server->serverid);
+        AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_publish failed, broker down\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+#endif
+
+    result = mqtt_server->client->publish(mqtt_server->mqtt_handle, &pub_info);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_publish failed %lx\n", result));
+        AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_publish failed %lx\n", result));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
 
@@ -1304,12 +2215,12 @@ static cy_rslt_t at_cmd_refapp_mqtt_subscribe(at_cmd_ref_app_mqtt_broker_info_t
     sub_info[0].topic = subscribe->topic;
     sub_info[0].topic_len = strlen(subscribe->topic);
 
-    AT_CMD_REFAPP_LOG_MSG(("Subscribing with QOS : %d, Topic : %s \n", sub_info[0].qos, sub_info[0].topic));
+    AT_CMD_REFAPP_LOG_DBG(("Subscribing with QOS : %d, Topic : %s \n", sub_info[0].qos, sub_info[0].topic));
 
-    result = cy_mqtt_subscribe(mqtt_server->mqtt_handle, &sub_info[0], 1);
+    result = mqtt_server->client->subscribe(mqtt_server->mqtt_handle, &sub_info[0], 1);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_subscribe failed %lx\n", result));
+        AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_subscribe failed %lx\n", result));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
 
@@ -1327,12 +2238,12 @@ static cy_rslt_t at_cmd_refapp_mqtt_unsubscribe(at_cmd_ref_app_mqtt_broker_info_
     unsub_info[0].topic = unsubscribe->topic;
     unsub_info[0].topic_len = strlen(unsubscribe->topic);
 
-    AT_CMD_REFAPP_LOG_MSG(("UnSubscribing with QOS : %d, Topic : %s \n", unsub_info[0].qos, unsub_info[0].topic));
+    AT_CMD_REFAPP_LOG_DBG(("UnSubscribing with QOS : %d, Topic : %s \n", unsub_info[0].qos, unsub_info[0].topic));
 
-    result = cy_mqtt_unsubscribe(mqtt_server->mqtt_handle, &unsub_info[0], 1);
+    result = mqtt_server->client->unsubscribe(mqtt_server->mqtt_handle, &unsub_info[0], 1);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("cy_mqtt_unsubscribe failed %lx\n", result));
+        AT_CMD_REFAPP_LOG_ERR(("cy_mqtt_unsubscribe failed %lx\n", result));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
 
@@ -1340,7 +2251,7 @@ static cy_rslt_t at_cmd_refapp_mqtt_unsubscribe(at_cmd_ref_app_mqtt_broker_info_
     return result;
 }
 
-static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_define_server_t *server_config)
+static cy_rslt_t at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_info_t *mqtt_server, at_cmd_ref_app_mqtt_define_server_t *server_config)
 {
     mqtt_server->serverid = server_config->brokerid;
     mqtt_server->connected = false;
@@ -1371,14 +2282,22 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
     mqtt_server->hostname = malloc(strlen(server_config->hostname) + 1);
     if (mqtt_server->hostname == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-        return;
+        AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
     memset(mqtt_server->hostname, 0, (strlen(server_config->hostname)+1));
     strcpy(mqtt_server->hostname, server_config->hostname);
 
-    AT_CMD_REFAPP_LOG_MSG(("mqtt_server->hostname:%p\n", mqtt_server->hostname));
-    AT_CMD_REFAPP_LOG_MSG(("func:%s mqtt_server->hostname :%s\n", __func__, mqtt_server->hostname));
+    AT_CMD_REFAPP_LOG_DBG(("mqtt_server->hostname:%p\n", mqtt_server->hostname));
+    AT_CMD_REFAPP_LOG_DBG(("func:%s mqtt_server->hostname :%s\n", __func__, mqtt_server->hostname));
+
+    mqtt_server->client = &g_mqtt_library_client;
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    if (strcmp(mqtt_server->hostname, AT_CMD_REF_APP_MQTT_LOOPBACK_HOST) == 0)
+    {
+        mqtt_server->client = at_cmd_refapp_mqtt_loopback_client();
+    }
+#endif
 
     /*
      * Port number.
@@ -1410,39 +2329,15 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
     /*
      * TLS certificates.
      */
-    if (server_config->rootca)
-    {
-        mqtt_server->rootca = malloc(strlen(server_config->rootca) + 1);
-        if (mqtt_server->rootca == NULL)
-        {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
-        }
-        memset(mqtt_server->rootca, 0, (strlen(server_config->rootca) + 1));
-        strcpy(mqtt_server->rootca, server_config->rootca);
-    }
-    if (server_config->cert)
-    {
-        mqtt_server->cert = malloc(strlen(server_config->cert) + 1);
-        if (mqtt_server->cert == NULL)
-        {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
-        }
-        memset(mqtt_server->cert, 0, (strlen(server_config->cert) + 1));
-        strcpy(mqtt_server->cert, server_config->cert);
-    }
-    if (server_config->key)
+    if ((at_cmd_refapp_mqtt_broker_set_cred(server_config->rootcaid, server_config->rootca, &mqtt_server->rootca_cred) != CY_RSLT_SUCCESS) ||
+        (at_cmd_refapp_mqtt_broker_set_cred(server_config->certid, server_config->cert, &mqtt_server->cert_cred) != CY_RSLT_SUCCESS) ||
+        (at_cmd_refapp_mqtt_broker_set_cred(server_config->keyid, server_config->key, &mqtt_server->key_cred) != CY_RSLT_SUCCESS))
     {
-        mqtt_server->key = malloc(strlen(server_config->key) + 1);
-        if (mqtt_server->key == NULL)
-        {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
-        }
-        memset(mqtt_server->key, 0, (strlen(server_config->key) + 1));
-        strcpy(mqtt_server->key, server_config->key);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
+    mqtt_server->rootca = (mqtt_server->rootca_cred != NULL) ? mqtt_server->rootca_cred->data : NULL;
+    mqtt_server->cert = (mqtt_server->cert_cred != NULL) ? mqtt_server->cert_cred->data : NULL;
+    mqtt_server->key = (mqtt_server->key_cred != NULL) ? mqtt_server->key_cred->data : NULL;
 
     /*
      * Cliend ID.
@@ -1452,15 +2347,15 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
         mqtt_server->clientid = malloc(strlen(server_config->clientid) + 1);
         if (mqtt_server->clientid == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         memset(mqtt_server->clientid, 0, (strlen(server_config->clientid) + 1));
         strcpy(mqtt_server->clientid, server_config->clientid);
     }
     else
     {
-        mqtt_server->clientid = AT_CMD_REF_APP_MQTT_CLIENT_ID;
+        mqtt_server->clientid = (char *)g_mqtt_default_clientid;
     }
 
     /*
@@ -1477,8 +2372,8 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
         mqtt_server->username = malloc(strlen(server_config->username) + 1);
         if (mqtt_server->username == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         memset(mqtt_server->username, 0, (strlen(server_config->username) + 1));
         strcpy(mqtt_server->username, server_config->username);
@@ -1492,8 +2387,8 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
         mqtt_server->password = malloc(strlen(server_config->password) + 1);
         if (mqtt_server->password == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         memset(mqtt_server->password, 0, (strlen(server_config->password) + 1));
         strcpy(mqtt_server->password, server_config->password);
@@ -1507,8 +2402,8 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
         mqtt_server->lastwilltopic = malloc(strlen(server_config->lastwilltopic) + 1);
         if (mqtt_server->lastwilltopic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         memset(mqtt_server->lastwilltopic, 0, (strlen(server_config->lastwilltopic) + 1));
         strcpy(mqtt_server->lastwilltopic, server_config->lastwilltopic);
@@ -1519,8 +2414,8 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
         mqtt_server->lastwillmessage = malloc(strlen(server_config->lastwillmessage) + 1);
         if (mqtt_server->lastwillmessage == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("memory error\n"));
-            return;
+            AT_CMD_REFAPP_LOG_ERR(("memory error\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         memset(mqtt_server->lastwillmessage, 0, (strlen(server_config->lastwillmessage) + 1));
         strcpy(mqtt_server->lastwillmessage, server_config->lastwillmessage);
@@ -1533,8 +2428,8 @@ static void at_cmd_refapp_create_mqtt_broker_info(at_cmd_ref_app_mqtt_broker_inf
     {
         mqtt_server->publishretrylimit = AT_CMD_REF_APP_MQTT_PUBLISH_RETRY_LIMIT;
     }
-    AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_create_mqtt_broker_info hostname:%s\n", mqtt_server->hostname));
-    return;
+    AT_CMD_REFAPP_LOG_DBG(("at_cmd_refapp_create_mqtt_broker_info hostname:%s\n", mqtt_server->hostname));
+    return CY_RSLT_SUCCESS;
 }
 
 static void at_cmd_refapp_mqtt_event_cb(cy_mqtt_t mqtt_handle, cy_mqtt_event_t event, void *user_data)
@@ -1544,7 +2439,7 @@ static void at_cmd_refapp_mqtt_event_cb(cy_mqtt_t mqtt_handle, cy_mqtt_event_t e
     uint32_t topiclen = 0;
     uint32_t payloadlen = 0;
 
-    AT_CMD_REFAPP_LOG_MSG(("Received  event=%d from MQTT callback\n", event.type));
+    AT_CMD_REFAPP_LOG_DBG(("Received  event=%d from MQTT callback\n", event.type));
 
     if (event.type == CY_MQTT_EVENT_TYPE_DISCONNECT)
     {
@@ -1555,16 +2450,17 @@ static void at_cmd_refapp_mqtt_event_cb(cy_mqtt_t mqtt_handle, cy_mqtt_event_t e
         msg = calloc(1, sizeof(at_cmd_ref_app_mqtt_disconnect_event_t));
         if (msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc failed \n"));
+            AT_CMD_REFAPP_LOG_ERR(("error alloc failed \n"));
             return;
         }
 
         msg->base.cmd_id = CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT;
         msg->base.serial = CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT;
+        msg->brokerid = (uint32_t)(uintptr_t)user_data;
         msg->disconnect_reason = event.data.reason;
         if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error sending at_cmd_refapp_send_message!!!\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
             free(msg);
         }
     }
@@ -1577,42 +2473,42 @@ static void at_cmd_refapp_mqtt_event_cb(cy_mqtt_t mqtt_handle, cy_mqtt_event_t e
         publish = calloc(1, sizeof(at_cmd_ref_app_mqtt_publish_t));
         if (publish == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc failed\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error alloc failed\n"));
             return;
         }
         publish->base.cmd_id = CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT;
         publish->base.serial = CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT;
 
-        publish->brokerid = event.data.pub_msg.packet_id;
+        publish->brokerid = (uint32_t)(uintptr_t)user_data;
         publish->qos = event.data.pub_msg.received_message.qos;
         topiclen = strlen(event.data.pub_msg.received_message.topic) + 1;
         publish->topic = malloc(topiclen);
         if (publish->topic == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc failed\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error alloc failed\n"));
             free(publish);
             return;
         }
         memset(publish->topic, 0, topiclen);
         memcpy(publish->topic, event.data.pub_msg.received_message.topic, event.data.pub_msg.received_message.topic_len);
-        AT_CMD_REFAPP_LOG_MSG(("publish->topic:%s\n", publish->topic));
+        AT_CMD_REFAPP_LOG_DBG(("publish->topic:%s\n", publish->topic));
 
         payloadlen = strlen(event.data.pub_msg.received_message.payload) + 1;
         publish->msg = malloc(payloadlen);
         if (publish->msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc failed\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error alloc failed\n"));
             free(publish->topic);
             free(publish);
             return;
         }
         memset(publish->msg, 0, payloadlen);
         memcpy(publish->msg, event.data.pub_msg.received_message.payload, event.data.pub_msg.received_message.payload_len);
-        AT_CMD_REFAPP_LOG_MSG(("publish->msg:%s\n", publish->msg));
+        AT_CMD_REFAPP_LOG_DBG(("publish->msg length:%d\n", (int)event.data.pub_msg.received_message.payload_len));
 
         if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)publish) != CY_RSLT_SUCCESS)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error sending at_cmd_refapp_send_message!!!\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
             free(publish->topic);
             free(publish->msg);
             free(publish);
@@ -1678,6 +2574,25 @@ static cy_rslt_t at_cmd_refapp_mqtt_server_config(at_cmd_ref_app_mqtt_define_ser
                 strcpy(ptr, key);
                 ptr += strlen(key) + 1;
             }
+
+            /*
+             * Credentials previously uploaded with MQTT_DefineCredential take
+             * precedence over the inline PEM strings.
+             */
+            if (cJSON_HasObjectItem(json, MQTT_TOKEN_ROOTCAID))
+            {
+                server_config->rootcaid = cJSON_GetObjectItem(json, MQTT_TOKEN_ROOTCAID)->valueint;
+            }
+
+            if (cJSON_HasObjectItem(json, MQTT_TOKEN_CLIENTCERTID))
+            {
+                server_config->certid = cJSON_GetObjectItem(json, MQTT_TOKEN_CLIENTCERTID)->valueint;
+            }
+
+            if (cJSON_HasObjectItem(json, MQTT_TOKEN_CLIENTKEYID))
+            {
+                server_config->keyid = cJSON_GetObjectItem(json, MQTT_TOKEN_CLIENTKEYID)->valueint;
+            }
         }
     }
     /*
@@ -1839,7 +2754,7 @@ cy_rslt_t at_cmd_refapp_mqtt_event_callback(uint32_t cmd_id, at_cmd_msg_base_t *
 
     if ((publish_msg == NULL) || (disconn_msg == NULL))
     {
-        AT_CMD_REFAPP_LOG_MSG(("func:%s publish_msg or disconn_msg is NULL!!\n", __func__));
+        AT_CMD_REFAPP_LOG_ERR(("func:%s publish_msg or disconn_msg is NULL!!\n", __func__));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
     switch (cmd_id)
@@ -1847,24 +2762,24 @@ cy_rslt_t at_cmd_refapp_mqtt_event_callback(uint32_t cmd_id, at_cmd_msg_base_t *
     case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
     {
         cy_linked_list_node_t *nodeptr = NULL;
-        nodeptr = (cy_linked_list_node_t *)g_mqtt_server_list.rear;
+        nodeptr = at_cmd_refapp_find_broker_id(disconn_msg->brokerid);
         if (nodeptr == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("func:%s disconn_msg unable to get broker info!!\n", __func__));
+            AT_CMD_REFAPP_LOG_ERR(("func:%s disconn_msg unable to get broker info!!\n", __func__));
             return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
         mqtt_broker_info = (at_cmd_ref_app_mqtt_broker_info_t *)nodeptr->data;
         if (mqtt_broker_info != NULL)
         {
             /* Clear the status flag bit to indicate MQTT disconnection. */
-            at_cmd_refapp_mqtt_disconnect(mqtt_broker_info);
+            at_cmd_refapp_mqtt_link_down(mqtt_broker_info);
         }
         /* MQTT connection with the MQTT broker is broken as the client
          * is unable to communicate with the broker. Set the appropriate
          * command to be sent to the MQTT task.
          */
         AT_CMD_REFAPP_LOG_MSG(("\nUnexpectedly disconnected from MQTT broker reason :%d!\n", disconn_msg->disconnect_reason));
-        at_cmd_refapp_process_mqtt_host_msg(cmd_id, (at_cmd_msg_base_t *)disconn_msg, result_str->result_text, sizeof(result_str->result_text));
+        at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_mqtt_write_json, cmd_id, (at_cmd_msg_base_t *)disconn_msg, false);
         break;
     }
 
@@ -1872,28 +2787,17 @@ cy_rslt_t at_cmd_refapp_mqtt_event_callback(uint32_t cmd_id, at_cmd_msg_base_t *
     {
         if (publish_msg != NULL && publish_msg->msg != NULL && publish_msg->topic != NULL)
         {
-            at_cmd_refapp_process_mqtt_host_msg(cmd_id, (at_cmd_msg_base_t *)publish_msg, result_str->result_text, sizeof(result_str->result_text));
+            /*
+             * The topic and the payload are freed by the mqtt_cmd worker once
+             * the message is sent, it is written while it is sent.
+             */
+            at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_mqtt_write_json, cmd_id, (at_cmd_msg_base_t *)publish_msg, false);
 
-            AT_CMD_REFAPP_LOG_MSG(("  Subscriber: Incoming MQTT message received:\n"
-                                   "    Publish topic name length:%d\n"
+            AT_CMD_REFAPP_LOG_DBG(("  Subscriber: Incoming MQTT message received:\n"
                                    "    Publish topic name: %s\n"
                                    "    Publish QoS: %d\n"
-                                   "    Publish payload length: %d\n\n"
-                                   "    Publish payload: %s\n\n",
-                                   (int)strlen(publish_msg->topic), publish_msg->topic,
-                                   (int)publish_msg->qos,
-                                   (int)strlen(publish_msg->msg), publish_msg->msg));
-
-            if (publish_msg->msg != NULL)
-            {
-                free(publish_msg->msg);
-                publish_msg->msg = NULL; // Set to NULL after freeing the memory
-            }
-            if (publish_msg->topic != NULL)
-            {
-                free(publish_msg->topic);
-                publish_msg->topic = NULL; // Set to NULL after freeing the memory
-            }
+                                   "    Publish payload length: %d\n\n",
+                                   publish_msg->topic, (int)publish_msg->qos, (int)strlen(publish_msg->msg)));
         }
 
         break;
@@ -1901,7 +2805,7 @@ cy_rslt_t at_cmd_refapp_mqtt_event_callback(uint32_t cmd_id, at_cmd_msg_base_t *
     default:
     {
         /* Unknown MQTT event */
-        AT_CMD_REFAPP_LOG_MSG(("\nUnknown Event received from MQTT callback!\n"));
+        AT_CMD_REFAPP_LOG_ERR(("\nUnknown Event received from MQTT callback!\n"));
         break;
     }
     }
@@ -0,0 +1,686 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/**
+ * @file at_cmd_refapp_mqtt_loopback.c
+ * @brief Loopback MQTT broker of the benchmark build: serves the MQTT client
+ *        calls of brokers defined with host "loopback" without a network,
+ *        with configurable PUBACK delay and loss and broker disconnects.
+ *        It replaces the client library calls, so MQTT packet encoding and
+ *        the socket path are not part of what it measures.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_MQTT
+#include "at_cmd_refapp.h"
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+
+/******************************************************
+ *                    Structures
+ ******************************************************/
+
+/*
+ * MQTT client connected to the loopback broker, the client handle points here.
+ */
+typedef struct
+{
+    bool               used;
+    uint32_t           generation;                                 /* tells a recreated slot apart        */
+    bool               connected;
+    bool               dropped;                                    /* dropped by the broker, not back yet */
+    uint32_t           drop_time;                                  /* trace clock at the drop             */
+    cy_mqtt_callback_t callback;
+    void              *user_data;
+    uint32_t           num_subs;
+    char               subs[AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_SUBS][AT_CMD_REF_APP_MQTT_LOOPBACK_TOPIC_LEN];
+    cy_mqtt_qos_t      sub_qos[AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_SUBS];
+} loopback_client_t;
+
+/*
+ * Message or disconnect on its way to a client, topic and payload follow.
+ */
+typedef struct loopback_delivery
+{
+    struct loopback_delivery *next;                                /* next one due                        */
+    loopback_client_t   *client;
+    uint32_t             generation;
+    cy_mqtt_event_type_t type;
+    cy_mqtt_qos_t        qos;
+    cy_time_t            due;
+    uint32_t             stamp;
+    uint16_t             topic_len;
+    uint32_t             payload_len;
+    char                 data[];
+} loopback_delivery_t;
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static cy_rslt_t loopback_create(uint8_t *buffer, uint32_t buff_len, cy_awsport_ssl_credentials_t *security,
+                                 cy_mqtt_broker_info_t *broker_info, char *descriptor, cy_mqtt_t *mqtt_handle);
+static cy_rslt_t loopback_register_event_callback(cy_mqtt_t mqtt_handle, cy_mqtt_callback_t event_callback, void *user_data);
+static cy_rslt_t loopback_connect(cy_mqtt_t mqtt_handle, cy_mqtt_connect_info_t *connect_info);
+static cy_rslt_t loopback_disconnect(cy_mqtt_t mqtt_handle);
+static cy_rslt_t loopback_destroy(cy_mqtt_t mqtt_handle);
+static cy_rslt_t loopback_publish(cy_mqtt_t mqtt_handle, cy_mqtt_publish_info_t *pub_msg);
+static cy_rslt_t loopback_subscribe(cy_mqtt_t mqtt_handle, cy_mqtt_subscribe_info_t *sub_info, uint8_t sub_count);
+static cy_rslt_t loopback_unsubscribe(cy_mqtt_t mqtt_handle, cy_mqtt_unsubscribe_info_t *unsub_info, uint8_t unsub_count);
+static void loopback_thread(cy_thread_arg_t arg);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+static const at_cmd_ref_app_mqtt_client_t g_loopback_client =
+{
+    .create                  = loopback_create,
+    .register_event_callback = loopback_register_event_callback,
+    .connect                 = loopback_connect,
+    .disconnect              = loopback_disconnect,
+    .destroy                 = loopback_destroy,
+    .publish                 = loopback_publish,
+    .subscribe               = loopback_subscribe,
+    .unsubscribe             = loopback_unsubscribe,
+};
+
+/*
+ * Broker state, shared by the mqtt_cmd worker and the delivery thread under
+ * the mutex. Deliveries wait in a list sorted by due time.
+ */
+static struct
+{
+    cy_mutex_t        mutex;
+    loopback_client_t clients[AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_CLIENTS];
+    uint32_t          generation;
+    loopback_delivery_t *pending;
+    uint32_t          num_pending;
+    loopback_client_t *calling;                                    /* client whose callback is running    */
+
+    /* Settings. */
+    uint32_t puback_delay;
+    uint32_t puback_loss;
+    uint32_t disconnect;
+    uint32_t delivery_delay;
+
+    /* Statistics. */
+    uint32_t published;
+    uint32_t acked;
+    uint32_t delivered;
+    uint32_t delivery_drops;
+    uint32_t acks_lost;
+    uint32_t disconnects;
+    uint32_t reconnects;
+    uint64_t delivery_total;
+    uint32_t delivery_max;
+    uint32_t reconnect_last;
+    uint32_t reconnect_max;
+
+    cy_semaphore_t wake;
+    cy_thread_t    thread;
+} g_loopback;
+
+static uint64_t g_loopback_stack[AT_CMD_REF_APP_MQTT_LOOPBACK_STACK_SIZE / 8];
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/**
+ * Start the thread delivering messages and disconnects to the clients
+ */
+cy_rslt_t at_cmd_refapp_mqtt_loopback_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_init_mutex(&g_loopback.mutex);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("loopback broker mutex init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_init_semaphore(&g_loopback.wake, 1, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("loopback broker semaphore init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_thread_create(&g_loopback.thread, &loopback_thread, "mqtt loopback", g_loopback_stack,
+                                   AT_CMD_REF_APP_MQTT_LOOPBACK_STACK_SIZE, AT_CMD_REF_APP_MQTT_LOOPBACK_PRIORITY, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("loopback broker thread create failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * Client calls served by the loopback broker
+ */
+const at_cmd_ref_app_mqtt_client_t *at_cmd_refapp_mqtt_loopback_client(void)
+{
+    return &g_loopback_client;
+}
+
+/**
+ * Report the statistics, then apply new settings and restart the statistics
+ */
+void at_cmd_refapp_mqtt_loopback_config(at_cmd_ref_app_mqtt_loopback_t *loopback)
+{
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+
+    loopback->published = g_loopback.published;
+    loopback->delivered = g_loopback.delivered;
+    loopback->delivery_drops = g_loopback.delivery_drops;
+    loopback->acks_lost = g_loopback.acks_lost;
+    loopback->disconnects = g_loopback.disconnects;
+    loopback->reconnects = g_loopback.reconnects;
+    loopback->delivery_avg = g_loopback.delivered ? (uint32_t)(g_loopback.delivery_total / g_loopback.delivered) : 0;
+    loopback->delivery_max = g_loopback.delivery_max;
+    loopback->reconnect_last = g_loopback.reconnect_last;
+    loopback->reconnect_max = g_loopback.reconnect_max;
+
+    if (loopback->configure)
+    {
+        g_loopback.puback_delay = loopback->puback_delay;
+        g_loopback.puback_loss = loopback->puback_loss;
+        g_loopback.disconnect = loopback->disconnect;
+        g_loopback.delivery_delay = loopback->delivery_delay;
+
+        g_loopback.published = 0;
+        g_loopback.acked = 0;
+        g_loopback.delivered = 0;
+        g_loopback.delivery_drops = 0;
+        g_loopback.acks_lost = 0;
+        g_loopback.disconnects = 0;
+        g_loopback.reconnects = 0;
+        g_loopback.delivery_total = 0;
+        g_loopback.delivery_max = 0;
+        g_loopback.reconnect_last = 0;
+        g_loopback.reconnect_max = 0;
+    }
+
+    loopback->puback_delay = g_loopback.puback_delay;
+    loopback->puback_loss = g_loopback.puback_loss;
+    loopback->disconnect = g_loopback.disconnect;
+    loopback->delivery_delay = g_loopback.delivery_delay;
+
+    cy_rtos_set_mutex(&g_loopback.mutex);
+}
+
+/*
+ * MQTT 3.1.1 topic filter match: "+" matches one level, a trailing "#" any
+ * number of levels including the parent level.
+ */
+static bool loopback_topic_match(const char *filter, const char *topic, uint32_t topic_len)
+{
+    const char *end = topic + topic_len;
+
+    while (*filter != '\0')
+    {
+        if (*filter == '#')
+        {
+            return true;
+        }
+        if (*filter == '+')
+        {
+            while ((topic < end) && (*topic != '/'))
+            {
+                topic++;
+            }
+            filter++;
+        }
+        else if ((topic < end) && (*filter == *topic))
+        {
+            filter++;
+            topic++;
+        }
+        else
+        {
+            return (topic == end) && (strcmp(filter, "/#") == 0);
+        }
+    }
+
+    return topic == end;
+}
+
+/*
+ * Queue a message or a disconnect for the delivery thread, after the
+ * deliveries due no later. Called with the mutex held.
+ */
+static void loopback_queue(loopback_client_t *client, cy_mqtt_event_type_t type, cy_mqtt_qos_t qos,
+                           const cy_mqtt_publish_info_t *pub_msg)
+{
+    loopback_delivery_t **link;
+    loopback_delivery_t *delivery;
+    uint32_t topic_len = pub_msg ? pub_msg->topic_len : 0;
+    uint32_t payload_len = pub_msg ? pub_msg->payload_len : 0;
+
+    if (g_loopback.num_pending >= AT_CMD_REF_APP_MQTT_LOOPBACK_QUEUE_MSGS)
+    {
+        g_loopback.delivery_drops++;
+        return;
+    }
+
+    /* Topic and payload are handed on NUL terminated. */
+    delivery = malloc(sizeof(loopback_delivery_t) + topic_len + payload_len + 2);
+    if (delivery == NULL)
+    {
+        g_loopback.delivery_drops++;
+        return;
+    }
+    delivery->client = client;
+    delivery->generation = client->generation;
+    delivery->type = type;
+    delivery->qos = qos;
+    delivery->topic_len = (uint16_t)topic_len;
+    delivery->payload_len = payload_len;
+    if (pub_msg != NULL)
+    {
+        memcpy(delivery->data, pub_msg->topic, topic_len);
+        memcpy(&delivery->data[topic_len + 1], pub_msg->payload, payload_len);
+    }
+    delivery->data[topic_len] = '\0';
+    delivery->data[topic_len + payload_len + 1] = '\0';
+    delivery->stamp = at_cmd_refapp_trace_clock();
+    cy_rtos_get_time(&delivery->due);
+    delivery->due += (type == CY_MQTT_EVENT_TYPE_DISCONNECT) ? 0 : g_loopback.delivery_delay;
+
+    for (link = &g_loopback.pending; (*link != NULL) && ((int32_t)((*link)->due - delivery->due) <= 0);
+         link = &(*link)->next)
+        ;
+    delivery->next = *link;
+    *link = delivery;
+    g_loopback.num_pending++;
+
+    /* A new first delivery changes how long the thread sleeps. */
+    if (link == &g_loopback.pending)
+    {
+        cy_rtos_set_semaphore(&g_loopback.wake, false);
+    }
+}
+
+/*
+ * The broker drops the client, reported from the delivery thread the way the
+ * MQTT library reports it from its own thread. Called with the mutex held.
+ */
+static void loopback_drop(loopback_client_t *client)
+{
+    client->connected = false;
+    client->dropped = true;
+    client->drop_time = at_cmd_refapp_trace_clock();
+    g_loopback.disconnects++;
+    loopback_queue(client, CY_MQTT_EVENT_TYPE_DISCONNECT, CY_MQTT_QOS0, NULL);
+}
+
+static cy_rslt_t loopback_create(uint8_t *buffer, uint32_t buff_len, cy_awsport_ssl_credentials_t *security,
+                                 cy_mqtt_broker_info_t *broker_info, char *descriptor, cy_mqtt_t *mqtt_handle)
+{
+    uint32_t i;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    for (i = 0; i < AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_CLIENTS; i++)
+    {
+        if (!g_loopback.clients[i].used)
+        {
+            memset(&g_loopback.clients[i], 0, sizeof(loopback_client_t));
+            g_loopback.clients[i].used = true;
+            g_loopback.clients[i].generation = ++g_loopback.generation;
+            *mqtt_handle = &g_loopback.clients[i];
+            cy_rtos_set_mutex(&g_loopback.mutex);
+            return CY_RSLT_SUCCESS;
+        }
+    }
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    AT_CMD_REFAPP_LOG_ERR(("loopback broker has no room for another client\n"));
+    return CY_RSLT_AT_CMD_REF_APP_ERR;
+}
+
+static cy_rslt_t loopback_register_event_callback(cy_mqtt_t mqtt_handle, cy_mqtt_callback_t event_callback, void *user_data)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    client->callback = event_callback;
+    client->user_data = user_data;
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t loopback_connect(cy_mqtt_t mqtt_handle, cy_mqtt_connect_info_t *connect_info)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+    uint32_t elapsed;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (connect_info->clean_session)
+    {
+        client->num_subs = 0;
+    }
+    client->connected = true;
+
+    if (client->dropped)
+    {
+        elapsed = (at_cmd_refapp_trace_clock() - client->drop_time) / 1000;
+        client->dropped = false;
+        g_loopback.reconnects++;
+        g_loopback.reconnect_last = elapsed;
+        g_loopback.reconnect_max = elapsed > g_loopback.reconnect_max ? elapsed : g_loopback.reconnect_max;
+    }
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t loopback_disconnect(cy_mqtt_t mqtt_handle)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    client->connected = false;
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Callbacks run without the mutex, a client being called back is released
+ * once its callback has returned.
+ */
+static cy_rslt_t loopback_destroy(cy_mqtt_t mqtt_handle)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    client->connected = false;
+    while (g_loopback.calling == client)
+    {
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        cy_rtos_delay_milliseconds(1);
+        cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    }
+    client->used = false;
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Route the message to the subscribed clients, once per client at the lower
+ * of the publish and subscription QoS, then wait for the PUBACK.
+ */
+static cy_rslt_t loopback_publish(cy_mqtt_t mqtt_handle, cy_mqtt_publish_info_t *pub_msg)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+    loopback_client_t *subscriber;
+    uint32_t puback_delay;
+    bool ack_lost = false;
+    uint32_t i;
+    uint32_t s;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (!client->connected)
+    {
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    g_loopback.published++;
+    if (g_loopback.disconnect && (g_loopback.published % g_loopback.disconnect == 0))
+    {
+        loopback_drop(client);
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    for (i = 0; i < AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_CLIENTS; i++)
+    {
+        subscriber = &g_loopback.clients[i];
+        if (!subscriber->used || !subscriber->connected)
+        {
+            continue;
+        }
+        for (s = 0; s < subscriber->num_subs; s++)
+        {
+            if (loopback_topic_match(subscriber->subs[s], pub_msg->topic, pub_msg->topic_len))
+            {
+                loopback_queue(subscriber, CY_MQTT_EVENT_TYPE_SUBSCRIPTION_MESSAGE_RECEIVE,
+                               pub_msg->qos < subscriber->sub_qos[s] ? pub_msg->qos : subscriber->sub_qos[s], pub_msg);
+                break;
+            }
+        }
+    }
+
+    if (pub_msg->qos == CY_MQTT_QOS0)
+    {
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* The broker took the message even if its PUBACK gets lost. */
+    g_loopback.acked++;
+    if (g_loopback.puback_loss && (g_loopback.acked % g_loopback.puback_loss == 0))
+    {
+        g_loopback.acks_lost++;
+        ack_lost = true;
+    }
+    puback_delay = g_loopback.puback_delay;
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    /* The delivery thread keeps running while the publish waits. */
+    if (ack_lost)
+    {
+        cy_rtos_delay_milliseconds(AT_CMD_REF_APP_MQTT_LOOPBACK_ACK_TIMEOUT_MS);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    if (puback_delay)
+    {
+        cy_rtos_delay_milliseconds(puback_delay);
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t loopback_subscribe(cy_mqtt_t mqtt_handle, cy_mqtt_subscribe_info_t *sub_info, uint8_t sub_count)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t i;
+    uint32_t s;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (!client->connected)
+    {
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    for (i = 0; i < sub_count; i++)
+    {
+        if (sub_info[i].topic_len >= AT_CMD_REF_APP_MQTT_LOOPBACK_TOPIC_LEN)
+        {
+            result = CY_RSLT_AT_CMD_REF_APP_ERR;
+            break;
+        }
+
+        /* A filter subscribed again replaces the old subscription. */
+        for (s = 0; s < client->num_subs; s++)
+        {
+            if ((strlen(client->subs[s]) == sub_info[i].topic_len) &&
+                (memcmp(client->subs[s], sub_info[i].topic, sub_info[i].topic_len) == 0))
+            {
+                break;
+            }
+        }
+        if (s == AT_CMD_REF_APP_MQTT_LOOPBACK_MAX_SUBS)
+        {
+            result = CY_RSLT_AT_CMD_REF_APP_ERR;
+            break;
+        }
+        if (s == client->num_subs)
+        {
+            memcpy(client->subs[s], sub_info[i].topic, sub_info[i].topic_len);
+            client->subs[s][sub_info[i].topic_len] = '\0';
+            client->num_subs++;
+        }
+        client->sub_qos[s] = sub_info[i].qos;
+        sub_info[i].allocated_qos = sub_info[i].qos;
+    }
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return result;
+}
+
+static cy_rslt_t loopback_unsubscribe(cy_mqtt_t mqtt_handle, cy_mqtt_unsubscribe_info_t *unsub_info, uint8_t unsub_count)
+{
+    loopback_client_t *client = (loopback_client_t *)mqtt_handle;
+    uint32_t i;
+    uint32_t s;
+
+    cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+    if (!client->connected)
+    {
+        cy_rtos_set_mutex(&g_loopback.mutex);
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    for (i = 0; i < unsub_count; i++)
+    {
+        for (s = 0; s < client->num_subs; s++)
+        {
+            if ((strlen(client->subs[s]) == unsub_info[i].topic_len) &&
+                (memcmp(client->subs[s], unsub_info[i].topic, unsub_info[i].topic_len) == 0))
+            {
+                client->num_subs--;
+                memcpy(client->subs[s], client->subs[client->num_subs], sizeof(client->subs[s]));
+                client->sub_qos[s] = client->sub_qos[client->num_subs];
+                break;
+            }
+        }
+    }
+    cy_rtos_set_mutex(&g_loopback.mutex);
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Hand messages and disconnects to the client event callbacks in the order
+ * they are due, sleeping until the first one is. A delivery queued for a
+ * client that was destroyed, or whose slot was taken by a new client since,
+ * is discarded. The callbacks run without the mutex; destroy waits for a
+ * running callback of its client.
+ */
+static void loopback_thread(cy_thread_arg_t arg)
+{
+    loopback_delivery_t *delivery;
+    loopback_client_t *client;
+    cy_mqtt_callback_t callback;
+    void *user_data;
+    cy_mqtt_event_t event;
+    cy_time_t now;
+    uint32_t latency;
+    uint32_t wait;
+
+    for (;;)
+    {
+        cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+        delivery = g_loopback.pending;
+        cy_rtos_get_time(&now);
+        if ((delivery == NULL) || ((int32_t)(delivery->due - now) > 0))
+        {
+            wait = delivery != NULL ? delivery->due - now : CY_RTOS_NEVER_TIMEOUT;
+            cy_rtos_set_mutex(&g_loopback.mutex);
+            cy_rtos_get_semaphore(&g_loopback.wake, wait, false);
+            continue;
+        }
+        g_loopback.pending = delivery->next;
+        g_loopback.num_pending--;
+
+        client = delivery->client;
+        callback = NULL;
+        memset(&event, 0, sizeof(event));
+        event.type = delivery->type;
+        if (!client->used || (client->generation != delivery->generation) || (client->callback == NULL))
+        {
+            /* The client went away in the meantime. */
+        }
+        else if (delivery->type == CY_MQTT_EVENT_TYPE_DISCONNECT)
+        {
+            event.data.reason = CY_MQTT_DISCONN_TYPE_BROKER_DOWN;
+            callback = client->callback;
+        }
+        else if (client->connected)
+        {
+            event.data.pub_msg.received_message.qos = delivery->qos;
+            event.data.pub_msg.received_message.topic = delivery->data;
+            event.data.pub_msg.received_message.topic_len = delivery->topic_len;
+            event.data.pub_msg.received_message.payload = &delivery->data[delivery->topic_len + 1];
+            event.data.pub_msg.received_message.payload_len = delivery->payload_len;
+            callback = client->callback;
+        }
+        user_data = client->user_data;
+        g_loopback.calling = callback != NULL ? client : NULL;
+        cy_rtos_set_mutex(&g_loopback.mutex);
+
+        if (callback != NULL)
+        {
+            callback((cy_mqtt_t)client, event, user_data);
+            latency = at_cmd_refapp_trace_clock() - delivery->stamp;
+
+            cy_rtos_get_mutex(&g_loopback.mutex, CY_RTOS_NEVER_TIMEOUT);
+            g_loopback.calling = NULL;
+            if (delivery->type != CY_MQTT_EVENT_TYPE_DISCONNECT)
+            {
+                g_loopback.delivered++;
+                g_loopback.delivery_total += latency;
+                g_loopback.delivery_max = latency > g_loopback.delivery_max ? latency : g_loopback.delivery_max;
+            }
+            cy_rtos_set_mutex(&g_loopback.mutex);
+        }
+        free(delivery);
+    }
+}
+
+#endif /* AT_CMD_REF_APP_BENCH_ENABLE */
+
+/* [] END OF FILE */
@@ -0,0 +1,1616 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+/**
+ * @file at_cmd_refapp_sys_handler.c
+ * @brief Main file for the SYS handler: command latency tracing and runtime
+ *        statistics.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#include "cyhal.h"
+#include "tx_api.h"
+#include "at_command_parser.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_SYS
+#include "at_cmd_refapp.h"
+
+#if defined(__GNUC__) && !defined(__ARMCC_VERSION)
+#include <malloc.h>
+#define SYS_HEAP_STATS_SUPPORTED
+#endif
+
+/*
+ * ThreadX fills unused stack with this pattern when a thread is created.
+ */
+#ifndef TX_STACK_FILL
+#define TX_STACK_FILL ((ULONG)0xEFEFEFEFUL)
+#endif
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+static uint32_t trace_default_clock(void);
+static uint32_t trace_rtos_clock(void);
+static bool sys_heap_sample(uint32_t *size, uint32_t *free_bytes);
+static bool sys_lock_scheduler(UINT *old_threshold);
+static void sys_unlock_scheduler(UINT old_threshold);
+static void sys_baud_timer_cb(cy_timer_callback_arg_t arg);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+
+/*
+ * Names of the intervals between two consecutive trace stamps.
+ */
+static const char *trace_interval_names[AT_CMD_REF_APP_TRACE_NUM_STAMPS - 1] =
+    {
+        SYS_TOKEN_PARSE,
+        SYS_TOKEN_QUEUE,
+        SYS_TOKEN_EXECUTE,
+        SYS_TOKEN_RESPOND};
+
+/*
+ * Upper bounds in us of the latency histogram buckets, the last bucket
+ * counts everything above.
+ */
+static const uint32_t trace_bucket_limits[AT_CMD_REF_APP_TRACE_BUCKETS - 1] =
+    {
+        1000, 4000, 16000, 64000, 256000, 1024000, 4096000};
+
+/*
+ * Messages in flight, found by message pointer. A slot is claimed by the
+ * parse stamp and released when the message is completed. The trace is
+ * updated from timer callbacks as well, so it is guarded by a critical
+ * section rather than a mutex.
+ */
+typedef struct
+{
+    const at_cmd_msg_base_t *msg;
+    uint32_t cmd_id;
+    uint32_t time[AT_CMD_REF_APP_TRACE_NUM_STAMPS];
+} trace_slot_t;
+
+/*
+ * Latency statistics per cmd_id. Each entry takes 52 bytes, 48 command ids
+ * use 2.5 KB of static RAM.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t total[AT_CMD_REF_APP_TRACE_NUM_STAMPS - 1];
+    uint32_t max[AT_CMD_REF_APP_TRACE_NUM_STAMPS - 1];
+    uint16_t histogram[AT_CMD_REF_APP_TRACE_BUCKETS];
+} trace_stats_t;
+
+static struct
+{
+    bool initialized;
+    at_cmd_refapp_trace_clock_t clock;
+    trace_slot_t slots[AT_CMD_REF_APP_TRACE_SLOTS];
+    trace_stats_t stats[AT_CMD_REF_APP_TRACE_MAX_CMD_ID];
+} g_trace;
+
+/*
+ * Runtime statistics reported by SYS_Stats. Counters are updated from the
+ * parser, client_task, WCM and MQTT threads and timer callbacks, under the
+ * same critical section as the trace.
+ */
+static struct
+{
+    cy_queue_t *msgq;
+    uint32_t queue_max_depth;
+    uint32_t drops;
+    uint32_t busy;
+    uint32_t credits_max_in_use;
+    uint32_t heap_sampled_min_free;
+    uint32_t commands[AT_CMD_REF_APP_SYS_MAX_CMD_ID];
+    uint32_t events[AT_CMD_REF_APP_SYS_MAX_CMD_ID];
+    uint32_t cmd_drops[AT_CMD_REF_APP_SYS_MAX_CMD_ID];
+} g_stats;
+
+static const uint32_t sys_baud_rates[] = AT_CMD_REF_APP_UART_BAUD_RATES;
+
+/*
+ * SYS_SetBaud handshake, run in client_task. A switch is pending from the
+ * SYS_SetBaud response until the host confirms the new rate or the timer
+ * restores the old one. The timer callback takes revert_msg, so it is
+ * exchanged under a critical section.
+ */
+static struct
+{
+    bool pending;
+    uint32_t old_baud;
+    uint32_t actual;
+    cy_timer_t timer;
+    at_cmd_ref_app_sys_baud_t *revert_msg;
+} g_baud;
+
+/*
+ * Default trace clock. The DWT cycle count is scaled to us; the RTOS time
+ * catches gaps longer than half a cycle counter wrap.
+ */
+static struct
+{
+    bool cycles;
+    uint32_t cycles_per_us;
+    uint32_t last_cycles;
+    uint32_t last_ms;
+    uint32_t remainder;
+    uint32_t us;
+} g_trace_clock;
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/**
+ * Initialize the SYS module
+ */
+cy_rslt_t at_cmd_refapp_sys_init(cy_queue_t *msgq)
+{
+    uint32_t heap_size;
+    uint32_t heap_free;
+
+    g_stats.msgq = msgq;
+    sys_heap_sample(&heap_size, &heap_free);
+    g_stats.heap_sampled_min_free = heap_free;
+
+#if defined(DWT_CTRL_CYCCNTENA_Msk) && defined(CoreDebug_DEMCR_TRCENA_Msk)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    g_trace_clock.cycles_per_us = SystemCoreClock / 1000000;
+    g_trace_clock.last_cycles = DWT->CYCCNT;
+    g_trace_clock.us = trace_rtos_clock();
+    g_trace_clock.last_ms = g_trace_clock.us / 1000;
+    g_trace_clock.cycles = ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0) && (SystemCoreClock >= 1000000);
+#endif
+    if (!g_trace_clock.cycles)
+    {
+        AT_CMD_REFAPP_LOG_MSG(("No cycle counter, trace times have ms resolution\n"));
+    }
+    if (g_trace.clock == NULL)
+    {
+        g_trace.clock = trace_default_clock;
+    }
+    g_trace.initialized = true;
+
+    at_cmd_refapp_keys_init();
+
+    if (cy_rtos_init_timer(&g_baud.timer, CY_TIMER_TYPE_ONCE, sys_baud_timer_cb, 0) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("SYS_SetBaud timer init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * RTOS time in us, with ms resolution.
+ */
+static uint32_t trace_rtos_clock(void)
+{
+    cy_time_t now;
+
+    cy_rtos_get_time(&now);
+    return (uint32_t)now * 1000;
+}
+
+/*
+ * Free running us from the DWT cycle counter, which wraps every 2^32 cycles
+ * (22 s at 192 MHz): the cycles since the last reading are added up, and if
+ * the RTOS time shows that the counter may have wrapped meanwhile the RTOS
+ * time is used for that gap. Falls back to the RTOS time without a cycle
+ * counter.
+ */
+static uint32_t trace_default_clock(void)
+{
+#if defined(DWT_CTRL_CYCCNTENA_Msk) && defined(CoreDebug_DEMCR_TRCENA_Msk)
+    uint64_t cycles;
+    cy_time_t now;
+    uint32_t wrap_ms;
+    uint32_t irq;
+    uint32_t us;
+
+    if (!g_trace_clock.cycles)
+    {
+        return trace_rtos_clock();
+    }
+
+    wrap_ms = (uint32_t)(((uint64_t)1 << 32) / (g_trace_clock.cycles_per_us * 1000));
+
+    irq = cyhal_system_critical_section_enter();
+    cy_rtos_get_time(&now);
+    cycles = (uint32_t)(DWT->CYCCNT - g_trace_clock.last_cycles);
+    g_trace_clock.last_cycles += (uint32_t)cycles;
+    if ((uint32_t)now - g_trace_clock.last_ms > wrap_ms / 2)
+    {
+        g_trace_clock.us += ((uint32_t)now - g_trace_clock.last_ms) * 1000;
+        g_trace_clock.remainder = 0;
+    }
+    else
+    {
+        cycles += g_trace_clock.remainder;
+        g_trace_clock.us += (uint32_t)(cycles / g_trace_clock.cycles_per_us);
+        g_trace_clock.remainder = (uint32_t)(cycles % g_trace_clock.cycles_per_us);
+    }
+    g_trace_clock.last_ms = now;
+    us = g_trace_clock.us;
+    cyhal_system_critical_section_exit(irq);
+
+    return us;
+#else
+    return trace_rtos_clock();
+#endif
+}
+
+/**
+ * Install the clock used for the trace stamps
+ */
+void at_cmd_refapp_trace_set_clock(at_cmd_refapp_trace_clock_t clock)
+{
+    g_trace.clock = clock != NULL ? clock : trace_default_clock;
+}
+
+/**
+ * Read the trace clock
+ */
+uint32_t at_cmd_refapp_trace_clock(void)
+{
+    return g_trace.clock != NULL ? g_trace.clock() : trace_default_clock();
+}
+
+/*
+ * Find the slot of msg. Called in the trace critical section.
+ */
+static trace_slot_t *trace_find_slot(const at_cmd_msg_base_t *msg)
+{
+    uint32_t i;
+
+    for (i = 0; i < AT_CMD_REF_APP_TRACE_SLOTS; i++)
+    {
+        if (g_trace.slots[i].msg == msg)
+        {
+            return &g_trace.slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Record the time a message reached a processing stage
+ */
+void at_cmd_refapp_trace_stamp(const at_cmd_msg_base_t *msg, at_cmd_ref_app_trace_stamp_t stamp, uint32_t time)
+{
+    trace_slot_t *slot;
+    trace_slot_t *oldest = NULL;
+    uint32_t irq;
+    uint32_t i;
+
+    if ((!g_trace.initialized) || (msg == NULL) || (stamp >= AT_CMD_REF_APP_TRACE_NUM_STAMPS))
+    {
+        return;
+    }
+
+    irq = cyhal_system_critical_section_enter();
+
+    slot = trace_find_slot(msg);
+    if (stamp == AT_CMD_REF_APP_TRACE_PARSE)
+    {
+        /*
+         * A new message. Reuse a stale slot of the same address, else a free
+         * slot, else the one in flight the longest (its message was lost).
+         */
+        for (i = 0; (slot == NULL) && (i < AT_CMD_REF_APP_TRACE_SLOTS); i++)
+        {
+            if (g_trace.slots[i].msg == NULL)
+            {
+                slot = &g_trace.slots[i];
+            }
+            else if ((oldest == NULL) || ((int32_t)(g_trace.slots[i].time[0] - oldest->time[0]) < 0))
+            {
+                oldest = &g_trace.slots[i];
+            }
+        }
+        slot = slot != NULL ? slot : oldest;
+        slot->msg = msg;
+        slot->cmd_id = msg->cmd_id;
+        for (i = 0; i < AT_CMD_REF_APP_TRACE_NUM_STAMPS; i++)
+        {
+            slot->time[i] = time;
+        }
+    }
+    else if (slot != NULL)
+    {
+        /*
+         * Stamps not taken, e.g. the parse stamp of events, count as zero time.
+         */
+        for (i = stamp; i < AT_CMD_REF_APP_TRACE_NUM_STAMPS; i++)
+        {
+            slot->time[i] = time;
+        }
+    }
+
+    cyhal_system_critical_section_exit(irq);
+}
+
+/**
+ * Forget a message that will not be processed
+ */
+void at_cmd_refapp_trace_cancel(const at_cmd_msg_base_t *msg)
+{
+    trace_slot_t *slot;
+    uint32_t irq;
+
+    if (!g_trace.initialized)
+    {
+        return;
+    }
+
+    irq = cyhal_system_critical_section_enter();
+    slot = trace_find_slot(msg);
+    if (slot != NULL)
+    {
+        slot->msg = NULL;
+    }
+    cyhal_system_critical_section_exit(irq);
+}
+
+/**
+ * Stamp the response time and add the message latency to the statistics
+ */
+void at_cmd_refapp_trace_complete(const at_cmd_msg_base_t *msg)
+{
+    trace_slot_t *slot;
+    trace_stats_t *stats;
+    uint32_t now;
+    uint32_t interval;
+    uint32_t irq;
+    uint32_t i;
+
+    if (!g_trace.initialized)
+    {
+        return;
+    }
+    now = at_cmd_refapp_trace_clock();
+
+    irq = cyhal_system_critical_section_enter();
+
+    slot = trace_find_slot(msg);
+    if (slot != NULL)
+    {
+        slot->time[AT_CMD_REF_APP_TRACE_RESPOND] = now;
+        if (slot->cmd_id < AT_CMD_REF_APP_TRACE_MAX_CMD_ID)
+        {
+            stats = &g_trace.stats[slot->cmd_id];
+            stats->count++;
+            for (i = 0; i < AT_CMD_REF_APP_TRACE_NUM_STAMPS - 1; i++)
+            {
+                interval = slot->time[i + 1] - slot->time[i];
+                stats->total[i] += interval;
+                stats->max[i] = interval > stats->max[i] ? interval : stats->max[i];
+            }
+
+            interval = now - slot->time[AT_CMD_REF_APP_TRACE_PARSE];
+            for (i = 0; (i < AT_CMD_REF_APP_TRACE_BUCKETS - 1) && (interval >= trace_bucket_limits[i]); i++)
+            {
+            }
+            if (stats->histogram[i] < 0xFFFF)
+            {
+                stats->histogram[i]++;
+            }
+        }
+        slot->msg = NULL;
+    }
+
+    cyhal_system_critical_section_exit(irq);
+}
+
+/*
+ * Keep threads from being created or deleted while the thread list is walked.
+ * Returns false if the kernel is built without preemption threshold.
+ */
+static bool sys_lock_scheduler(UINT *old_threshold)
+{
+    return tx_thread_preemption_change(tx_thread_identify(), 0, old_threshold) == TX_SUCCESS;
+}
+
+static void sys_unlock_scheduler(UINT old_threshold)
+{
+    UINT threshold;
+
+    tx_thread_preemption_change(tx_thread_identify(), old_threshold, &threshold);
+}
+
+/*
+ * Heap size and free heap from the allocator's own statistics. With newlib
+ * the size is the heap claimed from the system so far, which grows on
+ * demand. Returns false if the allocator keeps no statistics.
+ */
+static bool sys_heap_sample(uint32_t *size, uint32_t *free_bytes)
+{
+#if defined(AT_CMD_REF_APP_SYS_HEAP_POOL)
+    ULONG available = 0;
+
+    tx_byte_pool_info_get(AT_CMD_REF_APP_SYS_HEAP_POOL, TX_NULL, &available, TX_NULL, TX_NULL, TX_NULL, TX_NULL);
+    *size = (uint32_t)(AT_CMD_REF_APP_SYS_HEAP_POOL)->tx_byte_pool_size;
+    *free_bytes = (uint32_t)available;
+    return true;
+#elif defined(SYS_HEAP_STATS_SUPPORTED)
+    struct mallinfo info = mallinfo();
+
+    *size = (uint32_t)info.arena;
+    *free_bytes = (uint32_t)(info.arena - info.uordblks);
+    return true;
+#else
+    *size = 0;
+    *free_bytes = 0;
+    return false;
+#endif
+}
+
+/**
+ * Heap in use, for the benchmark heap peak
+ */
+uint32_t at_cmd_refapp_sys_heap_used(void)
+{
+    uint32_t size;
+    uint32_t free_bytes;
+
+    sys_heap_sample(&size, &free_bytes);
+    return size - free_bytes;
+}
+
+/*
+ * Bytes of the thread stack written since the thread was created. Stacks
+ * grow down, the untouched part of the fill is at the start. Only the kernel
+ * fills stacks, other threads' stacks are never written here.
+ */
+static uint32_t sys_stack_used(TX_THREAD *thread)
+{
+    ULONG *word = (ULONG *)thread->tx_thread_stack_start;
+    ULONG *end = (ULONG *)thread->tx_thread_stack_end;
+
+    while ((word < end) && (*word == TX_STACK_FILL))
+    {
+        word++;
+    }
+    return (uint32_t)((uint8_t *)thread->tx_thread_stack_end - (uint8_t *)word) + 1;
+}
+
+/**
+ * Count a command, event, dropped message or command rejected as busy
+ */
+void at_cmd_refapp_sys_stats_count(uint32_t cmd_id, at_cmd_ref_app_sys_count_t type)
+{
+    size_t depth = 0;
+    uint32_t in_use;
+    uint32_t irq;
+
+    if ((type != AT_CMD_REF_APP_SYS_COUNT_COMMAND) && (g_stats.msgq != NULL))
+    {
+        cy_rtos_queue_count(g_stats.msgq, &depth);
+    }
+    in_use = at_cmd_refapp_credits_in_use();
+
+    irq = cyhal_system_critical_section_enter();
+    if (cmd_id < AT_CMD_REF_APP_SYS_MAX_CMD_ID)
+    {
+        switch (type)
+        {
+        case AT_CMD_REF_APP_SYS_COUNT_COMMAND:
+            g_stats.commands[cmd_id]++;
+            break;
+        case AT_CMD_REF_APP_SYS_COUNT_EVENT:
+            g_stats.events[cmd_id]++;
+            break;
+        case AT_CMD_REF_APP_SYS_COUNT_DROP:
+            g_stats.cmd_drops[cmd_id]++;
+            break;
+        case AT_CMD_REF_APP_SYS_COUNT_BUSY:
+            break;
+        }
+    }
+    if (type == AT_CMD_REF_APP_SYS_COUNT_DROP)
+    {
+        g_stats.drops++;
+    }
+    else if (type == AT_CMD_REF_APP_SYS_COUNT_BUSY)
+    {
+        g_stats.busy++;
+    }
+    g_stats.credits_max_in_use = in_use > g_stats.credits_max_in_use ? in_use : g_stats.credits_max_in_use;
+    g_stats.queue_max_depth = depth > g_stats.queue_max_depth ? depth : g_stats.queue_max_depth;
+    cyhal_system_critical_section_exit(irq);
+}
+
+/**
+ * Sample the queue depth when a message is dispatched. The heap is only
+ * sampled by SYS_Stats, mallinfo walks the free list and is too slow for
+ * every message.
+ */
+void at_cmd_refapp_sys_stats_dispatch(void)
+{
+    size_t depth = 0;
+    uint32_t irq;
+
+    if (g_stats.msgq != NULL)
+    {
+        cy_rtos_queue_count(g_stats.msgq, &depth);
+    }
+
+    /* The dispatched message was in the queue as well. */
+    depth++;
+
+    irq = cyhal_system_critical_section_enter();
+    g_stats.queue_max_depth = depth > g_stats.queue_max_depth ? depth : g_stats.queue_max_depth;
+    cyhal_system_critical_section_exit(irq);
+}
+
+/**
+ * Messages dropped since the last reset
+ */
+uint32_t at_cmd_refapp_sys_stats_drops(void)
+{
+    return g_stats.drops;
+}
+
+/**
+ * Messages waiting in the command queue
+ */
+uint32_t at_cmd_refapp_sys_queue_depth(void)
+{
+    size_t depth = 0;
+
+    if (g_stats.msgq != NULL)
+    {
+        cy_rtos_queue_count(g_stats.msgq, &depth);
+    }
+    return (uint32_t)depth;
+}
+
+/*
+ * Collect the SYS_Stats host message, optionally resetting the statistics.
+ */
+static at_cmd_ref_app_sys_stats_info_t *sys_stats_collect(at_cmd_ref_app_sys_stats_t *request)
+{
+    at_cmd_ref_app_sys_stats_info_t *info;
+    TX_THREAD *current = tx_thread_identify();
+    TX_THREAD *thread;
+    size_t depth = 0;
+    UINT threshold = 0;
+    bool locked;
+    uint32_t irq;
+
+    info = (at_cmd_ref_app_sys_stats_info_t *)calloc(1, sizeof(at_cmd_ref_app_sys_stats_info_t));
+    if (info == NULL)
+    {
+        return NULL;
+    }
+    memcpy(&info->base, &request->base, sizeof(at_cmd_msg_base_t));
+
+    if (g_stats.msgq != NULL)
+    {
+        cy_rtos_queue_count(g_stats.msgq, &depth);
+    }
+
+    /* Taken before the scheduler is locked, the allocator has its own lock. */
+    info->heap_valid = sys_heap_sample(&info->heap_size, &info->heap_free);
+
+    locked = sys_lock_scheduler(&threshold);
+
+    /*
+     * Walk the list of created threads. Threads are not created or deleted
+     * while the scheduler is locked.
+     */
+    thread = current;
+    do
+    {
+        if (info->num_threads < AT_CMD_REF_APP_SYS_MAX_THREADS)
+        {
+            strncpy(info->threads[info->num_threads].name, thread->tx_thread_name != NULL ? thread->tx_thread_name : "",
+                    sizeof(info->threads[0].name) - 1);
+            info->threads[info->num_threads].stack_size = (uint32_t)thread->tx_thread_stack_size;
+            info->threads[info->num_threads].max_used = sys_stack_used(thread);
+            info->num_threads++;
+        }
+        thread = thread->tx_thread_created_next;
+    } while ((thread != NULL) && (thread != current));
+
+    if (locked)
+    {
+        sys_unlock_scheduler(threshold);
+    }
+
+    irq = cyhal_system_critical_section_enter();
+    info->queue_depth = (uint32_t)depth;
+    info->queue_max_depth = g_stats.queue_max_depth;
+    info->drops = g_stats.drops;
+    info->log_drops = at_cmd_refapp_log_get_drops();
+    info->credits_in_use = at_cmd_refapp_credits_in_use();
+    info->credits_max_in_use = g_stats.credits_max_in_use;
+    info->busy = g_stats.busy;
+    at_cmd_refapp_msg_pool_stats(&info->msg_pool, request->reset);
+    info->heap_sampled_min_free = info->heap_free < g_stats.heap_sampled_min_free ? info->heap_free : g_stats.heap_sampled_min_free;
+    memcpy(info->commands, g_stats.commands, sizeof(info->commands));
+    memcpy(info->events, g_stats.events, sizeof(info->events));
+    memcpy(info->cmd_drops, g_stats.cmd_drops, sizeof(info->cmd_drops));
+    if (request->reset)
+    {
+        g_stats.queue_max_depth = depth;
+        g_stats.drops = 0;
+        g_stats.busy = 0;
+        g_stats.credits_max_in_use = info->credits_in_use;
+        g_stats.heap_sampled_min_free = info->heap_free;
+        memset(g_stats.commands, 0, sizeof(g_stats.commands));
+        memset(g_stats.events, 0, sizeof(g_stats.events));
+        memset(g_stats.cmd_drops, 0, sizeof(g_stats.cmd_drops));
+    }
+    cyhal_system_critical_section_exit(irq);
+
+    return info;
+}
+
+/*
+ * Parse the optional {"reset":true} argument of the SYS commands.
+ */
+static bool sys_parse_reset(uint32_t cmd_len, char *cmd, bool *reset)
+{
+    cJSON *json;
+
+    *reset = false;
+    if ((cmd_len == 0) || (cmd == NULL) || (cmd[0] == '\0'))
+    {
+        return true;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS command arguments\n"));
+        return false;
+    }
+    *reset = cJSON_IsTrue(cJSON_GetObjectItem(json, SYS_TOKEN_RESET));
+    cJSON_Delete(json);
+    return true;
+}
+
+/*
+ * Parse the {"format":"compact","version":1} argument of SYS_SetFormat.
+ */
+static bool sys_parse_format(uint32_t cmd_len, char *cmd, at_cmd_ref_app_sys_format_t *format)
+{
+    cJSON *json;
+    cJSON *item;
+    bool valid = true;
+
+    if ((cmd_len == 0) || (cmd == NULL))
+    {
+        return false;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS_SetFormat arguments\n"));
+        return false;
+    }
+
+    item = cJSON_GetObjectItem(json, SYS_TOKEN_FORMAT);
+    if (cJSON_IsString(item) && (strcmp(item->valuestring, SYS_TOKEN_COMPACT) == 0))
+    {
+        format->compact = true;
+    }
+    else if (!cJSON_IsString(item) || (strcmp(item->valuestring, SYS_TOKEN_VERBOSE) != 0))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("SYS_SetFormat: unknown format\n"));
+        valid = false;
+    }
+
+    item = cJSON_GetObjectItem(json, SYS_TOKEN_VERSION);
+    if (cJSON_IsNumber(item) && (item->valuedouble > 0))
+    {
+        format->version = (uint32_t)item->valuedouble;
+    }
+
+    cJSON_Delete(json);
+    return valid;
+}
+
+/*
+ * Parse the {"baud":921600,"timeout":2000} or {"confirm":true} argument of SYS_SetBaud.
+ */
+static bool sys_parse_baud(uint32_t cmd_len, char *cmd, at_cmd_ref_app_sys_baud_t *baud)
+{
+    cJSON *json;
+    cJSON *item;
+    bool valid = true;
+
+    if ((cmd_len == 0) || (cmd == NULL))
+    {
+        return false;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS_SetBaud arguments\n"));
+        return false;
+    }
+
+    baud->confirm = cJSON_IsTrue(cJSON_GetObjectItem(json, SYS_TOKEN_CONFIRM));
+    if (!baud->confirm)
+    {
+        item = cJSON_GetObjectItem(json, SYS_TOKEN_BAUD);
+        if (cJSON_IsNumber(item) && (item->valuedouble >= 1))
+        {
+            baud->baud = (uint32_t)item->valuedouble;
+        }
+        else
+        {
+            AT_CMD_REFAPP_LOG_ERR(("SYS_SetBaud: missing baud\n"));
+            valid = false;
+        }
+
+        baud->timeout = AT_CMD_REF_APP_UART_CONFIRM_TIMEOUT_MS;
+        item = cJSON_GetObjectItem(json, SYS_TOKEN_TIMEOUT);
+        if (cJSON_IsNumber(item))
+        {
+            if ((item->valuedouble < 1) || (item->valuedouble > AT_CMD_REF_APP_UART_MAX_CONFIRM_TIMEOUT_MS))
+            {
+                AT_CMD_REFAPP_LOG_ERR(("SYS_SetBaud: invalid timeout\n"));
+                valid = false;
+            }
+            baud->timeout = (uint32_t)item->valuedouble;
+        }
+    }
+
+    cJSON_Delete(json);
+    return valid;
+}
+
+/*
+ * Parse the {"transport":"tcp","port":5000} argument of SYS_SetTransport.
+ */
+static bool sys_parse_transport(uint32_t cmd_len, char *cmd, at_cmd_ref_app_sys_transport_t *transport)
+{
+    cJSON *json;
+    cJSON *item;
+    bool valid = true;
+
+    if ((cmd_len == 0) || (cmd == NULL))
+    {
+        return false;
+    }
+
+    json = cJSON_Parse(cmd);
+    if (!json)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error parsing the SYS_SetTransport arguments\n"));
+        return false;
+    }
+
+    item = cJSON_GetObjectItem(json, SYS_TOKEN_TRANSPORT);
+    if (cJSON_IsString(item) && (strcmp(item->valuestring, AT_CMD_REF_APP_TRANSPORT_TCP) == 0))
+    {
+        transport->tcp = true;
+    }
+    else if (!cJSON_IsString(item) || (strcmp(item->valuestring, at_cmd_refapp_transport_default_name()) != 0))
+    {
+        AT_CMD_REFAPP_LOG_ERR(("SYS_SetTransport: unknown transport\n"));
+        valid = false;
+    }
+
+    transport->port = AT_CMD_REF_APP_TRANSPORT_TCP_PORT;
+    item = cJSON_GetObjectItem(json, SYS_TOKEN_PORT);
+    if (cJSON_IsNumber(item))
+    {
+        if ((item->valuedouble < 1) || (item->valuedouble > 65535))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("SYS_SetTransport: invalid port\n"));
+            valid = false;
+        }
+        transport->port = (uint32_t)item->valuedouble;
+    }
+
+    cJSON_Delete(json);
+    return valid;
+}
+
+/**
+ * Parse the SYS commands and get individual elements of structure
+ */
+at_cmd_msg_base_t *at_cmd_refapp_parse_sys_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_len, char *cmd)
+{
+    at_cmd_msg_base_t *msg = NULL;
+    at_cmd_ref_app_sys_trace_t *trace;
+    at_cmd_ref_app_sys_stats_t *stats;
+    at_cmd_ref_app_sys_format_t *format;
+    at_cmd_ref_app_sys_baud_t *baud;
+    at_cmd_ref_app_sys_transport_t *transport;
+
+    switch (cmd_id)
+    {
+    case CMD_ID_SYS_TRACE:
+        trace = calloc(1, sizeof(at_cmd_ref_app_sys_trace_t));
+        if (trace == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS trace message\n"));
+            break;
+        }
+
+        /*
+         * Arguments are optional, {"reset":true} clears the statistics after the dump.
+         */
+        if (!sys_parse_reset(cmd_len, cmd, &trace->reset))
+        {
+            free(trace);
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)trace;
+        break;
+
+    case CMD_ID_SYS_STATS:
+        stats = calloc(1, sizeof(at_cmd_ref_app_sys_stats_t));
+        if (stats == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS stats message\n"));
+            break;
+        }
+        if (!sys_parse_reset(cmd_len, cmd, &stats->reset))
+        {
+            free(stats);
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)stats;
+        break;
+
+    case CMD_ID_SYS_SET_FORMAT:
+        format = calloc(1, sizeof(at_cmd_ref_app_sys_format_t));
+        if (format == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS format message\n"));
+            break;
+        }
+        if (!sys_parse_format(cmd_len, cmd, format))
+        {
+            free(format);
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)format;
+        break;
+
+    case CMD_ID_SYS_SET_BAUD:
+        baud = calloc(1, sizeof(at_cmd_ref_app_sys_baud_t));
+        if (baud == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS baud message\n"));
+            break;
+        }
+        if (!sys_parse_baud(cmd_len, cmd, baud))
+        {
+            free(baud);
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)baud;
+        break;
+
+    case CMD_ID_SYS_SET_TRANSPORT:
+        transport = calloc(1, sizeof(at_cmd_ref_app_sys_transport_t));
+        if (transport == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating SYS transport message\n"));
+            break;
+        }
+        if (!sys_parse_transport(cmd_len, cmd, transport))
+        {
+            free(transport);
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)transport;
+        break;
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    case CMD_ID_SYS_BENCH:
+        msg = at_cmd_refapp_bench_parse(cmd_len, cmd);
+        break;
+
+    case CMD_ID_SYS_MICROBENCH:
+        msg = at_cmd_refapp_bench_parse_micro(cmd_len, cmd);
+        break;
+#endif
+
+    default:
+        AT_CMD_REFAPP_LOG_ERR(("Unimplemented cmd \n"));
+        break;
+    }
+
+    if (msg)
+    {
+        /*
+         * Set the message header fields.
+         */
+        msg->cmd_id = cmd_id;
+        msg->serial = serial;
+    }
+
+    return msg;
+}
+
+/*
+ * Take the message restoring the old rate from the timer.
+ */
+static at_cmd_ref_app_sys_baud_t *sys_baud_take_revert(void)
+{
+    at_cmd_ref_app_sys_baud_t *revert;
+    uint32_t irq;
+
+    irq = cyhal_system_critical_section_enter();
+    revert = g_baud.revert_msg;
+    g_baud.revert_msg = NULL;
+    cyhal_system_critical_section_exit(irq);
+    return revert;
+}
+
+/*
+ * The host did not confirm the new rate in time, have client_task restore
+ * the old one. A full queue is retried, the UART must not be left at a rate
+ * the host may not reach.
+ */
+static void sys_baud_timer_cb(cy_timer_callback_arg_t arg)
+{
+    at_cmd_ref_app_sys_baud_t *revert = sys_baud_take_revert();
+    uint32_t irq;
+
+    (void)arg;
+
+    if (revert == NULL)
+    {
+        return;
+    }
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)revert) != CY_RSLT_SUCCESS)
+    {
+        irq = cyhal_system_critical_section_enter();
+        g_baud.revert_msg = revert;
+        cyhal_system_critical_section_exit(irq);
+        cy_rtos_start_timer(&g_baud.timer, AT_CMD_REF_APP_UART_REVERT_RETRY_MS);
+    }
+}
+
+/*
+ * Start or confirm a rate change. The switch itself is queued so it runs
+ * after the SYS_SetBaud response went out at the old rate.
+ */
+static const char *sys_baud_request(at_cmd_ref_app_sys_baud_t *request)
+{
+    at_cmd_ref_app_sys_baud_t *rate_switch;
+    at_cmd_ref_app_sys_baud_t *revert;
+    uint32_t i;
+
+    if (request->confirm)
+    {
+        if (!g_baud.pending)
+        {
+            return "no-baud-change";
+        }
+
+        /*
+         * The confirmation came in at the new rate. A revert the timer
+         * already queued finds nothing pending and is dropped.
+         */
+        cy_rtos_stop_timer(&g_baud.timer);
+        free(sys_baud_take_revert());
+        g_baud.pending = false;
+        request->baud = at_cmd_refapp_transport_get_baud();
+        request->actual = g_baud.actual;
+        return NULL;
+    }
+
+    if (at_cmd_refapp_transport_get_baud() == 0)
+    {
+        /* The SDIO and TCP transports have no rate to change. */
+        return "not-supported";
+    }
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    if (at_cmd_refapp_bench_active())
+    {
+        return "busy";
+    }
+#endif
+    if (g_baud.pending)
+    {
+        return "baud-change-in-progress";
+    }
+    for (i = 0; i < sizeof(sys_baud_rates) / sizeof(sys_baud_rates[0]); i++)
+    {
+        if (sys_baud_rates[i] == request->baud)
+        {
+            break;
+        }
+    }
+    if (i == sizeof(sys_baud_rates) / sizeof(sys_baud_rates[0]))
+    {
+        return "unsupported-baud";
+    }
+
+    rate_switch = malloc(sizeof(at_cmd_ref_app_sys_baud_t));
+    revert = malloc(sizeof(at_cmd_ref_app_sys_baud_t));
+    if ((rate_switch == NULL) || (revert == NULL))
+    {
+        free(rate_switch);
+        free(revert);
+        return "memory error";
+    }
+    memcpy(rate_switch, request, sizeof(at_cmd_ref_app_sys_baud_t));
+    rate_switch->base.cmd_id = CMD_ID_HOST_SYS_BAUD_SWITCH;
+    memcpy(revert, request, sizeof(at_cmd_ref_app_sys_baud_t));
+    revert->base.cmd_id = CMD_ID_HOST_SYS_BAUD_REVERT;
+    revert->baud = at_cmd_refapp_transport_get_baud();
+
+    g_baud.old_baud = revert->baud;
+    g_baud.revert_msg = revert;
+    g_baud.pending = true;
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)rate_switch) != CY_RSLT_SUCCESS)
+    {
+        g_baud.pending = false;
+        free(sys_baud_take_revert());
+        free(rate_switch);
+        return "busy";
+    }
+    return NULL;
+}
+
+/*
+ * Listen for a TCP client, or go back to the transport of the build. Closing
+ * is queued so the response still goes out on the TCP client.
+ */
+static const char *sys_transport_request(at_cmd_ref_app_sys_transport_t *request)
+{
+    at_cmd_ref_app_sys_transport_t *close_msg;
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    if (at_cmd_refapp_bench_active())
+    {
+        return "busy";
+    }
+#endif
+    if (g_baud.pending)
+    {
+        return "baud-change-in-progress";
+    }
+
+    if (request->tcp)
+    {
+        if (at_cmd_refapp_transport_listen((uint16_t)request->port) != CY_RSLT_SUCCESS)
+        {
+            return "listen-failed";
+        }
+        return NULL;
+    }
+
+    close_msg = malloc(sizeof(at_cmd_ref_app_sys_transport_t));
+    if (close_msg == NULL)
+    {
+        return "memory error";
+    }
+    memcpy(close_msg, request, sizeof(at_cmd_ref_app_sys_transport_t));
+    close_msg->base.cmd_id = CMD_ID_HOST_SYS_TRANSPORT_CLOSE;
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)close_msg) != CY_RSLT_SUCCESS)
+    {
+        free(close_msg);
+        return "busy";
+    }
+    return NULL;
+}
+
+/**
+ * Switch the UART to the new rate, or restore the old rate
+ */
+void at_cmd_refapp_sys_baud_event(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str)
+{
+    at_cmd_ref_app_sys_baud_t *baud = (at_cmd_ref_app_sys_baud_t *)msg;
+
+    if (!g_baud.pending)
+    {
+        /* Confirmed before the revert was run. */
+        return;
+    }
+
+    if (msg->cmd_id == CMD_ID_HOST_SYS_BAUD_SWITCH)
+    {
+        if (at_cmd_refapp_transport_set_baud(baud->baud, &g_baud.actual) == CY_RSLT_SUCCESS)
+        {
+            if (cy_rtos_start_timer(&g_baud.timer, baud->timeout) == CY_RSLT_SUCCESS)
+            {
+                return;
+            }
+            AT_CMD_REFAPP_LOG_ERR(("SYS_SetBaud timer start failed\n"));
+        }
+        free(sys_baud_take_revert());
+    }
+
+    g_baud.pending = false;
+    at_cmd_refapp_transport_set_baud(g_baud.old_baud, NULL);
+    baud->baud = g_baud.old_baud;
+    AT_CMD_REFAPP_LOG_MSG(("UART rate restored to %lu baud\n", baud->baud));
+
+    at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_sys_write_json, CMD_ID_HOST_SYS_BAUD_REVERT, msg, false);
+    at_cmd_refapp_send_result(msg->serial, true, result_str);
+}
+
+/**
+ * Process the SYS command and create host message
+ */
+at_cmd_msg_base_t *at_cmd_refapp_sys_process_message(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str)
+{
+    at_cmd_msg_base_t *at_cmd_msg = NULL;
+    at_cmd_ref_app_sys_trace_t *dump;
+    const char *response_text;
+
+    switch (msg->cmd_id)
+    {
+    case CMD_ID_SYS_TRACE:
+    {
+        /*
+         * Queue the dump so it is sent after the command response.
+         */
+        dump = (at_cmd_ref_app_sys_trace_t *)malloc(sizeof(at_cmd_ref_app_sys_trace_t));
+        if (dump == NULL)
+        {
+            response_text = "memory error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        memcpy(dump, msg, sizeof(at_cmd_ref_app_sys_trace_t));
+        dump->base.cmd_id = CMD_ID_HOST_SYS_TRACE_DUMP;
+        if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)dump) != CY_RSLT_SUCCESS)
+        {
+            free(dump);
+            response_text = "busy";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        at_cmd_msg = msg;
+        break;
+    }
+
+    case CMD_ID_SYS_STATS:
+        at_cmd_msg = (at_cmd_msg_base_t *)sys_stats_collect((at_cmd_ref_app_sys_stats_t *)msg);
+        if (at_cmd_msg == NULL)
+        {
+            response_text = "memory error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+        }
+        break;
+
+    case CMD_ID_SYS_SET_FORMAT:
+        /*
+         * The response to SYS_SetFormat is already in the new format, its own
+         * keys are not in the dictionary so the host can always read it.
+         */
+        at_cmd_refapp_keys_set_compact(((at_cmd_ref_app_sys_format_t *)msg)->compact);
+        at_cmd_msg = msg;
+        break;
+
+    case CMD_ID_SYS_SET_BAUD:
+        response_text = sys_baud_request((at_cmd_ref_app_sys_baud_t *)msg);
+        if (response_text != NULL)
+        {
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        at_cmd_msg = msg;
+        break;
+
+    case CMD_ID_SYS_SET_TRANSPORT:
+        response_text = sys_transport_request((at_cmd_ref_app_sys_transport_t *)msg);
+        if (response_text != NULL)
+        {
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        at_cmd_msg = msg;
+        break;
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    case CMD_ID_SYS_BENCH:
+    case CMD_ID_SYS_MICROBENCH:
+        if (at_cmd_refapp_bench_start(msg) != CY_RSLT_SUCCESS)
+        {
+            at_cmd_refapp_bench_free_steps(msg);
+            response_text = "busy";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        at_cmd_msg = msg;
+        break;
+#endif
+
+    default:
+        AT_CMD_REFAPP_LOG_ERR(("Unimplemented cmd: 0x%04lx\n", msg->cmd_id));
+        break;
+    }
+
+    return at_cmd_msg;
+}
+
+/**
+ * Write the Json text of a SYS response
+ */
+void at_cmd_refapp_sys_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg)
+{
+    at_cmd_ref_app_sys_stats_info_t *info;
+    at_cmd_ref_app_sys_bench_result_t *bench;
+    at_cmd_ref_app_sys_microbench_result_t *micro;
+    at_cmd_ref_app_sys_format_t *format;
+    at_cmd_ref_app_sys_baud_t *baud;
+    at_cmd_ref_app_sys_transport_t *transport;
+    const char *key;
+    uint32_t commands = 0;
+    uint32_t i;
+
+    at_cmd_refapp_json_object_begin(json, NULL);
+    if (cmd_id == CMD_ID_SYS_TRACE)
+    {
+        for (i = 0; i < AT_CMD_REF_APP_TRACE_MAX_CMD_ID; i++)
+        {
+            commands += g_trace.stats[i].count > 0 ? 1 : 0;
+        }
+        at_cmd_refapp_json_number(json, SYS_TOKEN_COMMANDS, commands);
+    }
+    else if (cmd_id == CMD_ID_SYS_SET_FORMAT)
+    {
+        format = (at_cmd_ref_app_sys_format_t *)msg;
+
+        at_cmd_refapp_json_string(json, SYS_TOKEN_FORMAT, format->compact ? SYS_TOKEN_COMPACT : SYS_TOKEN_VERBOSE);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_VERSION, AT_CMD_REF_APP_KEYS_VERSION);
+
+        /* The dictionary is sent unless the host already has this version. */
+        if (format->compact && (format->version != AT_CMD_REF_APP_KEYS_VERSION))
+        {
+            at_cmd_refapp_json_array_begin(json, SYS_TOKEN_KEYS);
+            for (i = 0; (key = at_cmd_refapp_keys_get(i)) != NULL; i++)
+            {
+                at_cmd_refapp_json_string(json, NULL, key);
+            }
+            at_cmd_refapp_json_array_end(json);
+        }
+    }
+    else if ((cmd_id == CMD_ID_SYS_SET_BAUD) || (cmd_id == CMD_ID_HOST_SYS_BAUD_REVERT))
+    {
+        baud = (at_cmd_ref_app_sys_baud_t *)msg;
+
+        at_cmd_refapp_json_number(json, SYS_TOKEN_BAUD, baud->baud);
+        if (cmd_id == CMD_ID_HOST_SYS_BAUD_REVERT)
+        {
+            at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_REVERTED);
+        }
+        else if (baud->confirm)
+        {
+            at_cmd_refapp_json_number(json, SYS_TOKEN_ACTUAL, baud->actual);
+            at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_CONFIRMED);
+        }
+        else
+        {
+            at_cmd_refapp_json_number(json, SYS_TOKEN_TIMEOUT, baud->timeout);
+            at_cmd_refapp_json_bool(json, SYS_TOKEN_FLOW_CONTROL, AT_CMD_REF_APP_UART_FLOW_CONTROL);
+            at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_SWITCHING);
+        }
+    }
+    else if (cmd_id == CMD_ID_SYS_SET_TRANSPORT)
+    {
+        transport = (at_cmd_ref_app_sys_transport_t *)msg;
+
+        if (transport->tcp)
+        {
+            at_cmd_refapp_json_string(json, SYS_TOKEN_TRANSPORT, AT_CMD_REF_APP_TRANSPORT_TCP);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_PORT, transport->port);
+            at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_LISTENING);
+        }
+        else
+        {
+            at_cmd_refapp_json_string(json, SYS_TOKEN_TRANSPORT, at_cmd_refapp_transport_default_name());
+            at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_SELECTED);
+        }
+    }
+    else if (cmd_id == CMD_ID_SYS_STATS)
+    {
+        info = (at_cmd_ref_app_sys_stats_info_t *)msg;
+
+        at_cmd_refapp_json_object_begin(json, SYS_TOKEN_QUEUE);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_DEPTH, info->queue_depth);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_MAX_DEPTH, info->queue_max_depth);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_SIZE, AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS);
+        at_cmd_refapp_json_object_end(json);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_DROPS, info->drops);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_LOG_DROPS, info->log_drops);
+        at_cmd_refapp_json_object_begin(json, SYS_TOKEN_CREDITS);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_LIMIT, AT_CMD_REF_APP_CMD_CREDITS);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_IN_USE, info->credits_in_use);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_MAX_IN_USE, info->credits_max_in_use);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_BUSY, info->busy);
+        at_cmd_refapp_json_object_end(json);
+        at_cmd_refapp_json_object_begin(json, SYS_TOKEN_MSG_POOL);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_SIZE, AT_CMD_REF_APP_MSG_POOL_SLOTS);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_IN_USE, info->msg_pool.in_use);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_MAX_IN_USE, info->msg_pool.max_in_use);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_ALLOCS, info->msg_pool.allocs);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_FALLBACKS, info->msg_pool.fallbacks);
+        at_cmd_refapp_json_object_end(json);
+
+        if (info->heap_valid)
+        {
+            at_cmd_refapp_json_object_begin(json, SYS_TOKEN_HEAP);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_SIZE, info->heap_size);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_FREE, info->heap_free);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_SAMPLED_MIN_FREE, info->heap_sampled_min_free);
+            at_cmd_refapp_json_object_end(json);
+        }
+
+        at_cmd_refapp_json_array_begin(json, SYS_TOKEN_THREADS);
+        for (i = 0; i < info->num_threads; i++)
+        {
+            at_cmd_refapp_json_object_begin(json, NULL);
+            at_cmd_refapp_json_string(json, SYS_TOKEN_NAME, info->threads[i].name);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_STACK, info->threads[i].stack_size);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_MAX_USED, info->threads[i].max_used);
+            at_cmd_refapp_json_object_end(json);
+        }
+        at_cmd_refapp_json_array_end(json);
+
+        /*
+         * Counts are reported as [cmd-id, commands, events, drops] for the
+         * command ids seen.
+         */
+        at_cmd_refapp_json_array_begin(json, SYS_TOKEN_CMDS);
+        for (i = 0; i < AT_CMD_REF_APP_SYS_MAX_CMD_ID; i++)
+        {
+            if ((info->commands[i] == 0) && (info->events[i] == 0) && (info->cmd_drops[i] == 0))
+            {
+                continue;
+            }
+            at_cmd_refapp_json_array_begin(json, NULL);
+            at_cmd_refapp_json_number(json, NULL, i);
+            at_cmd_refapp_json_number(json, NULL, info->commands[i]);
+            at_cmd_refapp_json_number(json, NULL, info->events[i]);
+            at_cmd_refapp_json_number(json, NULL, info->cmd_drops[i]);
+            at_cmd_refapp_json_array_end(json);
+        }
+        at_cmd_refapp_json_array_end(json);
+    }
+    else if ((cmd_id == CMD_ID_SYS_BENCH) || (cmd_id == CMD_ID_SYS_MICROBENCH))
+    {
+        at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, SYS_TOKEN_ACCEPTED);
+    }
+    else if (cmd_id == CMD_ID_HOST_SYS_BENCH_RESULT)
+    {
+        bench = (at_cmd_ref_app_sys_bench_result_t *)msg;
+
+        at_cmd_refapp_json_string(json, SYS_TOKEN_NAME, bench->name);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_COMMANDS, bench->commands);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_ERRORS, bench->errors);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_TIMEOUTS, bench->timeouts);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_DURATION, bench->duration);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_RATE,
+                                  bench->duration ? (bench->commands * 1000ULL) / bench->duration : 0);
+
+        at_cmd_refapp_json_object_begin(json, SYS_TOKEN_LATENCY);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_P50, bench->p50);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_P99, bench->p99);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_P999, bench->p999);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_MAX, bench->max);
+        at_cmd_refapp_json_object_end(json);
+
+        at_cmd_refapp_json_number(json, SYS_TOKEN_HEAP_PEAK, bench->heap_peak);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_ALLOCS, bench->allocs);
+        at_cmd_refapp_json_number(json, SYS_TOKEN_ALLOC_BYTES, bench->alloc_bytes);
+
+        at_cmd_refapp_json_array_begin(json, SYS_TOKEN_STEPS);
+        for (i = 0; i < bench->num_steps; i++)
+        {
+            at_cmd_refapp_json_object_begin(json, NULL);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_COMMANDS, bench->steps[i].commands);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_ERRORS, bench->steps[i].errors);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_TIMEOUTS, bench->steps[i].timeouts);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_EVENTS, bench->steps[i].events);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_EVENT_DROPS, bench->steps[i].event_drops);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_DROPS, bench->steps[i].drops);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_MAX_DEPTH, bench->steps[i].max_depth);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_P50, bench->steps[i].p50);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_P99, bench->steps[i].p99);
+            at_cmd_refapp_json_number(json, SYS_TOKEN_FAULTS, bench->steps[i].faults);
+            if (bench->steps[i].after_faults)
+            {
+                at_cmd_refapp_json_number(json, SYS_TOKEN_RECOVERY, bench->steps[i].recovery);
+            }
+            at_cmd_refapp_json_object_end(json);
+        }
+        at_cmd_refapp_json_array_end(json);
+    }
+    else if (cmd_id == CMD_ID_HOST_SYS_MICROBENCH_RESULT)
+    {
+        micro = (at_cmd_ref_app_sys_microbench_result_t *)msg;
+
+        at_cmd_refapp_json_number(json, SYS_TOKEN_COUNT, micro->count);
+        at_cmd_refapp_json_array_begin(json, SYS_TOKEN_RESULTS);
+        for (i = 0; i < micro->num_cases; i++)
+        {
+            at_cmd_refapp_json_object_begin(json, NULL);
+            at_cmd_refapp_json_string(json, SYS_TOKEN_CASE, micro->cases[i].name);
+            if (micro->cases[i].failed)
+            {
+                at_cmd_refapp_json_string(json, SYS_TOKEN_STATUS, "failed");
+            }
+            else
+            {
+                at_cmd_refapp_json_number(json, SYS_TOKEN_NS_OP, micro->cases[i].ns_per_op);
+                if (micro->alloc_counts)
+                {
+                    at_cmd_refapp_json_number(json, SYS_TOKEN_BYTES_OP, (double)micro->cases[i].alloc_bytes / micro->count);
+                    at_cmd_refapp_json_number(json, SYS_TOKEN_ALLOCS_OP, (double)micro->cases[i].allocs / micro->count);
+                }
+            }
+            at_cmd_refapp_json_object_end(json);
+        }
+        at_cmd_refapp_json_array_end(json);
+    }
+    else
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Unimplemented cmd: 0x%04lx\n", cmd_id));
+    }
+    at_cmd_refapp_json_object_end(json);
+}
+
+/**
+ * Process the command and create json text output
+ */
+cy_rslt_t at_cmd_refapp_process_sys_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen)
+{
+    return at_cmd_refapp_json_render(at_cmd_refapp_sys_write_json, cmd_id, msg, buffer, buflen);
+}
+
+/**
+ * Send the latency statistics to the host as async responses, each holding
+ * up to AT_CMD_REF_APP_TRACE_RESULTS_PER_CHUNK commands.
+ */
+void at_cmd_refapp_sys_send_trace(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str)
+{
+    at_cmd_ref_app_sys_trace_t *dump = (at_cmd_ref_app_sys_trace_t *)msg;
+    trace_stats_t stats[AT_CMD_REF_APP_TRACE_RESULTS_PER_CHUNK];
+    uint8_t cmd_ids[AT_CMD_REF_APP_TRACE_RESULTS_PER_CHUNK];
+    cJSON *cjson = NULL;
+    cJSON *results = NULL;
+    cJSON *item = NULL;
+    cJSON *array = NULL;
+    char *json_text = NULL;
+    uint32_t cmd_id = 0;
+    uint32_t num;
+    uint32_t len;
+    uint32_t irq;
+    uint32_t i;
+    uint32_t j;
+
+    do
+    {
+        /*
+         * Copy the next chunk of commands with samples so interrupts are not
+         * held off while formatting.
+         */
+        num = 0;
+        irq = cyhal_system_critical_section_enter();
+        for (; (cmd_id < AT_CMD_REF_APP_TRACE_MAX_CMD_ID) && (num < AT_CMD_REF_APP_TRACE_RESULTS_PER_CHUNK); cmd_id++)
+        {
+            if (g_trace.stats[cmd_id].count > 0)
+            {
+                memcpy(&stats[num], &g_trace.stats[cmd_id], sizeof(trace_stats_t));
+                cmd_ids[num++] = (uint8_t)cmd_id;
+                if (dump->reset)
+                {
+                    memset(&g_trace.stats[cmd_id], 0, sizeof(trace_stats_t));
+                }
+            }
+        }
+        while ((cmd_id < AT_CMD_REF_APP_TRACE_MAX_CMD_ID) && (g_trace.stats[cmd_id].count == 0))
+        {
+            cmd_id++;
+        }
+        cyhal_system_critical_section_exit(irq);
+
+        cjson = cJSON_CreateObject();
+        if (cjson == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error alloc json object\n"));
+            return;
+        }
+        results = cJSON_AddArrayToObject(cjson, SYS_TOKEN_RESULTS);
+
+        for (i = 0; i < num; i++)
+        {
+            item = cJSON_CreateObject();
+            if (item == NULL)
+            {
+                break;
+            }
+            cJSON_AddNumberToObject(item, SYS_TOKEN_CMD_ID, cmd_ids[i]);
+            cJSON_AddNumberToObject(item, SYS_TOKEN_COUNT, stats[i].count);
+
+            /*
+             * Each interval is reported as [average, maximum] in us.
+             */
+            for (j = 0; j < AT_CMD_REF_APP_TRACE_NUM_STAMPS - 1; j++)
+            {
+                array = cJSON_AddArrayToObject(item, trace_interval_names[j]);
+                cJSON_AddItemToArray(array, cJSON_CreateNumber(stats[i].total[j] / stats[i].count));
+                cJSON_AddItemToArray(array, cJSON_CreateNumber(stats[i].max[j]));
+            }
+
+            array = cJSON_AddArrayToObject(item, SYS_TOKEN_HISTOGRAM);
+            for (j = 0; j < AT_CMD_REF_APP_TRACE_BUCKETS; j++)
+            {
+                cJSON_AddItemToArray(array, cJSON_CreateNumber(stats[i].histogram[j]));
+            }
+            cJSON_AddItemToArray(results, item);
+        }
+
+        cJSON_AddStringToObject(cjson, SYS_TOKEN_STATUS, cmd_id >= AT_CMD_REF_APP_TRACE_MAX_CMD_ID ? SYS_TOKEN_COMPLETE : SYS_TOKEN_INCOMPLETE);
+
+        json_text = cJSON_PrintUnformatted(cjson);
+        cJSON_Delete(cjson);
+        if (json_text == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error alloc json text\n"));
+            return;
+        }
+
+        len = strlen(json_text);
+        len = len >= result_str->result_size ? result_str->result_size - 1 : len;
+        memcpy(result_str->result_text, json_text, len);
+        result_str->result_text[len] = '\0';
+        free(json_text);
+
+        at_cmd_refapp_send_async_response(msg->serial, result_str->result_text);
+    } while (cmd_id < AT_CMD_REF_APP_TRACE_MAX_CMD_ID);
+}
+
+/* [] END OF FILE */
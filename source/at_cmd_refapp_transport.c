@@ -0,0 +1,724 @@
+/*
+ * Copyright 2023, Cypress Semiconductor Corporation or a subsidiary of
+ * Cypress Semiconductor Corporation. All Rights Reserved.
+ *
+ * This software, including source code, documentation and related
+ * materials ("Software"), is owned by Cypress Semiconductor Corporation
+ * or one of its subsidiaries ("Cypress") and is protected by and subject to
+ * worldwide patent protection (United States and foreign),
+ * United States copyright laws and international treaty provisions.
+ * Therefore, you may use this Software only as provided in the license
+ * agreement accompanying the software package from which you
+ * obtained this Software ("EULA").
+ * If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+ * non-transferable license to copy, modify, and compile the Software
+ * source code solely for use in connection with Cypress's
+ * integrated circuit products. Any reproduction, modification, translation,
+ * compilation, or representation of this Software except as specified
+ * above is prohibited without the express written permission of Cypress.
+ *
+ * Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+ * reserves the right to make changes to the Software without notice. Cypress
+ * does not assume any liability arising out of the application or use of the
+ * Software or any product or circuit described in the Software. Cypress does
+ * not authorize its products for use in any products where a malfunction or
+ * failure of the Cypress product may reasonably be expected to result in
+ * significant property damage, injury or death ("High Risk Product"). By
+ * including Cypress's product in a High Risk Product, the manufacturer
+ * of such system or application assumes all risk of such use and in doing
+ * so agrees to indemnify Cypress against all liability.
+ */
+
+
+/**
+ * @file at_cmd_refapp_transport.c
+ * @brief AT command transport: the UART or SDIO backend of the build, and a
+ *        TCP backend selected at runtime with SYS_SetTransport.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "cy_result.h"
+#include "cyabs_rtos.h"
+#include "cyhal.h"
+#include "cy_retarget_io.h"
+#include "cy_secure_sockets.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_APP
+#include "at_cmd_refapp.h"
+
+#if defined(SDIO_HM_AT_CMD)
+#include "sdio_at_cmd_support.h"
+#endif
+
+/******************************************************
+ *                    Structures
+ ******************************************************/
+
+/*
+ * Transport backend. The parser polls is_data_ready and read from its thread
+ * without the transport lock, write is called with the lock held and sends
+ * all of the buffer. Backends without a rate leave set_baud NULL.
+ */
+typedef struct
+{
+    const char *name;
+    bool (*is_data_ready)(void);
+    uint32_t (*read)(uint8_t *buffer, uint32_t size);
+    cy_rslt_t (*write)(const uint8_t *buffer, uint32_t length);
+    cy_rslt_t (*set_baud)(uint32_t baud, uint32_t *actual);
+} transport_backend_t;
+
+/******************************************************
+ *               Static Function Declarations
+ ******************************************************/
+#if defined(SDIO_HM_AT_CMD)
+static bool transport_sdio_is_data_ready(void);
+static uint32_t transport_sdio_read(uint8_t *buffer, uint32_t size);
+static cy_rslt_t transport_sdio_write(const uint8_t *buffer, uint32_t length);
+#else
+static bool transport_uart_is_data_ready(void);
+static uint32_t transport_uart_read(uint8_t *buffer, uint32_t size);
+static cy_rslt_t transport_uart_write(const uint8_t *buffer, uint32_t length);
+static cy_rslt_t transport_uart_set_baud(uint32_t baud, uint32_t *actual);
+#endif
+static bool transport_tcp_is_data_ready(void);
+static uint32_t transport_tcp_read(uint8_t *buffer, uint32_t size);
+static cy_rslt_t transport_tcp_write(const uint8_t *buffer, uint32_t length);
+static cy_rslt_t transport_tcp_connect_cb(cy_socket_t socket, void *arg);
+static cy_rslt_t transport_tcp_receive_cb(cy_socket_t socket, void *arg);
+static cy_rslt_t transport_tcp_disconnect_cb(cy_socket_t socket, void *arg);
+static void transport_tcp_drop_client(void);
+static void transport_tcp_reap(void);
+static void transport_tcp_close_detached(void);
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+#if defined(SDIO_HM_AT_CMD)
+static const transport_backend_t g_transport_default =
+    {
+        .name = AT_CMD_REF_APP_TRANSPORT_SDIO,
+        .is_data_ready = transport_sdio_is_data_ready,
+        .read = transport_sdio_read,
+        .write = transport_sdio_write,
+        .set_baud = NULL};
+#else
+static const transport_backend_t g_transport_default =
+    {
+        .name = AT_CMD_REF_APP_TRANSPORT_UART,
+        .is_data_ready = transport_uart_is_data_ready,
+        .read = transport_uart_read,
+        .write = transport_uart_write,
+        .set_baud = transport_uart_set_baud};
+#endif
+
+static const transport_backend_t g_transport_tcp =
+    {
+        .name = AT_CMD_REF_APP_TRANSPORT_TCP,
+        .is_data_ready = transport_tcp_is_data_ready,
+        .read = transport_tcp_read,
+        .write = transport_tcp_write,
+        .set_baud = NULL};
+
+/*
+ * The backend in use. It changes when a TCP client connects or goes away, so
+ * writes and the change are serialized by the lock. The lock also keeps
+ * response frames whole, it is held for a frame by the send helpers. Reads
+ * only come from the parser thread and do not take the lock.
+ */
+static struct
+{
+    cy_mutex_t lock;
+    const transport_backend_t *volatile active;
+    uint32_t baud;
+} g_transport;
+
+/*
+ * TCP backend: one client at a time, further connections are closed.
+ * rx_ready is set by the socket receive callback and cleared by the read.
+ * The socket library thread never takes the lock: the connect callback hands
+ * the accepted socket over in pending_socket and the disconnect callback
+ * only sets drop_pending, the parser thread attaches and drops the client.
+ * A client that goes away is detached under the lock and its socket handed
+ * to closing_socket. The parser thread, the only reader, deletes it, so a
+ * read never runs on a deleted socket.
+ */
+static struct
+{
+    cy_socket_t listen_socket;
+    cy_socket_t client_socket;
+    cy_socket_t closing_socket;
+    _Atomic(cy_socket_t) pending_socket;
+    uint16_t port;
+    atomic_bool rx_ready;
+    atomic_bool drop_pending;
+} g_tcp;
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+/**
+ * Create the transport lock and select the backend of the build
+ */
+cy_rslt_t at_cmd_refapp_transport_init(void)
+{
+    cy_rslt_t result;
+
+    result = cy_rtos_init_mutex(&g_transport.lock);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("transport lock init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    g_transport.active = &g_transport_default;
+    g_transport.baud = CY_RETARGET_IO_BAUDRATE;
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * Hold the transport, the lock is recursive
+ */
+void at_cmd_refapp_transport_lock(void)
+{
+    cy_rtos_get_mutex(&g_transport.lock, AT_CMD_REF_APP_WAITFOREVER);
+}
+
+void at_cmd_refapp_transport_unlock(void)
+{
+    cy_rtos_set_mutex(&g_transport.lock);
+}
+
+/**
+ * Name of the backend in use
+ */
+const char *at_cmd_refapp_transport_name(void)
+{
+    return g_transport.active->name;
+}
+
+/**
+ * Name of the backend of the build
+ */
+const char *at_cmd_refapp_transport_default_name(void)
+{
+    return g_transport_default.name;
+}
+
+/**
+ * transport data ready callback
+ */
+bool at_cmd_refapp_transport_is_data_ready(void *opaque)
+{
+    (void)opaque;
+
+    transport_tcp_reap();
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    /* Host input is held while a benchmark replays its script. */
+    if (at_cmd_refapp_bench_active())
+    {
+        return at_cmd_refapp_bench_is_data_ready();
+    }
+#endif
+    return g_transport.active->is_data_ready();
+}
+
+/**
+ * transport read callback
+ */
+uint32_t at_cmd_refapp_transport_read(uint8_t *buffer, uint32_t size, void *opaque)
+{
+    (void)opaque;
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    if (at_cmd_refapp_bench_active())
+    {
+        return at_cmd_refapp_bench_read(buffer, size);
+    }
+#endif
+    /* Writers keep going while a read waits for data. */
+    return g_transport.active->read(buffer, size);
+}
+
+/**
+ * Read raw data following a command, see at_cmd_refapp_transport_read_data
+ */
+uint32_t at_cmd_refapp_transport_read_data(uint8_t *buffer, uint32_t length, uint32_t timeout_ms)
+{
+    uint32_t received = 0;
+    cy_time_t start;
+    cy_time_t now;
+
+    cy_rtos_get_time(&start);
+    while (received < length)
+    {
+        if (at_cmd_refapp_transport_is_data_ready(NULL))
+        {
+            received += at_cmd_refapp_transport_read(&buffer[received], length - received, NULL);
+            continue;
+        }
+        cy_rtos_get_time(&now);
+        if (now - start >= timeout_ms)
+        {
+            break;
+        }
+        cy_rtos_delay_milliseconds(1);
+    }
+    return received;
+}
+
+/**
+ * transport write callback
+ */
+cy_rslt_t at_cmd_refapp_transport_write(uint8_t *buffer, uint32_t length, void *opaque)
+{
+    cy_rslt_t result;
+
+    (void)opaque;
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    /* Responses to replayed commands stay on the device. */
+    if (at_cmd_refapp_bench_write(buffer, length))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+#endif
+    at_cmd_refapp_transport_lock();
+    result = g_transport.active->write(buffer, length);
+    at_cmd_refapp_transport_unlock();
+    return result;
+}
+
+/**
+ * Change the rate of the AT UART. The lock holds back the responses and the
+ * rate changes once the last frame sent has left the UART.
+ */
+cy_rslt_t at_cmd_refapp_transport_set_baud(uint32_t baud, uint32_t *actual)
+{
+    uint32_t actual_baud = 0;
+    cy_rslt_t result = CY_RSLT_AT_CMD_REF_APP_ERR;
+
+    at_cmd_refapp_transport_lock();
+    if (g_transport.active->set_baud != NULL)
+    {
+        result = g_transport.active->set_baud(baud, &actual_baud);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            g_transport.baud = baud;
+        }
+    }
+    at_cmd_refapp_transport_unlock();
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("unable to set the %s transport to %lu baud result:0x%lx\n",
+                               at_cmd_refapp_transport_name(), baud, result));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    if (actual != NULL)
+    {
+        *actual = actual_baud;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * Rate of the transport in use, 0 when it has none
+ */
+uint32_t at_cmd_refapp_transport_get_baud(void)
+{
+    return g_transport.active->set_baud != NULL ? g_transport.baud : 0;
+}
+
+#if defined(SDIO_HM_AT_CMD)
+/*
+ * SDIO backend
+ */
+static bool transport_sdio_is_data_ready(void)
+{
+    return sdio_cmd_at_is_data_ready();
+}
+
+static uint32_t transport_sdio_read(uint8_t *buffer, uint32_t size)
+{
+    return sdio_cmd_at_read_data(buffer, size);
+}
+
+static cy_rslt_t transport_sdio_write(const uint8_t *buffer, uint32_t length)
+{
+    return sdio_cmd_at_write_data((uint8_t *)buffer, length);
+}
+#else
+/*
+ * UART backend on the retarget-io UART
+ */
+static bool transport_uart_is_data_ready(void)
+{
+    return cyhal_uart_readable(&cy_retarget_io_uart_obj) > 0;
+}
+
+static uint32_t transport_uart_read(uint8_t *buffer, uint32_t size)
+{
+    size_t len = cyhal_uart_readable(&cy_retarget_io_uart_obj);
+
+    len = len > size ? size : len;
+    cyhal_uart_read(&cy_retarget_io_uart_obj, buffer, &len);
+
+    return (uint32_t)len;
+}
+
+/*
+ * Fill the TX FIFO as far as it has room, then wait for room one byte at a
+ * time. With flow control the wait lasts as long as the host holds CTS.
+ */
+static cy_rslt_t transport_uart_write(const uint8_t *buffer, uint32_t length)
+{
+    cy_rslt_t result;
+    size_t len;
+
+    while (length > 0)
+    {
+        len = length;
+        result = cyhal_uart_write(&cy_retarget_io_uart_obj, (void *)buffer, &len);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        if (len == 0)
+        {
+            result = cyhal_uart_putc(&cy_retarget_io_uart_obj, buffer[0]);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                return result;
+            }
+            len = 1;
+        }
+        buffer += len;
+        length -= len;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t transport_uart_set_baud(uint32_t baud, uint32_t *actual)
+{
+    while (cyhal_uart_is_tx_active(&cy_retarget_io_uart_obj))
+    {
+        cy_rtos_delay_milliseconds(1);
+    }
+    return cyhal_uart_set_baud(&cy_retarget_io_uart_obj, baud, actual);
+}
+#endif /* SDIO_HM_AT_CMD */
+
+/*
+ * TCP backend
+ */
+static bool transport_tcp_is_data_ready(void)
+{
+    return atomic_load(&g_tcp.rx_ready);
+}
+
+/*
+ * Read what the socket holds. Readiness is cleared first so data arriving
+ * during the read sets it again; a full buffer may leave more behind.
+ */
+static uint32_t transport_tcp_read(uint8_t *buffer, uint32_t size)
+{
+    cy_socket_t socket = g_tcp.client_socket;
+    uint32_t received = 0;
+    cy_rslt_t result;
+
+    if (socket == NULL)
+    {
+        return 0;
+    }
+
+    atomic_store(&g_tcp.rx_ready, false);
+    result = cy_socket_recv(socket, buffer, size, CY_SOCKET_FLAGS_NONE, &received);
+    if (result == CY_RSLT_MODULE_SECURE_SOCKETS_CLOSED)
+    {
+        /* Also catches a disconnect reported before the client was attached. */
+        atomic_store(&g_tcp.drop_pending, true);
+    }
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return 0;
+    }
+    if (received == size)
+    {
+        atomic_store(&g_tcp.rx_ready, true);
+    }
+    return received;
+}
+
+static cy_rslt_t transport_tcp_write(const uint8_t *buffer, uint32_t length)
+{
+    uint32_t sent;
+    cy_rslt_t result;
+
+    if (g_tcp.client_socket == NULL)
+    {
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    while (length > 0)
+    {
+        sent = 0;
+        result = cy_socket_send(g_tcp.client_socket, buffer, length, CY_SOCKET_FLAGS_NONE, &sent);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            return result;
+        }
+        buffer += sent;
+        length -= sent;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * A host connected: accept it and hand its socket to the parser thread,
+ * which moves the AT commands over to it. Runs in the socket library thread.
+ */
+static cy_rslt_t transport_tcp_connect_cb(cy_socket_t socket, void *arg)
+{
+    cy_socket_opt_callback_t receive_cb = {.callback = transport_tcp_receive_cb, .arg = NULL};
+    cy_socket_opt_callback_t disconnect_cb = {.callback = transport_tcp_disconnect_cb, .arg = NULL};
+    uint32_t timeout = AT_CMD_REF_APP_TRANSPORT_TCP_RECV_TIMEOUT_MS;
+    cy_socket_sockaddr_t peer;
+    uint32_t peer_len = sizeof(peer);
+    cy_socket_t expected = NULL;
+    cy_socket_t client;
+    cy_rslt_t result;
+
+    (void)arg;
+
+    result = cy_socket_accept(socket, &peer, &peer_len, &client);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("TCP transport accept failed result:0x%lx\n", result));
+        return result;
+    }
+
+    cy_socket_setsockopt(client, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_RCVTIMEO, &timeout, sizeof(timeout));
+    cy_socket_setsockopt(client, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_RECEIVE_CALLBACK, &receive_cb, sizeof(receive_cb));
+    cy_socket_setsockopt(client, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_DISCONNECT_CALLBACK, &disconnect_cb, sizeof(disconnect_cb));
+
+    /* A connection not yet taken by the parser thread keeps its place. */
+    if (!atomic_compare_exchange_strong(&g_tcp.pending_socket, &expected, client))
+    {
+        AT_CMD_REFAPP_LOG_MSG(("TCP transport busy, connection closed\n"));
+        cy_socket_disconnect(client, 0);
+        cy_socket_delete(client);
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+static cy_rslt_t transport_tcp_receive_cb(cy_socket_t socket, void *arg)
+{
+    (void)socket;
+    (void)arg;
+
+    atomic_store(&g_tcp.rx_ready, true);
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Runs in the socket library thread, which must not wait for the lock or
+ * delete the socket it reports on. The parser thread drops the client.
+ */
+static cy_rslt_t transport_tcp_disconnect_cb(cy_socket_t socket, void *arg)
+{
+    (void)arg;
+
+    if (g_tcp.client_socket == socket)
+    {
+        atomic_store(&g_tcp.drop_pending, true);
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Detach the client and go back to the backend of the build, lock held. The
+ * socket is closed by transport_tcp_reap in the parser thread.
+ */
+static void transport_tcp_drop_client(void)
+{
+    g_transport.active = &g_transport_default;
+    atomic_store(&g_tcp.rx_ready, false);
+    g_tcp.closing_socket = g_tcp.client_socket;
+    g_tcp.client_socket = NULL;
+}
+
+/*
+ * Drop a client whose disconnect was reported, close detached sockets and
+ * attach a client the connect callback accepted. Called from the parser
+ * thread before it polls the transport.
+ */
+static void transport_tcp_reap(void)
+{
+    cy_socket_t socket;
+    bool attached = false;
+    bool rejected = false;
+
+    if (atomic_exchange(&g_tcp.drop_pending, false))
+    {
+        at_cmd_refapp_transport_lock();
+        if (g_tcp.client_socket != NULL)
+        {
+            transport_tcp_drop_client();
+            AT_CMD_REFAPP_LOG_MSG(("TCP client gone, AT commands on %s\n", g_transport_default.name));
+        }
+        at_cmd_refapp_transport_unlock();
+    }
+
+    transport_tcp_close_detached();
+
+    if (atomic_load(&g_tcp.pending_socket) == NULL)
+    {
+        return;
+    }
+
+    /*
+     * One client at a time, a second one is closed. A client that went away
+     * before it was attached fails its first read, which drops it.
+     */
+    at_cmd_refapp_transport_lock();
+    socket = atomic_load(&g_tcp.pending_socket);
+    if ((socket != NULL) && (g_tcp.client_socket == NULL))
+    {
+        /* Data may have come in before the client was attached. */
+        g_tcp.client_socket = socket;
+        atomic_store(&g_tcp.rx_ready, true);
+        g_transport.active = &g_transport_tcp;
+        atomic_store(&g_tcp.pending_socket, NULL);
+        attached = true;
+    }
+    else if ((socket != NULL) && (g_tcp.closing_socket == NULL))
+    {
+        g_tcp.closing_socket = socket;
+        atomic_store(&g_tcp.pending_socket, NULL);
+        rejected = true;
+    }
+    at_cmd_refapp_transport_unlock();
+
+    if (attached)
+    {
+        AT_CMD_REFAPP_LOG_MSG(("AT commands on TCP port %u\n", g_tcp.port));
+    }
+    else if (rejected)
+    {
+        AT_CMD_REFAPP_LOG_MSG(("TCP transport busy, connection closed\n"));
+        transport_tcp_close_detached();
+    }
+}
+
+/*
+ * Close the socket of a detached client, outside the lock.
+ */
+static void transport_tcp_close_detached(void)
+{
+    cy_socket_t socket;
+
+    if (g_tcp.closing_socket == NULL)
+    {
+        return;
+    }
+
+    at_cmd_refapp_transport_lock();
+    socket = g_tcp.closing_socket;
+    g_tcp.closing_socket = NULL;
+    at_cmd_refapp_transport_unlock();
+
+    if (socket != NULL)
+    {
+        cy_socket_disconnect(socket, 0);
+        cy_socket_delete(socket);
+    }
+}
+
+/**
+ * Listen for a TCP client on port, the AT commands move to the first client
+ * that connects. Listening again on the same port is a no-op.
+ */
+cy_rslt_t at_cmd_refapp_transport_listen(uint16_t port)
+{
+    cy_socket_opt_callback_t connect_cb = {.callback = transport_tcp_connect_cb, .arg = NULL};
+    cy_socket_sockaddr_t address;
+    cy_rslt_t result;
+
+    if (g_tcp.listen_socket != NULL)
+    {
+        return port == g_tcp.port ? CY_RSLT_SUCCESS : CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_socket_init();
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_STREAM, CY_SOCKET_IPPROTO_TCP, &g_tcp.listen_socket);
+    }
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("TCP transport socket create failed result:0x%lx\n", result));
+        g_tcp.listen_socket = NULL;
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.port = port;
+    address.ip_address.version = CY_SOCKET_IP_VER_V4;
+
+    result = cy_socket_setsockopt(g_tcp.listen_socket, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_CONNECT_REQUEST_CALLBACK,
+                                  &connect_cb, sizeof(connect_cb));
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_socket_bind(g_tcp.listen_socket, &address, sizeof(address));
+    }
+    if (result == CY_RSLT_SUCCESS)
+    {
+        result = cy_socket_listen(g_tcp.listen_socket, 1);
+    }
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("TCP transport listen on port %u failed result:0x%lx\n", port, result));
+        cy_socket_delete(g_tcp.listen_socket);
+        g_tcp.listen_socket = NULL;
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    g_tcp.port = port;
+    AT_CMD_REFAPP_LOG_MSG(("TCP transport listening on port %u\n", port));
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * Stop the TCP backend and go back to the backend of the build
+ */
+void at_cmd_refapp_transport_close(void)
+{
+    cy_socket_t pending;
+
+    at_cmd_refapp_transport_lock();
+    if (g_tcp.client_socket != NULL)
+    {
+        transport_tcp_drop_client();
+    }
+    pending = atomic_exchange(&g_tcp.pending_socket, NULL);
+    if (pending != NULL)
+    {
+        cy_socket_disconnect(pending, 0);
+        cy_socket_delete(pending);
+    }
+    if (g_tcp.listen_socket != NULL)
+    {
+        cy_socket_delete(g_tcp.listen_socket);
+        g_tcp.listen_socket = NULL;
+    }
+    at_cmd_refapp_transport_unlock();
+}
+
+/* [] END OF FILE */
@@ -42,7 +42,9 @@
 #include "cy_retarget_io.h"
 #include "cy_result.h"
 #include "cyabs_rtos.h"
+#include "cyhal.h"
 #include "at_command_parser.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_WCM
 #include "at_cmd_refapp.h"
 #include "cy_wcm.h"
 
@@ -51,6 +53,9 @@
  ******************************************************/
 static void network_event_change_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data);
 static void wifi_scan_handler(cy_wcm_scan_result_t *result_ptr, void *user_data, cy_wcm_scan_status_t status);
+static void wifi_worker(cy_thread_arg_t arg);
+static void wifi_notify_timer_cb(cy_timer_callback_arg_t arg);
+static void wifi_scan_write_chunk(at_cmd_ref_app_json_t *json, const at_cmd_ref_app_scan_chunk_t *chunk);
 /******************************************************
  *               Variable Definitions
  ******************************************************/
@@ -69,6 +74,115 @@ static at_cmd_security_def_t security_table[] =
         {"wpa3", CY_WCM_SECURITY_WPA3_SAE},
         {NULL, CY_WCM_SECURITY_UNKNOWN}};
 
+/*
+ * Access points found by scans, filled by wifi_scan_handler. The table is kept
+ * between scans so WCM_ScanGetResults can answer from it. The mutex guards the
+ * table against the WCM scan callback, the wcm_cmd worker and wifi_worker.
+ */
+static struct
+{
+    cy_mutex_t mutex;
+    bool active;
+    bool valid;
+    bool sort_rssi;
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t replaced;
+    cy_time_t scan_start_time;
+    cy_time_t last_scan_time;
+    at_cmd_ref_app_scan_filter_t filter;
+    at_cmd_ref_app_scan_entry_t entries[AT_CMD_REF_APP_SCAN_TABLE_SIZE];
+} g_scan_table;
+
+/*
+ * Access point of the last successful association, used for a directed
+ * connect the next time the host connects to the same SSID.
+ */
+static struct
+{
+    bool valid;
+    uint8_t ssid_length;
+    char ssid[CY_WCM_MAX_SSID_LEN + 1];
+    uint8_t bssid[CY_WCM_MAC_ADDR_LEN];
+    uint8_t channel;
+    cy_wcm_wifi_band_t band;
+    uint32_t full_connect_time;
+} g_wcm_last_ap;
+
+/*
+ * WCM worker. The job queue holds the connect and ping messages handed over
+ * by the wcm_cmd worker, only one connect and one ping can be pending at a
+ * time.
+ */
+static struct
+{
+    cy_thread_t thread;
+    cy_queue_t queue;
+    volatile bool connect_pending;
+    volatile bool ping_pending;
+} g_wcm_worker;
+
+static uint64_t g_wcm_worker_stack[AT_CMD_REF_APP_WCM_WORKER_STACK_SIZE / 8];
+
+/*
+ * Network change notification subscription. The pending event is owned by the
+ * wcm_cmd worker. The flush message is handed between the worker and the
+ * debounce timer under a critical section: whichever takes it first posts or
+ * re-arms it, so a pending event always gets a flush.
+ */
+static struct
+{
+    bool enabled;
+    uint32_t serial;
+    uint32_t events;
+    uint32_t debounce;
+    cy_timer_t timer;
+    bool pending;
+    at_cmd_ref_app_network_change_t last;
+    uint32_t coalesced;
+    at_cmd_ref_app_network_change_t *flush_msg;
+} g_wcm_notify;
+
+/*
+ * Network info snapshot, refreshed on WCM link and IP change events so
+ * WCM_GetIPAddress and WCM_GetIPV4Info are answered from memory.
+ */
+static struct
+{
+    cy_mutex_t mutex;
+    volatile bool connected;
+    bool dhcp;
+    ipv4_addr_t address;
+    ipv4_addr_t netmask;
+    ipv4_addr_t gateway;
+} g_wcm_netinfo;
+
+/*
+ * WCM event names, indexed by cy_wcm_event_t.
+ */
+static const char *wcm_event_names[] =
+    {
+        "connecting",
+        "connected",
+        "connect-failed",
+        "reconnected",
+        "disconnected",
+        "ip-changed",
+        "retry",
+        "sta-joined",
+        "sta-left"};
+
+#define WCM_EVENT_COUNT            (sizeof(wcm_event_names) / sizeof(wcm_event_names[0]))
+#define WCM_EVENT_DEFAULT_MASK     ((1 << CY_WCM_EVENT_CONNECTED) | (1 << CY_WCM_EVENT_CONNECT_FAILED) | \
+                                    (1 << CY_WCM_EVENT_RECONNECTED) | (1 << CY_WCM_EVENT_DISCONNECTED) | \
+                                    (1 << CY_WCM_EVENT_IP_CHANGED))
+
+static const char *connect_state_names[] =
+    {
+        WCM_TOKEN_ASSOCIATING,
+        WCM_TOKEN_IP_ACQUIRED,
+        WCM_TOKEN_FAILED};
+
 /******************************************************
  *               Function Definitions
  ******************************************************/
@@ -81,17 +195,53 @@ cy_rslt_t at_cmd_refapp_wcm_init(cy_queue_t *msgq)
     cy_rslt_t result = CY_RSLT_SUCCESS;
     cy_wcm_config_t config;
 
-    AT_CMD_REFAPP_LOG_MSG(("before WCM function\n"));
+    AT_CMD_REFAPP_LOG_DBG(("before WCM function\n"));
+
+    result = cy_rtos_queue_init(&g_wcm_worker.queue, AT_CMD_REF_APP_WCM_WORKER_QUEUE_MSGS, sizeof(at_cmd_msg_base_t *));
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("WCM worker queue init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_init_mutex(&g_wcm_netinfo.mutex);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("WCM network info mutex init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_init_mutex(&g_scan_table.mutex);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("WCM scan table mutex init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_init_timer(&g_wcm_notify.timer, CY_TIMER_TYPE_ONCE, wifi_notify_timer_cb, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("WCM notification timer init failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+
+    result = cy_rtos_thread_create(&g_wcm_worker.thread, &wifi_worker, "wcm_worker", g_wcm_worker_stack,
+                                   AT_CMD_REF_APP_WCM_WORKER_STACK_SIZE, AT_CMD_REF_APP_WCM_WORKER_PRIORITY, 0);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("WCM worker thread create failed\n"));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
 
     config.interface = CY_WCM_INTERFACE_TYPE_STA;
     result = cy_wcm_init(&config);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("WCM Initialization failed\n"));
+        AT_CMD_REFAPP_LOG_ERR(("WCM Initialization failed\n"));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
 
-    AT_CMD_REFAPP_LOG_MSG(("inside WCM function\n"));
+    AT_CMD_REFAPP_LOG_DBG(("inside WCM function\n"));
 
     /*
      * Register network event change callback with WCM library.
@@ -99,12 +249,328 @@ cy_rslt_t at_cmd_refapp_wcm_init(cy_queue_t *msgq)
     result = cy_wcm_register_event_callback(&network_event_change_callback);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("WCM callback registration failed\n"));
+        AT_CMD_REFAPP_LOG_ERR(("WCM callback registration failed\n"));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
     return result;
 }
 
+/*
+ * Parse a "xx:xx:xx:xx:xx:xx" MAC address string.
+ */
+static cy_rslt_t wifi_parse_macaddr(const char *str, uint8_t *macaddr)
+{
+    unsigned int octets[CY_WCM_MAC_ADDR_LEN];
+    int i;
+
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &octets[0], &octets[1], &octets[2],
+               &octets[3], &octets[4], &octets[5]) != CY_WCM_MAC_ADDR_LEN)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Invalid MAC address: %s\n", str));
+        return CY_RSLT_AT_CMD_REF_APP_ERR;
+    }
+    for (i = 0; i < CY_WCM_MAC_ADDR_LEN; i++)
+    {
+        macaddr[i] = (uint8_t)octets[i];
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Setup the scan filter from the optional WCM_ScanStart arguments.
+ */
+static cy_rslt_t wifi_parse_scan_filter(at_cmd_ref_app_scan_filter_t *filter, cJSON *json)
+{
+    cJSON *item;
+    cJSON *channel;
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_SSID);
+    if ((item != NULL) && cJSON_IsString(item))
+    {
+        if (strlen(item->valuestring) > CY_WCM_MAX_SSID_LEN)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("SSID too long\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        filter->ssid_length = strlen(item->valuestring);
+        memcpy(filter->ssid, item->valuestring, filter->ssid_length);
+        filter->flags |= AT_CMD_REF_APP_SCAN_FILTER_SSID;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_MACADDR);
+    if ((item != NULL) && cJSON_IsString(item))
+    {
+        if (wifi_parse_macaddr(item->valuestring, filter->bssid) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        filter->flags |= AT_CMD_REF_APP_SCAN_FILTER_MAC;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_MIN_RSSI);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        filter->min_rssi = item->valueint;
+        filter->flags |= AT_CMD_REF_APP_SCAN_FILTER_RSSI;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_BAND);
+    if ((item != NULL) && cJSON_IsNumber(item) && (item->valueint != CY_WCM_WIFI_BAND_ANY))
+    {
+        filter->band = (cy_wcm_wifi_band_t)item->valueint;
+        filter->flags |= AT_CMD_REF_APP_SCAN_FILTER_BAND;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_CHANNELS);
+    if ((item != NULL) && cJSON_IsArray(item))
+    {
+        cJSON_ArrayForEach(channel, item)
+        {
+            if ((!cJSON_IsNumber(channel)) || (channel->valueint <= 0) || (channel->valueint > UINT8_MAX) ||
+                (filter->num_channels >= AT_CMD_REF_APP_SCAN_MAX_CHANNELS))
+            {
+                AT_CMD_REFAPP_LOG_ERR(("Invalid channel list\n"));
+                return CY_RSLT_AT_CMD_REF_APP_ERR;
+            }
+            filter->channels[filter->num_channels++] = (uint8_t)channel->valueint;
+        }
+        if (filter->num_channels > 0)
+        {
+            filter->flags |= AT_CMD_REF_APP_SCAN_FILTER_CHANNEL;
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Setup the network change notification subscription. Without "events" the
+ * link and IP change events are notified.
+ */
+static cy_rslt_t wifi_parse_notification(at_cmd_ref_app_wcm_nw_change_notification_t *config, cJSON *json)
+{
+    cJSON *item;
+    cJSON *event;
+    uint32_t i;
+
+    item = cJSON_GetObjectItem(json, STR_TOKEN_ENABLE);
+    config->enable = cJSON_IsTrue(item) || (cJSON_IsNumber(item) && (item->valueint != 0));
+    config->events = WCM_EVENT_DEFAULT_MASK;
+    config->debounce = AT_CMD_REF_APP_NW_EVENT_DEBOUNCE_MS;
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_EVENTS);
+    if ((item != NULL) && cJSON_IsArray(item))
+    {
+        config->events = 0;
+        cJSON_ArrayForEach(event, item)
+        {
+            for (i = 0; i < WCM_EVENT_COUNT; i++)
+            {
+                if (cJSON_IsString(event) && (strcmp(event->valuestring, wcm_event_names[i]) == 0))
+                {
+                    config->events |= (1 << i);
+                    break;
+                }
+            }
+            if (i == WCM_EVENT_COUNT)
+            {
+                AT_CMD_REFAPP_LOG_ERR(("Unknown network event\n"));
+                return CY_RSLT_AT_CMD_REF_APP_ERR;
+            }
+        }
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_DEBOUNCE);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        if ((item->valueint < 0) || (item->valueint > AT_CMD_REF_APP_NW_EVENT_MAX_DEBOUNCE_MS))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid debounce time\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        config->debounce = item->valueint;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Setup the WCM_Ping target and options.
+ */
+static cy_rslt_t wifi_parse_ping(at_cmd_ref_ping_ip_addr_t *ping, cJSON *json)
+{
+    unsigned int octets[4];
+    cJSON *item;
+
+    item = cJSON_GetObjectItem(json, STR_TOKEN_IP_ADDRESS);
+    if ((item != NULL) && cJSON_IsString(item))
+    {
+        if ((sscanf(item->valuestring, "%u.%u.%u.%u", &octets[0], &octets[1], &octets[2], &octets[3]) != 4) ||
+            (octets[0] > 255) || (octets[1] > 255) || (octets[2] > 255) || (octets[3] > 255))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid ip-address: %s\n", item->valuestring));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        ping->ip_addr.version = CY_WCM_IP_VER_V4;
+        ping->ip_addr.ip.v4 = octets[0] | (octets[1] << 8) | (octets[2] << 16) | (octets[3] << 24);
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_COUNT);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        if ((item->valueint < 1) || (item->valueint > AT_CMD_REF_APP_PING_MAX_COUNT))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid ping count\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        ping->count = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_INTERVAL);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        if ((item->valueint < 0) || (item->valueint > AT_CMD_REF_APP_PING_MAX_INTERVAL))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid ping interval\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        ping->interval = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_TIMEOUT);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        if ((item->valueint < 1) || (item->valueint > AT_CMD_REF_APP_PING_MAX_TIMEOUT))
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid ping timeout\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        ping->timeout = item->valueint;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * Setup the max-age and sort options of WCM_ScanGetResults.
+ */
+static cy_rslt_t wifi_parse_scan_query(at_cmd_ref_app_scan_start_t *query, cJSON *json)
+{
+    cJSON *item;
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_MAX_AGE);
+    if ((item != NULL) && cJSON_IsNumber(item))
+    {
+        if (item->valueint <= 0)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Invalid max-age\n"));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        query->max_age = item->valueint;
+    }
+
+    item = cJSON_GetObjectItem(json, WCM_TOKEN_SORT);
+    if ((item != NULL) && cJSON_IsString(item))
+    {
+        if (strcmp(item->valuestring, WCM_TOKEN_SIGNAL_STRENGTH) != 0)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Unknown sort key: %s\n", item->valuestring));
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
+        query->sort_rssi = true;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+/*
+ * WCM filters on a single criterion only. Pick the most selective one, the
+ * remaining criteria are applied by wifi_scan_filter_match.
+ */
+static cy_wcm_scan_filter_t *wifi_scan_filter_to_wcm(const at_cmd_ref_app_scan_filter_t *filter, cy_wcm_scan_filter_t *wcm_filter)
+{
+    memset(wcm_filter, 0, sizeof(cy_wcm_scan_filter_t));
+
+    if (filter->flags & AT_CMD_REF_APP_SCAN_FILTER_MAC)
+    {
+        wcm_filter->mode = CY_WCM_SCAN_FILTER_TYPE_MAC;
+        memcpy(wcm_filter->param.BSSID, filter->bssid, CY_WCM_MAC_ADDR_LEN);
+    }
+    else if (filter->flags & AT_CMD_REF_APP_SCAN_FILTER_SSID)
+    {
+        wcm_filter->mode = CY_WCM_SCAN_FILTER_TYPE_SSID;
+        memcpy(wcm_filter->param.SSID, filter->ssid, filter->ssid_length);
+    }
+    else if (filter->flags & AT_CMD_REF_APP_SCAN_FILTER_BAND)
+    {
+        wcm_filter->mode = CY_WCM_SCAN_FILTER_TYPE_BAND;
+        wcm_filter->param.band = filter->band;
+    }
+    else if ((filter->flags & AT_CMD_REF_APP_SCAN_FILTER_RSSI) && (filter->min_rssi >= CY_WCM_SCAN_RSSI_FAIR))
+    {
+        /*
+         * WCM only knows a few RSSI ranges, use the tightest one below the floor.
+         */
+        wcm_filter->mode = CY_WCM_SCAN_FILTER_TYPE_RSSI;
+        if (filter->min_rssi >= CY_WCM_SCAN_RSSI_EXCELLENT)
+        {
+            wcm_filter->param.rssi_range = CY_WCM_SCAN_RSSI_EXCELLENT;
+        }
+        else if (filter->min_rssi >= CY_WCM_SCAN_RSSI_GOOD)
+        {
+            wcm_filter->param.rssi_range = CY_WCM_SCAN_RSSI_GOOD;
+        }
+        else
+        {
+            wcm_filter->param.rssi_range = CY_WCM_SCAN_RSSI_FAIR;
+        }
+    }
+    else
+    {
+        return NULL;
+    }
+    return wcm_filter;
+}
+
+/*
+ * Check an access point against all criteria of the filter.
+ */
+static bool wifi_scan_filter_match(const at_cmd_ref_app_scan_filter_t *filter, const uint8_t *bssid, const char *ssid,
+                                   int16_t signal_strength, uint8_t band, uint8_t channel)
+{
+    uint32_t i;
+
+    if ((filter->flags & AT_CMD_REF_APP_SCAN_FILTER_MAC) && (memcmp(filter->bssid, bssid, CY_WCM_MAC_ADDR_LEN) != 0))
+    {
+        return false;
+    }
+    if ((filter->flags & AT_CMD_REF_APP_SCAN_FILTER_SSID) &&
+        ((strnlen(ssid, CY_WCM_MAX_SSID_LEN) != filter->ssid_length) || (memcmp(filter->ssid, ssid, filter->ssid_length) != 0)))
+    {
+        return false;
+    }
+    if ((filter->flags & AT_CMD_REF_APP_SCAN_FILTER_RSSI) && (signal_strength < filter->min_rssi))
+    {
+        return false;
+    }
+    if ((filter->flags & AT_CMD_REF_APP_SCAN_FILTER_BAND) && (band != filter->band))
+    {
+        return false;
+    }
+    if (filter->flags & AT_CMD_REF_APP_SCAN_FILTER_CHANNEL)
+    {
+        for (i = 0; i < filter->num_channels; i++)
+        {
+            if (filter->channels[i] == channel)
+            {
+                break;
+            }
+        }
+        if (i == filter->num_channels)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Setup the WCM connect configuration parameters
  */
@@ -117,7 +583,7 @@ static cy_rslt_t setup_wcm_connect_config(at_cmd_ref_app_wcm_connect_specific_t
 
     if(strlen(ssid)>CY_WCM_MAX_SSID_LEN)
     {
-            AT_CMD_REFAPP_LOG_MSG(("SSID too long\n"));
+            AT_CMD_REFAPP_LOG_ERR(("SSID too long\n"));
             return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
     
@@ -127,7 +593,7 @@ static cy_rslt_t setup_wcm_connect_config(at_cmd_ref_app_wcm_connect_specific_t
     idx = at_cmd_refapp_security_table_lookup_by_name(cJSON_GetObjectItem(json, WCM_TOKEN_SECURITY_TYPE)->valuestring, security_table);
     if (idx < 0)
     {
-        AT_CMD_REFAPP_LOG_MSG(("Unknown security type: %s\n", cJSON_GetObjectItem(json, WCM_TOKEN_SECURITY_TYPE)->valuestring));
+        AT_CMD_REFAPP_LOG_ERR(("Unknown security type: %s\n", cJSON_GetObjectItem(json, WCM_TOKEN_SECURITY_TYPE)->valuestring));
         return CY_RSLT_AT_CMD_REF_APP_ERR;
     }
     connect_config->security_type = security_table[idx].cmd_id;
@@ -136,13 +602,13 @@ static cy_rslt_t setup_wcm_connect_config(at_cmd_ref_app_wcm_connect_specific_t
     {
         if (!cJSON_HasObjectItem(json, WCM_TOKEN_PASSWORD))
         {
-            AT_CMD_REFAPP_LOG_MSG(("No password\n"));
+            AT_CMD_REFAPP_LOG_ERR(("No password\n"));
             return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
 
         if (strlen(cJSON_GetObjectItem(json, WCM_TOKEN_PASSWORD)->valuestring) > CY_WCM_MAX_PASSPHRASE_LEN)
         {
-            AT_CMD_REFAPP_LOG_MSG(("password too long\n"));
+            AT_CMD_REFAPP_LOG_ERR(("password too long\n"));
             return CY_RSLT_AT_CMD_REF_APP_ERR;
         }
 
@@ -155,8 +621,10 @@ static cy_rslt_t setup_wcm_connect_config(at_cmd_ref_app_wcm_connect_specific_t
 
         macaddr = cJSON_GetObjectItem(json, WCM_TOKEN_MACADDR)->valuestring;
 
-        sscanf(macaddr, "%x:%x:%x:%x:%x:%x", (unsigned int *)&connect_config->macaddr[0], (unsigned int *)&connect_config->macaddr[1], (unsigned int *)&connect_config->macaddr[2],
-               (unsigned int *)&connect_config->macaddr[3], (unsigned int *)&connect_config->macaddr[4], (unsigned int *)&connect_config->macaddr[5]);
+        if (wifi_parse_macaddr(macaddr, connect_config->macaddr) != CY_RSLT_SUCCESS)
+        {
+            return CY_RSLT_AT_CMD_REF_APP_ERR;
+        }
     }
 
     if (cJSON_HasObjectItem(json, WCM_TOKEN_BAND))
@@ -176,6 +644,8 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd(uint32_t cmd_id, uint32_t serial,
     at_cmd_ref_app_wcm_connect_specific_t *connect_config;
     at_cmd_ref_app_wcm_get_ip_type_t *get_ip_config;
     at_cmd_ref_app_wcm_nw_change_notification_t *nw_change_notification_config;
+    at_cmd_ref_app_scan_start_t *scan_start;
+    at_cmd_ref_ping_ip_addr_t *ping;
     cy_rslt_t result;
     char *cmd_txt = cmd;
     cJSON *json;
@@ -183,84 +653,162 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd(uint32_t cmd_id, uint32_t serial,
     switch (cmd_id)
     {
     case CMD_ID_AP_DISCONNECT:
-    case CMD_ID_SCAN_START:
     case CMD_ID_SCAN_STOP:
     case CMD_ID_AP_GET_INFO:
-    case CMD_ID_GET_IPv4_ADDRESS:
-    case CMD_ID_PING:
         /*
          * Commands with no arguments. We just need a basic config message structure.
          */
-        msg = (at_cmd_msg_base_t *)malloc(sizeof(at_cmd_msg_base_t));
+        msg = at_cmd_refapp_msg_alloc(sizeof(at_cmd_msg_base_t));
         if (msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error allocating WCM config message\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM config message\n"));
             break;
         }
         break;
 
-    case CMD_ID_AP_CONNECT:
-
-        json = cJSON_Parse(cmd_txt);
-        if (!json)
+    case CMD_ID_GET_IPv4_ADDRESS:
+        /*
+         * No arguments, the message is also used for the response.
+         */
+        msg = at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_host_ipv4_info_t));
+        if (msg == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error parsing the WCM connect specific\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM IPv4 info message\n"));
             break;
         }
+        break;
 
-        connect_config = malloc(sizeof(at_cmd_ref_app_wcm_connect_specific_t));
-        if (connect_config == NULL)
+    case CMD_ID_PING:
+        ping = (at_cmd_ref_ping_ip_addr_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_ping_ip_addr_t));
+        if (ping == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error allocating WCM connect specific message\n"));
-            cJSON_Delete(json);
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM ping message\n"));
             break;
         }
-        memset(connect_config, 0, sizeof(at_cmd_ref_app_wcm_connect_specific_t));
+        ping->count = 1;
+        ping->interval = AT_CMD_REF_APP_PING_DEFAULT_INTERVAL;
+        ping->timeout = AT_CMD_REF_APP_PING_DEFAULT_TIMEOUT;
 
-        result = setup_wcm_connect_config(connect_config, json);
-        cJSON_Delete(json);
+        /*
+         * Arguments are optional, without them the gateway is pinged once.
+         */
+        if ((cmd_len > 0) && (cmd_txt != NULL) && (cmd_txt[0] != '\0'))
+        {
+            json = cJSON_Parse(cmd_txt);
+            if (!json)
+            {
+                AT_CMD_REFAPP_LOG_ERR(("error parsing the WCM ping arguments\n"));
+                at_cmd_refapp_msg_free(&ping->base);
+                break;
+            }
+            result = wifi_parse_ping(ping, json);
+            cJSON_Delete(json);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                at_cmd_refapp_msg_free(&ping->base);
+                break;
+            }
+        }
+        msg = (at_cmd_msg_base_t *)ping;
+        break;
 
-        if (result != CY_RSLT_SUCCESS)
+    case CMD_ID_SCAN_START:
+    case CMD_ID_SCAN_GET_RESULTS:
+        scan_start = (at_cmd_ref_app_scan_start_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_scan_start_t));
+        if (scan_start == NULL)
         {
-            free(connect_config);
-            AT_CMD_REFAPP_LOG_MSG(("error WCM connect config setup\n"));
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM scan start message\n"));
             break;
         }
-        msg = (at_cmd_msg_base_t *)connect_config;
-
-        break;
+        scan_start->max_age = AT_CMD_REF_APP_SCAN_MAX_AGE_ANY;
+
+        /*
+         * Filters are optional, without arguments all access points are reported.
+         */
+        if ((cmd_len > 0) && (cmd_txt != NULL) && (cmd_txt[0] != '\0'))
+        {
+            json = cJSON_Parse(cmd_txt);
+            if (!json)
+            {
+                AT_CMD_REFAPP_LOG_ERR(("error parsing the WCM scan filter\n"));
+                at_cmd_refapp_msg_free(&scan_start->base);
+                break;
+            }
+            result = wifi_parse_scan_filter(&scan_start->filter, json);
+            if ((result == CY_RSLT_SUCCESS) && (cmd_id == CMD_ID_SCAN_GET_RESULTS))
+            {
+                result = wifi_parse_scan_query(scan_start, json);
+            }
+            cJSON_Delete(json);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                at_cmd_refapp_msg_free(&scan_start->base);
+                break;
+            }
+        }
+        msg = (at_cmd_msg_base_t *)scan_start;
+        break;
+
+    case CMD_ID_AP_CONNECT:
+
+        json = cJSON_Parse(cmd_txt);
+        if (!json)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error parsing the WCM connect specific\n"));
+            break;
+        }
+
+        connect_config = (at_cmd_ref_app_wcm_connect_specific_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_wcm_connect_specific_t));
+        if (connect_config == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM connect specific message\n"));
+            cJSON_Delete(json);
+            break;
+        }
+
+        result = setup_wcm_connect_config(connect_config, json);
+        cJSON_Delete(json);
+
+        if (result != CY_RSLT_SUCCESS)
+        {
+            at_cmd_refapp_msg_free(&connect_config->base);
+            AT_CMD_REFAPP_LOG_ERR(("error WCM connect config setup\n"));
+            break;
+        }
+        msg = (at_cmd_msg_base_t *)connect_config;
+
+        break;
 
     case CMD_ID_GET_IP_ADDRESS:
         json = cJSON_Parse(cmd_txt);
         if (!json)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error parsing WCM get ip message \n"));
+            AT_CMD_REFAPP_LOG_ERR(("error parsing WCM get ip message \n"));
             break;
         }
 
         if (!cJSON_HasObjectItem(json, STR_TOKEN_ADDR_TYPE))
         {
-            AT_CMD_REFAPP_LOG_MSG(("Invalid parameter set\n"));
+            AT_CMD_REFAPP_LOG_ERR(("Invalid parameter set\n"));
             cJSON_Delete(json);
             break;
         }
 
-        get_ip_config = (at_cmd_ref_app_wcm_get_ip_type_t *)malloc(sizeof(at_cmd_ref_app_wcm_get_ip_type_t));
+        get_ip_config = (at_cmd_ref_app_wcm_get_ip_type_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_wcm_get_ip_type_t));
         if (get_ip_config == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error allocating WCM get ip config message \n"));
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM get ip config message \n"));
             cJSON_Delete(json);
             break;
         }
-        memset(get_ip_config, 0, sizeof(at_cmd_ref_app_wcm_get_ip_type_t));
 
         get_ip_config->addr_type.version = cJSON_GetObjectItem(json, STR_TOKEN_ADDR_TYPE)->valueint;
         cJSON_Delete(json);
 
         if (get_ip_config->addr_type.version != CY_WCM_IP_VER_V4 && get_ip_config->addr_type.version != CY_WCM_IP_VER_V6)
         {
-            AT_CMD_REFAPP_LOG_MSG(("Invalid IP address type\n"));
-            free(get_ip_config);
+            AT_CMD_REFAPP_LOG_ERR(("Invalid IP address type\n"));
+            at_cmd_refapp_msg_free(&get_ip_config->base);
             break;
         }
         msg = (at_cmd_msg_base_t *)get_ip_config;
@@ -270,34 +818,38 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd(uint32_t cmd_id, uint32_t serial,
         json = cJSON_Parse(cmd_txt);
         if (!json)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error parsing WCM enable network change notification message \n"));
+            AT_CMD_REFAPP_LOG_ERR(("error parsing WCM enable network change notification message \n"));
             break;
         }
 
         if (!cJSON_HasObjectItem(json, STR_TOKEN_ENABLE))
         {
-            AT_CMD_REFAPP_LOG_MSG(("Invalid parameter set\n"));
+            AT_CMD_REFAPP_LOG_ERR(("Invalid parameter set\n"));
             cJSON_Delete(json);
             break;
         }
 
-        nw_change_notification_config = malloc(sizeof(at_cmd_ref_app_wcm_nw_change_notification_t));
+        nw_change_notification_config = (at_cmd_ref_app_wcm_nw_change_notification_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_wcm_nw_change_notification_t));
         if (nw_change_notification_config == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("error allocating WCM network change notification message \n"));
+            AT_CMD_REFAPP_LOG_ERR(("error allocating WCM network change notification message \n"));
             cJSON_Delete(json);
             break;
         }
-        memset(nw_change_notification_config, 0, sizeof(at_cmd_ref_app_wcm_nw_change_notification_t));
-        nw_change_notification_config->enable = cJSON_GetObjectItem(json, STR_TOKEN_ENABLE)->valueint;
+        result = wifi_parse_notification(nw_change_notification_config, json);
 
         cJSON_Delete(json);
 
+        if (result != CY_RSLT_SUCCESS)
+        {
+            at_cmd_refapp_msg_free(&nw_change_notification_config->base);
+            break;
+        }
         msg = (at_cmd_msg_base_t *)nw_change_notification_config;
         break;
 
     default:
-        AT_CMD_REFAPP_LOG_MSG(("Unimplemented cmd \n"));
+        AT_CMD_REFAPP_LOG_ERR(("Unimplemented cmd \n"));
         break;
     }
 
@@ -313,239 +865,1034 @@ at_cmd_msg_base_t *at_cmd_refapp_parse_wcm_cmd(uint32_t cmd_id, uint32_t serial,
     return msg;
 }
 /**
- * Process the command and create json text output
+ * Write the json text of a WCM response
  */
-cy_rslt_t at_cmd_refapp_process_wcm_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen)
+void at_cmd_refapp_wcm_write_json(at_cmd_ref_app_json_t *json, uint32_t cmd_id, at_cmd_msg_base_t *msg)
 {
-    cy_rslt_t result = CY_RSLT_SUCCESS;
     at_cmd_ref_app_host_ap_info_result_t *ap_info;
-    at_cmd_ref_app_scan_result_t *scan;
     at_cmd_ref_app_wcm_get_ip_type_t *ip_msg;
     at_cmd_ref_host_ipv4_info_t *ip_info_msg;
     at_cmd_ref_app_network_change_t *nw_event_info_msg;
     at_cmd_ref_ping_ip_addr_t *ping_info;
-    cJSON *cjson = NULL;
-    char *json_text = NULL;
+    at_cmd_ref_app_wcm_connect_progress_t *progress;
     char tmp_str[AT_CMD_REF_APP_IP_ADDR_STR_LEN];
-    uint32_t len;
     int idx;
 
-    /*
-     * Create a JSON object to construct the output data.
-     */
-    cjson = cJSON_CreateObject();
-    if (cjson == NULL)
+    if (cmd_id == CMD_ID_AP_CONNECT)
     {
-        return CY_RSLT_AT_CMD_REF_APP_ERR;
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_STATUS, WCM_TOKEN_ACCEPTED);
     }
-
-    if (cmd_id == CMD_ID_HOST_WCM_SCAN_INFO)
+    else if (cmd_id == CMD_ID_HOST_WCM_CONNECT_PROGRESS)
     {
-        scan = (at_cmd_ref_app_scan_result_t *)msg;
-        if (scan->scan_complete)
+        progress = (at_cmd_ref_app_wcm_connect_progress_t *)msg;
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_STATUS, connect_state_names[progress->state]);
+        if (progress->state == AT_CMD_REF_APP_CONNECT_IP_ACQUIRED)
         {
-            cJSON_AddStringToObject(cjson, WCM_TOKEN_STATUS, WCM_TOKEN_COMPLETE);
+            sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(progress->ip_addr.ip.v4));
+            at_cmd_refapp_json_string(json, STR_TOKEN_IP_ADDRESS, tmp_str);
         }
-        else
+        else if (progress->state == AT_CMD_REF_APP_CONNECT_FAILED)
         {
-            /*
-             * Create the JSON object with the results.
-             */
-
-            cJSON_AddItemToObject(cjson, WCM_TOKEN_SSID, cJSON_CreateString((const char *)scan->ssid));
-
-            snprintf(tmp_str, sizeof(tmp_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-                     scan->macaddr[0], scan->macaddr[1], scan->macaddr[2],
-                     scan->macaddr[3], scan->macaddr[4], scan->macaddr[5]);
-
-            cJSON_AddItemToObject(cjson, WCM_TOKEN_MACADDR, cJSON_CreateString((const char *)tmp_str));
-            cJSON_AddNumberToObject(cjson, WCM_TOKEN_CHANNEL, scan->channel);
-            cJSON_AddNumberToObject(cjson, WCM_TOKEN_BAND, scan->band);
-            cJSON_AddNumberToObject(cjson, WCM_TOKEN_SIGNAL_STRENGTH, scan->signal_strength);
-
-            idx = at_cmd_refapp_security_table_lookup_by_value(scan->security_type, security_table);
-            cJSON_AddStringToObject(cjson, WCM_TOKEN_SECURITY_TYPE, idx >= 0 ? security_table[idx].cmd_name : WCM_TOKEN_UNKNOWN);
-            cJSON_AddStringToObject(cjson, WCM_TOKEN_STATUS, WCM_TOKEN_INCOMPLETE);
+            snprintf(tmp_str, sizeof(tmp_str), "0x%08lx", (unsigned long)progress->reason);
+            at_cmd_refapp_json_string(json, WCM_TOKEN_REASON, tmp_str);
+        }
+        if (progress->state >= AT_CMD_REF_APP_CONNECT_IP_ACQUIRED)
+        {
+            at_cmd_refapp_json_number(json, WCM_TOKEN_CONNECT_TIME, progress->connect_time);
+            at_cmd_refapp_json_bool(json, WCM_TOKEN_DIRECTED, progress->directed);
+        }
+        if ((progress->state == AT_CMD_REF_APP_CONNECT_IP_ACQUIRED) && (progress->saved_time > 0))
+        {
+            at_cmd_refapp_json_number(json, WCM_TOKEN_SAVED_TIME, progress->saved_time);
         }
     }
-    else if (cmd_id == CMD_ID_AP_GET_INFO)
+    else if (cmd_id == CMD_ID_HOST_WCM_SCAN_INFO)
+    {
+        wifi_scan_write_chunk(json, (at_cmd_ref_app_scan_chunk_t *)msg);
+        return;
+    }
+    else if (cmd_id == CMD_ID_SCAN_GET_RESULTS)
     {
-        ap_info = (at_cmd_ref_app_host_ap_info_result_t *)msg;
-
         /*
-         * Create the JSON object with the results.
+         * max_age is cleared when the query started a new scan.
          */
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_bool(json, WCM_TOKEN_CACHED, ((at_cmd_ref_app_scan_start_t *)msg)->max_age != 0);
+    }
+    else if (cmd_id == CMD_ID_AP_GET_INFO)
+    {
+        ap_info = (at_cmd_ref_app_host_ap_info_result_t *)msg;
 
-        cJSON_AddItemToObject(cjson, WCM_TOKEN_SSID, cJSON_CreateString((const char *)ap_info->ssid));
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_SSID, (const char *)ap_info->ssid);
 
         snprintf(tmp_str, sizeof(tmp_str), "%02x:%02x:%02x:%02x:%02x:%02x",
                  ap_info->bssid[0], ap_info->bssid[1], ap_info->bssid[2],
                  ap_info->bssid[3], ap_info->bssid[4], ap_info->bssid[5]);
 
-        cJSON_AddItemToObject(cjson, WCM_TOKEN_BSSID, cJSON_CreateString((const char *)tmp_str));
-        cJSON_AddNumberToObject(cjson, WCM_TOKEN_CHANNEL, ap_info->channel);
-        cJSON_AddNumberToObject(cjson, WCM_TOKEN_CHANNEL_WIDTH, ap_info->channel_width);
-        cJSON_AddNumberToObject(cjson, WCM_TOKEN_SIGNAL_STRENGTH, ap_info->signal_strength);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_BSSID, tmp_str);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_CHANNEL, ap_info->channel);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_CHANNEL_WIDTH, ap_info->channel_width);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_SIGNAL_STRENGTH, ap_info->signal_strength);
 
         idx = at_cmd_refapp_security_table_lookup_by_value(ap_info->security_type, security_table);
-        AT_CMD_REFAPP_LOG_MSG(("CMD_ID_AP_GET_INFO idx:%d security_type:%llx\n", idx, ap_info->security_type));
+        AT_CMD_REFAPP_LOG_DBG(("CMD_ID_AP_GET_INFO idx:%d security_type:%llx\n", idx, ap_info->security_type));
 
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_SECURITY_TYPE, idx >= 0 ? security_table[idx].cmd_name : WCM_TOKEN_UNKNOWN);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_SECURITY_TYPE, idx >= 0 ? security_table[idx].cmd_name : WCM_TOKEN_UNKNOWN);
     }
     else if (cmd_id == CMD_ID_GET_IP_ADDRESS)
     {
         ip_msg = (at_cmd_ref_app_wcm_get_ip_type_t *)msg;
 
         sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_msg->addr_type.ip.v4));
-        cJSON_AddStringToObject(cjson, STR_TOKEN_IP_ADDRESS, tmp_str);
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, STR_TOKEN_IP_ADDRESS, tmp_str);
     }
     else if (cmd_id == CMD_ID_PING)
+    {
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_STATUS, WCM_TOKEN_ACCEPTED);
+    }
+    else if (cmd_id == CMD_ID_HOST_WCM_PING_RESULT)
     {
         ping_info = (at_cmd_ref_ping_ip_addr_t *)msg;
-        cJSON_AddNumberToObject(cjson, STR_TOKEN_ELAPSED_TIME, ping_info->elapsed_time);
+
+        sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ping_info->ip_addr.ip.v4));
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, STR_TOKEN_IP_ADDRESS, tmp_str);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_SENT, ping_info->count);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_RECEIVED, ping_info->received);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_LOSS, ((ping_info->count - ping_info->received) * 100) / ping_info->count);
+        if (ping_info->received > 0)
+        {
+            at_cmd_refapp_json_number(json, WCM_TOKEN_MIN, ping_info->min_time);
+            at_cmd_refapp_json_number(json, WCM_TOKEN_AVG, ping_info->avg_time);
+            at_cmd_refapp_json_number(json, WCM_TOKEN_MAX, ping_info->max_time);
+            at_cmd_refapp_json_number(json, WCM_TOKEN_JITTER, ping_info->jitter);
+        }
     }
     else if (cmd_id == CMD_ID_GET_IPv4_ADDRESS)
     {
         ip_info_msg = (at_cmd_ref_host_ipv4_info_t *)msg;
 
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_METHOD, ip_info_msg->dhcp ? WCM_TOKEN_DHCP : WCM_TOKEN_STATIC);
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_METHOD, ip_info_msg->dhcp ? WCM_TOKEN_DHCP : WCM_TOKEN_STATIC);
 
         sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->address));
-        cJSON_AddStringToObject(cjson, STR_TOKEN_IP_ADDRESS, tmp_str);
+        at_cmd_refapp_json_string(json, STR_TOKEN_IP_ADDRESS, tmp_str);
 
         sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->netmask));
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_NETMASK, tmp_str);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_NETMASK, tmp_str);
 
         sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->gateway));
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_GATEWAY, tmp_str);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_GATEWAY, tmp_str);
+
+        /*
+         * WCM does not expose the DNS servers, only report them when known.
+         */
+        if (ip_info_msg->primary != 0)
+        {
+            sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->primary));
+            at_cmd_refapp_json_string(json, WCM_TOKEN_PRIMARY_DNS, tmp_str);
+        }
+
+        if (ip_info_msg->secondary != 0)
+        {
+            sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->secondary));
+            at_cmd_refapp_json_string(json, WCM_TOKEN_SECONDARY_DNS, tmp_str);
+        }
+    }
+    else if (cmd_id == CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION)
+    {
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_bool(json, STR_TOKEN_ENABLED, g_wcm_notify.enabled);
+        if (g_wcm_notify.enabled)
+        {
+            at_cmd_refapp_json_array_begin(json, WCM_TOKEN_EVENTS);
+            for (idx = 0; idx < (int)WCM_EVENT_COUNT; idx++)
+            {
+                if (g_wcm_notify.events & (1 << idx))
+                {
+                    at_cmd_refapp_json_string(json, NULL, wcm_event_names[idx]);
+                }
+            }
+            at_cmd_refapp_json_array_end(json);
+            at_cmd_refapp_json_number(json, WCM_TOKEN_DEBOUNCE, g_wcm_notify.debounce);
+        }
+    }
+    else if (cmd_id == CMD_ID_HOST_WCM_NETWORK_EVENT)
+    {
+        nw_event_info_msg = (at_cmd_ref_app_network_change_t *)msg;
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_EVENT, (uint32_t)nw_event_info_msg->event < WCM_EVENT_COUNT ?
+                                  wcm_event_names[nw_event_info_msg->event] : WCM_TOKEN_UNKNOWN);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_NW_STATUS, nw_event_info_msg->event);
+        if (nw_event_info_msg->ip_addr.ip.v4 != 0)
+        {
+            sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(nw_event_info_msg->ip_addr.ip.v4));
+            at_cmd_refapp_json_string(json, STR_TOKEN_IP_ADDRESS, tmp_str);
+        }
+        if (nw_event_info_msg->coalesced > 0)
+        {
+            at_cmd_refapp_json_number(json, WCM_TOKEN_COALESCED, nw_event_info_msg->coalesced);
+        }
+    }
+    else
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Unimplemented cmd: 0x%04lx\n", cmd_id));
+        return;
+    }
+    at_cmd_refapp_json_object_end(json);
+}
+
+/**
+ * Process the command and create json text output
+ */
+cy_rslt_t at_cmd_refapp_process_wcm_host_msg(uint32_t cmd_id, at_cmd_msg_base_t *msg, char *buffer, uint32_t buflen)
+{
+    return at_cmd_refapp_json_render(at_cmd_refapp_wcm_write_json, cmd_id, msg, buffer, buflen);
+}
+
+/*
+ * Find the scan table entry for bssid, or the slot a new access point should
+ * go into. When the table is full, the entry not seen for the longest time is
+ * replaced if it predates the current scan, else the weakest one if the new
+ * access point is stronger. Returns NULL if the result is dropped. Called with
+ * the scan table mutex held.
+ */
+static at_cmd_ref_app_scan_entry_t *wifi_scan_table_slot(const uint8_t *bssid, int16_t signal_strength)
+{
+    at_cmd_ref_app_scan_entry_t *oldest = NULL;
+    at_cmd_ref_app_scan_entry_t *weakest = NULL;
+    at_cmd_ref_app_scan_entry_t *entry;
+    uint32_t i;
+
+    for (i = 0; i < g_scan_table.count; i++)
+    {
+        entry = &g_scan_table.entries[i];
+        if (memcmp(entry->bssid, bssid, CY_WCM_MAC_ADDR_LEN) == 0)
+        {
+            return entry;
+        }
+        if ((oldest == NULL) || ((int32_t)(entry->last_seen - oldest->last_seen) < 0))
+        {
+            oldest = entry;
+        }
+        if ((weakest == NULL) || (entry->signal_strength < weakest->signal_strength))
+        {
+            weakest = entry;
+        }
+    }
+
+    if (g_scan_table.count < AT_CMD_REF_APP_SCAN_TABLE_SIZE)
+    {
+        entry = &g_scan_table.entries[g_scan_table.count++];
+        memset(entry, 0, sizeof(at_cmd_ref_app_scan_entry_t));
+        return entry;
+    }
+
+    if ((int32_t)(oldest->last_seen - g_scan_table.scan_start_time) < 0)
+    {
+        memset(oldest, 0, sizeof(at_cmd_ref_app_scan_entry_t));
+        return oldest;
+    }
+
+    if (weakest->signal_strength < signal_strength)
+    {
+        g_scan_table.replaced++;
+        memset(weakest, 0, sizeof(at_cmd_ref_app_scan_entry_t));
+        return weakest;
+    }
+    g_scan_table.dropped++;
+    return NULL;
+}
+
+/*
+ * Callback function which receives the scan results.
+ */
+static void wifi_scan_handler(cy_wcm_scan_result_t *result_ptr, void *user_data, cy_wcm_scan_status_t status)
+{
+    at_cmd_ref_app_scan_result_t *msg;
+    at_cmd_ref_app_scan_entry_t *entry;
+    cy_time_t now;
+    bool new_entry;
+
+    cy_rtos_get_time(&now);
+    cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+
+    if (!g_scan_table.active)
+    {
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+        return;
+    }
+
+    if (status == CY_WCM_SCAN_INCOMPLETE)
+    {
+        if (!wifi_scan_filter_match(&g_scan_table.filter, result_ptr->BSSID, (const char *)result_ptr->SSID,
+                                    result_ptr->signal_strength, result_ptr->band, result_ptr->channel))
+        {
+            cy_rtos_set_mutex(&g_scan_table.mutex);
+            return;
+        }
+
+        /*
+         * Access points are reported once per beacon/probe response, keep a
+         * single entry per BSSID with the strongest signal seen in this scan.
+         */
+        entry = wifi_scan_table_slot(result_ptr->BSSID, result_ptr->signal_strength);
+        if (entry == NULL)
+        {
+            cy_rtos_set_mutex(&g_scan_table.mutex);
+            return;
+        }
+        new_entry = NULL_MAC(entry->bssid) || ((int32_t)(entry->last_seen - g_scan_table.scan_start_time) < 0);
+        if (new_entry || (result_ptr->signal_strength > entry->signal_strength))
+        {
+            entry->signal_strength = result_ptr->signal_strength;
+            entry->channel = result_ptr->channel;
+            entry->band = result_ptr->band;
+            entry->security_type = result_ptr->security;
+        }
+        if (new_entry || ((entry->ssid_length == 0) && (result_ptr->SSID[0] != '\0')))
+        {
+            entry->ssid_length = strnlen((char *)result_ptr->SSID, CY_WCM_MAX_SSID_LEN);
+            memcpy(entry->ssid, result_ptr->SSID, entry->ssid_length);
+            entry->ssid[entry->ssid_length] = '\0';
+        }
+        memcpy(entry->bssid, result_ptr->BSSID, CY_WCM_MAC_ADDR_LEN);
+        entry->last_seen = now;
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+        return;
+    }
+
+    /*
+     * Scan complete, a single message tells the wcm_cmd worker to send the
+     * access points seen by this scan.
+     */
+    g_scan_table.active = false;
+    g_scan_table.valid = true;
+    g_scan_table.last_scan_time = now;
+
+    msg = (at_cmd_ref_app_scan_result_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_scan_result_t));
+    if (msg == NULL)
+    {
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+        AT_CMD_REFAPP_LOG_ERR(("wifi_scan_handler malloc failed\n"));
+        return;
+    }
+    msg->base.serial = (uint32_t)user_data;
+    msg->base.cmd_id = CMD_ID_HOST_WCM_SCAN_INFO;
+    memcpy(&msg->filter, &g_scan_table.filter, sizeof(at_cmd_ref_app_scan_filter_t));
+    msg->seen_since = g_scan_table.scan_start_time;
+    msg->sort_rssi = g_scan_table.sort_rssi;
+    msg->num_dropped = g_scan_table.dropped;
+    msg->num_replaced = g_scan_table.replaced;
+    cy_rtos_set_mutex(&g_scan_table.mutex);
+
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
+        at_cmd_refapp_msg_free(&msg->base);
+    }
+    else
+    {
+        AT_CMD_REFAPP_LOG_DBG(("posted message cmd_id:%ld \n", msg->base.cmd_id));
+    }
+}
+
+/*
+ * Start a scan that refreshes the scan table. Entries of earlier scans are
+ * kept with their age until they are seen again or replaced.
+ */
+static cy_rslt_t wifi_start_scan(uint32_t serial, const at_cmd_ref_app_scan_filter_t *filter, bool sort_rssi)
+{
+    cy_wcm_scan_filter_t wcm_filter;
+    cy_rslt_t result;
+
+    cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+    memcpy(&g_scan_table.filter, filter, sizeof(at_cmd_ref_app_scan_filter_t));
+    g_scan_table.sort_rssi = sort_rssi;
+    g_scan_table.dropped = 0;
+    g_scan_table.replaced = 0;
+    cy_rtos_get_time(&g_scan_table.scan_start_time);
+    g_scan_table.active = true;
+    cy_rtos_set_mutex(&g_scan_table.mutex);
+
+    result = cy_wcm_start_scan(wifi_scan_handler, (void *)serial, wifi_scan_filter_to_wcm(filter, &wcm_filter));
+    if (result != CY_RSLT_SUCCESS)
+    {
+        cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+        g_scan_table.active = false;
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+    }
+    return result;
+}
+
+/*
+ * The cached table can answer a query if the last scan is recent enough and
+ * was not restricted by a different filter. Called with the scan table mutex
+ * held.
+ */
+static bool wifi_scan_cache_usable(const at_cmd_ref_app_scan_start_t *query)
+{
+    cy_time_t now;
+
+    if ((!g_scan_table.valid) || g_scan_table.active)
+    {
+        return false;
+    }
+    if ((g_scan_table.filter.flags != 0) &&
+        (memcmp(&g_scan_table.filter, &query->filter, sizeof(at_cmd_ref_app_scan_filter_t)) != 0))
+    {
+        return false;
+    }
+    if (query->max_age != AT_CMD_REF_APP_SCAN_MAX_AGE_ANY)
+    {
+        cy_rtos_get_time(&now);
+        if ((now - g_scan_table.last_scan_time) > query->max_age)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Refresh the network info snapshot. Only called on link and IP changes.
+ */
+static void wifi_netinfo_refresh(bool connected)
+{
+    cy_wcm_ip_address_t ip_addr;
+    ipv4_addr_t address = 0;
+    ipv4_addr_t netmask = 0;
+    ipv4_addr_t gateway = 0;
+
+    if (connected)
+    {
+        if (cy_wcm_get_ip_addr(CY_WCM_INTERFACE_TYPE_STA, &ip_addr) == CY_RSLT_SUCCESS)
+        {
+            address = ip_addr.ip.v4;
+        }
+        if (cy_wcm_get_ip_netmask(CY_WCM_INTERFACE_TYPE_STA, &ip_addr) == CY_RSLT_SUCCESS)
+        {
+            netmask = ip_addr.ip.v4;
+        }
+        if (cy_wcm_get_gateway_ip_address(CY_WCM_INTERFACE_TYPE_STA, &ip_addr) == CY_RSLT_SUCCESS)
+        {
+            gateway = ip_addr.ip.v4;
+        }
+    }
+
+    cy_rtos_get_mutex(&g_wcm_netinfo.mutex, AT_CMD_REF_APP_WAITFOREVER);
+    /*
+     * Static IP is not supported by WCM_APConnect, the address is always
+     * from DHCP.
+     */
+    g_wcm_netinfo.dhcp = true;
+    g_wcm_netinfo.address = address;
+    g_wcm_netinfo.netmask = netmask;
+    g_wcm_netinfo.gateway = gateway;
+    g_wcm_netinfo.connected = connected && (address != 0);
+    cy_rtos_set_mutex(&g_wcm_netinfo.mutex);
+}
+
+/*
+ * Remember the access point we are associated with. The band is taken from
+ * the scan table if the AP was seen by a scan, else derived from the channel.
+ */
+static void wifi_save_last_ap(const at_cmd_ref_app_wcm_connect_specific_t *connect)
+{
+    cy_wcm_associated_ap_info_t ap_info;
+    uint32_t i;
+
+    memset(&ap_info, 0, sizeof(cy_wcm_associated_ap_info_t));
+    if (cy_wcm_get_associated_ap_info(&ap_info) != CY_RSLT_SUCCESS)
+    {
+        g_wcm_last_ap.valid = false;
+        return;
+    }
+
+    g_wcm_last_ap.ssid_length = connect->ssid_length;
+    memcpy(g_wcm_last_ap.ssid, connect->ssid, connect->ssid_length);
+    g_wcm_last_ap.ssid[connect->ssid_length] = '\0';
+    memcpy(g_wcm_last_ap.bssid, ap_info.BSSID, CY_WCM_MAC_ADDR_LEN);
+    g_wcm_last_ap.channel = ap_info.channel;
+    g_wcm_last_ap.band = (ap_info.channel > 14) ? CY_WCM_WIFI_BAND_5GHZ : CY_WCM_WIFI_BAND_2_4GHZ;
+    cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+    for (i = 0; i < g_scan_table.count; i++)
+    {
+        if (memcmp(g_scan_table.entries[i].bssid, ap_info.BSSID, CY_WCM_MAC_ADDR_LEN) == 0)
+        {
+            g_wcm_last_ap.band = g_scan_table.entries[i].band;
+            break;
+        }
+    }
+    cy_rtos_set_mutex(&g_scan_table.mutex);
+    g_wcm_last_ap.valid = !NULL_MAC(g_wcm_last_ap.bssid);
+}
+
+/*
+ * Connect to the AP, trying the last associated BSSID and band first if the
+ * host did not ask for a specific AP. WCM then only has to find that BSSID
+ * instead of scanning for the SSID on all channels.
+ */
+static cy_rslt_t wifi_connect(at_cmd_ref_app_wcm_connect_specific_t *connect, cy_wcm_connect_params_t *connect_param,
+                              cy_wcm_ip_address_t *ip_addr)
+{
+    cy_time_t start;
+    cy_time_t end;
+    cy_rslt_t result = CY_RSLT_AT_CMD_REF_APP_ERR;
+
+    cy_rtos_get_time(&start);
+
+    connect->directed = g_wcm_last_ap.valid && NULL_MAC(connect->macaddr) &&
+                        (connect->ssid_length == g_wcm_last_ap.ssid_length) &&
+                        (memcmp(connect->ssid, g_wcm_last_ap.ssid, connect->ssid_length) == 0) &&
+                        ((connect->band == CY_WCM_WIFI_BAND_ANY) || (connect->band == g_wcm_last_ap.band));
+    if (connect->directed)
+    {
+        memcpy(connect_param->BSSID, g_wcm_last_ap.bssid, CY_WCM_MAC_ADDR_LEN);
+        connect_param->band = g_wcm_last_ap.band;
+        result = cy_wcm_connect_ap(connect_param, ip_addr);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("directed connect to channel %d failed %lx, trying full scan\n", g_wcm_last_ap.channel, result));
+            g_wcm_last_ap.valid = false;
+            connect->directed = false;
+            memset(connect_param->BSSID, 0, CY_WCM_MAC_ADDR_LEN);
+            connect_param->band = connect->band;
+        }
+    }
+
+    if (!connect->directed)
+    {
+        result = cy_wcm_connect_ap(connect_param, ip_addr);
+    }
+
+    cy_rtos_get_time(&end);
+    connect->connect_time = end - start;
+
+    if (result == CY_RSLT_SUCCESS)
+    {
+        if (!connect->directed)
+        {
+            g_wcm_last_ap.full_connect_time = connect->connect_time;
+        }
+        wifi_save_last_ap(connect);
+    }
+    return result;
+}
+
+/*
+ * Queue a WCM_APConnect progress event for the host.
+ */
+static void wifi_post_connect_progress(uint32_t serial, at_cmd_ref_app_connect_state_t state, cy_rslt_t reason,
+                                       const cy_wcm_ip_address_t *ip_addr, const at_cmd_ref_app_wcm_connect_specific_t *connect)
+{
+    at_cmd_ref_app_wcm_connect_progress_t *msg;
+
+    msg = (at_cmd_ref_app_wcm_connect_progress_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_wcm_connect_progress_t));
+    if (msg == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("alloc at_cmd_ref_app_wcm_connect_progress_t failed\n"));
+        return;
+    }
+    msg->base.cmd_id = CMD_ID_HOST_WCM_CONNECT_PROGRESS;
+    msg->base.serial = serial;
+    msg->state = state;
+    msg->reason = reason;
+    if (ip_addr != NULL)
+    {
+        memcpy(&msg->ip_addr, ip_addr, sizeof(cy_wcm_ip_address_t));
+    }
+    if (connect != NULL)
+    {
+        msg->directed = connect->directed;
+        msg->connect_time = connect->connect_time;
+        if (connect->directed && (g_wcm_last_ap.full_connect_time > connect->connect_time))
+        {
+            msg->saved_time = g_wcm_last_ap.full_connect_time - connect->connect_time;
+        }
+    }
+
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
+        at_cmd_refapp_msg_free(&msg->base);
+    }
+}
+
+/*
+ * Run WCM_APConnect, reporting the progress to the host.
+ */
+static void wifi_worker_connect(at_cmd_ref_app_wcm_connect_specific_t *connect)
+{
+    cy_wcm_connect_params_t connect_param;
+    cy_wcm_ip_address_t ip_addr;
+    cy_rslt_t result;
+
+    /*
+     * Setup WCM connect parameters.
+     */
+    memset(&connect_param, 0, sizeof(cy_wcm_connect_params_t));
+    memset(&ip_addr, 0, sizeof(cy_wcm_ip_address_t));
+    memcpy(connect_param.ap_credentials.SSID, connect->ssid, connect->ssid_length);
+    connect_param.ap_credentials.security = connect->security_type;
+
+    if (connect_param.ap_credentials.security != CY_WCM_SECURITY_OPEN)
+    {
+        memcpy(connect_param.ap_credentials.password, connect->password, strlen(connect->password) + 1);
+    }
+
+    if (!NULL_MAC(connect->macaddr))
+    {
+        memcpy(connect_param.BSSID, connect->macaddr, CY_WCM_MAC_ADDR_LEN);
+    }
+    connect_param.band = connect->band;
+
+    wifi_post_connect_progress(connect->base.serial, AT_CMD_REF_APP_CONNECT_ASSOCIATING, CY_RSLT_SUCCESS, NULL, NULL);
+
+    /*
+     * Connect to AP.
+     */
+    result = wifi_connect(connect, &connect_param, &ip_addr);
+    if (result == CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_MSG(("network Connection successful IP:%d.%d.%d.%d time:%lu directed:%d\n",
+                               PRINT_IP(ip_addr.ip.v4), connect->connect_time, connect->directed));
+        wifi_netinfo_refresh(true);
+        wifi_post_connect_progress(connect->base.serial, AT_CMD_REF_APP_CONNECT_IP_ACQUIRED, result, &ip_addr, connect);
+    }
+    else
+    {
+        AT_CMD_REFAPP_LOG_ERR(("network Connection failed %lx\n", result));
+        wifi_post_connect_progress(connect->base.serial, AT_CMD_REF_APP_CONNECT_FAILED, result, NULL, connect);
+    }
+
+    memset(connect->password, 0, sizeof(connect->password));
+    at_cmd_refapp_msg_free(&connect->base);
+}
+
+/*
+ * Run WCM_Ping and post the statistics to the host. The ping message is
+ * reused for the result.
+ */
+static void wifi_worker_ping(at_cmd_ref_ping_ip_addr_t *ping)
+{
+    cy_time_t start;
+    cy_time_t end;
+    uint32_t elapsed_time;
+    uint32_t last_time = 0;
+    uint32_t total_time = 0;
+    uint32_t total_diff = 0;
+    uint32_t i;
+    cy_rslt_t result;
+
+    ping->received = 0;
+    ping->min_time = 0xFFFFFFFF;
+    ping->max_time = 0;
+
+    for (i = 0; i < ping->count; i++)
+    {
+        cy_rtos_get_time(&start);
+        elapsed_time = 0;
+        result = cy_wcm_ping(CY_WCM_INTERFACE_TYPE_STA, &ping->ip_addr, ping->timeout, &elapsed_time);
+        if (result == CY_RSLT_SUCCESS)
+        {
+            if (ping->received > 0)
+            {
+                total_diff += (elapsed_time > last_time) ? elapsed_time - last_time : last_time - elapsed_time;
+            }
+            ping->received++;
+            total_time += elapsed_time;
+            last_time = elapsed_time;
+            ping->min_time = elapsed_time < ping->min_time ? elapsed_time : ping->min_time;
+            ping->max_time = elapsed_time > ping->max_time ? elapsed_time : ping->max_time;
+        }
+        else
+        {
+            AT_CMD_REFAPP_LOG_ERR(("Ping failed result:%lx\n", result));
+        }
+
+        /*
+         * Send the pings interval ms apart, a timed out ping already used up
+         * part of the interval.
+         */
+        if (i + 1 < ping->count)
+        {
+            cy_rtos_get_time(&end);
+            if ((end - start) < ping->interval)
+            {
+                cy_rtos_delay_milliseconds(ping->interval - (end - start));
+            }
+        }
+    }
+
+    if (ping->received > 0)
+    {
+        ping->avg_time = total_time / ping->received;
+        ping->jitter = ping->received > 1 ? total_diff / (ping->received - 1) : 0;
+    }
+    else
+    {
+        ping->min_time = 0;
+    }
+
+    ping->base.cmd_id = CMD_ID_HOST_WCM_PING_RESULT;
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)ping) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
+        at_cmd_refapp_msg_free(&ping->base);
+    }
+}
+
+/*
+ * Worker thread running WCM_APConnect and WCM_Ping. The wcm_cmd worker hands
+ * over the job messages and keeps processing commands while we wait for WCM.
+ */
+static void wifi_worker(cy_thread_arg_t arg)
+{
+    at_cmd_msg_base_t *job;
+
+    (void)arg;
+
+    for (;;)
+    {
+        job = NULL;
+        if (cy_rtos_queue_get(&g_wcm_worker.queue, &job, AT_CMD_REF_APP_WAITFOREVER) != CY_RSLT_SUCCESS || job == NULL)
+        {
+            continue;
+        }
+
+        AT_CMD_REFAPP_BENCH_FAULT_DELAY(AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY);
+
+        if (job->cmd_id == CMD_ID_AP_CONNECT)
+        {
+            wifi_worker_connect((at_cmd_ref_app_wcm_connect_specific_t *)job);
+            g_wcm_worker.connect_pending = false;
+        }
+        else if (job->cmd_id == CMD_ID_PING)
+        {
+            wifi_worker_ping((at_cmd_ref_ping_ip_addr_t *)job);
+            g_wcm_worker.ping_pending = false;
+        }
+        else
+        {
+            AT_CMD_REFAPP_LOG_ERR(("WCM worker unknown job cmd_id:%ld\n", job->cmd_id));
+            at_cmd_refapp_msg_free(job);
+        }
+    }
+}
+
+/*
+ * Write a scan results chunk. Only the copied entries are read, so the two
+ * passes of a chunk sent in parts write the same text.
+ */
+static void wifi_scan_write_chunk(at_cmd_ref_app_json_t *json, const at_cmd_ref_app_scan_chunk_t *chunk)
+{
+    const at_cmd_ref_app_scan_entry_t *entry;
+    char tmp_str[AT_CMD_REF_APP_IP_ADDR_STR_LEN];
+    uint32_t i;
+    int idx;
+
+    at_cmd_refapp_json_object_begin(json, NULL);
+    at_cmd_refapp_json_array_begin(json, WCM_TOKEN_RESULTS);
+
+    for (i = 0; i < chunk->num_entries; i++)
+    {
+        entry = &chunk->entries[i];
+
+        at_cmd_refapp_json_object_begin(json, NULL);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_SSID, (const char *)entry->ssid);
+
+        snprintf(tmp_str, sizeof(tmp_str), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 entry->bssid[0], entry->bssid[1], entry->bssid[2],
+                 entry->bssid[3], entry->bssid[4], entry->bssid[5]);
+
+        at_cmd_refapp_json_string(json, WCM_TOKEN_MACADDR, tmp_str);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_CHANNEL, entry->channel);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_BAND, entry->band);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_SIGNAL_STRENGTH, entry->signal_strength);
+
+        idx = at_cmd_refapp_security_table_lookup_by_value(entry->security_type, security_table);
+        at_cmd_refapp_json_string(json, WCM_TOKEN_SECURITY_TYPE, idx >= 0 ? security_table[idx].cmd_name : WCM_TOKEN_UNKNOWN);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_AGE, chunk->now - entry->last_seen);
+        at_cmd_refapp_json_object_end(json);
+    }
+    at_cmd_refapp_json_array_end(json);
+
+    if (chunk->last)
+    {
+        at_cmd_refapp_json_string(json, WCM_TOKEN_STATUS, WCM_TOKEN_COMPLETE);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_COUNT, chunk->count);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_DROPPED, chunk->num_dropped);
+        at_cmd_refapp_json_number(json, WCM_TOKEN_REPLACED, chunk->num_replaced);
+    }
+    else
+    {
+        at_cmd_refapp_json_string(json, WCM_TOKEN_STATUS, WCM_TOKEN_INCOMPLETE);
+    }
+    at_cmd_refapp_json_object_end(json);
+}
+
+/**
+ * Send scan table entries to the host as async responses, each holding up to
+ * AT_CMD_REF_APP_SCAN_RESULTS_PER_CHUNK access points. The entries of a chunk
+ * are copied out of the table so the mutex is not held while sending, the
+ * chunk is written as it is sent, in parts if it is longer than a frame.
+ */
+void at_cmd_refapp_wcm_send_scan_results(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str)
+{
+    at_cmd_ref_app_scan_result_t *scan = (at_cmd_ref_app_scan_result_t *)msg;
+    at_cmd_ref_app_scan_entry_t *entry;
+    at_cmd_ref_app_scan_chunk_t chunk;
+    uint8_t order[AT_CMD_REF_APP_SCAN_TABLE_SIZE];
+    uint32_t num_results = 0;
+    uint32_t index = 0;
+    uint32_t i;
+    uint32_t j;
+
+    /*
+     * Select the entries to report, strongest first if requested.
+     */
+    cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+    for (i = 0; i < g_scan_table.count; i++)
+    {
+        entry = &g_scan_table.entries[i];
+        if (((scan->seen_since != 0) && ((int32_t)(entry->last_seen - scan->seen_since) < 0)) ||
+            (!wifi_scan_filter_match(&scan->filter, entry->bssid, entry->ssid, entry->signal_strength, entry->band, entry->channel)))
+        {
+            continue;
+        }
+        j = num_results++;
+        while (scan->sort_rssi && (j > 0) && (g_scan_table.entries[order[j - 1]].signal_strength < entry->signal_strength))
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (uint8_t)i;
+    }
+    cy_rtos_set_mutex(&g_scan_table.mutex);
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.base.cmd_id = CMD_ID_HOST_WCM_SCAN_INFO;
+    chunk.base.serial = msg->serial;
+    chunk.count = num_results;
+    chunk.num_dropped = scan->num_dropped;
+    chunk.num_replaced = scan->num_replaced;
+    cy_rtos_get_time(&chunk.now);
+
+    do
+    {
+        chunk.num_entries = num_results - index;
+        if (chunk.num_entries > AT_CMD_REF_APP_SCAN_RESULTS_PER_CHUNK)
+        {
+            chunk.num_entries = AT_CMD_REF_APP_SCAN_RESULTS_PER_CHUNK;
+        }
+
+        cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+        for (i = 0; i < chunk.num_entries; i++)
+        {
+            memcpy(&chunk.entries[i], &g_scan_table.entries[order[index + i]], sizeof(at_cmd_ref_app_scan_entry_t));
+        }
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+        index += chunk.num_entries;
+        chunk.last = index >= num_results;
+
+        at_cmd_refapp_json_send(msg->serial, AT_CMD_REF_APP_RESULT_STATUS_SUCCESS, true, at_cmd_refapp_wcm_write_json,
+                                CMD_ID_HOST_WCM_SCAN_INFO, &chunk.base, result_str->result_text, AT_CMD_REF_APP_JSON_PART_SIZE);
+    } while (index < num_results);
+}
+
+/**
+ *  event callback for handling wcm connection events
+ */
+static void network_event_change_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data)
+{
+    at_cmd_ref_app_network_change_t *msg = NULL;
+    at_cmd_msg_base_t *at_cmd_msg = NULL;
 
-        sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->primary));
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_PRIMARY_DNS, tmp_str);
+    AT_CMD_REFAPP_LOG_DBG(("Received WCM event = %d\n", event));
 
-        sprintf(tmp_str, "%d.%d.%d.%d", PRINT_IP(ip_info_msg->secondary));
-        cJSON_AddStringToObject(cjson, WCM_TOKEN_SECONDARY_DNS, tmp_str);
+    if ((event == CY_WCM_EVENT_CONNECTED) || (event == CY_WCM_EVENT_RECONNECTED) || (event == CY_WCM_EVENT_IP_CHANGED))
+    {
+        wifi_netinfo_refresh(true);
     }
-    else if (cmd_id == CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION)
+    else if (event == CY_WCM_EVENT_DISCONNECTED)
     {
-        nw_event_info_msg = (at_cmd_ref_app_network_change_t *)msg;
-        cJSON_AddNumberToObject(cjson, WCM_TOKEN_NW_STATUS, nw_event_info_msg->event);
+        wifi_netinfo_refresh(false);
     }
-    else
+
+    if ((!g_wcm_notify.enabled) || ((g_wcm_notify.events & (1 << event)) == 0))
     {
-        AT_CMD_REFAPP_LOG_MSG(("Unimplemented cmd: 0x%04lx\n", cmd_id));
-        cJSON_Delete(cjson);
-        cjson = NULL;
+        return;
     }
 
-    /*
-     * Do we have a JSON object to output?
-     */
-    if (cjson != NULL)
+    msg = (at_cmd_ref_app_network_change_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_network_change_t));
+    if (msg == NULL)
     {
-        /*
-         * Create the output JSON text and copy it to the output buffer.
-         */
-        json_text = cJSON_PrintUnformatted(cjson);
-        cJSON_Delete(cjson);
+        AT_CMD_REFAPP_LOG_ERR(("alloc at_cmd_ref_app_network_change_t failed\n"));
+        return;
+    }
 
-        if (json_text)
-        {
-            len = strlen(json_text) + 1;
-            len = len > buflen ? buflen - 1 : len;
-            memcpy(buffer, json_text, len);
-            free(json_text);
-        }
-        else
-        {
-            AT_CMD_REFAPP_LOG_MSG(("error alloc json text\n"));
-            result = CY_RSLT_AT_CMD_REF_APP_ERR;
-        }
+    at_cmd_msg = &msg->base;
+    at_cmd_msg->cmd_id = CMD_ID_HOST_WCM_NETWORK_EVENT;
+    at_cmd_msg->serial = g_wcm_notify.serial;
+    msg->event = event;
+
+    if (msg->event == CY_WCM_EVENT_IP_CHANGED)
+    {
+        memcpy(&(msg->ip_addr), &(event_data->ip_addr), sizeof(cy_wcm_ip_address_t));
     }
 
-    return result;
+    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
+        at_cmd_refapp_msg_free(&msg->base);
+    }
+}
+/*
+ * Take the flush message, NULL if the other side has it.
+ */
+static at_cmd_ref_app_network_change_t *wifi_notify_take_flush(void)
+{
+    at_cmd_ref_app_network_change_t *msg;
+    uint32_t irq;
+
+    irq = cyhal_system_critical_section_enter();
+    msg = g_wcm_notify.flush_msg;
+    g_wcm_notify.flush_msg = NULL;
+    cyhal_system_critical_section_exit(irq);
+
+    return msg;
 }
 
 /*
- * Callback function which receives the scan results.
+ * Debounce timer expired, let the wcm_cmd worker send the pending event. The
+ * flush message was allocated by the worker when the timer was started. If
+ * the queue is full it is put back and the timer re-armed rather than
+ * dropping the pending event.
  */
-static void wifi_scan_handler(cy_wcm_scan_result_t *result_ptr, void *user_data, cy_wcm_scan_status_t status)
+static void wifi_notify_timer_cb(cy_timer_callback_arg_t arg)
 {
-    at_cmd_ref_app_scan_result_t *msg;
+    at_cmd_ref_app_network_change_t *msg = wifi_notify_take_flush();
+    uint32_t irq;
+
+    (void)arg;
 
-    msg = (at_cmd_ref_app_scan_result_t *)malloc(sizeof(at_cmd_ref_app_scan_result_t));
     if (msg == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("wifi_scan_handler malloc failed\n"));
         return;
     }
-    memset(msg, 0, sizeof(at_cmd_ref_app_scan_result_t));
-    msg->base.serial = (uint32_t)user_data;
-    msg->base.cmd_id = CMD_ID_HOST_WCM_SCAN_INFO;
-    if (status == CY_WCM_SCAN_INCOMPLETE)
-    {
-        /*
-         * Copy the scan result into the message structure.
-         */
-        msg->ssid_length = strlen((char *)result_ptr->SSID);
-        memcpy(msg->ssid, result_ptr->SSID, msg->ssid_length);
-        memcpy(msg->macaddr, result_ptr->BSSID, CY_WCM_MAC_ADDR_LEN);
-        msg->channel = result_ptr->channel;
-        msg->band = result_ptr->band;
-        msg->signal_strength = result_ptr->signal_strength;
-        msg->security_type = result_ptr->security;
-    }
-    else
-    {
-        /*
-         * Just mark that the scan is complete.
-         */
-        msg->scan_complete = true;
-    }
     if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error sending at_cmd_refapp_send_message!!!\n"));
-        free(msg);
+        AT_CMD_REFAPP_LOG_ERR(("error sending at_cmd_refapp_send_message!!!\n"));
+        irq = cyhal_system_critical_section_enter();
+        if (g_wcm_notify.flush_msg == NULL)
+        {
+            g_wcm_notify.flush_msg = msg;
+            msg = NULL;
+        }
+        cyhal_system_critical_section_exit(irq);
+        if (msg == NULL)
+        {
+            cy_rtos_start_timer(&g_wcm_notify.timer, g_wcm_notify.debounce);
+        }
+        else
+        {
+            /* The worker armed a new flush meanwhile. */
+            at_cmd_refapp_msg_free(&msg->base);
+        }
     }
-    else
+}
+
+/*
+ * Send the pending network event to the host.
+ */
+static void wifi_notify_send(at_cmd_result_data_t *result_str)
+{
+    if (g_wcm_notify.enabled && g_wcm_notify.pending)
     {
-        AT_CMD_REFAPP_LOG_MSG(("posted message cmd_id:%ld \n", msg->base.cmd_id));
+        g_wcm_notify.last.coalesced = g_wcm_notify.coalesced;
+        at_cmd_refapp_json_send(g_wcm_notify.serial, AT_CMD_REF_APP_RESULT_STATUS_SUCCESS, true, at_cmd_refapp_wcm_write_json,
+                                CMD_ID_HOST_WCM_NETWORK_EVENT, &g_wcm_notify.last.base,
+                                result_str->result_text, AT_CMD_REF_APP_JSON_PART_SIZE);
     }
+    g_wcm_notify.pending = false;
+    g_wcm_notify.coalesced = 0;
 }
 
 /**
- *  event callback for handling wcm connection events
+ * Handle a network change event in the wcm_cmd worker. Events are held
+ * until the debounce time passed without another event, so a flapping link
+ * results in one notification with the final state.
  */
-static void network_event_change_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data)
+void at_cmd_refapp_wcm_network_event(at_cmd_msg_base_t *msg, at_cmd_result_data_t *result_str)
 {
-    at_cmd_ref_app_network_change_t *msg = NULL;
-    at_cmd_msg_base_t *at_cmd_msg = NULL;
+    at_cmd_ref_app_network_change_t *event = (at_cmd_ref_app_network_change_t *)msg;
+    at_cmd_ref_app_network_change_t *flush;
+    cy_wcm_ip_address_t ip_addr;
+    uint32_t irq;
 
-    AT_CMD_REFAPP_LOG_MSG(("Received WCM event = %d\n", event));
-
-    msg = calloc(1, sizeof(at_cmd_ref_app_network_change_t));
-    if (msg == NULL)
+    if (event->flush)
     {
-        AT_CMD_REFAPP_LOG_MSG(("alloc at_cmd_ref_app_network_change_t failed\n"));
+        wifi_notify_send(result_str);
         return;
     }
 
-    memset(msg, 0, sizeof(at_cmd_ref_app_network_change_t));
-    at_cmd_msg = &msg->base;
-    at_cmd_msg->cmd_id = CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION;
-    at_cmd_msg->serial = CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION;
-    msg->event = event;
+    /*
+     * Keep the last known IP address so a coalesced link up event still
+     * reports it.
+     */
+    memcpy(&ip_addr, &g_wcm_notify.last.ip_addr, sizeof(cy_wcm_ip_address_t));
+    if (g_wcm_notify.pending)
+    {
+        g_wcm_notify.coalesced++;
+    }
+    memcpy(&g_wcm_notify.last, event, sizeof(at_cmd_ref_app_network_change_t));
+    if (event->event == CY_WCM_EVENT_DISCONNECTED)
+    {
+        memset(&g_wcm_notify.last.ip_addr, 0, sizeof(cy_wcm_ip_address_t));
+    }
+    else if (event->event != CY_WCM_EVENT_IP_CHANGED)
+    {
+        memcpy(&g_wcm_notify.last.ip_addr, &ip_addr, sizeof(cy_wcm_ip_address_t));
+    }
+    g_wcm_notify.pending = true;
 
-    if (msg->event == CY_WCM_EVENT_IP_CHANGED)
+    if (g_wcm_notify.debounce == 0)
     {
-        memcpy(&(msg->ip_addr), &(event_data->ip_addr), sizeof(cy_wcm_ip_address_t));
+        wifi_notify_send(result_str);
+        return;
     }
 
-    if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)msg) != CY_RSLT_SUCCESS)
+    /*
+     * Take the flush message back before restarting the timer. If the timer
+     * expired first its flush is already queued behind this event and sends
+     * it early, a new flush message covers the events that follow.
+     */
+    flush = wifi_notify_take_flush();
+    if (flush == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("error sending at_cmd_refapp_send_message!!!\n"));
-        free(msg);
+        flush = (at_cmd_ref_app_network_change_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_network_change_t));
+        if (flush == NULL)
+        {
+            wifi_notify_send(result_str);
+            return;
+        }
+        flush->base.cmd_id = CMD_ID_HOST_WCM_NETWORK_EVENT;
+        flush->base.serial = g_wcm_notify.serial;
+        flush->flush = true;
     }
+    cy_rtos_stop_timer(&g_wcm_notify.timer);
+    irq = cyhal_system_critical_section_enter();
+    g_wcm_notify.flush_msg = flush;
+    cyhal_system_critical_section_exit(irq);
+    cy_rtos_start_timer(&g_wcm_notify.timer, g_wcm_notify.debounce);
 }
+
 /** look up table to get security type base on name */
 int at_cmd_refapp_security_table_lookup_by_name(char *cmd_name, at_cmd_security_def_t *table)
 {
@@ -598,81 +1945,144 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
     at_cmd_ref_app_host_ap_info_result_t *ap_msg = NULL;
     at_cmd_ref_host_ipv4_info_t *ip_info_msg = NULL;
     at_cmd_msg_base_t *at_cmd_msg = NULL;
-    at_cmd_ref_app_wcm_get_ip_type_t *ip_msg = NULL;
     at_cmd_ref_ping_ip_addr_t *ping_info = NULL;
 
     cmd_id = msg->cmd_id;
 
+    /* Benchmark fault: the WCM call blocks the wcm_cmd worker. */
+    AT_CMD_REFAPP_BENCH_FAULT_DELAY(AT_CMD_REF_APP_BENCH_FAULT_WCM_DELAY);
+
     switch (cmd_id)
     {
     case CMD_ID_AP_CONNECT:
     {
         at_cmd_ref_app_wcm_connect_specific_t *ptr = (at_cmd_ref_app_wcm_connect_specific_t *)msg;
-        cy_wcm_connect_params_t connect_param;
-        cy_wcm_ip_address_t ip_addr;
-        char ip_addr_str[AT_CMD_REF_APP_IP_ADDR_STR_LEN];
-
-        /*
-         * Setup WCM connect parameters.
-         */
-        memset(&connect_param, 0, sizeof(cy_wcm_connect_params_t));
-        memcpy(connect_param.ap_credentials.SSID, ptr->ssid, ptr->ssid_length);
-        connect_param.ap_credentials.security = ptr->security_type;
+        at_cmd_ref_app_wcm_connect_specific_t *job;
 
-        if (connect_param.ap_credentials.security != CY_WCM_SECURITY_OPEN)
-        {
-            memcpy(connect_param.ap_credentials.password, ptr->password, strlen(ptr->password) + 1);
-        }
-        else if (connect_param.ap_credentials.security == CY_WCM_SECURITY_WPA2_AES_PSK)
+        if (g_wcm_worker.connect_pending)
         {
-            AT_CMD_REFAPP_LOG_MSG(("auth type is set to CY_WCM_SECURITY_WPA2_AES_PSK\n"));
+            response_text = "connect-in-progress";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
         }
 
-        if (!NULL_MAC(ptr->macaddr))
-        {
-            memcpy(connect_param.BSSID, ptr->macaddr, CY_WCM_MAC_ADDR_LEN);
-        }
-        connect_param.band = ptr->band;
         /*
-         * Connect to AP.
+         * The command message is freed once we return, the worker gets a copy.
+         * It is larger than a message pool slot, so it comes from the heap
+         * through at_cmd_refapp_msg_alloc.
          */
-        result = cy_wcm_connect_ap(&connect_param, &ip_addr);
-        if (result == CY_RSLT_SUCCESS)
+        job = (at_cmd_ref_app_wcm_connect_specific_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_wcm_connect_specific_t));
+        if (job == NULL)
         {
-            sprintf(ip_addr_str, "%d.%d.%d.%d", PRINT_IP(ip_addr.ip.v4));
-            AT_CMD_REFAPP_LOG_MSG(("network Connection successful IP:%s \n", ip_addr_str));
+            AT_CMD_REFAPP_LOG_ERR(("memory error"));
+            response_text = "memory error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
         }
-        else
+        memcpy(job, ptr, sizeof(at_cmd_ref_app_wcm_connect_specific_t));
+        memset(ptr->password, 0, sizeof(ptr->password));
+
+        g_wcm_worker.connect_pending = true;
+        result = cy_rtos_put_queue(&g_wcm_worker.queue, &job, 0, false);
+        if (result != CY_RSLT_SUCCESS)
         {
+            g_wcm_worker.connect_pending = false;
+            at_cmd_refapp_msg_free(&job->base);
             response_text = "wcm-error";
-            AT_CMD_REFAPP_LOG_MSG(("network Connection failed %lx\n", result));
+            AT_CMD_REFAPP_LOG_ERR(("unable to queue connect %lx\n", result));
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
         }
+        at_cmd_msg = (at_cmd_msg_base_t *)ptr;
         break;
     }
 
     case CMD_ID_SCAN_START:
     {
-        result = cy_wcm_start_scan(wifi_scan_handler, (void *)((at_cmd_msg_base_t *)msg)->serial, NULL);
+        at_cmd_ref_app_scan_start_t *scan_start = (at_cmd_ref_app_scan_start_t *)msg;
 
+        result = wifi_start_scan(msg->serial, &scan_start->filter, scan_start->sort_rssi);
         if (result != CY_RSLT_SUCCESS)
         {
             response_text = "wcm-error";
-            AT_CMD_REFAPP_LOG_MSG(("Start Scan failed\n"));
+            AT_CMD_REFAPP_LOG_ERR(("Start Scan failed\n"));
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+        }
+        break;
+    }
+
+    case CMD_ID_SCAN_GET_RESULTS:
+    {
+        at_cmd_ref_app_scan_start_t *query = (at_cmd_ref_app_scan_start_t *)msg;
+        at_cmd_ref_app_scan_result_t *scan_msg = NULL;
+        cy_time_t now;
+
+        /*
+         * Only scan if the cached table cannot answer the query.
+         */
+        query->base.cmd_id = CMD_ID_SCAN_GET_RESULTS;
+        cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+        query->max_age = wifi_scan_cache_usable(query) ? query->max_age : 0;
+        cy_rtos_set_mutex(&g_scan_table.mutex);
+        if (query->max_age == 0)
+        {
+            result = wifi_start_scan(msg->serial, &query->filter, query->sort_rssi);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                response_text = "wcm-error";
+                AT_CMD_REFAPP_LOG_ERR(("Start Scan failed\n"));
+                strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+                result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+                break;
+            }
+            at_cmd_msg = (at_cmd_msg_base_t *)query;
+            break;
+        }
+
+        /*
+         * Queue the cached results so they are sent after the command response.
+         */
+        scan_msg = (at_cmd_ref_app_scan_result_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_scan_result_t));
+        if (scan_msg == NULL)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("memory error"));
+            response_text = "memory error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            return NULL;
+        }
+        scan_msg->base.serial = msg->serial;
+        scan_msg->base.cmd_id = CMD_ID_HOST_WCM_SCAN_INFO;
+        memcpy(&scan_msg->filter, &query->filter, sizeof(at_cmd_ref_app_scan_filter_t));
+        scan_msg->sort_rssi = query->sort_rssi;
+        cy_rtos_get_time(&now);
+        scan_msg->seen_since = (query->max_age == AT_CMD_REF_APP_SCAN_MAX_AGE_ANY) ? 0 : now - query->max_age;
+        if (at_cmd_refapp_send_message((at_cmd_msg_base_t *)scan_msg) != CY_RSLT_SUCCESS)
+        {
+            at_cmd_refapp_msg_free(&scan_msg->base);
+            response_text = "busy";
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
         }
+        at_cmd_msg = (at_cmd_msg_base_t *)query;
         break;
     }
 
     case CMD_ID_SCAN_STOP:
     {
         result = cy_wcm_stop_scan();
+        cy_rtos_get_mutex(&g_scan_table.mutex, AT_CMD_REF_APP_WAITFOREVER);
+        g_scan_table.active = false;
+        cy_rtos_set_mutex(&g_scan_table.mutex);
         if (result != CY_RSLT_SUCCESS)
         {
             response_text = "no-active-scan";
-            AT_CMD_REFAPP_LOG_MSG(("Stop Scan failed %lx\n", result));
+            AT_CMD_REFAPP_LOG_ERR(("Stop Scan failed %lx\n", result));
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
             ;
@@ -689,10 +2099,10 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
 
             if (result == CY_RSLT_SUCCESS)
             {
-                ap_msg = (at_cmd_ref_app_host_ap_info_result_t *)calloc(1, sizeof(at_cmd_ref_app_host_ap_info_result_t));
+                ap_msg = (at_cmd_ref_app_host_ap_info_result_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_app_host_ap_info_result_t));
                 if (ap_msg == NULL)
                 {
-                    AT_CMD_REFAPP_LOG_MSG(("memory error"));
+                    AT_CMD_REFAPP_LOG_ERR(("memory error"));
                     response_text = "memory error";
                     strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
                     result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
@@ -715,7 +2125,7 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
             }
             else
             {
-                AT_CMD_REFAPP_LOG_MSG(("Get AP info failed\n"));
+                AT_CMD_REFAPP_LOG_ERR(("Get AP info failed\n"));
                 response_text = "not connected error";
                 strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
                 result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
@@ -739,12 +2149,13 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
         result = cy_wcm_disconnect_ap();
         if (result == CY_RSLT_SUCCESS)
         {
+            wifi_netinfo_refresh(false);
             AT_CMD_REFAPP_LOG_MSG(("network Disconnection successful\n"));
         }
         else
         {
             response_text = "wcm-error";
-            AT_CMD_REFAPP_LOG_MSG(("network Disconnection failed %lx\n", result));
+            AT_CMD_REFAPP_LOG_ERR(("network Disconnection failed %lx\n", result));
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
         }
@@ -753,195 +2164,143 @@ at_cmd_msg_base_t *at_cmd_refapp_wcm_process_message(at_cmd_msg_base_t *msg, at_
 
     case CMD_ID_GET_IP_ADDRESS:
     {
-        if (cy_wcm_is_connected_to_ap())
-        {
-            at_cmd_ref_app_wcm_get_ip_type_t *ptr = (at_cmd_ref_app_wcm_get_ip_type_t *)msg;
-
-            if (ptr->addr_type.version == CY_WCM_IP_VER_V4)
-            {
-                ip_msg = (at_cmd_ref_app_wcm_get_ip_type_t *)calloc(1, sizeof(at_cmd_ref_app_wcm_get_ip_type_t));
-                if (ip_msg == NULL)
-                {
-                    AT_CMD_REFAPP_LOG_MSG(("memory error"));
-                    response_text = "memory error";
-                    strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
-                    result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
-                    return NULL;
-                }
+        at_cmd_ref_app_wcm_get_ip_type_t *ptr = (at_cmd_ref_app_wcm_get_ip_type_t *)msg;
 
-                /*
-                 * Retrieve IPv4 address from WCM library.
-                 */
-                result = cy_wcm_get_ip_addr(CY_WCM_INTERFACE_TYPE_STA, &ip_msg->addr_type);
-                if (result == CY_RSLT_SUCCESS)
-                {
-                    AT_CMD_REFAPP_LOG_MSG(("WCM GetIP address successful\n"));
-                    ip_msg->base.serial = ptr->base.serial;
-                    ip_msg->base.cmd_id = CMD_ID_GET_IP_ADDRESS;
-                    at_cmd_msg = (at_cmd_msg_base_t *)ip_msg;
-                }
-                else
-                {
-                    free(ip_msg);
-                    AT_CMD_REFAPP_LOG_MSG(("WCM GetIP address failed %lx\n", result));
-                    response_text = "not connected error";
-                    strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
-                    result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
-                }
-            }
-            else
-            {
-                AT_CMD_REFAPP_LOG_MSG(("IPV6 not supported %lx\n", result));
-                response_text = "not connected error";
-                strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
-                result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
-            }
-        }
-        else
+        /*
+         * Answered from the network info snapshot, no WCM calls.
+         */
+        if (!g_wcm_netinfo.connected)
         {
             AT_CMD_REFAPP_LOG_MSG(("Not connected to AP\n"));
             response_text = "not connected error";
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
         }
+        else if (ptr->addr_type.version != CY_WCM_IP_VER_V4)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("IPV6 not supported\n"));
+            response_text = "not connected error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+        }
+        else
+        {
+            cy_rtos_get_mutex(&g_wcm_netinfo.mutex, AT_CMD_REF_APP_WAITFOREVER);
+            ptr->addr_type.ip.v4 = g_wcm_netinfo.address;
+            cy_rtos_set_mutex(&g_wcm_netinfo.mutex);
+            at_cmd_msg = (at_cmd_msg_base_t *)ptr;
+        }
         break;
     }
 
     case CMD_ID_GET_IPv4_ADDRESS:
     {
-        if (cy_wcm_is_connected_to_ap())
-        {
-            cy_wcm_ip_address_t ip_addr;
-
-            ip_info_msg = (at_cmd_ref_host_ipv4_info_t *)calloc(1, sizeof(at_cmd_ref_host_ipv4_info_t));
-            if (ip_info_msg == NULL)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("memory error"));
-                response_text = "memory error";
-                strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
-                result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
-                return NULL;
-            }
-
-            /*
-             * For now setting method dhcp always. Need to fix it once the static method is supported.
-             */
-
-            ip_info_msg->dhcp = true;
-
-            /*
-             * Retrieve IPv4 address from WCM library.
-             */
-            result = cy_wcm_get_ip_addr(CY_WCM_INTERFACE_TYPE_STA, &ip_addr);
-            if (result == CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("WCM GetIP address successful\n"));
-                ip_info_msg->address = ip_addr.ip.v4;
-            }
-
-            /*
-             * Retrieve netmask address from WCM library.
-             */
-            result = cy_wcm_get_ip_netmask(CY_WCM_INTERFACE_TYPE_STA, &ip_addr);
-            if (result == CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("WCM Netmask address successful\n"));
-                ip_info_msg->netmask = ip_addr.ip.v4;
-            }
-
-            /*
-             * Retrieve gateway address from WCM library.
-             */
-            result = cy_wcm_get_gateway_ip_address(CY_WCM_INTERFACE_TYPE_STA, &ip_addr);
-            if (result == CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("WCM Get gateway address successful\n"));
-                ip_info_msg->gateway = ip_addr.ip.v4;
-            }
+        ip_info_msg = (at_cmd_ref_host_ipv4_info_t *)msg;
 
-            ip_info_msg->primary = 0;
-            ip_info_msg->base.serial = ((at_cmd_msg_base_t *)msg)->serial;
-            ip_info_msg->base.cmd_id = CMD_ID_GET_IPv4_ADDRESS;
-            at_cmd_msg = (at_cmd_msg_base_t *)ip_info_msg;
-        }
-        else
+        if (!g_wcm_netinfo.connected)
         {
             response_text = "not connected error";
-            AT_CMD_REFAPP_LOG_MSG(("not connected error"));
+            AT_CMD_REFAPP_LOG_ERR(("not connected error"));
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
         }
+
+        cy_rtos_get_mutex(&g_wcm_netinfo.mutex, AT_CMD_REF_APP_WAITFOREVER);
+        ip_info_msg->dhcp = g_wcm_netinfo.dhcp;
+        ip_info_msg->address = g_wcm_netinfo.address;
+        ip_info_msg->netmask = g_wcm_netinfo.netmask;
+        ip_info_msg->gateway = g_wcm_netinfo.gateway;
+        cy_rtos_set_mutex(&g_wcm_netinfo.mutex);
+        at_cmd_msg = (at_cmd_msg_base_t *)ip_info_msg;
         break;
     }
 
     case CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION:
     {
-        at_cmd_ref_app_network_change_t *ptr = (at_cmd_ref_app_network_change_t *)msg;
-        ptr->base.cmd_id = CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION;
-        ptr->base.serial = msg->serial;
-        at_cmd_msg = (at_cmd_msg_base_t *)ptr;
-        break;
-    }
+        at_cmd_ref_app_wcm_nw_change_notification_t *ptr = (at_cmd_ref_app_wcm_nw_change_notification_t *)msg;
 
-    case CMD_ID_HOST_WCM_SCAN_INFO:
-    {
-        at_cmd_ref_app_scan_result_t *ptr = (at_cmd_ref_app_scan_result_t *)msg;
-        ptr->base.cmd_id = CMD_ID_HOST_WCM_SCAN_INFO;
-        ptr->base.serial = msg->serial;
+        /*
+         * Events are sent as async responses with the serial of this command.
+         */
+        cy_rtos_stop_timer(&g_wcm_notify.timer);
+        g_wcm_notify.pending = false;
+        g_wcm_notify.coalesced = 0;
+        g_wcm_notify.serial = msg->serial;
+        g_wcm_notify.events = ptr->events;
+        g_wcm_notify.debounce = ptr->debounce;
+        g_wcm_notify.enabled = ptr->enable;
         at_cmd_msg = (at_cmd_msg_base_t *)ptr;
         break;
     }
 
     case CMD_ID_PING:
-        if (cy_wcm_is_connected_to_ap())
-        {
-            cy_wcm_ip_address_t ip_addr;
-            uint32_t timeout_ms = AT_CMD_REF_APP_IP_ADDR_STR_LEN;
-
-            ping_info = (at_cmd_ref_ping_ip_addr_t *)calloc(1, sizeof(at_cmd_ref_ping_ip_addr_t));
-
-            if (ping_info == NULL)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("memory error"));
-                response_text = "memory error";
-                strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
-                result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
-                return NULL;
-            }
+    {
+        at_cmd_ref_ping_ip_addr_t *ping = (at_cmd_ref_ping_ip_addr_t *)msg;
 
-            memset(ping_info, 0, sizeof(at_cmd_ref_ping_ip_addr_t));
+        if (!cy_wcm_is_connected_to_ap())
+        {
+            AT_CMD_REFAPP_LOG_MSG(("Not connected to AP\n"));
+            response_text = "not connected error";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        if (g_wcm_worker.ping_pending)
+        {
+            response_text = "ping-in-progress";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
 
-            /* Retrieve gateway address from WCM library */
-            result = cy_wcm_get_gateway_ip_address(CY_WCM_INTERFACE_TYPE_STA, &ip_addr);
-            if (result == CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("WCM Get gateway address successful\n"));
-                result = cy_wcm_ping(CY_WCM_INTERFACE_TYPE_STA, &ip_addr, timeout_ms, &ping_info->elapsed_time);
-                if (result != CY_RSLT_SUCCESS)
-                {
-                    AT_CMD_REFAPP_LOG_MSG(("Ping failed result:%lx\n", result));
-                }
-            }
-            else
+        /*
+         * Ping the gateway if the host did not give a target address.
+         */
+        if (ping->ip_addr.ip.v4 == 0)
+        {
+            result = cy_wcm_get_gateway_ip_address(CY_WCM_INTERFACE_TYPE_STA, &ping->ip_addr);
+            if (result != CY_RSLT_SUCCESS)
             {
                 response_text = "ping error";
                 strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
                 result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+                break;
             }
         }
-        else
+
+        /*
+         * The command message is freed once we return, the worker gets a copy.
+         */
+        ping_info = (at_cmd_ref_ping_ip_addr_t *)at_cmd_refapp_msg_alloc(sizeof(at_cmd_ref_ping_ip_addr_t));
+        if (ping_info == NULL)
         {
-            AT_CMD_REFAPP_LOG_MSG(("Not connected to AP\n"));
-            response_text = "not connected error";
+            AT_CMD_REFAPP_LOG_ERR(("memory error"));
+            response_text = "memory error";
             strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
             result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            return NULL;
         }
-        at_cmd_msg = (at_cmd_msg_base_t *)ping_info;
+        memcpy(ping_info, ping, sizeof(at_cmd_ref_ping_ip_addr_t));
+
+        g_wcm_worker.ping_pending = true;
+        result = cy_rtos_put_queue(&g_wcm_worker.queue, &ping_info, 0, false);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            g_wcm_worker.ping_pending = false;
+            at_cmd_refapp_msg_free(&ping_info->base);
+            response_text = "busy";
+            strncpy(result_str->result_text, response_text, strlen(response_text) + 1);
+            result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_ERROR;
+            break;
+        }
+        at_cmd_msg = (at_cmd_msg_base_t *)ping;
         break;
+    }
 
     default:
     {
-        AT_CMD_REFAPP_LOG_MSG(("invalid command id\n\r"));
+        AT_CMD_REFAPP_LOG_ERR(("invalid command id\n\r"));
         break;
     }
     }
@@ -59,28 +59,120 @@
 #include "at_command_parser.h"
 /* TCP client task header file. */
 #include "cy_nw_helper.h"
+#define AT_CMD_REFAPP_LOG_MODULE_LEVEL AT_CMD_REFAPP_LOG_LEVEL_APP
 #include "at_cmd_refapp.h"
 
 /* Standard C header files */
 #include <inttypes.h>
+#include <stdatomic.h>
 
-#if defined(SDIO_HM_AT_CMD)
-#include "sdio_at_cmd_support.h"
-#endif
+/*******************************************************************************
+ * Structures
+ ********************************************************************************/
+
+/*
+ * Subsystems whose messages run in their own command worker thread. SYS
+ * messages run in client_task.
+ */
+typedef enum
+{
+    CLIENT_WORKER_WCM = 0,
+    CLIENT_WORKER_MQTT,
+    CLIENT_NUM_WORKERS
+} client_worker_id_t;
+
+/*
+ * Slot of the small message pool, it holds the messages allocated with
+ * at_cmd_refapp_msg_alloc.
+ */
+typedef union
+{
+    at_cmd_msg_base_t                     base;
+    at_cmd_ref_host_ipv4_info_t           ipv4_info;
+    at_cmd_ref_ping_ip_addr_t             ping;
+    at_cmd_ref_app_scan_start_t           scan_start;
+    at_cmd_ref_app_scan_result_t          scan_result;
+    at_cmd_ref_app_host_ap_info_result_t  ap_info;
+    at_cmd_ref_app_network_change_t       network_change;
+    at_cmd_ref_app_wcm_connect_progress_t connect_progress;
+} client_msg_slot_t;
+
+typedef struct
+{
+    const char          *name;
+    cy_queue_t           queue;
+    cy_semaphore_t       event_slots;                    /* queue slots left for application messages */
+    cy_thread_t          thread;
+    at_cmd_result_data_t result_str;
+    char                 result_buffer[AT_CMD_REF_APP_JSON_PART_SIZE]; /* frame buffer, the responses are written in parts */
+    uint64_t             stack[AT_CMD_REF_APP_CMD_WORKER_STACK_SIZE / 8];
+} client_worker_t;
 
 /*******************************************************************************
  * Function Prototypes
  ********************************************************************************/
 
+static bool client_credit_take(void);
+static void client_credit_give(void);
+static at_cmd_msg_base_t *client_busy_message(uint32_t cmd_id, uint32_t serial);
+static void client_compact_keys(char *text);
+static client_worker_t *client_route(uint32_t cmd_id);
+static bool client_is_event(uint32_t cmd_id);
+static void client_drop_event(at_cmd_msg_base_t *cmd);
+static void client_execute(at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str);
+static void client_worker(cy_thread_arg_t arg);
+static cy_rslt_t client_workers_init(void);
+
+/*******************************************************************************
+ * Global Variables
+ ********************************************************************************/
+
+static client_worker_t g_client_workers[CLIENT_NUM_WORKERS] =
+    {
+        [CLIENT_WORKER_WCM] = {.name = "wcm_cmd"},
+        [CLIENT_WORKER_MQTT] = {.name = "mqtt_cmd"}};
+
+/* Host commands parsed and not yet responded to. */
+static atomic_uint g_client_credits;
+
+/*
+ * Small message pool. Messages are allocated in the parser thread and freed
+ * in client_task and the workers, the slots are taken and returned with
+ * atomic operations on a bit per slot.
+ */
+static client_msg_slot_t g_client_msg_pool[AT_CMD_REF_APP_MSG_POOL_SLOTS];
+static atomic_uint g_client_msg_used;
+static atomic_uint g_client_msg_max_in_use;
+static atomic_uint g_client_msg_allocs;
+static atomic_uint g_client_msg_fallbacks;
+
+#define CLIENT_MSG_POOL_FULL    ((unsigned int)(((uint64_t)1 << AT_CMD_REF_APP_MSG_POOL_SLOTS) - 1))
+
+_Static_assert((AT_CMD_REF_APP_MSG_POOL_SLOTS > 0) && (AT_CMD_REF_APP_MSG_POOL_SLOTS <= 32),
+               "the pool has a bit per slot in an atomic_uint");
+
 static at_cmd_msg_base_t *cmd_callback_wcm_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_args_len, uint8_t *cmd_args)
 {
 
     at_cmd_msg_base_t *at_cmd_msg;
+    uint32_t trace_start = AT_CMD_REFAPP_TRACE_CLOCK();
     //  AT_CMD_REFAPP_LOG_MSG(("cmd_callback_wcm_cmd: cmd_id %lu, serial %lu, args %s\n", cmd_id, serial, (char *)cmd_args));
+    if (!client_credit_take())
+    {
+        return client_busy_message(cmd_id, serial);
+    }
     at_cmd_msg = at_cmd_refapp_parse_wcm_cmd(cmd_id, serial, cmd_args_len, (char *)cmd_args);
     if (at_cmd_msg == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_parse_wcm_cmd failed\n"));
+        AT_CMD_REFAPP_LOG_ERR(("at_cmd_refapp_parse_wcm_cmd failed\n"));
+        client_credit_give();
+    }
+    else
+    {
+        /* The parser queues the message once the callback returns. */
+        at_cmd_refapp_sys_stats_count(cmd_id, AT_CMD_REF_APP_SYS_COUNT_COMMAND);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_PARSE, trace_start);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_ENQUEUE, AT_CMD_REFAPP_TRACE_CLOCK());
     }
     return (at_cmd_msg_base_t *)at_cmd_msg;
 }
@@ -88,15 +180,47 @@ static at_cmd_msg_base_t *cmd_callback_wcm_cmd(uint32_t cmd_id, uint32_t serial,
 static at_cmd_msg_base_t *cmd_callback_mqtt_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_args_len, uint8_t *cmd_args)
 {
     at_cmd_msg_base_t *at_cmd_msg;
+    uint32_t trace_start = AT_CMD_REFAPP_TRACE_CLOCK();
     //  AT_CMD_REFAPP_LOG_MSG(("cmd_callback_mqtt_cmd: cmd_id %lu, serial %lu\n", cmd_id, serial));
+    if (!client_credit_take())
+    {
+        return client_busy_message(cmd_id, serial);
+    }
     at_cmd_msg = at_cmd_refapp_parse_mqtt_cmd(cmd_id, serial, cmd_args_len, (char *)cmd_args);
     if (at_cmd_msg == NULL)
     {
-        AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_parse_wcm_cmd failed\n"));
+        AT_CMD_REFAPP_LOG_ERR(("at_cmd_refapp_parse_mqtt_cmd failed\n"));
+        client_credit_give();
     }
     else
     {
-        AT_CMD_REFAPP_LOG_MSG(("%s exit at_cmd_msg->cmd_id:%ld\n", __func__, at_cmd_msg->cmd_id));
+        AT_CMD_REFAPP_LOG_DBG(("%s exit at_cmd_msg->cmd_id:%ld\n", __func__, at_cmd_msg->cmd_id));
+        at_cmd_refapp_sys_stats_count(cmd_id, AT_CMD_REF_APP_SYS_COUNT_COMMAND);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_PARSE, trace_start);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_ENQUEUE, AT_CMD_REFAPP_TRACE_CLOCK());
+    }
+    return (at_cmd_msg_base_t *)at_cmd_msg;
+}
+
+static at_cmd_msg_base_t *cmd_callback_sys_cmd(uint32_t cmd_id, uint32_t serial, uint32_t cmd_args_len, uint8_t *cmd_args)
+{
+    at_cmd_msg_base_t *at_cmd_msg;
+    uint32_t trace_start = AT_CMD_REFAPP_TRACE_CLOCK();
+    if (!client_credit_take())
+    {
+        return client_busy_message(cmd_id, serial);
+    }
+    at_cmd_msg = at_cmd_refapp_parse_sys_cmd(cmd_id, serial, cmd_args_len, (char *)cmd_args);
+    if (at_cmd_msg == NULL)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("at_cmd_refapp_parse_sys_cmd failed\n"));
+        client_credit_give();
+    }
+    else
+    {
+        at_cmd_refapp_sys_stats_count(cmd_id, AT_CMD_REF_APP_SYS_COUNT_COMMAND);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_PARSE, trace_start);
+        AT_CMD_REFAPP_TRACE_STAMP(at_cmd_msg, AT_CMD_REF_APP_TRACE_ENQUEUE, AT_CMD_REFAPP_TRACE_CLOCK());
     }
     return (at_cmd_msg_base_t *)at_cmd_msg;
 }
@@ -111,6 +235,8 @@ static at_cmd_def_t at_cmd_refapp_wcm_cmd_table[] =
         {"WCM_Ping", CMD_ID_PING, cmd_callback_wcm_cmd},
         {"WCM_ScanStart", CMD_ID_SCAN_START, cmd_callback_wcm_cmd},
         {"WCM_ScanStop", CMD_ID_SCAN_STOP, cmd_callback_wcm_cmd},
+        {"WCM_ScanGetResults", CMD_ID_SCAN_GET_RESULTS, cmd_callback_wcm_cmd},
+        {"WCM_NetworkChangeNotification", CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION, cmd_callback_wcm_cmd},
         {"MQTT_DefineBroker", CMD_ID_MQTT_DEFINE_BROKER, cmd_callback_mqtt_cmd},
         {"MQTT_GetBroker", CMD_ID_MQTT_GET_BROKER, cmd_callback_mqtt_cmd},
         {"MQTT_DeleteBroker", CMD_ID_MQTT_DELETE_BROKER, cmd_callback_mqtt_cmd},
@@ -119,65 +245,507 @@ static at_cmd_def_t at_cmd_refapp_wcm_cmd_table[] =
         {"MQTT_Subscribe", CMD_ID_MQTT_SUBSCRIBE, cmd_callback_mqtt_cmd},
         {"MQTT_Unsubscribe", CMD_ID_MQTT_UNSUBSCRIBE, cmd_callback_mqtt_cmd},
         {"MQTT_Publish", CMD_ID_MQTT_PUBLISH, cmd_callback_mqtt_cmd},
+        {"MQTT_DefineCredential", CMD_ID_MQTT_DEFINE_CREDENTIAL, cmd_callback_mqtt_cmd},
+        {"MQTT_DeleteCredential", CMD_ID_MQTT_DELETE_CREDENTIAL, cmd_callback_mqtt_cmd},
+        {"MQTT_UploadCredential", CMD_ID_MQTT_UPLOAD_CREDENTIAL, cmd_callback_mqtt_cmd},
+        {"SYS_Trace", CMD_ID_SYS_TRACE, cmd_callback_sys_cmd},
+        {"SYS_Stats", CMD_ID_SYS_STATS, cmd_callback_sys_cmd},
+        {"SYS_SetFormat", CMD_ID_SYS_SET_FORMAT, cmd_callback_sys_cmd},
+        {"SYS_SetBaud", CMD_ID_SYS_SET_BAUD, cmd_callback_sys_cmd},
+        {"SYS_SetTransport", CMD_ID_SYS_SET_TRANSPORT, cmd_callback_sys_cmd},
+#if AT_CMD_REF_APP_BENCH_ENABLE
+        {"SYS_Bench", CMD_ID_SYS_BENCH, cmd_callback_sys_cmd},
+        {"SYS_MicroBench", CMD_ID_SYS_MICROBENCH, cmd_callback_sys_cmd},
+        {"MQTT_Loopback", CMD_ID_MQTT_LOOPBACK, cmd_callback_mqtt_cmd},
+#endif
         {NULL, CMD_ID_INVALID, cmd_callback_wcm_cmd}
 
 };
 
 static cy_queue_t msgq;
-at_cmd_result_data_t result_str;
+static char g_client_result_buffer[AT_CMD_REF_APP_BUFFER_SIZE];
+at_cmd_result_data_t result_str = {.result_text = g_client_result_buffer, .result_size = sizeof(g_client_result_buffer)};
+
+/**
+ * Take a credit for a host command, false when all credits are in use
+ */
+static bool client_credit_take(void)
+{
+    unsigned int credits = atomic_load_explicit(&g_client_credits, memory_order_relaxed);
+
+    do
+    {
+        if (credits >= AT_CMD_REF_APP_CMD_CREDITS)
+        {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&g_client_credits, &credits, credits + 1,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return true;
+}
+
+/**
+ * Return the credit of a host command once its response is about to be sent
+ */
+static void client_credit_give(void)
+{
+    atomic_fetch_sub_explicit(&g_client_credits, 1, memory_order_relaxed);
+}
+
+/**
+ * Build the message answering a command received without a credit. It carries
+ * nothing but the serial, so the command arguments are not parsed.
+ */
+static at_cmd_msg_base_t *client_busy_message(uint32_t cmd_id, uint32_t serial)
+{
+    at_cmd_msg_base_t *msg;
+
+    AT_CMD_REFAPP_LOG_DBG(("no credit left for cmd_id:%lu serial:%lu\n", cmd_id, serial));
+    at_cmd_refapp_sys_stats_count(cmd_id, AT_CMD_REF_APP_SYS_COUNT_BUSY);
+
+    msg = at_cmd_refapp_msg_alloc(sizeof(at_cmd_msg_base_t));
+    if (msg != NULL)
+    {
+        msg->cmd_id = CMD_ID_HOST_CMD_BUSY;
+        msg->serial = serial;
+    }
+    return msg;
+}
+
+/**
+ * Host commands holding a credit
+ */
+uint32_t at_cmd_refapp_credits_in_use(void)
+{
+    return atomic_load_explicit(&g_client_credits, memory_order_relaxed);
+}
+
+/**
+ * Allocate a zeroed message. A message that fits a slot of the small message
+ * pool is taken from it, so the common commands do not use the allocator.
+ */
+at_cmd_msg_base_t *at_cmd_refapp_msg_alloc(uint32_t size)
+{
+    unsigned int used = atomic_load_explicit(&g_client_msg_used, memory_order_relaxed);
+    unsigned int max_in_use;
+    unsigned int in_use;
+    unsigned int slot;
+
+    while ((size <= sizeof(client_msg_slot_t)) && (used != CLIENT_MSG_POOL_FULL))
+    {
+        slot = (unsigned int)__builtin_ctz(~used);
+        if (!atomic_compare_exchange_weak_explicit(&g_client_msg_used, &used, used | (1u << slot),
+                                                   memory_order_acquire, memory_order_relaxed))
+        {
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&g_client_msg_allocs, 1, memory_order_relaxed);
+        in_use = (unsigned int)__builtin_popcount(used) + 1;
+        max_in_use = atomic_load_explicit(&g_client_msg_max_in_use, memory_order_relaxed);
+        while ((in_use > max_in_use) &&
+               !atomic_compare_exchange_weak_explicit(&g_client_msg_max_in_use, &max_in_use, in_use,
+                                                      memory_order_relaxed, memory_order_relaxed))
+        {
+        }
+        memset(&g_client_msg_pool[slot], 0, size);
+        return &g_client_msg_pool[slot].base;
+    }
+
+    if (size <= sizeof(client_msg_slot_t))
+    {
+        atomic_fetch_add_explicit(&g_client_msg_fallbacks, 1, memory_order_relaxed);
+    }
+    return (at_cmd_msg_base_t *)calloc(1, size);
+}
+
+/**
+ * Free a message, returning it to the pool if it came from it
+ */
+void at_cmd_refapp_msg_free(at_cmd_msg_base_t *msg)
+{
+    client_msg_slot_t *slot = (client_msg_slot_t *)msg;
+
+    if ((slot >= &g_client_msg_pool[0]) && (slot < &g_client_msg_pool[AT_CMD_REF_APP_MSG_POOL_SLOTS]))
+    {
+        atomic_fetch_and_explicit(&g_client_msg_used, ~(1u << (slot - g_client_msg_pool)), memory_order_release);
+        return;
+    }
+    free(msg);
+}
+
+/**
+ * Read the small message pool statistics
+ */
+void at_cmd_refapp_msg_pool_stats(at_cmd_ref_app_msg_pool_stats_t *stats, bool reset)
+{
+    stats->in_use = (uint32_t)__builtin_popcount(atomic_load_explicit(&g_client_msg_used, memory_order_relaxed));
+    stats->max_in_use = atomic_load_explicit(&g_client_msg_max_in_use, memory_order_relaxed);
+    stats->allocs = atomic_load_explicit(&g_client_msg_allocs, memory_order_relaxed);
+    stats->fallbacks = atomic_load_explicit(&g_client_msg_fallbacks, memory_order_relaxed);
+    if (reset)
+    {
+        atomic_store_explicit(&g_client_msg_max_in_use, stats->in_use, memory_order_relaxed);
+        atomic_store_explicit(&g_client_msg_allocs, 0, memory_order_relaxed);
+        atomic_store_explicit(&g_client_msg_fallbacks, 0, memory_order_relaxed);
+    }
+}
+
+/**
+ * Rewrite a JSON response with compact keys when the host asked for them.
+ * Error texts are no JSON and are sent as they are.
+ */
+static void client_compact_keys(char *text)
+{
+    if (at_cmd_refapp_keys_is_compact() && (text != NULL) && ((text[0] == '{') || (text[0] == '[')))
+    {
+        at_cmd_refapp_keys_compact(text);
+    }
+}
+
+/**
+ * Send a frame as it is, the text has its final keys
+ */
+cy_rslt_t at_cmd_refapp_send_frame(uint32_t serial, uint32_t status, bool async, char *text)
+{
+    cy_rslt_t result;
+
+    at_cmd_refapp_transport_lock();
+    if (async)
+    {
+        result = at_cmd_parser_send_cmd_async_response(serial, text);
+    }
+    else
+    {
+        result = at_cmd_parser_send_cmd_response(serial, status, text);
+    }
+    at_cmd_refapp_transport_unlock();
+    return result;
+}
+
+/**
+ * Send a response to a host command
+ */
+cy_rslt_t at_cmd_refapp_send_response(uint32_t serial, uint32_t status, char *text)
+{
+    client_compact_keys(text);
+    return at_cmd_refapp_send_frame(serial, status, false, text);
+}
+
+/**
+ * Send an asynchronous message to the host
+ */
+cy_rslt_t at_cmd_refapp_send_async_response(uint32_t serial, char *text)
+{
+    client_compact_keys(text);
+    return at_cmd_refapp_send_frame(serial, AT_CMD_REF_APP_RESULT_STATUS_SUCCESS, true, text);
+}
+
+/**
+ * Have the response written by fn when the result is sent
+ */
+void at_cmd_refapp_result_set_json(at_cmd_result_data_t *result_str, at_cmd_refapp_json_fn_t fn, uint32_t cmd_id,
+                                   at_cmd_msg_base_t *msg, bool free_msg)
+{
+    result_str->json_fn = fn;
+    result_str->json_cmd_id = cmd_id;
+    result_str->json_msg = msg;
+    result_str->json_msg_free = free_msg;
+}
+
+/**
+ * Send a result, the text or the response written by its json_fn. The
+ * response is written as it is sent, in parts if it is longer than a frame.
+ */
+cy_rslt_t at_cmd_refapp_send_result(uint32_t serial, bool async, at_cmd_result_data_t *result_str)
+{
+    cy_rslt_t result;
+
+    if (result_str->json_fn == NULL)
+    {
+        return async ? at_cmd_refapp_send_async_response(serial, result_str->result_text) :
+                       at_cmd_refapp_send_response(serial, result_str->result_status, result_str->result_text);
+    }
 
-bool at_cmd_refapp_transport_is_data_ready(void *opaque)
+    result = at_cmd_refapp_json_send(serial, result_str->result_status, async, result_str->json_fn,
+                                     result_str->json_cmd_id, result_str->json_msg,
+                                     result_str->result_text, AT_CMD_REF_APP_JSON_PART_SIZE);
+    if (result_str->json_msg_free)
+    {
+        at_cmd_refapp_msg_free(result_str->json_msg);
+    }
+    result_str->json_fn = NULL;
+    result_str->json_msg = NULL;
+    return result;
+}
+
+/**
+ * The worker running the messages of cmd_id, NULL for client_task
+ */
+static client_worker_t *client_route(uint32_t cmd_id)
 {
-#if defined(SDIO_HM_AT_CMD)
-    return sdio_cmd_at_is_data_ready();
-#else
-    volatile bool is_transport_ready = false;
-    uint32_t num_bytes = 0;
-    num_bytes = cyhal_uart_readable(&cy_retarget_io_uart_obj);
-    if (num_bytes > 0)
-        is_transport_ready = true;
-
-    return is_transport_ready;
-#endif /* AT_CMD_OVER_SDIO */
+    switch (cmd_id)
+    {
+    case CMD_ID_AP_CONNECT:
+    case CMD_ID_AP_DISCONNECT:
+    case CMD_ID_AP_GET_INFO:
+    case CMD_ID_SCAN_START:
+    case CMD_ID_SCAN_STOP:
+    case CMD_ID_SCAN_GET_RESULTS:
+    case CMD_ID_GET_IP_ADDRESS:
+    case CMD_ID_GET_IPv4_ADDRESS:
+    case CMD_ID_PING:
+    case CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION:
+    case CMD_ID_HOST_WCM_SCAN_INFO:
+    case CMD_ID_HOST_WCM_NETWORK_EVENT:
+    case CMD_ID_HOST_WCM_CONNECT_PROGRESS:
+    case CMD_ID_HOST_WCM_PING_RESULT:
+        return &g_client_workers[CLIENT_WORKER_WCM];
+    case CMD_ID_MQTT_DEFINE_BROKER:
+    case CMD_ID_MQTT_GET_BROKER:
+    case CMD_ID_MQTT_DELETE_BROKER:
+    case CMD_ID_MQTT_CONNECT_BROKER:
+    case CMD_ID_MQTT_DISCONNECT_BROKER:
+    case CMD_ID_MQTT_SUBSCRIBE:
+    case CMD_ID_MQTT_UNSUBSCRIBE:
+    case CMD_ID_MQTT_PUBLISH:
+    case CMD_ID_MQTT_DEFINE_CREDENTIAL:
+    case CMD_ID_MQTT_DELETE_CREDENTIAL:
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    case CMD_ID_MQTT_LOOPBACK:
+    case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
+    case CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT:
+        return &g_client_workers[CLIENT_WORKER_MQTT];
+    default:
+        return NULL;
+    }
 }
 
 /**
- * transport read callback
+ * True for the application messages routed to a worker, false for host commands
  */
-static uint32_t transport_read_data(uint8_t *buffer, uint32_t size, void *opaque)
+static bool client_is_event(uint32_t cmd_id)
 {
-#if defined(SDIO_HM_AT_CMD)
-    return sdio_cmd_at_read_data(buffer, size);
-#else
-    size_t len = cyhal_uart_readable(&cy_retarget_io_uart_obj);
+    switch (cmd_id)
+    {
+    case CMD_ID_HOST_WCM_SCAN_INFO:
+    case CMD_ID_HOST_WCM_NETWORK_EVENT:
+    case CMD_ID_HOST_WCM_CONNECT_PROGRESS:
+    case CMD_ID_HOST_WCM_PING_RESULT:
+    case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
+    case CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    cyhal_uart_read(&cy_retarget_io_uart_obj, buffer, &len);
+/**
+ * Drop an application message its worker had no room for
+ */
+static void client_drop_event(at_cmd_msg_base_t *cmd)
+{
+    at_cmd_ref_app_mqtt_publish_t *publish;
 
-    return (uint32_t)len;
-#endif /* AT_CMD_OVER_SDIO */
+    AT_CMD_REFAPP_LOG_ERR(("worker queue full, dropped cmd_id:%ld\n", cmd->cmd_id));
+    AT_CMD_REFAPP_TRACE_CANCEL(cmd);
+    at_cmd_refapp_sys_stats_count(cmd->cmd_id, AT_CMD_REF_APP_SYS_COUNT_DROP);
+    if (cmd->cmd_id == CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT)
+    {
+        publish = (at_cmd_ref_app_mqtt_publish_t *)cmd;
+        free(publish->topic);
+        free(publish->msg);
+    }
+    at_cmd_refapp_msg_free(cmd);
 }
 
 /**
- * transport write callback
+ * Execute a message and send its response. The message is freed here. The
+ * credit of a host command is returned before its response is sent, so the
+ * host may send the next command as soon as it reads the response.
  */
-static cy_rslt_t transport_write_data(uint8_t *buffer, uint32_t length, void *opaque)
+static void client_execute(at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str)
 {
-#if defined(SDIO_HM_AT_CMD)
-    return sdio_cmd_at_write_data(buffer, length);
-#else
-    for (int i = 0; i < length; i++)
+    at_cmd_ref_app_mqtt_disconnect_event_t *mqtt_async_disconnect_event = NULL;
+    at_cmd_ref_app_mqtt_publish_t *async_subscriber_event = NULL;
+
+    /* The buffer stays, the rest of the result is cleared. */
+    result_str->result_text[0] = '\0';
+    result_str->result_status = AT_CMD_REF_APP_RESULT_STATUS_SUCCESS;
+    result_str->json_fn = NULL;
+    result_str->json_cmd_id = 0;
+    result_str->json_msg = NULL;
+    result_str->json_msg_free = false;
+    AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_DISPATCH, AT_CMD_REFAPP_TRACE_CLOCK());
+    AT_CMD_REFAPP_LOG_DBG(("\nReceived command message - cmd_id: %lu, serial: %lu\n",
+                           cmd->cmd_id, cmd->serial));
+    switch (cmd->cmd_id)
     {
-        cyhal_uart_putc(&cy_retarget_io_uart_obj, buffer[i]);
+    case CMD_ID_AP_CONNECT:
+    case CMD_ID_AP_DISCONNECT:
+    case CMD_ID_AP_GET_INFO:
+    case CMD_ID_SCAN_START:
+    case CMD_ID_SCAN_STOP:
+    case CMD_ID_SCAN_GET_RESULTS:
+    case CMD_ID_GET_IP_ADDRESS:
+    case CMD_ID_GET_IPv4_ADDRESS:
+    case CMD_ID_PING:
+    case CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION:
+        at_cmd_refapp_build_wcm_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, result_str);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        client_credit_give();
+        at_cmd_refapp_send_result(cmd->serial, false, result_str);
+        break;
+    case CMD_ID_HOST_WCM_SCAN_INFO:
+        at_cmd_refapp_wcm_send_scan_results(cmd, result_str);
+        break;
+    case CMD_ID_HOST_WCM_NETWORK_EVENT:
+        at_cmd_refapp_wcm_network_event(cmd, result_str);
+        break;
+    case CMD_ID_HOST_WCM_CONNECT_PROGRESS:
+    case CMD_ID_HOST_WCM_PING_RESULT:
+        at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_wcm_write_json, cmd->cmd_id, cmd, false);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        at_cmd_refapp_send_result(cmd->serial, true, result_str);
+        break;
+    case CMD_ID_MQTT_DEFINE_BROKER:
+    case CMD_ID_MQTT_GET_BROKER:
+    case CMD_ID_MQTT_DELETE_BROKER:
+    case CMD_ID_MQTT_CONNECT_BROKER:
+    case CMD_ID_MQTT_DISCONNECT_BROKER:
+    case CMD_ID_MQTT_SUBSCRIBE:
+    case CMD_ID_MQTT_UNSUBSCRIBE:
+    case CMD_ID_MQTT_PUBLISH:
+    case CMD_ID_MQTT_DEFINE_CREDENTIAL:
+    case CMD_ID_MQTT_DELETE_CREDENTIAL:
+    case CMD_ID_MQTT_UPLOAD_CREDENTIAL:
+    case CMD_ID_MQTT_LOOPBACK:
+        at_cmd_refapp_build_mqtt_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, result_str);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        client_credit_give();
+        at_cmd_refapp_send_result(cmd->serial, false, result_str);
+        break;
+    case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
+        mqtt_async_disconnect_event = (at_cmd_ref_app_mqtt_disconnect_event_t *)cmd;
+        at_cmd_refapp_mqtt_event_callback(cmd->cmd_id, (at_cmd_msg_base_t *)mqtt_async_disconnect_event, result_str);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        at_cmd_refapp_send_result(cmd->serial, true, result_str);
+        break;
+    case CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT:
+        async_subscriber_event = (at_cmd_ref_app_mqtt_publish_t *)cmd;
+        at_cmd_refapp_mqtt_event_callback(cmd->cmd_id, (at_cmd_msg_base_t *)async_subscriber_event, result_str);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        at_cmd_refapp_send_result(cmd->serial, true, result_str);
+        free(async_subscriber_event->topic);
+        free(async_subscriber_event->msg);
+        break;
+    case CMD_ID_SYS_TRACE:
+    case CMD_ID_SYS_STATS:
+    case CMD_ID_SYS_SET_FORMAT:
+    case CMD_ID_SYS_SET_BAUD:
+    case CMD_ID_SYS_SET_TRANSPORT:
+    case CMD_ID_SYS_BENCH:
+    case CMD_ID_SYS_MICROBENCH:
+        at_cmd_refapp_build_sys_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, result_str);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        client_credit_give();
+        at_cmd_refapp_send_result(cmd->serial, false, result_str);
+        break;
+    case CMD_ID_HOST_SYS_TRACE_DUMP:
+        at_cmd_refapp_sys_send_trace(cmd, result_str);
+        break;
+    case CMD_ID_HOST_SYS_BAUD_SWITCH:
+    case CMD_ID_HOST_SYS_BAUD_REVERT:
+        at_cmd_refapp_sys_baud_event(cmd, result_str);
+        break;
+    case CMD_ID_HOST_SYS_TRANSPORT_CLOSE:
+        at_cmd_refapp_transport_close();
+        break;
+    case CMD_ID_HOST_SYS_BENCH_RESULT:
+    case CMD_ID_HOST_SYS_MICROBENCH_RESULT:
+        at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_sys_write_json, cmd->cmd_id, cmd, false);
+        AT_CMD_REFAPP_TRACE_STAMP(cmd, AT_CMD_REF_APP_TRACE_EXECUTE, AT_CMD_REFAPP_TRACE_CLOCK());
+        at_cmd_refapp_send_result(cmd->serial, true, result_str);
+        break;
+    case CMD_ID_HOST_CMD_BUSY:
+        at_cmd_refapp_send_response(cmd->serial, AT_CMD_REF_APP_RESULT_STATUS_ERROR, "busy");
+        break;
+    default:
+        AT_CMD_REFAPP_LOG_ERR(("unknown command received cmd_id:%ld \n", cmd->cmd_id));
+        break;
+    } /* end of switch */
+    AT_CMD_REFAPP_TRACE_COMPLETE(cmd);
+    at_cmd_refapp_msg_free(cmd);
+}
+/**
+ * Command worker thread, runs the messages of one subsystem in order
+ */
+static void client_worker(cy_thread_arg_t arg)
+{
+    client_worker_t *worker = (client_worker_t *)arg;
+    at_cmd_msg_queue_t msg_queue_entry;
+    cy_rslt_t result;
+
+    for (;;)
+    {
+        result = cy_rtos_queue_get(&worker->queue, &msg_queue_entry, AT_CMD_REF_APP_WAITFOREVER);
+        if ((result == CY_RSLT_SUCCESS) && (msg_queue_entry.msg != NULL))
+        {
+            if (client_is_event(msg_queue_entry.msg->cmd_id))
+            {
+                cy_rtos_set_semaphore(&worker->event_slots, false);
+            }
+            client_execute(msg_queue_entry.msg, &worker->result_str);
+        }
     }
+}
+
+/**
+ * Create the command workers
+ */
+static cy_rslt_t client_workers_init(void)
+{
+    cy_rslt_t result;
+    uint32_t i;
 
+    for (i = 0; i < CLIENT_NUM_WORKERS; i++)
+    {
+        g_client_workers[i].result_str.result_text = g_client_workers[i].result_buffer;
+        g_client_workers[i].result_str.result_size = sizeof(g_client_workers[i].result_buffer);
+
+        result = cy_rtos_queue_init(&g_client_workers[i].queue, AT_CMD_REF_APP_CMD_WORKER_QUEUE_MSGS, sizeof(at_cmd_msg_queue_t));
+        if (result != CY_RSLT_SUCCESS)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("%s queue init failed\n", g_client_workers[i].name));
+            return result;
+        }
+
+        result = cy_rtos_init_semaphore(&g_client_workers[i].event_slots, AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS,
+                                        AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("%s semaphore init failed\n", g_client_workers[i].name));
+            return result;
+        }
+
+        result = cy_rtos_thread_create(&g_client_workers[i].thread, &client_worker, g_client_workers[i].name,
+                                       g_client_workers[i].stack, AT_CMD_REF_APP_CMD_WORKER_STACK_SIZE,
+                                       AT_CMD_REF_APP_CMD_WORKER_PRIORITY, (cy_thread_arg_t)&g_client_workers[i]);
+        if (result != CY_RSLT_SUCCESS)
+        {
+            AT_CMD_REFAPP_LOG_ERR(("%s thread create failed\n", g_client_workers[i].name));
+            return result;
+        }
+    }
     return CY_RSLT_SUCCESS;
-#endif /* AT_CMD_OVER_SDIO */
 }
 
 /*******************************************************************************
  * Function Name: client_task
  *******************************************************************************
  * Summary:
+ *  Receives the parsed host commands and the application messages. WCM and
+ *  MQTT messages are handed to their command worker, SYS messages are run here.
  *
  * Parameters:
  *  void *args : Task parameter defined during task creation (unused).
@@ -191,25 +759,55 @@ void client_task(cy_thread_arg_t arg)
     cy_rslt_t result;
     at_cmd_params_t params;
     at_cmd_msg_queue_t msg_queue_entry;
-    at_cmd_ref_app_mqtt_disconnect_event_t *mqtt_async_disconnect_event = NULL;
-    at_cmd_ref_app_mqtt_publish_t *async_subscriber_event = NULL;
+    client_worker_t *worker;
 
-    cy_wcm_config_t wifi_config = {.interface = CY_WCM_INTERFACE_TYPE_STA};
+    /* Start the log drain first, messages logged before are kept in the ring. */
+    result = at_cmd_refapp_log_init();
 
     result = cy_rtos_queue_init(&msgq, AT_CMD_REF_APP_NUM_CMD_QUEUE_MSGS, sizeof(at_cmd_msg_queue_t));
 
+    /* Initialize the SYS module first so all commands are traced. */
+    result = at_cmd_refapp_sys_init(&msgq);
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Error initializing SYS \n"));
+    }
+
+    /* Responses are sent from client_task and the workers, one frame at a time. */
+    result = at_cmd_refapp_transport_init();
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Error initializing transport \n"));
+        CY_ASSERT(0);
+    }
+
+    result = client_workers_init();
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Error initializing command workers \n"));
+        CY_ASSERT(0);
+    }
+
+#if AT_CMD_REF_APP_BENCH_ENABLE
+    result = at_cmd_refapp_bench_init();
+    if (result != CY_RSLT_SUCCESS)
+    {
+        AT_CMD_REFAPP_LOG_ERR(("Error initializing benchmark \n"));
+    }
+#endif
+
     memset(&params, 0, sizeof(params));
     params.cmd_msg_queue = &msgq;
     params.is_data_ready = at_cmd_refapp_transport_is_data_ready;
-    params.read_data = transport_read_data;
-    params.write_data = transport_write_data;
+    params.read_data = at_cmd_refapp_transport_read;
+    params.write_data = at_cmd_refapp_transport_write;
 
     result = at_cmd_parser_init(&params);
 
     result = at_cmd_parser_register_commands(at_cmd_refapp_wcm_cmd_table, sizeof(at_cmd_refapp_wcm_cmd_table) / sizeof(at_cmd_def_t));
 
     /* Initialize Wi-Fi connection manager. */
-    result = cy_wcm_init(&wifi_config);
+    result = at_cmd_refapp_wcm_init(&msgq);
 
     if (result != CY_RSLT_SUCCESS)
     {
@@ -221,76 +819,67 @@ void client_task(cy_thread_arg_t arg)
     result = at_cmd_refapp_mqtt_init();
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("Error initializing MQTT \n"));
+        AT_CMD_REFAPP_LOG_ERR(("Error initializing MQTT \n"));
     }
 
     printf("MQTT library  initialized.\r\n");
+    AT_CMD_REFAPP_LOG_DBG(("AT command credits: %d\n", AT_CMD_REF_APP_CMD_CREDITS));
 
     for (;;)
     {
 
         memset(&msg_queue_entry, 0, sizeof(msg_queue_entry));
-        memset(&result_str, 0, sizeof(result_str));
         result = cy_rtos_queue_get(&msgq, &msg_queue_entry, AT_CMD_REF_APP_WAITFOREVER);
         if (result == CY_RSLT_SUCCESS)
         {
             at_cmd_msg_base_t *cmd = (at_cmd_msg_base_t *)msg_queue_entry.msg;
             if ((cmd == NULL))
             {
-                AT_CMD_REFAPP_LOG_MSG(("NULL buffer: received ignore and drop\n"));
+                AT_CMD_REFAPP_LOG_ERR(("NULL buffer: received ignore and drop\n"));
                 continue;
             }
             if (cmd->cmd_id > CMD_ID_INVALID)
             {
-                AT_CMD_REFAPP_LOG_MSG(("invalid cmd received continue cmd_id:%ld\n", cmd->cmd_id));
+                AT_CMD_REFAPP_LOG_ERR(("invalid cmd received continue cmd_id:%ld\n", cmd->cmd_id));
+                continue;
+            }
+            at_cmd_refapp_sys_stats_dispatch();
+
+            worker = client_route(cmd->cmd_id);
+            if (worker == NULL)
+            {
+                client_execute(cmd, &result_str);
                 continue;
             }
-            AT_CMD_REFAPP_LOG_MSG(("\nReceived command message - cmd_id: %lu, serial: %lu\n",
-                                   cmd->cmd_id, cmd->serial));
-            switch (cmd->cmd_id)
+
+            /*
+             * The worker queue keeps a slot for every credit, so host commands
+             * always fit. Application messages share the other slots, one
+             * that finds none free within the timeout is dropped rather than
+             * holding up client_task.
+             */
+            if (client_is_event(cmd->cmd_id))
             {
-            case CMD_ID_AP_CONNECT:
-            case CMD_ID_AP_DISCONNECT:
-            case CMD_ID_AP_GET_INFO:
-            case CMD_ID_SCAN_START:
-            case CMD_ID_SCAN_STOP:
-            case CMD_ID_GET_IP_ADDRESS:
-            case CMD_ID_GET_IPv4_ADDRESS:
-            case CMD_ID_PING:
-                at_cmd_refapp_build_wcm_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, &result_str);
-                at_cmd_parser_send_cmd_response(cmd->serial, result_str.result_status, result_str.result_text);
-                break;
-            case CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION:
-            case CMD_ID_HOST_WCM_SCAN_INFO:
-                at_cmd_refapp_build_wcm_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, &result_str);
-                at_cmd_parser_send_cmd_response(cmd->serial, result_str.result_status, result_str.result_text);
-                break;
-            case CMD_ID_MQTT_DEFINE_BROKER:
-            case CMD_ID_MQTT_GET_BROKER:
-            case CMD_ID_MQTT_DELETE_BROKER:
-            case CMD_ID_MQTT_CONNECT_BROKER:
-            case CMD_ID_MQTT_DISCONNECT_BROKER:
-            case CMD_ID_MQTT_SUBSCRIBE:
-            case CMD_ID_MQTT_UNSUBSCRIBE:
-            case CMD_ID_MQTT_PUBLISH:
-                at_cmd_refapp_build_mqtt_json_text_to_host(cmd->cmd_id, cmd->serial, cmd, &result_str);
-                at_cmd_parser_send_cmd_response(cmd->serial, result_str.result_status, result_str.result_text);
-                break;
-            case CMD_ID_MQTT_ASYNC_DISCONNECT_EVENT:
-                mqtt_async_disconnect_event = (at_cmd_ref_app_mqtt_disconnect_event_t *)cmd;
-                at_cmd_refapp_mqtt_event_callback(cmd->cmd_id, (at_cmd_msg_base_t *)mqtt_async_disconnect_event, &result_str);
-                at_cmd_parser_send_cmd_async_response(cmd->serial, result_str.result_text);
-                break;
-            case CMD_ID_MQTT_ASYNC_SUBSCRIPTION_EVENT:
-                async_subscriber_event = (at_cmd_ref_app_mqtt_publish_t *)cmd;
-                at_cmd_refapp_mqtt_event_callback(cmd->cmd_id, (at_cmd_msg_base_t *)async_subscriber_event, &result_str);
-                at_cmd_parser_send_cmd_async_response(cmd->serial, result_str.result_text);
-                break;
-            default:
-                AT_CMD_REFAPP_LOG_MSG(("unknown command received cmd_id:%ld \n", cmd->cmd_id));
-                break;
-            } /* end of switch */
-            free(cmd);
+                if (cy_rtos_get_semaphore(&worker->event_slots, AT_CMD_REF_APP_CMD_WORKER_EVENT_TIMEOUT_MS, false) != CY_RSLT_SUCCESS)
+                {
+                    client_drop_event(cmd);
+                    continue;
+                }
+            }
+            result = cy_rtos_put_queue(&worker->queue, &msg_queue_entry, 0, false);
+            if (result != CY_RSLT_SUCCESS)
+            {
+                AT_CMD_REFAPP_LOG_ERR(("unable to put msg on %s queue\n", worker->name));
+                if (client_is_event(cmd->cmd_id))
+                {
+                    cy_rtos_set_semaphore(&worker->event_slots, false);
+                    client_drop_event(cmd);
+                }
+                else
+                {
+                    client_execute(cmd, &result_str);
+                }
+            }
         }
         else
         {
@@ -302,7 +891,6 @@ void client_task(cy_thread_arg_t arg)
 void at_cmd_refapp_build_wcm_json_text_to_host(uint32_t cmd_id, uint32_t serial, at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str)
 {
     at_cmd_msg_base_t *host_resp_msg = NULL;
-    cy_rslt_t result = CY_RSLT_SUCCESS;
     switch (cmd_id)
     {
     case CMD_ID_AP_CONNECT:
@@ -310,25 +898,52 @@ void at_cmd_refapp_build_wcm_json_text_to_host(uint32_t cmd_id, uint32_t serial,
     case CMD_ID_AP_DISCONNECT:
     case CMD_ID_SCAN_START:
     case CMD_ID_SCAN_STOP:
+    case CMD_ID_SCAN_GET_RESULTS:
     case CMD_ID_GET_IP_ADDRESS:
     case CMD_ID_GET_IPv4_ADDRESS:
     case CMD_ID_PING:
     case CMD_ID_WCM_NETWORK_CHANGE_NOTIFICATION:
-    case CMD_ID_HOST_WCM_SCAN_INFO:
         host_resp_msg = at_cmd_refapp_wcm_process_message((at_cmd_msg_base_t *)cmd, result_str);
         if (host_resp_msg != NULL)
         {
-            /* process host message */
-            result = at_cmd_refapp_process_wcm_host_msg(cmd_id, host_resp_msg, result_str->result_text, sizeof(result_str->result_text));
-            if (result != CY_RSLT_SUCCESS)
-            {
-                AT_CMD_REFAPP_LOG_MSG(("at_cmd_refapp_process_wcm_host_msg failed result:%ld\n", result));
-            }
+            /*
+             * The response is written as it is sent. Responses not built in
+             * the command message are freed then, the command message is
+             * freed by client_task.
+             */
+            at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_wcm_write_json, cmd_id, host_resp_msg, host_resp_msg != cmd);
         }
         break;
 
     default:
-        AT_CMD_REFAPP_LOG_MSG(("unknown command received cmd_id:%ld\n", cmd_id));
+        AT_CMD_REFAPP_LOG_ERR(("unknown command received cmd_id:%ld\n", cmd_id));
+        break;
+    }
+}
+
+void at_cmd_refapp_build_sys_json_text_to_host(uint32_t cmd_id, uint32_t serial, at_cmd_msg_base_t *cmd, at_cmd_result_data_t *result_str)
+{
+    at_cmd_msg_base_t *host_resp_msg = NULL;
+    switch (cmd_id)
+    {
+    case CMD_ID_SYS_TRACE:
+    case CMD_ID_SYS_STATS:
+    case CMD_ID_SYS_SET_FORMAT:
+    case CMD_ID_SYS_SET_BAUD:
+    case CMD_ID_SYS_SET_TRANSPORT:
+    case CMD_ID_SYS_BENCH:
+    case CMD_ID_SYS_MICROBENCH:
+        host_resp_msg = at_cmd_refapp_sys_process_message((at_cmd_msg_base_t *)cmd, result_str);
+        if (host_resp_msg != NULL)
+        {
+            /* The response is written when it is sent, the message is freed then. */
+            at_cmd_refapp_result_set_json(result_str, at_cmd_refapp_sys_write_json, cmd_id, host_resp_msg,
+                                          host_resp_msg != cmd);
+        }
+        break;
+
+    default:
+        AT_CMD_REFAPP_LOG_ERR(("unknown command received cmd_id:%ld\n", cmd_id));
         break;
     }
 }
@@ -341,11 +956,23 @@ cy_rslt_t at_cmd_refapp_send_message(at_cmd_msg_base_t *msg)
     at_cmd_msg_queue_t msg_queue_entry;
     msg_queue_entry.msg = (at_cmd_msg_base_t *)msg;
     cy_rslt_t result;
+    uint32_t trace_time = AT_CMD_REFAPP_TRACE_CLOCK();
 
+    /*
+     * Messages posted by the application have no parse stage, the stamp has
+     * to be taken before the message can be dispatched.
+     */
+    AT_CMD_REFAPP_TRACE_STAMP(msg, AT_CMD_REF_APP_TRACE_PARSE, trace_time);
     result = cy_rtos_put_queue(&msgq, &msg_queue_entry, 0, true);
     if (result != CY_RSLT_SUCCESS)
     {
-        AT_CMD_REFAPP_LOG_MSG(("unable to put msg on queue\n"));
+        AT_CMD_REFAPP_LOG_ERR(("unable to put msg on queue\n"));
+        AT_CMD_REFAPP_TRACE_CANCEL(msg);
+        at_cmd_refapp_sys_stats_count(msg->cmd_id, AT_CMD_REF_APP_SYS_COUNT_DROP);
+    }
+    else
+    {
+        at_cmd_refapp_sys_stats_count(msg->cmd_id, AT_CMD_REF_APP_SYS_COUNT_EVENT);
     }
     return result;
 }
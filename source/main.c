@@ -63,6 +63,11 @@
 /* RTOS related macros. */
 #define TASK_STACK_SIZE (1024 * 8)
 #define TASK_PRIORITY (CY_RTOS_PRIORITY_NORMAL)
+
+/* Middleware log level, debug output of the libraries slows down every command. */
+#ifndef CY_LOG_LEVEL_APP
+#define CY_LOG_LEVEL_APP (CY_LOG_WARNING)
+#endif
 static uint64_t task_stack[TASK_STACK_SIZE / 8];
 
 /*******************************************************************************
@@ -114,16 +119,20 @@ int main()
     __enable_irq();
 
     /* Initialize retarget-io to use the debug UART port. */
+#if AT_CMD_REF_APP_UART_FLOW_CONTROL
+    cy_retarget_io_init_fc(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX,
+                           CYBSP_DEBUG_UART_CTS, CYBSP_DEBUG_UART_RTS,
+                           CY_RETARGET_IO_BAUDRATE);
+#else
     cy_retarget_io_init(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX,
                         CY_RETARGET_IO_BAUDRATE);
+#endif
 
     /* Initialize the User LED. */
     cyhal_gpio_init(CYBSP_USER_LED, CYHAL_GPIO_DIR_OUTPUT,
                     CYHAL_GPIO_DRIVE_STRONG, CYBSP_LED_STATE_OFF);
 
-    cy_log_init(CY_LOG_INFO, cy_log_output_handler, NULL);
-    cy_log_set_facility_level(CYLF_MIDDLEWARE, CY_LOG_DEBUG);
-    cy_log_set_all_levels(CY_LOG_MAX);
+    cy_log_init(CY_LOG_LEVEL_APP, cy_log_output_handler, NULL);
 
     /* \x1b[2J\x1b[;H - ANSI ESC sequence to clear screen */
     printf("\x1b[2J\x1b[;H");